@@ -1316,11 +1316,17 @@ sds genAofTimestampAnnotationIfNeeded(int force) {
  *          this is used in order to decide if a `select` command
  *          should also be written to the aof. Value of -1 means
  *          to avoid writing `select` command in any case.
- * argv   - The command to write to the aof.
- * argc   - Number of values in argv
+ * cmd    - The command to write to the aof, already serialized in the
+ *          RESP protocol, so that propagateNow() can format it just once
+ *          for both the AOF and the replication stream.
+ * len    - Length of cmd in bytes
  */
-void feedAppendOnlyFile(int dictid, robj **argv, int argc) {
-    sds buf = sdsempty();
+void feedAppendOnlyFileProto(int dictid, const char *cmd, size_t len) {
+    /* Append to the AOF buffer. This will be flushed on disk just before
+     * of re-entering the event loop, so before the client will get a
+     * positive reply about the operation performed. */
+    int append = server.aof_state == AOF_ON ||
+        (server.aof_state == AOF_WAIT_REWRITE && server.child_type == CHILD_TYPE_AOF);
 
     serverAssert(dictid == -1 || (dictid >= 0 && dictid < server.dbnum));
 
@@ -1328,7 +1334,7 @@ void feedAppendOnlyFile(int dictid, robj **argv, int argc) {
     if (server.aof_timestamp_enabled) {
         sds ts = genAofTimestampAnnotationIfNeeded(0);
         if (ts != NULL) {
-            buf = sdscatsds(buf, ts);
+            if (append) server.aof_buf = sdscatsds(server.aof_buf, ts);
             sdsfree(ts);
         }
     }
@@ -1339,25 +1345,15 @@ void feedAppendOnlyFile(int dictid, robj **argv, int argc) {
         char seldb[64];
 
         snprintf(seldb,sizeof(seldb),"%d",dictid);
-        buf = sdscatprintf(buf,"*2\r\n$6\r\nSELECT\r\n$%lu\r\n%s\r\n",
-            (unsigned long)strlen(seldb),seldb);
+        if (append) {
+            server.aof_buf = sdscatprintf(server.aof_buf,
+                "*2\r\n$6\r\nSELECT\r\n$%lu\r\n%s\r\n",
+                (unsigned long)strlen(seldb),seldb);
+        }
         server.aof_selected_db = dictid;
     }
 
-    /* All commands should be propagated the same way in AOF as in replication.
-     * No need for AOF-specific translation. */
-    buf = catAppendOnlyGenericCommand(buf,argc,argv);
-
-    /* Append to the AOF buffer. This will be flushed on disk just before
-     * of re-entering the event loop, so before the client will get a
-     * positive reply about the operation performed. */
-    if (server.aof_state == AOF_ON ||
-        (server.aof_state == AOF_WAIT_REWRITE && server.child_type == CHILD_TYPE_AOF))
-    {
-        server.aof_buf = sdscatlen(server.aof_buf, buf, sdslen(buf));
-    }
-
-    sdsfree(buf);
+    if (append) server.aof_buf = sdscatlen(server.aof_buf, cmd, len);
 }
 
 /* ----------------------------------------------------------------------------
@@ -1572,6 +1568,11 @@ int loadSingleAppendOnlyFile(char *filename) {
         /* Clean up. Command code may have changed argv/argc so we use the
          * argv/argc of the client instead of the local variables. */
         freeClientArgv(fakeClient);
+
+        /* The command ran outside of call(), so nothing released the
+         * objects it created for the propagation, that can't happen while
+         * loading anyway. */
+        redisOpArrayFree(&server.also_propagate);
         if (server.aof_load_truncated) valid_up_to = ftello(fp);
         if (server.key_load_delay)
             debugDelay(server.key_load_delay);
@@ -2057,6 +2058,28 @@ int rioWriteStreamEmptyConsumer(rio *r, robj *key, const char *groupname, size_t
     return 1;
 }
 
+/* Helper for rewriteStreamObject(): emit the commands needed in order to
+ * remember the idempotency key 'idmp_key' of the entry 'id', that is no
+ * longer in the stream. The entry is added back with a placeholder field and
+ * deleted: the XSETID emitted later restores the stream metadata. */
+int rioWriteStreamIdmpKey(rio *r, robj *key, sds idmp_key, streamID *id) {
+    /* XADD <key> IDEMPOTENT <idmp_key> <id> x y */
+    if (rioWriteBulkCount(r,'*',7) == 0) return 0;
+    if (rioWriteBulkString(r,"XADD",4) == 0) return 0;
+    if (rioWriteBulkObject(r,key) == 0) return 0;
+    if (rioWriteBulkString(r,"IDEMPOTENT",10) == 0) return 0;
+    if (rioWriteBulkString(r,idmp_key,sdslen(idmp_key)) == 0) return 0;
+    if (rioWriteBulkStreamID(r,id) == 0) return 0;
+    if (rioWriteBulkString(r,"x",1) == 0) return 0;
+    if (rioWriteBulkString(r,"y",1) == 0) return 0;
+    /* XDEL <key> <id> */
+    if (rioWriteBulkCount(r,'*',3) == 0) return 0;
+    if (rioWriteBulkString(r,"XDEL",4) == 0) return 0;
+    if (rioWriteBulkObject(r,key) == 0) return 0;
+    if (rioWriteBulkStreamID(r,id) == 0) return 0;
+    return 1;
+}
+
 /* Emit the commands needed to rebuild a stream object.
  * The function returns 0 on error, 1 on success. */
 int rewriteStreamObject(rio *r, robj *key, robj *o) {
@@ -2066,20 +2089,46 @@ int rewriteStreamObject(rio *r, robj *key, robj *o) {
     streamID id;
     int64_t numfields;
 
-    if (s->length) {
+    /* The idempotency keys are emitted in ID order along with the entries,
+     * since XADD can't add entries smaller than the stream top item. */
+    raxIterator ri_idmp;
+    streamID idmp_id;
+    int idmp_next = 0;
+    if (streamIdmpLength(s)) {
+        raxStart(&ri_idmp,s->idmp->ids);
+        raxSeek(&ri_idmp,"^",NULL,0);
+        if ((idmp_next = raxNext(&ri_idmp))) streamDecodeID(ri_idmp.key,&idmp_id);
+    }
+
+    if (s->length || idmp_next) {
         /* Reconstruct the stream data using XADD commands. */
         while(streamIteratorGetID(&si,&id,&numfields)) {
+            /* Idempotency keys of entries deleted before this one. */
+            while (idmp_next && streamCompareID(&idmp_id,&id) < 0) {
+                if (!rioWriteStreamIdmpKey(r,key,ri_idmp.data,&idmp_id))
+                    goto werr;
+                if ((idmp_next = raxNext(&ri_idmp))) streamDecodeID(ri_idmp.key,&idmp_id);
+            }
+            sds idmp_key = NULL;
+            if (idmp_next && streamCompareID(&idmp_id,&id) == 0) {
+                idmp_key = ri_idmp.data;
+                if ((idmp_next = raxNext(&ri_idmp))) streamDecodeID(ri_idmp.key,&idmp_id);
+            }
+
             /* Emit a two elements array for each item. The first is
              * the ID, the second is an array of field-value pairs. */
 
-            /* Emit the XADD <key> <id> ...fields... command. */
-            if (!rioWriteBulkCount(r,'*',3+numfields*2) || 
+            /* Emit the XADD <key> [IDEMPOTENT <idmp_key>] <id> ...fields...
+             * command. */
+            if (!rioWriteBulkCount(r,'*',3+numfields*2+(idmp_key ? 2 : 0)) ||
                 !rioWriteBulkString(r,"XADD",4) ||
                 !rioWriteBulkObject(r,key) ||
-                !rioWriteBulkStreamID(r,&id)) 
+                (idmp_key &&
+                 (!rioWriteBulkString(r,"IDEMPOTENT",10) ||
+                  !rioWriteBulkString(r,idmp_key,sdslen(idmp_key)))) ||
+                !rioWriteBulkStreamID(r,&id))
             {
-                streamIteratorStop(&si);
-                return 0;
+                goto werr;
             }
             while(numfields--) {
                 unsigned char *field, *value;
@@ -2088,11 +2137,16 @@ int rewriteStreamObject(rio *r, robj *key, robj *o) {
                 if (!rioWriteBulkString(r,(char*)field,field_len) ||
                     !rioWriteBulkString(r,(char*)value,value_len)) 
                 {
-                    streamIteratorStop(&si);
-                    return 0;                  
+                    goto werr;
                 }
             }
         }
+        /* Idempotency keys of entries deleted after the last one. */
+        while (idmp_next) {
+            if (!rioWriteStreamIdmpKey(r,key,ri_idmp.data,&idmp_id))
+                goto werr;
+            if ((idmp_next = raxNext(&ri_idmp))) streamDecodeID(ri_idmp.key,&idmp_id);
+        }
     } else {
         /* Use the XADD MAXLEN 0 trick to generate an empty stream if
          * the key we are serializing is an empty string, which is possible
@@ -2107,10 +2161,10 @@ int rewriteStreamObject(rio *r, robj *key, robj *o) {
             !rioWriteBulkString(r,"x",1) ||
             !rioWriteBulkString(r,"y",1))
         {
-            streamIteratorStop(&si);
-            return 0;     
+            goto werr;
         }
     }
+    if (streamIdmpLength(s)) raxStop(&ri_idmp);
 
     /* Append XSETID after XADD, make sure lastid is correct,
      * in case of XDEL lastid. */
@@ -2150,6 +2204,21 @@ int rewriteStreamObject(rio *r, robj *key, robj *o) {
                 return 0;
             }
 
+            /* Emit the XGROUP SETDLQ of the dead letter stream, if any. */
+            if (group->max_deliveries &&
+                (!rioWriteBulkCount(r,'*',6) ||
+                 !rioWriteBulkString(r,"XGROUP",6) ||
+                 !rioWriteBulkString(r,"SETDLQ",6) ||
+                 !rioWriteBulkObject(r,key) ||
+                 !rioWriteBulkString(r,(char*)ri.key,ri.key_len) ||
+                 !rioWriteBulkObject(r,group->dlq_key) ||
+                 !rioWriteBulkLongLong(r,group->max_deliveries)))
+            {
+                raxStop(&ri);
+                streamIteratorStop(&si);
+                return 0;
+            }
+
             /* Generate XCLAIMs for each consumer that happens to
              * have pending entries. Empty consumers would be generated with
              * XGROUP CREATECONSUMER. */
@@ -2197,6 +2266,11 @@ int rewriteStreamObject(rio *r, robj *key, robj *o) {
 
     streamIteratorStop(&si);
     return 1;
+
+werr:
+    if (streamIdmpLength(s)) raxStop(&ri_idmp);
+    streamIteratorStop(&si);
+    return 0;
 }
 
 /* Call the module type callback in order to rewrite a data type
@@ -2437,7 +2511,7 @@ int rewriteAppendOnlyFileBackground(void) {
     }
 
     /* We set aof_selected_db to -1 in order to force the next call to the
-     * feedAppendOnlyFile() to issue a SELECT command. */
+     * feedAppendOnlyFileProto() to issue a SELECT command. */
     server.aof_selected_db = -1;
     flushAppendOnlyFile(1);
     if (openNewIncrAofForAppend() != C_OK) {
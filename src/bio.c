@@ -67,6 +67,7 @@ static char* bio_worker_title[] = {
     "bio_close_file",
     "bio_aof",
     "bio_lazy_free",
+    "bio_stream_tier",
 };
 
 #define BIO_WORKER_NUM (sizeof(bio_worker_title) / sizeof(*bio_worker_title))
@@ -76,6 +77,7 @@ static unsigned int bio_job_to_worker[] = {
     [BIO_AOF_FSYNC] = 1,
     [BIO_CLOSE_AOF] = 1,
     [BIO_LAZY_FREE] = 2,
+    [BIO_STREAM_TIER] = 3,
 };
 
 static pthread_t bio_threads[BIO_WORKER_NUM];
@@ -107,6 +109,12 @@ typedef union bio_job {
         lazy_free_fn *free_fn; /* Function that will free the provided arguments */
         void *free_args[]; /* List of arguments to be passed to the free function */
     } free_args;
+
+    struct {
+        int type;
+        bio_job_fn *fn; /* Function performing the job */
+        void *privdata; /* Argument passed to the function */
+    } fn_args;
 } bio_job;
 
 void *bioProcessBackgroundJobs(void *arg);
@@ -174,6 +182,14 @@ void bioCreateLazyFreeJob(lazy_free_fn free_fn, int arg_count, ...) {
     bioSubmitJob(BIO_LAZY_FREE, job);
 }
 
+void bioCreateStreamTierJob(bio_job_fn *fn, void *privdata) {
+    bio_job *job = zmalloc(sizeof(*job));
+    job->fn_args.fn = fn;
+    job->fn_args.privdata = privdata;
+
+    bioSubmitJob(BIO_STREAM_TIER, job);
+}
+
 void bioCreateCloseJob(int fd, int need_fsync, int need_reclaim_cache) {
     bio_job *job = zmalloc(sizeof(*job));
     job->fd_args.fd = fd;
@@ -285,6 +301,8 @@ void *bioProcessBackgroundJobs(void *arg) {
                 close(job->fd_args.fd);
         } else if (job_type == BIO_LAZY_FREE) {
             job->free_args.free_fn(job->free_args.free_args);
+        } else if (job_type == BIO_STREAM_TIER) {
+            job->fn_args.fn(job->fn_args.privdata);
         } else {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
@@ -80,6 +80,8 @@ void initClientBlockingState(client *c) {
     c->bstate.reploffset = 0;
     c->bstate.unblock_on_nokey = 0;
     c->bstate.async_rm_call_handle = NULL;
+    c->bstate.stream_reply = NULL;
+    c->bstate.stream_gather = NULL;
 }
 
 /* Block a client for the specific operation type. Once the CLIENT_BLOCKED
@@ -196,6 +198,10 @@ void unblockClient(client *c, int queue_for_reprocessing) {
         c->postponed_list_node = NULL;
     } else if (c->bstate.btype == BLOCKED_SHUTDOWN) {
         /* No special cleanup. */
+    } else if (c->bstate.btype == BLOCKED_STREAM_REPLY) {
+        unblockClientStreamReply(c);
+    } else if (c->bstate.btype == BLOCKED_STREAM_GATHER) {
+        unblockClientStreamGather(c);
     } else {
         serverPanic("Unknown btype in unblockClient().");
     }
@@ -240,6 +246,9 @@ void replyToBlockedClientTimedOut(client *c) {
         addReplyLongLong(c,replicationCountAOFAcksByOffset(c->bstate.reploffset));
     } else if (c->bstate.btype == BLOCKED_MODULE) {
         moduleBlockedClientTimedOut(c);
+    } else if (c->bstate.btype == BLOCKED_STREAM_GATHER) {
+        addReplyNullArray(c);
+        updateStatsOnUnblock(c, 0, 0, 0);
     } else {
         serverPanic("Unknown btype in replyToBlockedClientTimedOut().");
     }
@@ -284,6 +293,12 @@ void disconnectAllBlockedClients(void) {
             if (c->bstate.btype == BLOCKED_POSTPONE)
                 continue;
 
+            /* A range reply being produced in slices can't be interrupted
+             * without breaking the protocol, and it doesn't depend on the
+             * role of the instance anyway. */
+            if (c->bstate.btype == BLOCKED_STREAM_REPLY)
+                continue;
+
             unblockClientOnError(c,
                 "-UNBLOCKED force unblock from blocking operation, "
                 "instance state changed (master -> replica?)");
@@ -456,6 +471,9 @@ static blocking_type getBlockedTypeByType(int type) {
 static void signalKeyAsReadyLogic(redisDb *db, robj *key, int type, int deleted) {
     readyList *rl;
 
+    /* XGATHER reads don't block clients on keys. */
+    if (type == OBJ_STREAM) streamGatherSignalKey(db,key);
+
     /* Quick returns. */
     int btype = getBlockedTypeByType(type);
     if (btype == BLOCKED_NONE) {
@@ -553,6 +571,8 @@ void signalKeyAsReady(redisDb *db, robj *key, int type) {
 }
 
 void signalDeletedKeyAsReady(redisDb *db, robj *key, int type) {
+    /* The XRANGE replies in progress can't lose their entries. */
+    if (type == OBJ_STREAM) streamFinishRangeReplies(db, key, NULL);
     signalKeyAsReadyLogic(db, key, type, 1);
 }
 
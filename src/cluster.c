@@ -1007,7 +1007,11 @@ void clusterInit(void) {
         server.cluster->stats_bus_messages_received[i] = 0;
     }
     server.cluster->stats_pfail_nodes = 0;
+    server.cluster->stats_bus_bytes_sent = 0;
+    server.cluster->stats_bus_bytes_received = 0;
+    server.cluster->stats_bus_slots_delta_sent = 0;
     server.cluster->stat_cluster_links_buffer_limit_exceeded = 0;
+    server.cluster->last_config_change = mstime();
 
     memset(server.cluster->slots,0, sizeof(server.cluster->slots));
     clusterCloseAllSlots();
@@ -1201,6 +1205,13 @@ clusterLink *createClusterLink(clusterNode *node) {
     server.stat_cluster_links_memory += link->rcvbuf_alloc + link->send_msg_queue_mem;
     link->conn = NULL;
     link->node = node;
+    link->slots_delta = 0;
+    link->slots_sent = NULL;
+    link->slots_received = NULL;
+    link->messages_sent = 0;
+    link->messages_received = 0;
+    link->bytes_sent = 0;
+    link->bytes_received = 0;
     /* Related node can only possibly be known at link creation time if this is an outbound link */
     link->inbound = (node == NULL);
     if (!link->inbound) {
@@ -1221,6 +1232,14 @@ void freeClusterLink(clusterLink *link) {
     listRelease(link->send_msg_queue);
     server.stat_cluster_links_memory -= link->rcvbuf_alloc;
     zfree(link->rcvbuf);
+    if (link->slots_sent) {
+        server.stat_cluster_links_memory -= CLUSTER_SLOTS/8;
+        zfree(link->slots_sent);
+    }
+    if (link->slots_received) {
+        server.stat_cluster_links_memory -= CLUSTER_SLOTS/8;
+        zfree(link->slots_received);
+    }
     if (link->node) {
         if (link->node->link == link) {
             serverAssert(!link->inbound);
@@ -1350,24 +1369,35 @@ unsigned long getClusterConnectionsCount(void) {
  * { and } is hashed. This may be useful in the future to force certain
  * keys to be in the same node (assuming no resharding is in progress). */
 unsigned int keyHashSlot(char *key, int keylen) {
-    int s, e; /* start-end indexes of { and } */
+    char *s, *e; /* { and } */
 
-    for (s = 0; s < keylen; s++)
-        if (key[s] == '{') break;
+    s = memchr(key,'{',keylen);
 
     /* No '{' ? Hash the whole key. This is the base case. */
-    if (s == keylen) return crc16(key,keylen) & 0x3FFF;
+    if (s == NULL) return crc16(key,keylen) & 0x3FFF;
 
     /* '{' found? Check if we have the corresponding '}'. */
-    for (e = s+1; e < keylen; e++)
-        if (key[e] == '}') break;
+    e = memchr(s+1,'}',keylen-(s+1-key));
 
     /* No '}' or nothing between {} ? Hash the whole key. */
-    if (e == keylen || e == s+1) return crc16(key,keylen) & 0x3FFF;
+    if (e == NULL || e == s+1) return crc16(key,keylen) & 0x3FFF;
 
     /* If we are here there is both a { and a } on its right. Hash
      * what is in the middle between { and }. */
-    return crc16(key+s+1,e-s-1) & 0x3FFF;
+    return crc16(s+1,e-s-1) & 0x3FFF;
+}
+
+/* Like keyHashSlot(), for a key object. The keys of the command being
+ * executed were already hashed by getNodeByQuery(), that found them all in
+ * c->slot, so the slot of a key that is one of the arguments of the command
+ * is not computed again. */
+unsigned int getKeySlot(robj *key) {
+    client *c = server.executing_client;
+    if (c && c->slot != -1) {
+        for (int j = 1; j < c->argc; j++)
+            if (c->argv[j] == key) return c->slot;
+    }
+    return keyHashSlot(key->ptr,sdslen(key->ptr));
 }
 
 /* -----------------------------------------------------------------------------
@@ -2808,6 +2838,10 @@ int clusterProcessPacket(clusterLink *link) {
         explen = sizeof(clusterMsg)-sizeof(union clusterMsgData);
         explen += sizeof(clusterMsgModule) -
                 3 + ntohl(hdr->data.module.msg.len);
+    } else if (type == CLUSTERMSG_TYPE_GATHER) {
+        explen = sizeof(clusterMsg)-sizeof(union clusterMsgData);
+        explen += sizeof(clusterMsgGather) -
+                8 + ntohl(hdr->data.gather.msg.len);
     } else {
         /* We don't know this type of packet, so we assume it's well formed. */
         explen = totlen;
@@ -3245,6 +3279,11 @@ int clusterProcessPacket(clusterLink *link) {
         uint8_t type = hdr->data.module.msg.type;
         unsigned char *payload = hdr->data.module.msg.bulk_data;
         moduleCallClusterReceivers(sender->name,module_id,type,payload,len);
+    } else if (type == CLUSTERMSG_TYPE_GATHER) {
+        if (!sender) return 1;  /* Only serve known nodes. */
+        clusterMsgGather *msg = &hdr->data.gather.msg;
+        streamGatherReceive(sender->name,msg->id,ntohs(msg->flags),
+                            msg->resp,(char*)msg->bulk_data,ntohl(msg->len));
     } else {
         serverLog(LL_WARNING,"Received unknown packet type: %d", type);
     }
@@ -3281,6 +3320,8 @@ void clusterWriteHandler(connection *conn) {
             handleLinkIOError(link);
             return;
         }
+        link->bytes_sent += nwritten;
+        server.cluster->stats_bus_bytes_sent += nwritten;
         if (msg_offset + nwritten < msg_len) {
             /* If full message wasn't written, record the offset
              * and continue sending from this point next time */
@@ -3289,6 +3330,7 @@ void clusterWriteHandler(connection *conn) {
         }
         serverAssert((msg_offset + nwritten) == msg_len);
         link->head_msg_send_offset = 0;
+        link->messages_sent++;
 
         /* Delete the node and update our memory tracking */
         uint32_t blocklen = msgblock->totlen;
@@ -3348,6 +3390,81 @@ void clusterLinkConnectHandler(connection *conn) {
             node->name, node->ip, node->cport);
 }
 
+/* Flip the slots in the 'count' ranges of a slots delta in 'bitmap'.
+ * Returns 0 if a range is malformed. */
+static int clusterApplySlotsDelta(unsigned char *bitmap, clusterMsgSlotRange *ranges, uint32_t count) {
+    for (uint32_t j = 0; j < count; j++) {
+        int start = ntohs(ranges[j].start), end = ntohs(ranges[j].end);
+        if (start > end || end >= CLUSTER_SLOTS) return 0;
+        for (int slot = start; slot <= end; slot++)
+            bitmap[slot>>3] ^= 1<<(slot&7);
+    }
+    return 1;
+}
+
+/* Called for every complete message read from the link, before it is
+ * processed (or dropped) in any way, so that the two sides of the link
+ * always agree on the slots bitmap the next delta applies to.
+ *
+ * Remembers the slots bitmap of PING, PONG and MEET messages, and rewrites
+ * CLUSTER_PROTO_VER_SLOTS_DELTA messages in link->rcvbuf into their full
+ * form, so that clusterProcessPacket() only ever deals with full messages.
+ *
+ * Returns 0 if the message is malformed and the link should be dropped. */
+static int clusterLinkExpandSlotsDelta(clusterLink *link) {
+    clusterMsg *hdr = (clusterMsg*) link->rcvbuf;
+    uint32_t totlen = ntohl(hdr->totlen);
+    uint16_t type = ntohs(hdr->type);
+    uint16_t ver = ntohs(hdr->ver);
+    size_t head = offsetof(clusterMsg, myslots);
+
+    if (ver != CLUSTER_PROTO_VER_SLOTS_DELTA) {
+        if (totlen < CLUSTERMSG_MIN_LEN) return 0;
+        /* Unknown versions are ignored by clusterProcessPacket(). */
+        if (ver != CLUSTER_PROTO_VER) return 1;
+    }
+    if (type != CLUSTERMSG_TYPE_PING && type != CLUSTERMSG_TYPE_PONG &&
+        type != CLUSTERMSG_TYPE_MEET)
+    {
+        return ver == CLUSTER_PROTO_VER;
+    }
+
+    if (hdr->mflags[0] & CLUSTERMSG_FLAG0_SLOTS_DELTA) link->slots_delta = 1;
+    if (ver == CLUSTER_PROTO_VER) {
+        if (link->slots_received == NULL) {
+            link->slots_received = zmalloc(CLUSTER_SLOTS/8);
+            server.stat_cluster_links_memory += CLUSTER_SLOTS/8;
+        }
+        memcpy(link->slots_received,hdr->myslots,CLUSTER_SLOTS/8);
+        return 1;
+    }
+
+    /* A delta is only valid on top of a full bitmap sent on the same link. */
+    if (link->slots_received == NULL) return 0;
+    clusterMsgSlotsDelta *delta = (clusterMsgSlotsDelta*) (link->rcvbuf+head);
+    uint32_t count = ntohl(delta->count);
+    if (count > CLUSTERMSG_SLOTS_DELTA_MAX_RANGES) return 0;
+    size_t deltalen = sizeof(*delta) + count*sizeof(clusterMsgSlotRange);
+    if (totlen < CLUSTERMSG_SLOTS_DELTA_MIN_LEN - sizeof(*delta) + deltalen)
+        return 0;
+    if (!clusterApplySlotsDelta(link->slots_received,delta->ranges,count))
+        return 0;
+
+    size_t taillen = totlen - head - deltalen;
+    size_t fulllen = head + CLUSTER_SLOTS/8 + taillen;
+    if (link->rcvbuf_alloc < fulllen) {
+        server.stat_cluster_links_memory += fulllen - link->rcvbuf_alloc;
+        link->rcvbuf = zrealloc(link->rcvbuf, link->rcvbuf_alloc = fulllen);
+    }
+    memmove(link->rcvbuf+head+CLUSTER_SLOTS/8,link->rcvbuf+head+deltalen,taillen);
+    memcpy(link->rcvbuf+head,link->slots_received,CLUSTER_SLOTS/8);
+    link->rcvbuf_len = fulllen;
+    hdr = (clusterMsg*) link->rcvbuf;
+    hdr->ver = htons(CLUSTER_PROTO_VER);
+    hdr->totlen = htonl(fulllen);
+    return 1;
+}
+
 /* Read data. Try to read the first field of the header first to check the
  * full length of the packet. When a whole packet is in memory this function
  * will call the function to process the packet. And so forth. */
@@ -3371,7 +3488,7 @@ void clusterReadHandler(connection *conn) {
                 /* Perform some sanity check on the message signature
                  * and length. */
                 if (memcmp(hdr->sig,"RCmb",4) != 0 ||
-                    ntohl(hdr->totlen) < CLUSTERMSG_MIN_LEN)
+                    ntohl(hdr->totlen) < CLUSTERMSG_SLOTS_DELTA_MIN_LEN)
                 {
                     char ip[NET_IP_STR_LEN];
                     int port;
@@ -3414,12 +3531,22 @@ void clusterReadHandler(connection *conn) {
             }
             memcpy(link->rcvbuf + link->rcvbuf_len, buf, nread);
             link->rcvbuf_len += nread;
+            link->bytes_received += nread;
+            server.cluster->stats_bus_bytes_received += nread;
             hdr = (clusterMsg*) link->rcvbuf;
             rcvbuflen += nread;
         }
 
         /* Total length obtained? Process this packet. */
         if (rcvbuflen >= 8 && rcvbuflen == ntohl(hdr->totlen)) {
+            link->messages_received++;
+            if (!clusterLinkExpandSlotsDelta(link)) {
+                serverLog(LL_WARNING,
+                    "Malformed message of %u bytes received on the Cluster bus.",
+                    rcvbuflen);
+                handleLinkIOError(link);
+                return;
+            }
             if (clusterProcessPacket(link)) {
                 if (link->rcvbuf_alloc > RCVBUF_INIT_LEN) {
                     size_t prev_rcvbuf_alloc = link->rcvbuf_alloc;
@@ -3543,6 +3670,7 @@ static void clusterBuildMessageHdr(clusterMsg *hdr, int type, size_t msglen) {
     /* Set the message flags. */
     if (nodeIsMaster(myself) && server.cluster->mf_end)
         hdr->mflags[0] |= CLUSTERMSG_FLAG0_PAUSED;
+    hdr->mflags[0] |= CLUSTERMSG_FLAG0_SLOTS_DELTA;
 
     hdr->totlen = htonl(msglen);
 }
@@ -3568,6 +3696,55 @@ void clusterSetGossipEntry(clusterMsg *hdr, int i, clusterNode *n) {
     gossip->notused1 = 0;
 }
 
+/* Replace the slots bitmap of a PING, PONG or MEET about to be queued on
+ * 'link' with the ranges that flipped since the previous one, if the peer
+ * can decode them. The first message of every link carries the full bitmap,
+ * so the peer always has something to apply the delta to. When too many
+ * ranges flipped the full bitmap is sent instead. */
+static void clusterMsgEncodeSlotsDelta(clusterLink *link, clusterMsg *hdr) {
+    clusterMsgSlotRange ranges[CLUSTERMSG_SLOTS_DELTA_MAX_RANGES];
+    unsigned char *base = link->slots_sent;
+    uint32_t count = 0;
+    int start = -1;
+
+    if (base == NULL) {
+        link->slots_sent = zmalloc(CLUSTER_SLOTS/8);
+        server.stat_cluster_links_memory += CLUSTER_SLOTS/8;
+        memcpy(link->slots_sent,hdr->myslots,CLUSTER_SLOTS/8);
+        return;
+    }
+    if (link->slots_delta && memcmp(base,hdr->myslots,CLUSTER_SLOTS/8) != 0) {
+        for (int j = 0; j <= CLUSTER_SLOTS; j++) {
+            int flipped = j < CLUSTER_SLOTS &&
+                          ((base[j>>3] ^ hdr->myslots[j>>3]) & (1<<(j&7)));
+            if (flipped && start == -1) {
+                start = j;
+            } else if (!flipped && start != -1) {
+                if (count == CLUSTERMSG_SLOTS_DELTA_MAX_RANGES) break;
+                ranges[count].start = htons(start);
+                ranges[count].end = htons(j-1);
+                count++;
+                start = -1;
+            }
+        }
+    }
+    memcpy(base,hdr->myslots,CLUSTER_SLOTS/8);
+    /* Too many ranges to fit, stopped with one still open. */
+    if (!link->slots_delta || start != -1) return;
+
+    uint32_t totlen = ntohl(hdr->totlen);
+    size_t head = offsetof(clusterMsg, myslots);
+    size_t deltalen = sizeof(clusterMsgSlotsDelta) + count*sizeof(clusterMsgSlotRange);
+    clusterMsgSlotsDelta *delta = (clusterMsgSlotsDelta*) ((char*)hdr+head);
+    delta->count = htonl(count);
+    memcpy(delta->ranges,ranges,count*sizeof(clusterMsgSlotRange));
+    memmove((char*)hdr+head+deltalen,(char*)hdr+head+CLUSTER_SLOTS/8,
+            totlen-head-CLUSTER_SLOTS/8);
+    hdr->totlen = htonl(totlen-CLUSTER_SLOTS/8+deltalen);
+    hdr->ver = htons(CLUSTER_PROTO_VER_SLOTS_DELTA);
+    server.cluster->stats_bus_slots_delta_sent++;
+}
+
 /* Send a PING or PONG packet to the specified node, making sure to add enough
  * gossip information. */
 void clusterSendPing(clusterLink *link, int type) {
@@ -3695,6 +3872,7 @@ void clusterSendPing(clusterLink *link, int type) {
     serverAssert(gossipcount < USHRT_MAX);
     hdr->count = htons(gossipcount);
     hdr->totlen = htonl(totlen);
+    clusterMsgEncodeSlotsDelta(link,hdr);
 
     clusterSendMessage(link,msgblock);
     clusterMsgSendBlockDecrRefCount(msgblock);
@@ -3833,6 +4011,32 @@ void clusterSendModule(clusterLink *link, uint64_t module_id, uint8_t type,
     clusterMsgSendBlockDecrRefCount(msgblock);
 }
 
+/* Send an XGATHER request or reply to the node named 'target'. The ID is
+ * opaque to everybody but the requesting node.
+ *
+ * The function returns C_OK if the target is known and connected, otherwise
+ * C_ERR is returned. */
+int clusterSendGather(const char *target, uint64_t id, uint16_t flags, uint8_t resp,
+                      const char *payload, uint32_t len) {
+    clusterNode *node = clusterLookupNode(target, CLUSTER_NAMELEN);
+    if (node == NULL || node->link == NULL) return C_ERR;
+
+    uint32_t msglen = sizeof(clusterMsg)-sizeof(union clusterMsgData);
+    msglen += sizeof(clusterMsgGather) - 8 + len;
+    clusterMsgSendBlock *msgblock = createClusterMsgSendBlock(CLUSTERMSG_TYPE_GATHER, msglen);
+
+    clusterMsg *hdr = &msgblock->msg;
+    hdr->data.gather.msg.id = id;
+    hdr->data.gather.msg.len = htonl(len);
+    hdr->data.gather.msg.flags = htons(flags);
+    hdr->data.gather.msg.resp = resp;
+    if (len) memcpy(hdr->data.gather.msg.bulk_data,payload,len);
+
+    clusterSendMessage(node->link,msgblock);
+    clusterMsgSendBlockDecrRefCount(msgblock);
+    return C_OK;
+}
+
 /* This function gets a cluster node ID string as target, the same way the nodes
  * addresses are represented in the modules side, resolves the node, and sends
  * the message. If the target is NULL the message is broadcasted.
@@ -4620,6 +4824,7 @@ void clusterCron(void) {
     clusterNode *min_pong_node = NULL;
     static unsigned long long iteration = 0;
     mstime_t handshake_timeout;
+    int stable; /* No failures, handshakes or config changes for a while. */
 
     iteration++; /* Number of times this function was called so far. */
 
@@ -4632,12 +4837,22 @@ void clusterCron(void) {
     handshake_timeout = server.cluster_node_timeout;
     if (handshake_timeout < 1000) handshake_timeout = 1000;
 
+    /* When nothing changed for a while PONGs carry no news, so we can ping
+     * less often: see the ping_interval computation below. */
+    stable = server.cluster->state == CLUSTER_OK &&
+             server.cluster->mf_end == 0 &&
+             now - server.cluster->last_config_change >
+             server.cluster_node_timeout * CLUSTER_STABLE_TIME_MULT;
+
     /* Clear so clusterNodeCronHandleReconnect can count the number of nodes in PFAIL. */
     server.cluster->stats_pfail_nodes = 0;
     /* Run through some of the operations we want to do on each cluster node. */
     di = dictGetSafeIterator(server.cluster->nodes);
     while((de = dictNext(di)) != NULL) {
         clusterNode *node = dictGetVal(de);
+        if (node->flags & (CLUSTER_NODE_PFAIL|CLUSTER_NODE_FAIL|
+                           CLUSTER_NODE_HANDSHAKE|CLUSTER_NODE_MEET))
+            stable = 0;
         /* We free the inbound or outboud link to the node if the link has an
          * oversized message send queue and immediately try reconnecting. */
         clusterNodeCronFreeLinkOnBufferLimitReached(node);
@@ -4734,6 +4949,13 @@ void clusterCron(void) {
          * a too big delay. */
         mstime_t ping_interval = server.cluster_ping_interval ? 
             server.cluster_ping_interval : server.cluster_node_timeout/2;
+        /* In a stable cluster stretch the interval, still leaving a quarter
+         * of the node timeout for the PONG to arrive before the node is
+         * flagged as PFAIL. Any failure or config change restores the
+         * normal interval at the next cron run. */
+        if (stable && !server.cluster_ping_interval)
+            ping_interval = server.cluster_node_timeout *
+                            CLUSTER_STABLE_PING_MULT / CLUSTER_STABLE_PING_DIV;
         if (node->link &&
             node->ping_sent == 0 &&
             (now - node->pong_received) > ping_interval)
@@ -4813,6 +5035,9 @@ void clusterCron(void) {
 
     if (update_state || server.cluster->state == CLUSTER_FAIL)
         clusterUpdateState();
+
+    /* Give up on the XGATHER requests the owners didn't answer. */
+    streamGatherCron();
 }
 
 /* This function is called before the event handler returns to sleep for
@@ -4853,6 +5078,8 @@ void clusterBeforeSleep(void) {
 }
 
 void clusterDoBeforeSleep(int flags) {
+    if (flags & CLUSTER_TODO_SAVE_CONFIG)
+        server.cluster->last_config_change = mstime();
     server.cluster->todo_before_sleep |= flags;
 }
 
@@ -5431,7 +5658,7 @@ sds clusterGenNodesDescription(client *c, int filter, int tls_primary) {
 /* Add to the output buffer of the given client the description of the given cluster link.
  * The description is a map with each entry being an attribute of the link. */
 void addReplyClusterLinkDescription(client *c, clusterLink *link) {
-    addReplyMapLen(c, 6);
+    addReplyMapLen(c, 10);
 
     addReplyBulkCString(c, "direction");
     addReplyBulkCString(c, link->inbound ? "from" : "to");
@@ -5463,6 +5690,18 @@ void addReplyClusterLinkDescription(client *c, clusterLink *link) {
 
     addReplyBulkCString(c, "send-buffer-used");
     addReplyLongLong(c, link->send_msg_queue_mem);
+
+    addReplyBulkCString(c, "messages-sent");
+    addReplyLongLong(c, link->messages_sent);
+
+    addReplyBulkCString(c, "messages-received");
+    addReplyLongLong(c, link->messages_received);
+
+    addReplyBulkCString(c, "bytes-sent");
+    addReplyLongLong(c, link->bytes_sent);
+
+    addReplyBulkCString(c, "bytes-received");
+    addReplyLongLong(c, link->bytes_received);
 }
 
 /* Add to the output buffer of the given client an array of cluster link descriptions,
@@ -5518,6 +5757,7 @@ const char *clusterGetMessageTypeString(int type) {
     case CLUSTERMSG_TYPE_UPDATE: return "update";
     case CLUSTERMSG_TYPE_MFSTART: return "mfstart";
     case CLUSTERMSG_TYPE_MODULE: return "module";
+    case CLUSTERMSG_TYPE_GATHER: return "gather";
     }
     return "unknown";
 }
@@ -5877,6 +6117,14 @@ sds genClusterInfoString(void) {
     info = sdscatprintf(info,
         "cluster_stats_messages_received:%lld\r\n", tot_msg_received);
 
+    info = sdscatprintf(info,
+        "cluster_stats_messages_slots_delta_sent:%lld\r\n"
+        "cluster_stats_bytes_sent:%lld\r\n"
+        "cluster_stats_bytes_received:%lld\r\n",
+        server.cluster->stats_bus_slots_delta_sent,
+        server.cluster->stats_bus_bytes_sent,
+        server.cluster->stats_bus_bytes_received);
+
     info = sdscatprintf(info,
         "total_cluster_links_buffer_limit_exceeded:%llu\r\n",
         server.cluster->stat_cluster_links_buffer_limit_exceeded);
@@ -7272,6 +7520,7 @@ clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, in
         _ms.count = 1;
         mc.argv = argv;
         mc.argc = argc;
+        mc.slot = -1;
         mc.cmd = cmd;
     }
 
@@ -7297,8 +7546,11 @@ clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, in
 
         for (j = 0; j < numkeys; j++) {
             robj *thiskey = margv[keyindex[j].pos];
-            int thisslot = keyHashSlot((char*)thiskey->ptr,
-                                       sdslen(thiskey->ptr));
+            /* The keys of the queued commands were found to be all in
+             * the same slot when the commands were queued. */
+            int thisslot = ms->commands[i].slot != -1 ?
+                ms->commands[i].slot :
+                (int)keyHashSlot((char*)thiskey->ptr,sdslen(thiskey->ptr));
 
             if (firstkey == NULL) {
                 /* This is the first key we see. Check what is the slot
@@ -7561,9 +7813,7 @@ int clusterRedirectBlockedClientIfNeeded(client *c) {
  * while rehashing the cluster and in other conditions when we need to
  * understand if we have keys for a given hash slot. */
 
-void slotToKeyAddEntry(dictEntry *entry, redisDb *db) {
-    sds key = dictGetKey(entry);
-    unsigned int hashslot = keyHashSlot(key, sdslen(key));
+void slotToKeyAddEntry(dictEntry *entry, redisDb *db, unsigned int hashslot) {
     slotToKeys *slot_to_keys = &(*db->slots_to_keys).by_slot[hashslot];
     slot_to_keys->count++;
 
@@ -7578,9 +7828,7 @@ void slotToKeyAddEntry(dictEntry *entry, redisDb *db) {
     slot_to_keys->head = entry;
 }
 
-void slotToKeyDelEntry(dictEntry *entry, redisDb *db) {
-    sds key = dictGetKey(entry);
-    unsigned int hashslot = keyHashSlot(key, sdslen(key));
+void slotToKeyDelEntry(dictEntry *entry, redisDb *db, unsigned int hashslot) {
     slotToKeys *slot_to_keys = &(*db->slots_to_keys).by_slot[hashslot];
     slot_to_keys->count--;
 
@@ -18,6 +18,9 @@
 #define CLUSTER_MF_TIMEOUT 5000 /* Milliseconds to do a manual failover. */
 #define CLUSTER_MF_PAUSE_MULT 2 /* Master pause manual failover mult. */
 #define CLUSTER_SLAVE_MIGRATION_DELAY 5000 /* Delay for slave migration. */
+#define CLUSTER_STABLE_TIME_MULT 2 /* No config change for so long = stable. */
+#define CLUSTER_STABLE_PING_MULT 3 /* Ping every node_timeout*3/4 when stable. */
+#define CLUSTER_STABLE_PING_DIV 4
 
 /* Redirection errors returned by getNodeByQuery(). */
 #define CLUSTER_REDIR_NONE 0          /* Node can serve the request. */
@@ -43,6 +46,13 @@ typedef struct clusterLink {
     size_t rcvbuf_alloc;        /* Allocated size of rcvbuf */
     struct clusterNode *node;   /* Node related to this link. Initialized to NULL when unknown */
     int inbound;                /* 1 if this link is an inbound link accepted from the related node */
+    int slots_delta;            /* 1 if the peer can decode slot deltas (CLUSTERMSG_FLAG0_SLOTS_DELTA) */
+    unsigned char *slots_sent;  /* Slots bitmap of the last PING/PONG/MEET sent, base for the next delta */
+    unsigned char *slots_received; /* Slots bitmap of the last PING/PONG/MEET received */
+    unsigned long long messages_sent;     /* Messages fully written to the link */
+    unsigned long long messages_received; /* Messages fully read from the link */
+    unsigned long long bytes_sent;        /* Bytes written to the link */
+    unsigned long long bytes_received;    /* Bytes read from the link */
 } clusterLink;
 
 /* Cluster node flags and macros. */
@@ -99,7 +109,8 @@ typedef struct clusterLink {
 #define CLUSTERMSG_TYPE_MFSTART 8       /* Pause clients for manual failover */
 #define CLUSTERMSG_TYPE_MODULE 9        /* Module cluster API message. */
 #define CLUSTERMSG_TYPE_PUBLISHSHARD 10 /* Pub/Sub Publish shard propagation */
-#define CLUSTERMSG_TYPE_COUNT 11        /* Total number of message types. */
+#define CLUSTERMSG_TYPE_GATHER 11       /* XGATHER read request or reply */
+#define CLUSTERMSG_TYPE_COUNT 12        /* Total number of message types. */
 
 /* Flags that a module can set in order to prevent certain Redis Cluster
  * features to be enabled. Useful when implementing a different distributed
@@ -212,6 +223,11 @@ typedef struct clusterState {
     long long stats_bus_messages_received[CLUSTERMSG_TYPE_COUNT];
     long long stats_pfail_nodes;    /* Number of nodes in PFAIL status,
                                        excluding nodes without address. */
+    long long stats_bus_bytes_sent;     /* Bytes written to all the links. */
+    long long stats_bus_bytes_received; /* Bytes read from all the links. */
+    long long stats_bus_slots_delta_sent; /* PING/PONG/MEET sent as slot deltas. */
+    mstime_t last_config_change; /* Time of the last config change, used to
+                                    tell if the cluster is stable. */
     unsigned long long stat_cluster_links_buffer_limit_exceeded;  /* Total number of cluster links freed due to exceeding buffer limit */
 
     /* Bit map for slots that are no longer claimed by the owner in cluster PING
@@ -262,6 +278,25 @@ typedef struct {
     unsigned char bulk_data[3]; /* 3 bytes just as placeholder. */
 } clusterMsgModule;
 
+/* XGATHER message flags, see stream_gather.c. */
+#define CLUSTERMSG_GATHER_REPLY (1<<0)    /* Reply, otherwise request. */
+#define CLUSTERMSG_GATHER_BLOCK (1<<1)    /* Request: watch the streams if
+                                             the read returns nothing. */
+#define CLUSTERMSG_GATHER_CANCEL (1<<2)   /* Request: drop the watch. */
+#define CLUSTERMSG_GATHER_WATCHING (1<<3) /* Reply: nothing read, watching. */
+#define CLUSTERMSG_GATHER_FIRED (1<<4)    /* Reply: read by a watch. */
+#define CLUSTERMSG_GATHER_REFRESH (1<<5)  /* Request: renew the watch lease. */
+
+typedef struct {
+    uint64_t id;            /* Request ID, chosen by the requesting node. */
+    uint32_t len;           /* Length of bulk_data. */
+    uint16_t flags;         /* CLUSTERMSG_GATHER_... */
+    uint8_t resp;           /* RESP version of the reply. */
+    uint8_t notused;
+    unsigned char bulk_data[8]; /* Request: the read arguments, reply: the
+                                   read reply. 8 bytes just as placeholder. */
+} clusterMsgGather;
+
 /* The cluster supports optional extension messages that can be sent
  * along with ping/pong/meet messages to give additional info in a 
  * consistent manner. */
@@ -336,9 +371,32 @@ union clusterMsgData {
     struct {
         clusterMsgModule msg;
     } module;
+
+    /* GATHER */
+    struct {
+        clusterMsgGather msg;
+    } gather;
 };
 
 #define CLUSTER_PROTO_VER 1 /* Cluster bus protocol version. */
+#define CLUSTER_PROTO_VER_SLOTS_DELTA 2 /* PING/PONG/MEET with myslots replaced
+                                           by a clusterMsgSlotsDelta. */
+
+/* Range of slots whose ownership bit flipped since the previous PING, PONG or
+ * MEET sent on the same link. */
+typedef struct {
+    uint16_t start;
+    uint16_t end;       /* Inclusive. */
+} clusterMsgSlotRange;
+
+/* Replaces myslots in CLUSTER_PROTO_VER_SLOTS_DELTA messages: the receiver
+ * rebuilds myslots by flipping 'count' ranges in the bitmap it received last
+ * on the same link. Everything after myslots follows unchanged, so the
+ * message is sizeof(myslots) - the delta length shorter than its full form. */
+typedef struct {
+    uint32_t count;     /* Number of ranges. */
+    clusterMsgSlotRange ranges[]; /* Flipped ranges, in ascending order. */
+} clusterMsgSlotsDelta;
 
 typedef struct {
     char sig[4];        /* Signature "RCmb" (Redis Cluster message bus). */
@@ -400,6 +458,9 @@ static_assert(offsetof(clusterMsg, mflags) == 2253, "unexpected field offset");
 static_assert(offsetof(clusterMsg, data) == 2256, "unexpected field offset");
 
 #define CLUSTERMSG_MIN_LEN (sizeof(clusterMsg)-sizeof(union clusterMsgData))
+#define CLUSTERMSG_SLOTS_DELTA_MIN_LEN (CLUSTERMSG_MIN_LEN-CLUSTER_SLOTS/8+sizeof(clusterMsgSlotsDelta))
+/* Beyond this many ranges the full bitmap is cheaper to encode and apply. */
+#define CLUSTERMSG_SLOTS_DELTA_MAX_RANGES 256
 
 /* Message flags better specify the packet content or are used to
  * provide some information about the node state. */
@@ -407,6 +468,8 @@ static_assert(offsetof(clusterMsg, data) == 2256, "unexpected field offset");
 #define CLUSTERMSG_FLAG0_FORCEACK (1<<1) /* Give ACK to AUTH_REQUEST even if
                                             master is up. */
 #define CLUSTERMSG_FLAG0_EXT_DATA (1<<2) /* Message contains extension data */
+#define CLUSTERMSG_FLAG0_SLOTS_DELTA (1<<3) /* Sender can decode
+                                               CLUSTER_PROTO_VER_SLOTS_DELTA. */
 
 /* ---------------------- API exported outside cluster.c -------------------- */
 void clusterInit(void);
@@ -423,10 +486,12 @@ void migrateCloseTimedoutSockets(void);
 int verifyClusterConfigWithData(void);
 unsigned long getClusterConnectionsCount(void);
 int clusterSendModuleMessageToTarget(const char *target, uint64_t module_id, uint8_t type, const char *payload, uint32_t len);
+int clusterSendGather(const char *target, uint64_t id, uint16_t flags, uint8_t resp, const char *payload, uint32_t len);
 void clusterPropagatePublish(robj *channel, robj *message, int sharded);
 unsigned int keyHashSlot(char *key, int keylen);
-void slotToKeyAddEntry(dictEntry *entry, redisDb *db);
-void slotToKeyDelEntry(dictEntry *entry, redisDb *db);
+unsigned int getKeySlot(robj *key);
+void slotToKeyAddEntry(dictEntry *entry, redisDb *db, unsigned int hashslot);
+void slotToKeyDelEntry(dictEntry *entry, redisDb *db, unsigned int hashslot);
 void slotToKeyReplaceEntry(dict *d, dictEntry *entry);
 void slotToKeyInit(redisDb *db);
 void slotToKeyFlush(redisDb *db);
@@ -109,6 +109,7 @@ typedef struct ConnectionType {
 
     /* TLS specified methods */
     sds (*get_peer_cert)(struct connection *conn);
+    const char *(*get_tls_mode)(struct connection *conn);
 } ConnectionType;
 
 struct connection {
@@ -379,6 +380,16 @@ static inline sds connGetPeerCert(connection *conn) {
     return NULL;
 }
 
+/* Return how the TLS crypto of the connection is done ("user", "ktls",
+ * "ktls-tx" or "ktls-rx"), or "no" if the connection doesn't use TLS. */
+static inline const char *connGetTLSMode(connection *conn) {
+    if (conn && conn->type->get_tls_mode) {
+        return conn->type->get_tls_mode(conn);
+    }
+
+    return "no";
+}
+
 /* Initialize the redis connection framework */
 int connTypeInitialize(void);
 
@@ -79,10 +79,131 @@ static const uint16_t crc16tab[256]= {
     0x6e17,0x7e36,0x4e55,0x5e74,0x2e93,0x3eb2,0x0ed1,0x1ef0
 };
 
+/* Slicing-by-8 tables: crc16slice[k][b] is the CRC of the byte 'b' followed
+ * by 'k' zero bytes, so crc16slice[0] is crc16tab. Since the CRC is linear,
+ * the CRC of eight bytes is the XOR of the eight lookups of every byte in the
+ * table of its distance from the end, once the current CRC is folded into
+ * the first two bytes: the lookups don't depend on each other, unlike the
+ * chain of the byte at a time loop. Filled by the first call to crc16(). */
+static uint16_t crc16slice[8][256];
+static redisAtomic int crc16slice_ready = 0;
+
+static void crc16SliceInit(void) {
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = crc16tab[b];
+        crc16slice[0][b] = crc;
+        for (int k = 1; k < 8; k++) {
+            crc = (crc<<8) ^ crc16tab[crc>>8];
+            crc16slice[k][b] = crc;
+        }
+    }
+    atomicSetWithSync(crc16slice_ready,1);
+}
+
 uint16_t crc16(const char *buf, int len) {
-    int counter;
+    const unsigned char *p = (const unsigned char*)buf;
+    uint16_t crc = 0;
+    int ready;
+
+    atomicGetWithSync(crc16slice_ready,ready);
+    if (!ready) crc16SliceInit();
+    while (len >= 8) {
+        crc = crc16slice[7][p[0] ^ (crc>>8)] ^
+              crc16slice[6][p[1] ^ (crc&0xff)] ^
+              crc16slice[5][p[2]] ^ crc16slice[4][p[3]] ^
+              crc16slice[3][p[4]] ^ crc16slice[2][p[5]] ^
+              crc16slice[1][p[6]] ^ crc16slice[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *p++)&0x00FF];
+    return crc;
+}
+
+#ifdef REDIS_TEST
+#include <stdio.h>
+#include <sys/time.h>
+#include "testhelp.h"
+
+#define TEST(name) printf("test — %s\n", name);
+
+/* The byte at a time implementation crc16() replaced. */
+static uint16_t crc16Bytewise(const char *buf, int len) {
     uint16_t crc = 0;
-    for (counter = 0; counter < len; counter++)
-            crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *buf++)&0x00FF];
+    for (int counter = 0; counter < len; counter++)
+        crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *buf++)&0x00FF];
     return crc;
 }
+
+static long long crc16BenchUs(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (long long)tv.tv_sec*1000000+tv.tv_usec;
+}
+
+/* Nanoseconds per call of 'fn' over 'keys', 'iter' times. */
+static double crc16BenchKeys(unsigned int (*fn)(char*,int), char **keys, int numkeys,
+                             int keylen, long iter, unsigned int *sink) {
+    long long start = crc16BenchUs();
+    for (long i = 0; i < iter; i++)
+        *sink += fn(keys[i % numkeys],keylen);
+    return (double)(crc16BenchUs()-start)*1000/iter;
+}
+
+static unsigned int crc16BytewiseSlot(char *key, int keylen) {
+    return crc16Bytewise(key,keylen) & 0x3FFF;
+}
+
+static unsigned int crc16SlicedSlot(char *key, int keylen) {
+    return crc16(key,keylen) & 0x3FFF;
+}
+
+int crc16Test(int argc, char *argv[], int flags) {
+    UNUSED(argc);
+    UNUSED(argv);
+    int accurate = flags & REDIS_TEST_ACCURATE;
+
+    TEST("crc16: check value of the XMODEM parameters") {
+        assert(crc16("123456789",9) == 0x31C3);
+        assert(crc16("",0) == 0);
+    }
+
+    TEST("crc16: sliced and bytewise implementations agree") {
+        char buf[257];
+        for (int j = 0; j < 10000; j++) {
+            int len = rand() % sizeof(buf);
+            for (int i = 0; i < len; i++) buf[i] = rand();
+            assert(crc16(buf,len) == crc16Bytewise(buf,len));
+            /* Unaligned buffers too. */
+            if (len) assert(crc16(buf+1,len-1) == crc16Bytewise(buf+1,len-1));
+        }
+    }
+
+    /* Routing microbenchmark: the slot of stream names of different
+     * lengths, as computed by getNodeByQuery() for every key. */
+    TEST("crc16: routing microbenchmark") {
+        int lens[] = {8, 16, 32, 64, 128};
+        long iter = accurate ? 50000000 : 5000000;
+        int numkeys = 1024;
+        unsigned int sink = 0;
+        for (size_t l = 0; l < sizeof(lens)/sizeof(lens[0]); l++) {
+            int keylen = lens[l];
+            char **keys = zmalloc(sizeof(char*)*numkeys);
+            for (int j = 0; j < numkeys; j++) {
+                keys[j] = zmalloc(keylen);
+                for (int i = 0; i < keylen; i++) keys[j][i] = 'a'+rand()%26;
+            }
+            double bytewise = crc16BenchKeys(crc16BytewiseSlot,keys,numkeys,keylen,iter,&sink);
+            double sliced = crc16BenchKeys(crc16SlicedSlot,keys,numkeys,keylen,iter,&sink);
+            printf("    key length %3d: bytewise %6.2f ns, sliced %6.2f ns (%.2fx)\n",
+                   keylen,bytewise,sliced,bytewise/sliced);
+            for (int j = 0; j < numkeys; j++) zfree(keys[j]);
+            zfree(keys);
+        }
+        printf("    (checksum %u)\n",sink);
+    }
+
+    return 0;
+}
+#endif
@@ -201,7 +201,7 @@ static void dbAddInternal(redisDb *db, robj *key, robj *val, int update_if_exist
     initObjectLRUOrLFU(val);
     dictSetVal(db->dict, de, val);
     signalKeyAsReady(db, key, val->type);
-    if (server.cluster_enabled) slotToKeyAddEntry(de, db);
+    if (server.cluster_enabled) slotToKeyAddEntry(de, db, getKeySlot(key));
     notifyKeyspaceEvent(NOTIFY_NEW,"new",key,db->id);
 }
 
@@ -225,7 +225,7 @@ int dbAddRDBLoad(redisDb *db, sds key, robj *val) {
     if (de == NULL) return 0;
     initObjectLRUOrLFU(val);
     dictSetVal(db->dict, de, val);
-    if (server.cluster_enabled) slotToKeyAddEntry(de, db);
+    if (server.cluster_enabled) slotToKeyAddEntry(de, db, keyHashSlot(key, sdslen(key)));
     return 1;
 }
 
@@ -374,7 +374,7 @@ int dbGenericDelete(redisDb *db, robj *key, int async, int flags) {
             freeObjAsync(key, dictGetVal(de), db->id);
             dictSetVal(db->dict, de, NULL);
         }
-        if (server.cluster_enabled) slotToKeyDelEntry(de, db);
+        if (server.cluster_enabled) slotToKeyDelEntry(de, db, getKeySlot(key));
 
         /* Deleting an entry from the expires dict will not free the sds of
         * the key, because it is shared with the main dictionary. */
@@ -702,6 +702,10 @@ void flushdbCommand(client *c) {
  * Flushes the whole server data set. */
 void flushallCommand(client *c) {
     int flags;
+    if (server.db_isolation_strict && !mustObeyClient(c)) {
+        addReplyError(c,"FLUSHALL is not allowed with db-isolation-strict, use FLUSHDB");
+        return;
+    }
     if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     /* flushall should not flush the functions */
     flushAllDataAndResetRDB(flags | EMPTYDB_NOFUNCTIONS);
@@ -774,6 +778,13 @@ void selectCommand(client *c) {
         addReplyError(c,"SELECT is not allowed in cluster mode");
         return;
     }
+    /* A transaction or a script would access several databases at once. */
+    if (server.db_isolation_strict && server.execution_nesting > 1 &&
+        !mustObeyClient(c) && id != c->db->id)
+    {
+        addReplyError(c,"SELECT is not allowed in transactions and scripts with db-isolation-strict");
+        return;
+    }
     if (selectDb(c,id) == C_ERR) {
         addReplyError(c,"DB index is out of range");
     } else {
@@ -1304,6 +1315,10 @@ void scanDatabaseForReadyKeys(redisDb *db) {
  * database was flushed/swapped. */
 void scanDatabaseForDeletedKeys(redisDb *emptied, redisDb *replaced_with) {
     dictEntry *de;
+
+    /* The XRANGE replies in progress can't lose their entries. */
+    streamFinishRangeReplies(emptied, NULL, NULL);
+
     dictIterator *di = dictGetSafeIterator(emptied->blocking_keys);
     while((de = dictNext(di)) != NULL) {
         robj *key = dictGetKey(de);
@@ -1383,18 +1398,19 @@ int dbSwapDatabases(int id1, int id2) {
     return C_OK;
 }
 
-/* Logically, this discards (flushes) the old main database, and apply the newly loaded
- * database (temp) as the main (active) database, the actual freeing of old database
- * (which will now be placed in the temp one) is done later. */
-void swapMainDbWithTempDb(redisDb *tempDb) {
-    if (server.cluster_enabled) {
+/* Like swapMainDbWithTempDb() but only for the databases from 'first' to
+ * 'last' (included): used to apply a dataset loaded in tempDb one database
+ * at a time, so that each old database can be freed before the next one is
+ * loaded. */
+void swapMainDbRangeWithTempDb(redisDb *tempDb, int first, int last) {
+    if (server.cluster_enabled && first == 0) {
         /* Swap slots_to_keys from tempdb just loaded with main db slots_to_keys. */
         clusterSlotToKeyMapping *aux = server.db->slots_to_keys;
         server.db->slots_to_keys = tempDb->slots_to_keys;
         tempDb->slots_to_keys = aux;
     }
 
-    for (int i=0; i<server.dbnum; i++) {
+    for (int i=first; i<=last; i++) {
         redisDb aux = server.db[i];
         redisDb *activedb = &server.db[i], *newdb = &tempDb[i];
 
@@ -1434,6 +1450,13 @@ void swapMainDbWithTempDb(redisDb *tempDb) {
     flushSlaveKeysWithExpireList();
 }
 
+/* Logically, this discards (flushes) the old main database, and apply the newly loaded
+ * database (temp) as the main (active) database, the actual freeing of old database
+ * (which will now be placed in the temp one) is done later. */
+void swapMainDbWithTempDb(redisDb *tempDb) {
+    swapMainDbRangeWithTempDb(tempDb,0,server.dbnum-1);
+}
+
 /*-----------------------------------------------------------------------------
  * Expires API
  *----------------------------------------------------------------------------*/
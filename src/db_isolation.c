@@ -0,0 +1,118 @@
+/* Database isolation.
+ *
+ * Deployments serving one tenant per database share the single main thread:
+ * a tenant running slow commands (big XRANGE, DEL of huge streams, scripts)
+ * delays the commands of every other tenant. With db-isolation-slice set,
+ * the time spent by the commands of every database is accounted for during
+ * each event loop iteration. Once the commands of a database used more than
+ * db-isolation-slice microseconds in the current iteration, while clients of
+ * other databases executed commands too, the next commands of its clients
+ * are postponed to the next iteration, so that the other databases get their
+ * share of the main thread first. A database alone never waits. Commands
+ * that access no key (PING, AUTH, CLIENT, INFO, CONFIG, ...) are neither
+ * accounted nor postponed: they don't belong to a tenant. EXEC is accounted
+ * and postponed like the commands of its transaction.
+ *
+ * With db-isolation-strict, the commands reaching more than one database are
+ * refused: FLUSHALL, and SELECT inside MULTI/EXEC and scripts, so that the
+ * commands of a client only ever access the database it selected.
+ *
+ * This is not parallelism: all the databases are still served by the main
+ * thread, this only keeps one tenant from starving the others. */
+
+#include "server.h"
+
+static long long *db_busy = NULL;       /* Usecs used in this iteration. */
+static long long db_busy_total = 0;     /* Sum of db_busy. */
+static list *db_postponed;              /* IDs of the clients postponed. */
+static long long db_stat_postponed = 0; /* Commands postponed. */
+static long long *db_stat_postponed_db = NULL; /* Commands postponed by DB. */
+
+void dbIsolationInit(void) {
+    db_busy = zcalloc(sizeof(long long)*server.dbnum);
+    db_stat_postponed_db = zcalloc(sizeof(long long)*server.dbnum);
+    db_postponed = listCreate();
+    listSetFreeMethod(db_postponed,zfree);
+}
+
+/* Return 1 if 'cmd' accesses no key, so it doesn't belong to the database
+ * of the client executing it. */
+static int dbIsolationKeyless(struct redisCommand *cmd) {
+    return cmd->key_specs_num == 0 && !(cmd->flags & CMD_MOVABLE_KEYS) &&
+           cmd->proc != execCommand;
+}
+
+/* Account 'duration' microseconds of the execution of 'cmd' to the database
+ * 'dbid'. Called by call() for the commands that are not nested in another
+ * one. */
+void dbIsolationAccount(struct redisCommand *cmd, int dbid, long long duration) {
+    if (!server.db_isolation_slice || dbIsolationKeyless(cmd)) return;
+    db_busy[dbid] += duration;
+    db_busy_total += duration;
+}
+
+/* Called by processCommand() before executing the command of 'c': if the
+ * database of the client used its share of the current iteration, postpone
+ * the client and return 1. Otherwise return 0. */
+int dbIsolationPostponeClient(client *c) {
+    if (!server.db_isolation_slice) return 0;
+    if (c->flags & (CLIENT_MASTER|CLIENT_SLAVE|CLIENT_MODULE|CLIENT_DENY_BLOCKING))
+        return 0;
+    if (c->id == CLIENT_ID_AOF || server.loading) return 0;
+    /* Queuing a command in MULTI is cheap, only EXEC counts. */
+    if (c->flags & CLIENT_MULTI && c->cmd->proc != execCommand) return 0;
+    if (dbIsolationKeyless(c->cmd)) return 0;
+
+    long long busy = db_busy[c->db->id];
+    if (busy < server.db_isolation_slice || busy == db_busy_total) return 0;
+
+    uint64_t *id = zmalloc(sizeof(*id));
+    *id = c->id;
+    listAddNodeTail(db_postponed,id);
+    blockPostponeClient(c);
+    db_stat_postponed++;
+    db_stat_postponed_db[c->db->id]++;
+    return 1;
+}
+
+/* Called by beforeSleep() after the blocked clients were served: start a new
+ * iteration, and queue the postponed clients so that they are executed in
+ * the next one, after the commands read in the meantime. */
+void dbIsolationBeforeSleep(void) {
+    if (db_busy_total) {
+        memset(db_busy,0,sizeof(long long)*server.dbnum);
+        db_busy_total = 0;
+    }
+    if (listLength(db_postponed) == 0) return;
+
+    listIter li;
+    listNode *ln;
+    listRewind(db_postponed,&li);
+    while ((ln = listNext(&li))) {
+        client *c = lookupClientByID(*(uint64_t*)listNodeValue(ln));
+        if (c && c->flags & CLIENT_BLOCKED && c->bstate.btype == BLOCKED_POSTPONE)
+            unblockClient(c,1);
+    }
+    listEmpty(db_postponed);
+    aeSetDontWait(server.el,1);
+}
+
+void dbIsolationResetStats(void) {
+    db_stat_postponed = 0;
+    if (db_stat_postponed_db)
+        memset(db_stat_postponed_db,0,sizeof(long long)*server.dbnum);
+}
+
+/* The total, followed by the count of every database that was postponed. */
+sds genDbIsolationInfoString(sds info) {
+    info = sdscatprintf(info,
+        "db_isolation_postponed_commands:%lld\r\n",
+        db_stat_postponed);
+    for (int j = 0; j < server.dbnum; j++) {
+        if (db_stat_postponed_db[j] == 0) continue;
+        info = sdscatprintf(info,
+            "db_isolation_postponed_db%d:%lld\r\n",
+            j, db_stat_postponed_db[j]);
+    }
+    return info;
+}
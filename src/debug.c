@@ -252,6 +252,20 @@ void xorObjectDigest(redisDb *db, robj *keyobj, unsigned char *digest, robj *o)
             }
         }
         streamIteratorStop(&si);
+
+        /* The idempotency keys decide the result of the next appends. */
+        stream *s = o->ptr;
+        if (streamIdmpLength(s)) {
+            raxIterator ri;
+            raxStart(&ri,s->idmp->ids);
+            raxSeek(&ri,"^",NULL,0);
+            while(raxNext(&ri)) {
+                sds key = ri.data;
+                mixDigest(digest,ri.key,ri.key_len);
+                mixDigest(digest,key,sdslen(key));
+            }
+            raxStop(&ri);
+        }
     } else if (o->type == OBJ_MODULE) {
         RedisModuleDigest md = {{0},{0},keyobj,db->id};
         moduleValue *mv = o->ptr;
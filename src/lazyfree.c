@@ -122,6 +122,9 @@ size_t lazyfreeGetFreeEffort(robj *key, robj *obj, int dbid) {
          * node in the Stream is one allocation. */
         effort += s->rax->numnodes;
 
+        /* Every out of line value is an allocation as well. */
+        effort += streamBlobsLength(s);
+
         /* Every consumer group is an allocation and so are the entries in its
          * PEL. We use size of the first group's PEL as an estimate for all
          * others. */
@@ -542,6 +542,7 @@ void dismissStreamObject(robj *o, size_t size_hint) {
         raxStart(&ri,rax);
         raxSeek(&ri,"^",NULL,0);
         while (raxNext(&ri)) {
+            if (streamNodeIsStub(ri.data)) continue;
             dismissMemory(ri.data, lpBytes(ri.data));
         }
         raxStop(&ri);
@@ -1122,6 +1123,34 @@ size_t objectComputeSize(robj *key, robj *o, size_t sample_size, int dbid) {
         }
         raxStop(&ri);
 
+        /* The idempotency keys: both trees, the entry IDs, and the copy of
+         * every key in the tree ordered by ID, whose size is sampled. */
+        if (s->idmp) {
+            size_t numkeys = raxSize(s->idmp->ids);
+            asize += sizeof(*s->idmp);
+            asize += streamRadixTreeMemoryUsage(s->idmp->keys);
+            asize += streamRadixTreeMemoryUsage(s->idmp->ids);
+            asize += numkeys * sizeof(streamID);
+
+            size_t keysize = 0;
+            samples = 0;
+            raxStart(&ri,s->idmp->ids);
+            raxSeek(&ri,"^",NULL,0);
+            while(samples < sample_size && raxNext(&ri)) {
+                keysize += sdsAllocSize(ri.data);
+                samples++;
+            }
+            raxStop(&ri);
+            if (samples) asize += keysize / samples * numkeys;
+        }
+
+        /* The out of line values are accounted as they are added, so
+         * there is no need to sample them. */
+        if (s->blobs) {
+            asize += streamRadixTreeMemoryUsage(s->blobs);
+            asize += s->blobs_bytes;
+        }
+
         /* Consumer groups also have a non trivial memory overhead if there
          * are many consumers and many groups, let's count at least the
          * overhead of the pending entries in the groups and consumers
@@ -571,6 +571,41 @@ robj *rdbLoadStringObject(rio *rdb) {
     return rdbGenericLoadStringObject(rdb,RDB_LOAD_NONE,NULL);
 }
 
+/* The rio of the RDB file loaded with stream-mmap-load, see rdbLoad(), and
+ * the number of nodes left in the mapped file. */
+static rio *rdb_mapped_rio = NULL;
+static long long rdb_mapped_nodes = 0;
+
+/* Load the listpack of a stream node like rdbGenericLoadStringObject() with
+ * RDB_LOAD_PLAIN does. However when loading a mapped RDB file, an uncompressed
+ * listpack is not read: it is skipped, '*mapped' is set to 1, and the
+ * returned listpack points to the mapped file, so it must not be freed. */
+static unsigned char *rdbLoadStreamListpack(rio *rdb, size_t *lenptr, int *mapped) {
+    *mapped = 0;
+    if (rdb != rdb_mapped_rio)
+        return rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,lenptr);
+
+    int isencoded;
+    unsigned long long len = rdbLoadLen(rdb,&isencoded);
+    if (len == RDB_LENERR) return NULL;
+    if (isencoded) {
+        if (len == RDB_ENC_LZF)
+            return rdbLoadLzfStringObject(rdb,RDB_LOAD_PLAIN,lenptr);
+        rdbReportCorruptRDB("Unknown RDB listpack encoding type %llu",len);
+        return NULL;
+    }
+
+    unsigned char *lp = streamTierMapped(rioTell(rdb),len);
+    if (lp == NULL || fseeko(rdb->io.file.fp,len,SEEK_CUR) == -1) return NULL;
+    /* The skipped bytes are still part of the checksum, they are read from
+     * the mapping instead of being copied. */
+    if (rdb->update_cksum) rdb->update_cksum(rdb,lp,len);
+    rdb->processed_bytes += len;
+    *lenptr = len;
+    *mapped = 1;
+    return lp;
+}
+
 robj *rdbLoadEncodedStringObject(rio *rdb) {
     return rdbGenericLoadStringObject(rdb,RDB_LOAD_ENC,NULL);
 }
@@ -657,6 +692,34 @@ int rdbLoadBinaryFloatValue(rio *rdb, float *val) {
     return 0;
 }
 
+/* Return the number of consumer groups of the stream 's' with a dead letter
+ * stream. */
+static size_t rdbStreamDeadLetterGroups(stream *s) {
+    size_t count = 0;
+    if (s->cgroups == NULL) return 0;
+
+    raxIterator ri;
+    raxStart(&ri,s->cgroups);
+    raxSeek(&ri,"^",NULL,0);
+    while(raxNext(&ri)) {
+        streamCG *cg = ri.data;
+        if (cg->max_deliveries) count++;
+    }
+    raxStop(&ri);
+    return count;
+}
+
+/* Return the RDB type of the stream 's': every type adds data to the
+ * previous one, so the oldest type able to hold the data actually used is
+ * picked, and the streams using none of the additions can still be loaded
+ * by older versions. */
+static int rdbStreamType(stream *s) {
+    if (rdbStreamDeadLetterGroups(s)) return RDB_TYPE_STREAM_LISTPACKS_6;
+    if (streamBlobsLength(s)) return RDB_TYPE_STREAM_LISTPACKS_5;
+    if (streamIdmpLength(s)) return RDB_TYPE_STREAM_LISTPACKS_4;
+    return RDB_TYPE_STREAM_LISTPACKS_3;
+}
+
 /* Save the object type of object "o". */
 int rdbSaveObjectType(rio *rdb, robj *o) {
     switch (o->type) {
@@ -691,7 +754,7 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         else
             serverPanic("Unknown hash encoding");
     case OBJ_STREAM:
-        return rdbSaveType(rdb,RDB_TYPE_STREAM_LISTPACKS_3);
+        return rdbSaveType(rdb,rdbStreamType(o->ptr));
     case OBJ_MODULE:
         return rdbSaveType(rdb,RDB_TYPE_MODULE_2);
     default:
@@ -982,13 +1045,20 @@ ssize_t rdbSaveObject(rio *rdb, robj *o, robj *key, int dbid) {
         raxSeek(&ri,"^",NULL,0);
         while (raxNext(&ri)) {
             unsigned char *lp = ri.data;
+            /* Spilled nodes are read from the tier file just for the time
+             * needed to save them, without faulting them in. */
+            unsigned char *spilled = NULL;
+            if (streamNodeIsStub(lp)) lp = spilled = streamTierReadNode(ri.data);
             size_t lp_bytes = lpBytes(lp);
             if ((n = rdbSaveRawString(rdb,ri.key,ri.key_len)) == -1) {
+                if (spilled) lpFree(spilled);
                 raxStop(&ri);
                 return -1;
             }
             nwritten += n;
-            if ((n = rdbSaveRawString(rdb,lp,lp_bytes)) == -1) {
+            n = rdbSaveRawString(rdb,lp,lp_bytes);
+            if (spilled) lpFree(spilled);
+            if (n == -1) {
                 raxStop(&ri);
                 return -1;
             }
@@ -1077,6 +1147,97 @@ ssize_t rdbSaveObject(rio *rdb, robj *o, robj *key, int dbid) {
             }
             raxStop(&ri);
         }
+
+        /* The additions of the newer types follow, see rdbStreamType(). */
+        int rdbtype = rdbStreamType(s);
+
+        /* Save the idempotency keys, ordered by entry ID. */
+        size_t num_idmp = streamIdmpLength(s);
+        if (rdbtype >= RDB_TYPE_STREAM_LISTPACKS_4) {
+            if ((n = rdbSaveLen(rdb,num_idmp)) == -1) return -1;
+            nwritten += n;
+        }
+
+        if (num_idmp) {
+            raxStart(&ri,s->idmp->ids);
+            raxSeek(&ri,"^",NULL,0);
+            while(raxNext(&ri)) {
+                sds key = ri.data;
+                if ((n = rdbSaveRawString(rdb,(unsigned char*)key,sdslen(key))) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+
+                /* The entry ID, in raw form like in the PEL. */
+                if ((n = rdbWriteRaw(rdb,ri.key,sizeof(streamID))) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+            }
+            raxStop(&ri);
+        }
+
+        /* Save the out of line values, if any. Their count is always there
+         * when the dead letter streams are. */
+        size_t num_blobs = streamBlobsLength(s);
+        size_t num_dlq = rdbStreamDeadLetterGroups(s);
+        if (rdbtype >= RDB_TYPE_STREAM_LISTPACKS_5) {
+            if ((n = rdbSaveLen(rdb,num_blobs)) == -1) return -1;
+            nwritten += n;
+        }
+        if (num_blobs) {
+            raxStart(&ri,s->blobs);
+            raxSeek(&ri,"^",NULL,0);
+            while(raxNext(&ri)) {
+                uint64_t handle;
+                memcpy(&handle,ri.key,sizeof(handle));
+                if ((n = rdbSaveLen(rdb,ntohu64(handle))) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+
+                sds blob = ri.data;
+                if ((n = rdbSaveRawString(rdb,(unsigned char*)blob,sdslen(blob))) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+            }
+            raxStop(&ri);
+        }
+
+        /* Save the dead letter streams of the groups, if any. */
+        if (num_dlq) {
+            if ((n = rdbSaveLen(rdb,num_dlq)) == -1) return -1;
+            nwritten += n;
+
+            raxStart(&ri,s->cgroups);
+            raxSeek(&ri,"^",NULL,0);
+            while(raxNext(&ri)) {
+                streamCG *cg = ri.data;
+                if (cg->max_deliveries == 0) continue;
+                if ((n = rdbSaveRawString(rdb,ri.key,ri.key_len)) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+                if ((n = rdbSaveLen(rdb,cg->max_deliveries)) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+                sds dlq_key = cg->dlq_key->ptr;
+                if ((n = rdbSaveRawString(rdb,(unsigned char*)dlq_key,sdslen(dlq_key))) == -1) {
+                    raxStop(&ri);
+                    return -1;
+                }
+                nwritten += n;
+            }
+            raxStop(&ri);
+        }
     } else if (o->type == OBJ_MODULE) {
         /* Save a module-specific value. */
         RedisModuleIO io;
@@ -2476,7 +2637,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int dbid, int *error) {
         }
     } else if (rdbtype == RDB_TYPE_STREAM_LISTPACKS ||
                rdbtype == RDB_TYPE_STREAM_LISTPACKS_2 ||
-               rdbtype == RDB_TYPE_STREAM_LISTPACKS_3)
+               rdbtype == RDB_TYPE_STREAM_LISTPACKS_3 ||
+               rdbtype == RDB_TYPE_STREAM_LISTPACKS_4 ||
+               rdbtype == RDB_TYPE_STREAM_LISTPACKS_5 ||
+               rdbtype == RDB_TYPE_STREAM_LISTPACKS_6)
     {
         o = createStreamObject();
         stream *s = o->ptr;
@@ -2507,8 +2671,8 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int dbid, int *error) {
 
             /* Load the listpack. */
             size_t lp_size;
-            unsigned char *lp =
-                rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,&lp_size);
+            int mapped;
+            unsigned char *lp = rdbLoadStreamListpack(rdb,&lp_size,&mapped);
             if (lp == NULL) {
                 rdbReportReadError("Stream listpacks loading failed.");
                 sdsfree(nodekey);
@@ -2520,7 +2684,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int dbid, int *error) {
                 rdbReportCorruptRDB("Stream listpack integrity check failed.");
                 sdsfree(nodekey);
                 decrRefCount(o);
-                zfree(lp);
+                if (!mapped) zfree(lp);
                 return NULL;
             }
 
@@ -2532,18 +2696,29 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int dbid, int *error) {
                 rdbReportCorruptRDB("Empty listpack inside stream");
                 sdsfree(nodekey);
                 decrRefCount(o);
-                zfree(lp);
+                if (!mapped) zfree(lp);
                 return NULL;
             }
 
+            /* A mapped node is referenced by a stub, and read the first
+             * time it is accessed. */
+            void *node = lp;
+            if (mapped) {
+                streamID master_id;
+                streamDecodeID(nodekey,&master_id);
+                node = streamTierMapNode(lp,lp_size,&master_id);
+                rdb_mapped_nodes++;
+            }
+
             /* Insert the key in the radix tree. */
             int retval = raxTryInsert(s->rax,
-                (unsigned char*)nodekey,sizeof(streamID),lp,NULL);
+                (unsigned char*)nodekey,sizeof(streamID),node,NULL);
             sdsfree(nodekey);
             if (!retval) {
                 rdbReportCorruptRDB("Listpack re-added with existing key");
                 decrRefCount(o);
-                zfree(lp);
+                if (mapped) streamTierFreeStub(node);
+                else zfree(lp);
                 return NULL;
             }
         }
@@ -2780,6 +2955,128 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int dbid, int *error) {
                 raxStop(&ri_cg_pel);
             }
         }
+
+        /* Load the idempotency keys. */
+        if (rdbtype >= RDB_TYPE_STREAM_LISTPACKS_4) {
+            uint64_t idmp_num = rdbLoadLen(rdb,NULL);
+            if (idmp_num == RDB_LENERR) {
+                rdbReportReadError("Stream idempotency keys num loading failed.");
+                decrRefCount(o);
+                return NULL;
+            }
+            while(idmp_num--) {
+                sds key = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL);
+                if (key == NULL) {
+                    rdbReportReadError(
+                        "Error reading the idempotency key of a stream.");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                unsigned char rawid[sizeof(streamID)];
+                if (rioRead(rdb,rawid,sizeof(rawid)) == 0) {
+                    rdbReportReadError(
+                        "Stream short read reading idempotency key ID.");
+                    sdsfree(key);
+                    decrRefCount(o);
+                    return NULL;
+                }
+                streamID id;
+                streamDecodeID(rawid,&id);
+                int added = streamIdmpAdd(s,key,&id);
+                sdsfree(key);
+                if (!added) {
+                    rdbReportCorruptRDB("Duplicated stream idempotency key");
+                    decrRefCount(o);
+                    return NULL;
+                }
+            }
+        }
+
+        /* Load the out of line values. */
+        if (rdbtype >= RDB_TYPE_STREAM_LISTPACKS_5) {
+            uint64_t blobs_num = rdbLoadLen(rdb,NULL);
+            if (blobs_num == RDB_LENERR) {
+                rdbReportReadError("Stream out of line values num loading failed.");
+                decrRefCount(o);
+                return NULL;
+            }
+            while(blobs_num--) {
+                uint64_t handle = rdbLoadLen(rdb,NULL);
+                if (handle == RDB_LENERR) {
+                    rdbReportReadError("Stream out of line value handle loading failed.");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                sds blob = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL);
+                if (blob == NULL) {
+                    rdbReportReadError(
+                        "Error reading an out of line value of a stream.");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                if (!streamBlobInsert(s,handle,blob)) {
+                    rdbReportCorruptRDB("Duplicated stream out of line value");
+                    sdsfree(blob);
+                    decrRefCount(o);
+                    return NULL;
+                }
+            }
+        }
+
+        /* Load the dead letter streams of the groups. */
+        if (rdbtype >= RDB_TYPE_STREAM_LISTPACKS_6) {
+            uint64_t dlq_num = rdbLoadLen(rdb,NULL);
+            if (dlq_num == RDB_LENERR) {
+                rdbReportReadError("Stream dead letter groups num loading failed.");
+                decrRefCount(o);
+                return NULL;
+            }
+            while(dlq_num--) {
+                sds cgname = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL);
+                if (cgname == NULL) {
+                    rdbReportReadError(
+                        "Error reading the consumer group name of a dead letter stream.");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                streamCG *cg = streamLookupCG(s,cgname);
+                sdsfree(cgname);
+                if (cg == NULL || cg->max_deliveries) {
+                    rdbReportCorruptRDB("Dead letter stream of an unknown consumer group");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                uint64_t max_deliveries = rdbLoadLen(rdb,NULL);
+                if (max_deliveries == RDB_LENERR || max_deliveries == 0) {
+                    rdbReportCorruptRDB("Invalid max deliveries of a dead letter stream");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                sds dlq_key = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL);
+                if (dlq_key == NULL) {
+                    rdbReportReadError("Error reading the key of a dead letter stream.");
+                    decrRefCount(o);
+                    return NULL;
+                }
+                cg->max_deliveries = max_deliveries;
+                cg->dlq_key = createObject(OBJ_STRING,dlq_key);
+            }
+        }
+
+        /* Check that the entries and the out of line values agree, a
+         * missing value would crash the server when the entry is read. */
+        if (deep_integrity_validation && !streamValidateBlobs(s)) {
+            rdbReportCorruptRDB("Stream out of line values don't match the entries");
+            decrRefCount(o);
+            return NULL;
+        }
+        if (deep_integrity_validation && rdbtype < RDB_TYPE_STREAM_LISTPACKS_5 &&
+            streamHasLargeValues(s))
+        {
+            rdbReportCorruptRDB("Stream entries with out of line values in an older type");
+            decrRefCount(o);
+            return NULL;
+        }
     } else if (rdbtype == RDB_TYPE_MODULE_PRE_GA) {
             rdbReportCorruptRDB("Pre-release module format not supported");
             return NULL;
@@ -3144,6 +3441,13 @@ int rdbLoadRioWithLoadingCtx(rio *rdb, int rdbflags, rdbSaveInfo *rsi, rdbLoadin
                     "databases. Exiting\n", server.dbnum);
                 exit(1);
             }
+            /* The previous database is complete: the RDB stores every
+             * database once, in order. */
+            if (rdb_loading_ctx->db_loaded &&
+                db != rdb_loading_ctx->dbarray+dbid)
+            {
+                rdb_loading_ctx->db_loaded(db - rdb_loading_ctx->dbarray);
+            }
             db = rdb_loading_ctx->dbarray+dbid;
             continue; /* Read next opcode. */
         } else if (type == RDB_OPCODE_RESIZEDB) {
@@ -3463,12 +3767,28 @@ int rdbLoad(char *filename, rdbSaveInfo *rsi, int rdbflags) {
     startLoadingFile(sb.st_size, filename, rdbflags);
     rioInitWithFile(&rdb,fp);
 
+    /* With stream-mmap-load the stream nodes are left in the file, unless
+     * they must be fully validated. */
+    rdb_mapped_nodes = 0;
+    if (server.stream_mmap_load &&
+        server.sanitize_dump_payload != SANITIZE_DUMP_YES &&
+        streamTierMapRdb(fileno(fp),sb.st_size) == C_OK)
+    {
+        rdb_mapped_rio = &rdb;
+    }
+
     retval = rdbLoadRio(&rdb,rdbflags,rsi);
+    if (rdb_mapped_rio) {
+        serverLog(LL_NOTICE,"%lld stream nodes left in the mapped RDB file.",
+                  rdb_mapped_nodes);
+        streamTierMapRdbLoaded();
+        rdb_mapped_rio = NULL;
+    }
 
     fclose(fp);
     stopLoading(retval==C_OK);
-    /* Reclaim the cache backed by rdb */
-    if (retval == C_OK && !(rdbflags & RDBFLAGS_KEEP_CACHE)) {
+    /* Reclaim the cache backed by rdb, unless nodes are still mapped. */
+    if (retval == C_OK && !(rdbflags & RDBFLAGS_KEEP_CACHE) && !rdb_mapped_nodes) {
         /* TODO: maybe we could combine the fopen and open into one in the future */
         rdb_fd = open(filename, O_RDONLY);
         if (rdb_fd > 0) bioCreateCloseJob(rdb_fd, 0, 1);
@@ -94,10 +94,20 @@
 #define RDB_TYPE_STREAM_LISTPACKS_2 19
 #define RDB_TYPE_SET_LISTPACK  20
 #define RDB_TYPE_STREAM_LISTPACKS_3 21
+/* The types below are private to RedQueue: they are numbered away from the
+ * upstream types, that grow up from the low numbers, and from the opcodes,
+ * that grow down from 255. They are only written for the keys using the data
+ * they add, so the version is not bumped: the files without them are still
+ * loaded by older versions, that refuse the files with them as holding an
+ * unknown type. */
+#define RDB_TYPE_STREAM_LISTPACKS_4 100 /* + idempotency keys. */
+#define RDB_TYPE_STREAM_LISTPACKS_5 101 /* + out of line values. */
+#define RDB_TYPE_STREAM_LISTPACKS_6 102 /* + dead letter streams. */
 /* NOTE: WHEN ADDING NEW RDB TYPE, UPDATE rdbIsObjectType(), and rdb_type_string[] */
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) (((t) >= 0 && (t) <= 7) || ((t) >= 9 && (t) <= 21))
+#define rdbIsObjectType(t) (((t) >= 0 && (t) <= 7) || ((t) >= 9 && (t) <= 21) || \
+                            ((t) >= 100 && (t) <= 102))
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
 #define RDB_OPCODE_FUNCTION2  245   /* function library data */
@@ -99,6 +99,8 @@ static struct config {
     int randomkeys_keyspacelen;
     int keepalive;
     int pipeline;
+    double rate; /* Requests per second per client, open-loop mode if > 0. */
+    long long rate_interval; /* Microseconds between the pipelines of a client. */
     long long start;
     long long totlatency;
     const char *title;
@@ -140,6 +142,8 @@ typedef struct _client {
     size_t written;         /* Bytes of 'obuf' already written */
     long long start;        /* Start time of a request */
     long long latency;      /* Request latency */
+    long long next_send;    /* Scheduled start of the next request (open-loop) */
+    long long send_timer;   /* Timer waiting for 'next_send', or -1 */
     int pending;            /* Number of pending requests (replies to consume) */
     int prefix_pending;     /* If non-zero, number of pending prefix commands. Commands
                                such as auth and select are prefixed to the pipeline of
@@ -373,6 +377,7 @@ static void freeClient(client c) {
     listNode *ln;
     aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
     aeDeleteFileEvent(el,c->context->fd,AE_READABLE);
+    if (c->send_timer != -1) aeDeleteTimeEvent(el,c->send_timer);
     if (c->thread_id >= 0) {
         int requests_finished = 0;
         atomicGet(config.requests_finished, requests_finished);
@@ -590,6 +595,36 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
 }
 
+static int sendTimerHandler(aeEventLoop *el, long long id, void *privdata) {
+    client c = privdata;
+    UNUSED(id);
+    c->send_timer = -1;
+    aeCreateFileEvent(el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    return AE_NOMORE;
+}
+
+/* In open-loop mode, return 1 if the client is early on its schedule, after
+ * arming a timer that will resume writing at the scheduled time. Clients late
+ * on their schedule send right away: their latency is measured from the time
+ * the request should have been sent, so the time spent waiting for a slow
+ * server is accounted for (no coordinated omission). */
+static int clientIsEarly(aeEventLoop *el, client c) {
+    long long now = ustime();
+
+    /* Spread the first request of the clients over an interval, so that
+     * they don't all send at the same time. */
+    if (c->next_send == 0)
+        c->next_send = now + random() % config.rate_interval;
+    if (now >= c->next_send) return 0;
+
+    /* The timers have a millisecond resolution: the last fraction of a
+     * millisecond is waited polling from the next event loop iteration. */
+    aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+    c->send_timer = aeCreateTimeEvent(el,(c->next_send-now)/1000,
+                                      sendTimerHandler,c,NULL);
+    return 1;
+}
+
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     client c = privdata;
     UNUSED(el);
@@ -598,6 +633,8 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
 
     /* Initialize request when nothing was written. */
     if (c->written == 0) {
+        if (config.rate > 0 && clientIsEarly(el,c)) return;
+
         /* Enforce upper bound to number of requests. */
         int requests_issued = 0;
         atomicGetIncr(config.requests_issued, requests_issued, config.pipeline);
@@ -609,7 +646,12 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         if (config.randomkeys) randomizeClientKey(c);
         if (config.cluster_mode && c->staglen > 0) setClusterKeyHashTag(c);
         atomicGet(config.slots_last_update, c->slots_last_update);
-        c->start = ustime();
+        if (config.rate > 0) {
+            c->start = c->next_send;
+            c->next_send += config.rate_interval;
+        } else {
+            c->start = ustime();
+        }
         c->latency = -1;
     }
     const ssize_t buflen = sdslen(c->obuf);
@@ -767,6 +809,9 @@ static client createClient(char *cmd, size_t len, client from, int thread_id) {
 
     c->written = 0;
     c->pending = config.pipeline+c->prefix_pending;
+    /* A reconnecting client keeps the schedule of the one it replaces. */
+    c->next_send = from ? from->next_send : 0;
+    c->send_timer = -1;
     c->randptr = NULL;
     c->randlen = 0;
     c->stagptr = NULL;
@@ -872,6 +917,7 @@ static void showLatencyReport(void) {
     const float p50 = hdr_value_at_percentile(config.latency_histogram, 50.0 )/1000.0f;
     const float p95 = hdr_value_at_percentile(config.latency_histogram, 95.0 )/1000.0f;
     const float p99 = hdr_value_at_percentile(config.latency_histogram, 99.0 )/1000.0f;
+    const float p999 = hdr_value_at_percentile(config.latency_histogram, 99.9 )/1000.0f;
     const float p100 = ((float) hdr_max(config.latency_histogram))/1000.0f;
     const float avg = hdr_mean(config.latency_histogram)/1000.0f;
 
@@ -883,6 +929,9 @@ static void showLatencyReport(void) {
         printf("  %d parallel clients\n", config.numclients);
         printf("  %d bytes payload\n", config.datasize);
         printf("  keep alive: %d\n", config.keepalive);
+        if (config.rate > 0)
+            printf("  open-loop rate: %.2f requests per second per client\n",
+                   config.rate);
         if (config.cluster_mode) {
             printf("  cluster mode: yes (%d masters)\n",
                    config.cluster_node_count);
@@ -948,10 +997,12 @@ static void showLatencyReport(void) {
         printf("Summary:\n");
         printf("  throughput summary: %.2f requests per second\n", reqpersec);
         printf("  latency summary (msec):\n");
-        printf("    %9s %9s %9s %9s %9s %9s\n", "avg", "min", "p50", "p95", "p99", "max");
-        printf("    %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", avg, p0, p50, p95, p99, p100);
+        printf("    %9s %9s %9s %9s %9s %9s %9s\n", "avg", "min", "p50", "p95", "p99", "p99.9", "max");
+        printf("    %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", avg, p0, p50, p95, p99, p999, p100);
     } else if (config.csv) {
-        printf("\"%s\",\"%.2f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\"\n", config.title, reqpersec, avg, p0, p50, p95, p99, p100);
+        /* p99.9 comes last so that the columns of older versions keep
+         * their position. */
+        printf("\"%s\",\"%.2f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\"\n", config.title, reqpersec, avg, p0, p50, p95, p99, p100, p999);
     } else {
         printf("%*s\r", config.last_printed_bytes, " "); // ensure there is a clean line
         printf("%s: %.2f requests per second, p50=%.3f msec\n", config.title, reqpersec, p50);
@@ -1473,6 +1524,10 @@ int parseOptions(int argc, char **argv) {
             if (lastarg) goto invalid;
             config.pipeline = atoi(argv[++i]);
             if (config.pipeline <= 0) config.pipeline=1;
+        } else if (!strcmp(argv[i],"--rate")) {
+            if (lastarg) goto invalid;
+            config.rate = strtod(argv[++i],NULL);
+            if (config.rate <= 0) goto invalid;
         } else if (!strcmp(argv[i],"-r")) {
             if (lastarg) goto invalid;
             const char *next = argv[++i], *p = next;
@@ -1632,6 +1687,11 @@ usage:
 "                    Note: If -r is omitted, all commands in a benchmark will\n"
 "                    use the same key.\n"
 " -P <numreq>        Pipeline <numreq> requests. Default 1 (no pipeline).\n"
+" --rate <req/sec>   Open-loop mode: every client sends its requests on a fixed\n"
+"                    schedule at the given rate (per client, per second), and\n"
+"                    latency is measured from the scheduled send time, so that\n"
+"                    the queueing delay of a stalled server is not hidden.\n"
+"                    A client late on its schedule sends immediately.\n"
 " -q                 Quiet. Just show query/sec values\n"
 " --precision        Number of decimal places to display in latency output (default 0)\n"
 " --csv              Output in CSV format\n"
@@ -1744,6 +1804,7 @@ int main(int argc, char **argv) {
     config.keepalive = 1;
     config.datasize = 3;
     config.pipeline = 1;
+    config.rate = 0;
     config.randomkeys = 0;
     config.randomkeys_keyspacelen = 0;
     config.quiet = 0;
@@ -1775,6 +1836,13 @@ int main(int argc, char **argv) {
     argc -= i;
     argv += i;
 
+    /* In open-loop mode a client sends a whole pipeline at once, so the
+     * pipelines are scheduled to honor the rate of single requests. */
+    if (config.rate > 0) {
+        config.rate_interval = (long long)(config.pipeline*1000000/config.rate);
+        if (config.rate_interval < 1) config.rate_interval = 1;
+    }
+
     tag = "";
 
 #ifdef USE_OPENSSL
@@ -1862,7 +1930,7 @@ int main(int argc, char **argv) {
         /* and will wait for every */
     }
     if(config.csv){
-        printf("\"test\",\"rps\",\"avg_latency_ms\",\"min_latency_ms\",\"p50_latency_ms\",\"p95_latency_ms\",\"p99_latency_ms\",\"max_latency_ms\"\n");
+        printf("\"test\",\"rps\",\"avg_latency_ms\",\"min_latency_ms\",\"p50_latency_ms\",\"p95_latency_ms\",\"p99_latency_ms\",\"max_latency_ms\",\"p999_latency_ms\"\n");
     }
     /* Run benchmark with command in the remainder of the arguments. */
     if (argc) {
@@ -101,6 +101,9 @@ char *rdb_type_string[] = {
     "stream-v2",
     "set-listpack",
     "stream-v3",
+    [RDB_TYPE_STREAM_LISTPACKS_4] = "stream-v4",
+    [RDB_TYPE_STREAM_LISTPACKS_5] = "stream-v5",
+    [RDB_TYPE_STREAM_LISTPACKS_6] = "stream-v6",
 };
 
 /* Show a few stats collected into 'rdbstate' */
@@ -133,7 +136,8 @@ void rdbCheckError(const char *fmt, ...) {
         printf("[additional info] Reading type %d (%s)\n",
             rdbstate.key_type,
             ((unsigned)rdbstate.key_type <
-             sizeof(rdb_type_string)/sizeof(char*)) ?
+             sizeof(rdb_type_string)/sizeof(char*) &&
+             rdb_type_string[rdbstate.key_type]) ?
                 rdb_type_string[rdbstate.key_type] : "unknown");
     rdbShowGenericInfo();
 }
@@ -0,0 +1,5 @@
+#define REDIS_GIT_SHA1 "2ecb5a7a"
+#define REDIS_GIT_DIRTY "212"
+#define REDIS_BUILD_ID "vm-1792365648"
+#include "version.h"
+#define REDIS_BUILD_ID_RAW REDQUEUE_NAME REDQUEUE_VERSION REDIS_BUILD_ID REDIS_GIT_DIRTY REDIS_GIT_SHA1
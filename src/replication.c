@@ -434,8 +434,10 @@ void feedReplicationBuffer(char *s, size_t len) {
  * received by our clients in order to create the replication stream.
  * Instead if the instance is a replica and has sub-replicas attached, we use
  * replicationFeedStreamFromMasterStream() */
-void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
-    int j, len;
+/* Common part of replicationFeedSlaves() and replicationFeedSlavesProto():
+ * returns 0 if the command must not be fed to the replication buffer,
+ * otherwise makes sure the right DB is selected and returns 1. */
+static int replicationFeedSlavesPrepare(list *slaves, int dictid) {
     char llstr[LONG_STR_SIZE];
 
     /* In case we propagate a command that doesn't touch keys (PING, REPLCONF) we
@@ -447,7 +449,7 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
      * propagate *identical* replication stream. In this way this slave can
      * advertise the same replication ID as the master (since it shares the
      * master replication history and has the same backlog and offsets). */
-    if (server.masterhost != NULL) return;
+    if (server.masterhost != NULL) return 0;
 
     /* If there aren't slaves, and there is no backlog buffer to populate,
      * we can return ASAP. */
@@ -456,7 +458,7 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
          * even when there's no replication active. This code will not be reached if AOF
          * is also disabled. */
         server.master_repl_offset += 1;
-        return;
+        return 0;
     }
 
     /* We can't have slaves attached and no backlog. */
@@ -490,6 +492,13 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
 
         server.slaveseldb = dictid;
     }
+    return 1;
+}
+
+void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
+    int j, len;
+
+    if (!replicationFeedSlavesPrepare(slaves,dictid)) return;
 
     /* Write the command to the replication buffer if any. */
     char aux[LONG_STR_SIZE+3];
@@ -517,6 +526,13 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
     }
 }
 
+/* Like replicationFeedSlaves() but the command is already serialized in the
+ * RESP protocol. */
+void replicationFeedSlavesProto(list *slaves, int dictid, const char *cmd, size_t len) {
+    if (!replicationFeedSlavesPrepare(slaves,dictid)) return;
+    feedReplicationBuffer((char*)cmd,len);
+}
+
 /* This is a debugging function that gets called when we detect something
  * wrong with the replication protocol: the goal is to peek into the
  * replication backlog and show a few final bytes to make simpler to
@@ -573,6 +589,23 @@ void replicationFeedStreamFromMasterStream(char *buf, size_t buflen) {
     }
 }
 
+/* Proxy to our sub-slaves, and to the backlog, the part of the master
+ * stream applied since the last call. commandProcessed() only advances the
+ * applied offset of the master client, so that a whole batch of commands
+ * read from the master is proxied with a single call: this is done at the
+ * end of processInputBuffer(), and before the master client is freed or
+ * cached, since its unprocessed query buffer is discarded. */
+void replicationProxyAppliedMasterStream(client *c) {
+    /* Offset of the first byte of the query buffer not proxied yet. */
+    long long proxied = c->read_reploff - sdslen(c->querybuf) + c->repl_applied;
+    long long applied = c->reploff - proxied;
+
+    if (applied > 0) {
+        replicationFeedStreamFromMasterStream(c->querybuf+c->repl_applied,applied);
+        c->repl_applied += applied;
+    }
+}
+
 void replicationFeedMonitors(client *c, list *monitors, int dictid, robj **argv, int argc) {
     /* Fast path to return if the monitors list is empty or the server is in loading. */
     if (monitors == NULL || listLength(monitors) == 0 || server.loading) return;
@@ -1814,6 +1847,7 @@ void restartAOFAfterSYNC(void) {
 static int useDisklessLoad(void) {
     /* compute boolean decision to use diskless load */
     int enabled = server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB ||
+           server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB_PER_DB ||
            (server.repl_diskless_load == REPL_DISKLESS_LOAD_WHEN_DB_EMPTY && dbTotalServerKeyCount()==0);
 
     if (enabled) {
@@ -1824,7 +1858,7 @@ static int useDisklessLoad(void) {
             enabled = 0;
         }
         /* Check all modules handle async replication, otherwise it's not safe to use diskless load. */
-        else if (server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB && !moduleAllModulesHandleReplAsyncLoad()) {
+        else if (server.repl_diskless_load != REPL_DISKLESS_LOAD_WHEN_DB_EMPTY && !moduleAllModulesHandleReplAsyncLoad()) {
             serverLog(LL_NOTICE,
                 "Skipping diskless-load because there are modules that are not aware of async replication.");
             enabled = 0;
@@ -1846,6 +1880,28 @@ void disklessLoadDiscardTempDb(redisDb *tempDb) {
     discardTempDb(tempDb, replicationEmptyDbCallback);
 }
 
+/* With repl-diskless-load swapdb-per-db the databases loaded in tempDb are
+ * swapped with the main ones one at a time, as soon as the loading moves past
+ * them, instead of all together when the loading completes. The old version
+ * of every swapped database is released in background right away, while the
+ * databases not loaded yet keep serving stale reads. This only lowers the
+ * memory peak when the dataset spans several databases: the old and the new
+ * version of the database being loaded are still in memory together. */
+static redisDb *async_swap_tempDb = NULL;
+static int async_swap_next = 0; /* First database not swapped yet. */
+
+/* rdbLoadingCtx 'db_loaded' callback of the swapdb-per-db loading. */
+static void disklessLoadSwapLoadedDb(int dbid) {
+    if (dbid < async_swap_next) return;
+
+    serverLog(LL_NOTICE, "MASTER <-> REPLICA sync: Swapping loaded DB %d "
+                         "and discarding the old one in background", dbid);
+    swapMainDbRangeWithTempDb(async_swap_tempDb,async_swap_next,dbid);
+    for (int j = async_swap_next; j <= dbid; j++)
+        emptyDbStructure(async_swap_tempDb,j,1,NULL);
+    async_swap_next = dbid+1;
+}
+
 /* If we know we got an entirely different data set from our master
  * we have no way to incrementally feed our replicas after that.
  * We want our replicas to resync with us as well, if we have any sub-replicas.
@@ -1866,6 +1922,8 @@ void readSyncBulkPayload(connection *conn) {
     char buf[PROTO_IOBUF_LEN];
     ssize_t nread, readlen, nwritten;
     int use_diskless_load = useDisklessLoad();
+    int swapdb = server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB ||
+                 server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB_PER_DB;
     redisDb *diskless_load_tempDb = NULL;
     functionsLibCtx* temp_functions_lib_ctx = NULL;
     int empty_db_flags = server.repl_slave_lazy_flush ? EMPTYDB_ASYNC :
@@ -2059,7 +2117,7 @@ void readSyncBulkPayload(connection *conn) {
         killRDBChild();
     }
 
-    if (use_diskless_load && server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB) {
+    if (use_diskless_load && swapdb) {
         /* Initialize empty tempDb dictionaries. */
         diskless_load_tempDb = disklessLoadInitTempDb();
         temp_functions_lib_ctx = functionsLibCtxCreate();
@@ -2088,7 +2146,7 @@ void readSyncBulkPayload(connection *conn) {
         functionsLibCtx* functions_lib_ctx;
         int asyncLoading = 0;
 
-        if (server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB) {
+        if (swapdb) {
             /* Async loading means we continue serving read commands during full resync, and
              * "swap" the new db with the old db only when loading is done.
              * It is enabled only on SWAPDB diskless replication when master replication ID hasn't changed,
@@ -2115,6 +2173,13 @@ void readSyncBulkPayload(connection *conn) {
 
         int loadingFailed = 0;
         rdbLoadingCtx loadingCtx = { .dbarray = dbarray, .functions_lib_ctx = functions_lib_ctx };
+        if (asyncLoading && server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB_PER_DB) {
+            /* Swapping the databases one by one is only safe when the old
+             * dataset has the same history of the one we receive. */
+            async_swap_tempDb = diskless_load_tempDb;
+            async_swap_next = 0;
+            loadingCtx.db_loaded = disklessLoadSwapLoadedDb;
+        }
         if (rdbLoadRioWithLoadingCtx(&rdb,RDBFLAGS_REPLICATION,&rsi,&loadingCtx) != C_OK) {
             /* RDB loading failed. */
             serverLog(LL_WARNING,
@@ -2136,7 +2201,11 @@ void readSyncBulkPayload(connection *conn) {
             cancelReplicationHandshake(1);
             rioFreeConn(&rdb, NULL);
 
-            if (server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB) {
+            if (swapdb) {
+                int swapped = async_swap_next;
+                async_swap_tempDb = NULL;
+                async_swap_next = 0;
+
                 /* Discard potentially partially loaded tempDb. */
                 moduleFireServerEvent(REDISMODULE_EVENT_REPL_ASYNC_LOAD,
                                       REDISMODULE_SUBEVENT_REPL_ASYNC_LOAD_ABORTED,
@@ -2145,6 +2214,16 @@ void readSyncBulkPayload(connection *conn) {
                 disklessLoadDiscardTempDb(diskless_load_tempDb);
                 functionsLibCtxFree(temp_functions_lib_ctx);
                 serverLog(LL_NOTICE, "MASTER <-> REPLICA sync: Discarding temporary DB in background");
+
+                /* Some databases were already swapped: rather than serving
+                 * a mix of the old and the new dataset, and since the old
+                 * one is gone, flush everything and wait for a full sync. */
+                if (swapped) {
+                    serverLog(LL_NOTICE, "MASTER <-> REPLICA sync: Some databases were "
+                                         "already swapped, flushing the old ones");
+                    replicationAttachToNewMaster();
+                    emptyData(-1,empty_db_flags,replicationEmptyDbCallback);
+                }
             } else {
                 /* Remove the half-loaded data in case we started with an empty replica. */
                 emptyData(-1,empty_db_flags,replicationEmptyDbCallback);
@@ -2157,14 +2236,16 @@ void readSyncBulkPayload(connection *conn) {
         }
 
         /* RDB loading succeeded if we reach this point. */
-        if (server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB) {
+        if (swapdb) {
             /* We will soon swap main db with tempDb and replicas will start
              * to apply data from new master, we must discard the cached
              * master structure and force resync of sub-replicas. */
             replicationAttachToNewMaster();
 
             serverLog(LL_NOTICE, "MASTER <-> REPLICA sync: Swapping active DB with loaded DB");
-            swapMainDbWithTempDb(diskless_load_tempDb);
+            swapMainDbRangeWithTempDb(diskless_load_tempDb,async_swap_next,server.dbnum-1);
+            async_swap_tempDb = NULL;
+            async_swap_next = 0;
 
             /* swap existing functions ctx with the temporary one */
             functionsLibCtxSwapWithCurrent(temp_functions_lib_ctx);
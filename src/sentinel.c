@@ -105,6 +105,9 @@ static mstime_t sentinel_default_failover_timeout = 60*3*1000;
 #define SENTINEL_DEFAULT_DENY_SCRIPTS_RECONFIG 1
 #define SENTINEL_DEFAULT_RESOLVE_HOSTNAMES 0
 #define SENTINEL_DEFAULT_ANNOUNCE_HOSTNAMES 0
+#define SENTINEL_DEFAULT_FAST_DETECTION_PERIOD 0 /* Disabled. */
+#define SENTINEL_MIN_FAST_DETECTION_PERIOD 10
+#define SENTINEL_DEFAULT_MASTERS_PER_TICK 0 /* All the masters every tick. */
 
 /* Failover machine different states. */
 #define SENTINEL_FAILOVER_STATE_NONE 0  /* No failover in progress. */
@@ -243,6 +246,19 @@ typedef struct sentinelRedisInstance {
     mstime_t failover_timeout;      /* Max time to refresh failover state. */
     mstime_t failover_delay_logged; /* For what failover_start_time value we
                                        logged the failover delay. */
+    /* Failover phases timing. The *_time fields are the start of the phase
+     * for the failover in progress, the last_*_ms fields are the duration
+     * of every phase the last time it completed. */
+    mstime_t down_detect_start_time; /* First unanswered probe before SDOWN. */
+    mstime_t failover_try_time;      /* +try-failover time. */
+    mstime_t failover_elected_time;  /* +elected-leader time. */
+    mstime_t failover_promoted_time; /* +promoted-slave time. */
+    mstime_t last_failover_detection_ms;  /* Unreachable -> ODOWN. */
+    mstime_t last_failover_election_ms;   /* +try-failover -> elected. */
+    mstime_t last_failover_promotion_ms;  /* Elected -> promoted slave. */
+    mstime_t last_failover_reconf_ms;     /* Promoted -> +failover-end. */
+    uint64_t handled_tick; /* Last sentinel.tick in which we handled this
+                              master, see sentinelHandleMastersIncrementally. */
     struct sentinelRedisInstance *promoted_slave; /* Promoted slave instance. */
     /* Scripts executed to notify admin or reconfigure clients: when they
      * are set to NULL no script is executed. */
@@ -274,6 +290,18 @@ struct sentinelState {
     char *sentinel_auth_user;    /* Username for ACLs AUTH against other sentinel. */
     int resolve_hostnames;       /* Support use of hostnames, assuming DNS is well configured. */
     int announce_hostnames;      /* Announce hostnames instead of IPs when we have them. */
+    mstime_t fast_detection_period; /* If non zero, probe masters with this
+                                       period from a dedicated timer. */
+    long long fast_detection_timer_id; /* Fast detection timer, or -1. */
+    unsigned long masters_per_tick; /* If non zero, max number of healthy
+                                       masters handled per timer tick. */
+    unsigned long masters_cursor;   /* dictScan() cursor over the masters. */
+    uint64_t tick;                  /* Number of sentinelTimer() calls. */
+    long long tick_instances;       /* Instances handled in the last tick. */
+    long long tick_duration;        /* Last tick duration in microseconds. */
+    long long tick_duration_max;    /* Max tick duration in microseconds. */
+    long long tick_duration_sum;    /* Sum of the ticks duration, in
+                                       microseconds, used for the average. */
 } sentinel;
 
 /* A script execution job. */
@@ -461,6 +489,7 @@ dictType renamedCommandsDictType = {
 
 void sentinelSetCommand(client *c);
 void sentinelConfigGetCommand(client *c);
+void sentinelUpdateFastDetectionTimer(void);
 void sentinelConfigSetCommand(client *c);
 
 /* this array is used for sentinel config lookup, which need to be loaded
@@ -474,7 +503,9 @@ const char *preMonitorCfgName[] = {
     "current-epoch",
     "myid",
     "resolve-hostnames",
-    "announce-hostnames"
+    "announce-hostnames",
+    "fast-detection-period",
+    "masters-per-tick"
 };
 
 /* This function overwrites a few normal Redis config default with Sentinel
@@ -504,6 +535,15 @@ void initSentinel(void) {
     sentinel.sentinel_auth_user = NULL;
     sentinel.resolve_hostnames = SENTINEL_DEFAULT_RESOLVE_HOSTNAMES;
     sentinel.announce_hostnames = SENTINEL_DEFAULT_ANNOUNCE_HOSTNAMES;
+    sentinel.fast_detection_period = SENTINEL_DEFAULT_FAST_DETECTION_PERIOD;
+    sentinel.fast_detection_timer_id = -1;
+    sentinel.masters_per_tick = SENTINEL_DEFAULT_MASTERS_PER_TICK;
+    sentinel.masters_cursor = 0;
+    sentinel.tick = 0;
+    sentinel.tick_instances = 0;
+    sentinel.tick_duration = 0;
+    sentinel.tick_duration_max = 0;
+    sentinel.tick_duration_sum = 0;
     memset(sentinel.myid,0,sizeof(sentinel.myid));
     server.sentinel_config = NULL;
 }
@@ -546,6 +586,9 @@ void sentinelIsRunning(void) {
     /* We want to generate a +monitor event for every configured master
      * at startup. */
     sentinelGenerateInitialMonitorEvents();
+
+    /* Start the fast detection timer if configured. */
+    sentinelUpdateFastDetectionTimer();
 }
 
 /* ============================== sentinelAddr ============================== */
@@ -1359,6 +1402,15 @@ sentinelRedisInstance *createSentinelRedisInstance(char *name, int flags, char *
     ri->failover_start_time = 0;
     ri->failover_timeout = sentinel_default_failover_timeout;
     ri->failover_delay_logged = 0;
+    ri->down_detect_start_time = 0;
+    ri->failover_try_time = 0;
+    ri->failover_elected_time = 0;
+    ri->failover_promoted_time = 0;
+    ri->last_failover_detection_ms = -1;
+    ri->last_failover_election_ms = -1;
+    ri->last_failover_promotion_ms = -1;
+    ri->last_failover_reconf_ms = -1;
+    ri->handled_tick = 0;
     ri->promoted_slave = NULL;
     ri->notification_script = NULL;
     ri->client_reconfig_script = NULL;
@@ -2008,6 +2060,18 @@ const char *sentinelHandleConfiguration(char **argv, int argc) {
         if ((sentinel.announce_hostnames = yesnotoi(argv[1])) == -1) {
             return "Please specify yes or no for the announce-hostnames option.";
         }
+    } else if (!strcasecmp(argv[0],"fast-detection-period") && argc == 2) {
+        /* fast-detection-period <milliseconds> */
+        sentinel.fast_detection_period = atoi(argv[1]);
+        if (sentinel.fast_detection_period != 0 &&
+            sentinel.fast_detection_period < SENTINEL_MIN_FAST_DETECTION_PERIOD)
+            return "fast-detection-period must be 0 or at least 10 milliseconds.";
+    } else if (!strcasecmp(argv[0],"masters-per-tick") && argc == 2) {
+        /* masters-per-tick <count> */
+        long long count;
+        if (string2ll(argv[1],strlen(argv[1]),&count) == 0 || count < 0)
+            return "masters-per-tick must be a non negative integer.";
+        sentinel.masters_per_tick = count;
     } else if (!strcasecmp(argv[0],"master-reboot-down-after-period") && argc == 3) {
         /* master-reboot-down-after-period <name> <milliseconds> */
         ri = sentinelGetMasterByName(argv[1]);
@@ -2056,6 +2120,18 @@ void rewriteConfigSentinelOption(struct rewriteConfigState *state) {
     rewriteConfigRewriteLine(state,"sentinel announce-hostnames",line,
                              sentinel.announce_hostnames != SENTINEL_DEFAULT_ANNOUNCE_HOSTNAMES);
 
+    /* sentinel fast-detection-period. */
+    line = sdscatprintf(sdsempty(), "sentinel fast-detection-period %lld",
+                        (long long) sentinel.fast_detection_period);
+    rewriteConfigRewriteLine(state,"sentinel fast-detection-period",line,
+                             sentinel.fast_detection_period != SENTINEL_DEFAULT_FAST_DETECTION_PERIOD);
+
+    /* sentinel masters-per-tick. */
+    line = sdscatprintf(sdsempty(), "sentinel masters-per-tick %lu",
+                        sentinel.masters_per_tick);
+    rewriteConfigRewriteLine(state,"sentinel masters-per-tick",line,
+                             sentinel.masters_per_tick != SENTINEL_DEFAULT_MASTERS_PER_TICK);
+
     /* For every master emit a "sentinel monitor" config entry. */
     di = dictGetIterator(sentinel.masters);
     while((de = dictNext(di)) != NULL) {
@@ -2689,6 +2765,8 @@ void sentinelRefreshInstanceInfo(sentinelRedisInstance *ri, const char *info) {
             ri->master->config_epoch = ri->master->failover_epoch;
             ri->master->failover_state = SENTINEL_FAILOVER_STATE_RECONF_SLAVES;
             ri->master->failover_state_change_time = mstime();
+            ri->master->failover_promoted_time =
+                ri->master->failover_state_change_time;
             sentinelFlushConfig();
             sentinelEvent(LL_WARNING,"+promoted-slave",ri,"%@");
             if (sentinel.simfailure_flags &
@@ -3211,6 +3289,8 @@ void sentinelConfigSetCommand(client *c) {
         "announce-port",
         "announce-hostnames",
         "loglevel",
+        "fast-detection-period",
+        "masters-per-tick",
         NULL};
     static dict *options_dict = NULL;
     if (!options_dict) {
@@ -3251,6 +3331,13 @@ void sentinelConfigSetCommand(client *c) {
         } else if (!strcasecmp(option, "announce-port")) {
             if (getLongLongFromObject(val, &numval) == C_ERR ||
                 numval < 0 || numval > 65535) goto badfmt;
+        } else if (!strcasecmp(option, "fast-detection-period")) {
+            if (getLongLongFromObject(val, &numval) == C_ERR ||
+                (numval != 0 && numval < SENTINEL_MIN_FAST_DETECTION_PERIOD) ||
+                numval > INT_MAX) goto badfmt;
+        } else if (!strcasecmp(option, "masters-per-tick")) {
+            if (getLongLongFromObject(val, &numval) == C_ERR ||
+                numval < 0) goto badfmt;
         } else if (!strcasecmp(option, "loglevel")) {
             if (!(!strcasecmp(val->ptr, "debug") || !strcasecmp(val->ptr, "verbose") ||
                 !strcasecmp(val->ptr, "notice") || !strcasecmp(val->ptr, "warning") ||
@@ -3290,6 +3377,15 @@ void sentinelConfigSetCommand(client *c) {
             val = c->argv[++i];
             getLongLongFromObject(val, &numval);
             sentinel.announce_port = numval;
+        } else if (!strcasecmp(option, "fast-detection-period") && moreargs > 0) {
+            val = c->argv[++i];
+            getLongLongFromObject(val, &numval);
+            sentinel.fast_detection_period = numval;
+            sentinelUpdateFastDetectionTimer();
+        } else if (!strcasecmp(option, "masters-per-tick") && moreargs > 0) {
+            val = c->argv[++i];
+            getLongLongFromObject(val, &numval);
+            sentinel.masters_per_tick = numval;
         } else if (!strcasecmp(option, "sentinel-user") && moreargs > 0) {
             val = c->argv[++i];
             sdsfree(sentinel.sentinel_auth_user);
@@ -3372,6 +3468,18 @@ void sentinelConfigGetCommand(client *c) {
             dictAdd(d, "sentinel-pass", NULL);
             matches++;
         }
+        if (stringmatch(pattern, "fast-detection-period", 1) && !dictFind(d, "fast-detection-period")) {
+            addReplyBulkCString(c, "fast-detection-period");
+            addReplyBulkLongLong(c, sentinel.fast_detection_period);
+            dictAdd(d, "fast-detection-period", NULL);
+            matches++;
+        }
+        if (stringmatch(pattern, "masters-per-tick", 1) && !dictFind(d, "masters-per-tick")) {
+            addReplyBulkCString(c, "masters-per-tick");
+            addReplyBulkLongLong(c, sentinel.masters_per_tick);
+            dictAdd(d, "masters-per-tick", NULL);
+            matches++;
+        }
         if (stringmatch(pattern, "loglevel", 1) && !dictFind(d, "loglevel")) {
             addReplyBulkCString(c, "loglevel");
             addReplyBulkCString(c, getLogLevel());
@@ -3457,6 +3565,25 @@ void addReplySentinelRedisInstance(client *c, sentinelRedisInstance *ri) {
         fields++;
     }
 
+    /* Duration of every phase of the last failover, -1 if unknown. */
+    if (ri->flags & SRI_MASTER) {
+        addReplyBulkCString(c,"last-failover-detection-ms");
+        addReplyBulkLongLong(c,ri->last_failover_detection_ms);
+        fields++;
+
+        addReplyBulkCString(c,"last-failover-election-ms");
+        addReplyBulkLongLong(c,ri->last_failover_election_ms);
+        fields++;
+
+        addReplyBulkCString(c,"last-failover-promotion-ms");
+        addReplyBulkLongLong(c,ri->last_failover_promotion_ms);
+        fields++;
+
+        addReplyBulkCString(c,"last-failover-reconf-ms");
+        addReplyBulkLongLong(c,ri->last_failover_reconf_ms);
+        fields++;
+    }
+
     addReplyBulkCString(c,"last-ping-sent");
     addReplyBulkLongLong(c,
         ri->link->act_ping_time ? (mstime() - ri->link->act_ping_time) : 0);
@@ -4292,13 +4419,25 @@ void sentinelInfoCommand(client *c) {
             "sentinel_tilt_since_seconds:%jd\r\n"
             "sentinel_running_scripts:%d\r\n"
             "sentinel_scripts_queue_length:%ld\r\n"
-            "sentinel_simulate_failure_flags:%lu\r\n",
+            "sentinel_simulate_failure_flags:%lu\r\n"
+            "sentinel_fast_detection_period:%lld\r\n"
+            "sentinel_masters_per_tick:%lu\r\n"
+            "sentinel_tick_instances:%lld\r\n"
+            "sentinel_tick_duration_usec:%lld\r\n"
+            "sentinel_tick_duration_max_usec:%lld\r\n"
+            "sentinel_tick_duration_avg_usec:%lld\r\n",
             dictSize(sentinel.masters),
             sentinel.tilt,
             sentinel.tilt ? (intmax_t)((mstime()-sentinel.tilt_start_time)/1000) : -1,
             sentinel.running_scripts,
             listLength(sentinel.scripts_queue),
-            sentinel.simfailure_flags);
+            sentinel.simfailure_flags,
+            (long long) sentinel.fast_detection_period,
+            sentinel.masters_per_tick,
+            sentinel.tick_instances,
+            sentinel.tick_duration,
+            sentinel.tick_duration_max,
+            sentinel.tick ? (long long)(sentinel.tick_duration_sum/sentinel.tick) : 0);
 
         di = dictGetIterator(sentinel.masters);
         while((de = dictNext(di)) != NULL) {
@@ -4591,6 +4730,8 @@ void sentinelCheckSubjectivelyDown(sentinelRedisInstance *ri) {
         if ((ri->flags & SRI_S_DOWN) == 0) {
             sentinelEvent(LL_WARNING,"+sdown",ri,"%@");
             ri->s_down_since_time = mstime();
+            ri->down_detect_start_time = ri->link->act_ping_time ?
+                ri->link->act_ping_time : ri->link->last_avail_time;
             ri->flags |= SRI_S_DOWN;
         }
     } else {
@@ -4634,6 +4775,9 @@ void sentinelCheckObjectivelyDown(sentinelRedisInstance *master) {
                 quorum, master->quorum);
             master->flags |= SRI_O_DOWN;
             master->o_down_since_time = mstime();
+            if (master->down_detect_start_time)
+                master->last_failover_detection_ms =
+                    master->o_down_since_time - master->down_detect_start_time;
         }
     } else {
         if (master->flags & SRI_O_DOWN) {
@@ -4688,6 +4832,16 @@ void sentinelReceiveIsMasterDownReply(redisAsyncContext *c, void *reply, void *p
  * in order to get the replies that allow to reach the quorum
  * needed to mark the master in ODOWN state and trigger a failover. */
 #define SENTINEL_ASK_FORCED (1<<0)
+
+/* In fast detection mode we ask other Sentinels as often as we probe the
+ * master, so that the quorum is reached as soon as they agree. */
+mstime_t sentinelAskPeriod(void) {
+    if (sentinel.fast_detection_period &&
+        sentinel.fast_detection_period < sentinel_ask_period)
+        return sentinel.fast_detection_period;
+    return sentinel_ask_period;
+}
+
 void sentinelAskMasterStateToOtherSentinels(sentinelRedisInstance *master, int flags) {
     dictIterator *di;
     dictEntry *de;
@@ -4714,7 +4868,7 @@ void sentinelAskMasterStateToOtherSentinels(sentinelRedisInstance *master, int f
         if ((master->flags & SRI_S_DOWN) == 0) continue;
         if (ri->link->disconnected) continue;
         if (!(flags & SENTINEL_ASK_FORCED) &&
-            mstime() - ri->last_master_down_reply_time < sentinel_ask_period)
+            mstime() - ri->last_master_down_reply_time < sentinelAskPeriod())
             continue;
 
         /* Ask */
@@ -4956,6 +5110,9 @@ void sentinelStartFailover(sentinelRedisInstance *master) {
     sentinelEvent(LL_WARNING,"+try-failover",master,"%@");
     master->failover_start_time = mstime()+rand()%SENTINEL_MAX_DESYNC;
     master->failover_state_change_time = mstime();
+    master->failover_try_time = master->failover_state_change_time;
+    master->failover_elected_time = 0;
+    master->failover_promoted_time = 0;
 }
 
 /* This function checks if there are the conditions to start the failover,
@@ -5135,6 +5292,7 @@ void sentinelFailoverWaitStart(sentinelRedisInstance *ri) {
         sentinelSimFailureCrash();
     ri->failover_state = SENTINEL_FAILOVER_STATE_SELECT_SLAVE;
     ri->failover_state_change_time = mstime();
+    ri->failover_elected_time = ri->failover_state_change_time;
     sentinelEvent(LL_WARNING,"+failover-state-select-slave",ri,"%@");
 }
 
@@ -5194,6 +5352,20 @@ void sentinelFailoverWaitPromotion(sentinelRedisInstance *ri) {
     }
 }
 
+/* Called when the failover ends in order to remember how long every phase
+ * took. Phases we did not observe are reported as -1. */
+void sentinelRecordFailoverTiming(sentinelRedisInstance *master) {
+    mstime_t now = master->failover_state_change_time;
+
+    master->last_failover_election_ms = master->failover_elected_time ?
+        master->failover_elected_time - master->failover_try_time : -1;
+    master->last_failover_promotion_ms =
+        (master->failover_elected_time && master->failover_promoted_time) ?
+        master->failover_promoted_time - master->failover_elected_time : -1;
+    master->last_failover_reconf_ms = master->failover_promoted_time ?
+        now - master->failover_promoted_time : -1;
+}
+
 void sentinelFailoverDetectEnd(sentinelRedisInstance *master) {
     int not_reconfigured = 0, timeout = 0;
     dictIterator *di;
@@ -5228,6 +5400,7 @@ void sentinelFailoverDetectEnd(sentinelRedisInstance *master) {
         sentinelEvent(LL_WARNING,"+failover-end",master,"%@");
         master->failover_state = SENTINEL_FAILOVER_STATE_UPDATE_CONFIG;
         master->failover_state_change_time = mstime();
+        sentinelRecordFailoverTiming(master);
     }
 
     /* If I'm the leader it is a good idea to send a best effort SLAVEOF
@@ -5377,6 +5550,8 @@ void sentinelAbortFailover(sentinelRedisInstance *ri) {
 
 /* Perform scheduled operations for the specified Redis instance. */
 void sentinelHandleRedisInstance(sentinelRedisInstance *ri) {
+    sentinel.tick_instances++;
+
     /* ========== MONITORING HALF ============ */
     /* Every kind of instance */
     sentinelReconnectInstance(ri);
@@ -5436,6 +5611,65 @@ void sentinelHandleDictOfRedisInstances(dict *instances) {
     dictReleaseIterator(di);
 }
 
+/* When there are many monitored masters, handling all of them, with their
+ * replicas and Sentinels, at every tick makes the timer slow enough to
+ * delay everything else, including the tick itself. With 'masters-per-tick'
+ * set we only handle that many masters per tick, continuing with a
+ * dictScan() cursor from where the previous tick stopped, so that every
+ * master is handled once every dictSize(masters)/masters-per-tick ticks.
+ *
+ * Masters that need attention (down, or with a failover in progress) are
+ * handled at every tick anyway, so failure handling is never delayed once
+ * a failure is detected. */
+void sentinelCollectMastersScanCallback(void *privdata, const dictEntry *de) {
+    list *batch = privdata;
+    sentinelRedisInstance *ri = dictGetVal(de);
+
+    if (ri->handled_tick == sentinel.tick) return;
+    ri->handled_tick = sentinel.tick;
+    listAddNodeTail(batch,ri);
+}
+
+void sentinelHandleMastersIncrementally(void) {
+    list *batch = listCreate();
+    unsigned long target;
+    dictIterator *di;
+    dictEntry *de;
+    listIter li;
+    listNode *ln;
+
+    /* Masters that need attention. */
+    di = dictGetIterator(sentinel.masters);
+    while((de = dictNext(di)) != NULL) {
+        sentinelRedisInstance *ri = dictGetVal(de);
+
+        if (ri->flags & (SRI_S_DOWN|SRI_O_DOWN|SRI_FAILOVER_IN_PROGRESS)) {
+            ri->handled_tick = sentinel.tick;
+            listAddNodeTail(batch,ri);
+        }
+    }
+    dictReleaseIterator(di);
+
+    /* The next slice of masters. */
+    target = listLength(batch) + sentinel.masters_per_tick;
+    do {
+        sentinel.masters_cursor = dictScan(sentinel.masters,
+            sentinel.masters_cursor, sentinelCollectMastersScanCallback, batch);
+    } while (sentinel.masters_cursor != 0 && listLength(batch) < target);
+
+    listRewind(batch,&li);
+    while((ln = listNext(&li)) != NULL) {
+        sentinelRedisInstance *ri = ln->value;
+
+        sentinelHandleRedisInstance(ri);
+        sentinelHandleDictOfRedisInstances(ri->slaves);
+        sentinelHandleDictOfRedisInstances(ri->sentinels);
+        if (ri->failover_state == SENTINEL_FAILOVER_STATE_UPDATE_CONFIG)
+            sentinelFailoverSwitchToPromotedSlave(ri);
+    }
+    listRelease(batch);
+}
+
 /* This function checks if we need to enter the TILT mode.
  *
  * The TILT mode is entered if we detect that between two invocations of the
@@ -5467,13 +5701,106 @@ void sentinelCheckTiltCondition(void) {
     sentinel.previous_time = mstime();
 }
 
+/* ========================= Fast failure detection =========================
+ * The normal monitoring half runs from sentinelTimer() at server.hz, and
+ * pings instances at most every SENTINEL_PING_PERIOD milliseconds, so the
+ * failure detection granularity does not go below a few hundred
+ * milliseconds even with small down-after-milliseconds values.
+ *
+ * When 'fast-detection-period' is set, a dedicated timer probes every
+ * master at that period and evaluates the SDOWN / ODOWN state of every
+ * master independently, right after sending the probes. The PINGs for all
+ * the masters, and the SENTINEL is-master-down-by-addr requests sent over
+ * the links shared with the other Sentinels, are only queued in the
+ * hiredis output buffers here: they are written in a single pipelined
+ * write per link on the next event loop iteration.
+ *
+ * Failover itself is still driven by sentinelTimer(): this timer only
+ * shortens the time needed to reach ODOWN and start the failover.
+ * -------------------------------------------------------------------------- */
+
+/* Probe and evaluate a single master. */
+void sentinelFastDetectMaster(sentinelRedisInstance *master) {
+    instanceLink *link = master->link;
+    int was_sdown = master->flags & SRI_S_DOWN;
+
+    if (!link->disconnected &&
+        link->pending_commands < SENTINEL_MAX_PENDING_COMMANDS &&
+        mstime() - link->last_ping_time >= sentinel.fast_detection_period)
+    {
+        sentinelSendPing(master);
+    }
+
+    /* Don't act while in TILT mode, sentinelTimer() will exit it. */
+    if (sentinel.tilt) return;
+
+    sentinelCheckSubjectivelyDown(master);
+    sentinelCheckObjectivelyDown(master);
+    if (sentinelStartFailoverIfNeeded(master) ||
+        (!was_sdown && (master->flags & SRI_S_DOWN)))
+    {
+        /* Don't wait for the next ask period if we just noticed the
+         * master is down, or we just started a failover. */
+        sentinelAskMasterStateToOtherSentinels(master,SENTINEL_ASK_FORCED);
+    } else {
+        sentinelAskMasterStateToOtherSentinels(master,SENTINEL_NO_FLAGS);
+    }
+}
+
+int sentinelFastDetectionTimer(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    dictIterator *di;
+    dictEntry *de;
+    UNUSED(eventLoop);
+    UNUSED(id);
+    UNUSED(clientData);
+
+    if (sentinel.fast_detection_period == 0) {
+        sentinel.fast_detection_timer_id = -1;
+        return AE_NOMORE;
+    }
+
+    di = dictGetIterator(sentinel.masters);
+    while((de = dictNext(di)) != NULL)
+        sentinelFastDetectMaster(dictGetVal(de));
+    dictReleaseIterator(di);
+    return sentinel.fast_detection_period;
+}
+
+/* Start the fast detection timer if it is enabled and not already running.
+ * When disabled, the timer removes itself the next time it fires. */
+void sentinelUpdateFastDetectionTimer(void) {
+    if (sentinel.fast_detection_period == 0 ||
+        sentinel.fast_detection_timer_id != -1) return;
+    sentinel.fast_detection_timer_id = aeCreateTimeEvent(server.el,
+        sentinel.fast_detection_period, sentinelFastDetectionTimer, NULL, NULL);
+    if (sentinel.fast_detection_timer_id == AE_ERR) {
+        serverLog(LL_WARNING,"Can't create the fast detection timer.");
+        sentinel.fast_detection_timer_id = -1;
+    }
+}
+
 void sentinelTimer(void) {
+    long long start = ustime();
+
+    sentinel.tick++;
+    sentinel.tick_instances = 0;
     sentinelCheckTiltCondition();
-    sentinelHandleDictOfRedisInstances(sentinel.masters);
+    if (sentinel.masters_per_tick == 0 ||
+        dictSize(sentinel.masters) <= sentinel.masters_per_tick)
+    {
+        sentinelHandleDictOfRedisInstances(sentinel.masters);
+    } else {
+        sentinelHandleMastersIncrementally();
+    }
     sentinelRunPendingScripts();
     sentinelCollectTerminatedScripts();
     sentinelKillTimedoutScripts();
 
+    sentinel.tick_duration = ustime()-start;
+    sentinel.tick_duration_sum += sentinel.tick_duration;
+    if (sentinel.tick_duration > sentinel.tick_duration_max)
+        sentinel.tick_duration_max = sentinel.tick_duration;
+
     /* We continuously change the frequency of the Redis "timer interrupt"
      * in order to desynchronize every Sentinel from every other.
      * This non-determinism avoids that Sentinels started at the same time
@@ -984,7 +984,9 @@ void clientsCron(void) {
      * process all the clients in 1 second. */
     int numclients = listLength(server.clients);
     int iterations = numclients/server.hz;
+    int processed = 0;
     mstime_t now = mstime();
+    monotime start = getMonotonicUs();
 
     /* Process at least a few clients while we are at it, even if we need
      * to process less than CLIENTS_CRON_MIN_ITERATIONS to meet our contract
@@ -1015,6 +1017,15 @@ void clientsCron(void) {
         client *c;
         listNode *head;
 
+        /* Stop once the time budget is used: since the list is rotated
+         * the next call will resume from the first client we skipped. */
+        if (server.cron_task_budget && (++processed % 16) == 0 &&
+            getMonotonicUs()-start > (monotime)server.cron_task_budget)
+        {
+            server.cron_task_stats[CRON_TASK_CLIENTS].interrupted++;
+            break;
+        }
+
         /* Take the current head, process, and then rotate the head to tail.
          * This way we can fairly iterate all clients step by step. */
         head = listFirst(server.clients);
@@ -1070,12 +1081,20 @@ void databasesCron(void) {
         static unsigned int rehash_db = 0;
         int dbs_per_call = CRON_DBS_PER_CALL;
         int j;
+        monotime start = getMonotonicUs();
 
         /* Don't test more DBs than we have. */
         if (dbs_per_call > server.dbnum) dbs_per_call = server.dbnum;
 
-        /* Resize */
+        /* Resize, leaving the remaining DBs to the next call if the time
+         * budget is used. */
         for (j = 0; j < dbs_per_call; j++) {
+            if (server.cron_task_budget && j &&
+                getMonotonicUs()-start > (monotime)server.cron_task_budget)
+            {
+                server.cron_task_stats[CRON_TASK_DATABASES].interrupted++;
+                break;
+            }
             tryResizeHashTables(resize_db % server.dbnum);
             resize_db++;
         }
@@ -1238,6 +1257,22 @@ void cronUpdateMemoryStats(void) {
     }
 }
 
+static const char *cronTaskName[CRON_TASK_NUM] = {
+    "clients", "databases", "persistence", "replication", "cluster", "modules", "stream_tier"
+};
+
+/* Account the time elapsed since 'start' to the given serverCron() task. */
+static void cronTaskDone(int task, monotime start) {
+    cronTaskStats *ts = &server.cron_task_stats[task];
+    monotime duration = getMonotonicUs()-start;
+
+    ts->duration.cnt++;
+    ts->duration.sum += duration;
+    if (duration > ts->duration.max) ts->duration.max = duration;
+    if (server.cron_task_budget && duration > (monotime)server.cron_task_budget)
+        ts->over_budget++;
+}
+
 /* This is our timer interrupt, called server.hz times per second.
  * Here is where we do a number of things that need to be done asynchronously.
  * For instance:
@@ -1255,6 +1290,12 @@ void cronUpdateMemoryStats(void) {
  * Everything directly called here will be called server.hz times per second,
  * so in order to throttle execution of things we want to do less frequently
  * a macro is used: run_with_period(milliseconds) { .... }
+ *
+ * Tasks with the same period are spread across ticks with
+ * run_with_period_phase(), and the tasks that can be split (clients and
+ * databases cron) stop once they used cron-task-budget microseconds, the
+ * rest of the work being done at the next tick. The cost of every task is
+ * reported by INFO cronstats.
  */
 
 int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
@@ -1345,7 +1386,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 
     /* Show some info about non-empty databases */
     if (server.verbosity <= LL_VERBOSE) {
-        run_with_period(5000) {
+        run_with_period_phase(5000,3) {
             for (j = 0; j < server.dbnum; j++) {
                 long long size, used, vkeys;
 
@@ -1361,7 +1402,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 
     /* Show information about connected clients */
     if (!server.sentinel_mode) {
-        run_with_period(5000) {
+        run_with_period_phase(5000,4) {
             serverLog(LL_DEBUG,
                 "%lu clients connected (%lu replicas), %zu bytes in use",
                 listLength(server.clients)-listLength(server.slaves),
@@ -1371,13 +1412,19 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     }
 
     /* We need to do a few operations on clients asynchronously. */
+    monotime task_start = getMonotonicUs();
     clientsCron();
+    cronTaskDone(CRON_TASK_CLIENTS,task_start);
 
     /* Handle background operations on Redis databases. */
+    task_start = getMonotonicUs();
     databasesCron();
+    cronTaskDone(CRON_TASK_DATABASES,task_start);
 
     /* Start a scheduled AOF rewrite if this was requested by the user while
      * a BGSAVE was in progress. */
+    task_start = getMonotonicUs();
+    int had_child = hasActiveChildProcess() || ldbPendingChildren();
     if (!hasActiveChildProcess() &&
         server.aof_rewrite_scheduled &&
         !aofRewriteLimited())
@@ -1434,6 +1481,11 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
      * call this function when needed. */
     updateDictResizePolicy();
 
+    /* The ticks that neither checked nor started a child only compared a few
+     * counters: accounting them would just hide the costly ones. */
+    if (had_child || hasActiveChildProcess())
+        cronTaskDone(CRON_TASK_PERSISTENCE,task_start);
+
 
     /* AOF postponed flush: Try at every cron cycle if the slow fsync
      * completed. */
@@ -1463,22 +1515,32 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
      * 
      * If Redis is trying to failover then run the replication cron faster so
      * progress on the handshake happens more quickly. */
+    int run_replication = 0;
     if (server.failover_state != NO_FAILOVER) {
-        run_with_period(100) replicationCron();
+        run_with_period(100) run_replication = 1;
     } else {
-        run_with_period(1000) replicationCron();
+        run_with_period_phase(1000,1) run_replication = 1;
+    }
+    if (run_replication) {
+        task_start = getMonotonicUs();
+        replicationCron();
+        cronTaskDone(CRON_TASK_REPLICATION,task_start);
     }
 
     /* Run the Redis Cluster cron. */
-    run_with_period(100) {
-        if (server.cluster_enabled) clusterCron();
+    run_with_period_phase(100,1) {
+        if (server.cluster_enabled) {
+            task_start = getMonotonicUs();
+            clusterCron();
+            cronTaskDone(CRON_TASK_CLUSTER,task_start);
+        }
     }
 
     /* Run the Sentinel timer if we are in sentinel mode. */
     if (server.sentinel_mode) sentinelTimer();
 
     /* Cleanup expired MIGRATE cached sockets. */
-    run_with_period(1000) {
+    run_with_period_phase(1000,2) {
         migrateCloseTimedoutSockets();
     }
 
@@ -1509,8 +1571,19 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
             server.rdb_bgsave_scheduled = 0;
     }
 
-    run_with_period(100) {
-        if (moduleCount()) modulesCron();
+    run_with_period_phase(100,2) {
+        if (moduleCount()) {
+            task_start = getMonotonicUs();
+            modulesCron();
+            cronTaskDone(CRON_TASK_MODULES,task_start);
+        }
+    }
+
+    /* Spill the cold stream nodes to the tier file. */
+    run_with_period_phase(100,3) {
+        task_start = getMonotonicUs();
+        streamTierCron();
+        cronTaskDone(CRON_TASK_STREAM_TIER,task_start);
     }
 
     /* Fire the cron loop modules event. */
@@ -1666,6 +1739,14 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
      * since the unblocked clients may write data. */
     blockedBeforeSleep();
 
+    /* Execute again the XGATHER reads whose streams changed, must be done
+     * before flushAppendOnlyFile since consumer groups reads write data. */
+    handleStreamGatherWatches();
+
+    /* Clients postponed by db-isolation-slice run in the next iteration,
+     * must be done after blockedBeforeSleep. */
+    dbIsolationBeforeSleep();
+
     /* Record cron time in beforeSleep, which is the sum of active-expire, active-defrag and all other
      * tasks done by cron and beforeSleep, but excluding read, write and AOF, that are counted by other
      * sets of metrics. */
@@ -1711,6 +1792,9 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
      * client side caching protocol in broadcasting (BCAST) mode. */
     trackingBroadcastInvalidationMessages();
 
+    /* Send the delayed invalidation messages about stream metadata. */
+    trackingHandlePendingStreamMetaInvalidations();
+
     /* Record time consumption of AOF writing. */
     monotime aof_start_time = getMonotonicUs();
     /* Record cron time in beforeSleep. This does not include the time consumed by AOF writing and IO writing below. */
@@ -1734,9 +1818,19 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
         server.fsynced_reploff = fsynced_reploff_pending;
     }
 
+    /* Produce the next slice of the range replies whose previous slice
+     * was fully written to the socket. */
+    if (listLength(server.stream_reply_clients))
+        handleClientsWithStreamReplies();
+
     /* Handle writes with pending output buffers. */
     handleClientsWithPendingWritesUsingThreads();
 
+    /* Don't sleep if a range reply was fully written: its next slice can be
+     * produced right away. */
+    if (listLength(server.stream_reply_clients) && streamRepliesReady())
+        aeSetDontWait(server.el,1);
+
     /* Record cron time in beforeSleep. This does not include the time consumed by AOF writing and IO writing above. */
     monotime cron_start_time_after_write = getMonotonicUs();
 
@@ -1931,6 +2025,10 @@ void createSharedObjects(void) {
     shared.srem = createStringObject("SREM",4);
     shared.xgroup = createStringObject("XGROUP",6);
     shared.xclaim = createStringObject("XCLAIM",6);
+    shared.xadd = createStringObject("XADD",4);
+    shared.xdel = createStringObject("XDEL",4);
+    shared.xdeadletter = createStringObject("XDEADLETTER",11);
+    shared.rpush = createStringObject("RPUSH",5);
     shared.script = createStringObject("SCRIPT",6);
     shared.replconf = createStringObject("REPLCONF",8);
     shared.pexpireat = createStringObject("PEXPIREAT",9);
@@ -1949,6 +2047,7 @@ void createSharedObjects(void) {
     shared.justid = createStringObject("JUSTID",6);
     shared.entriesread = createStringObject("ENTRIESREAD",11);
     shared.lastid = createStringObject("LASTID",6);
+    shared.dlqid = createStringObject("DLQID",5);
     shared.default_username = createStringObject("default",7);
     shared.ping = createStringObject("ping",4);
     shared.setid = createStringObject("SETID",5);
@@ -2518,6 +2617,8 @@ void resetServerStats(void) {
     server.stat_sync_full = 0;
     server.stat_sync_partial_ok = 0;
     server.stat_sync_partial_err = 0;
+    server.stat_repl_apply_batches = 0;
+    server.stat_repl_apply_commands = 0;
     server.stat_io_reads_processed = 0;
     atomicSet(server.stat_total_reads_processed, 0);
     server.stat_io_writes_processed = 0;
@@ -2543,8 +2644,10 @@ void resetServerStats(void) {
     server.stat_reply_buffer_shrinks = 0;
     server.stat_reply_buffer_expands = 0;
     memset(server.duration_stats, 0, sizeof(durationStats) * EL_DURATION_TYPE_NUM);
+    memset(server.cron_task_stats, 0, sizeof(cronTaskStats) * CRON_TASK_NUM);
     server.el_cmd_cnt_max = 0;
     lazyfreeResetStats();
+    dbIsolationResetStats();
 }
 
 /* Make the thread killable at any time, so that kill threads functions
@@ -2602,6 +2705,7 @@ void initServer(void) {
     server.tracking_pending_keys = listCreate();
     server.pending_push_messages = listCreate();
     server.clients_waiting_acks = listCreate();
+    server.stream_reply_clients = listCreate();
     server.get_ack_from_slaves = 0;
     server.paused_actions = 0;
     memset(server.client_pause_per_purpose, 0,
@@ -2675,6 +2779,7 @@ void initServer(void) {
     server.child_info_pipe[1] = -1;
     server.child_info_nread = 0;
     server.aof_buf = sdsempty();
+    server.propagate_buf = sdsempty();
     server.lastsave = time(NULL); /* At startup we consider the DB saved. */
     server.lastbgsave_try = 0;    /* At startup we never tried to BGSAVE. */
     server.rdb_save_time_last = -1;
@@ -2721,6 +2826,7 @@ void initServer(void) {
     server.acl_info.invalid_key_accesses  = 0;
     server.acl_info.user_auth_failures = 0;
     server.acl_info.invalid_channel_accesses = 0;
+    streamTierResetStats();
 
     /* Create the timer callback, this is our way to process many background
      * operations incrementally, like clients timeout, eviction of unaccessed
@@ -2737,6 +2843,9 @@ void initServer(void) {
             serverPanic(
                 "Error registering the readable event for the module pipe.");
     }
+    streamTierInit();
+    streamGatherInit();
+    dbIsolationInit();
 
     /* Register before and after sleep handlers (note this needs to be done
      * before loading persistence since it is used by processEventsWhileBlocked. */
@@ -3091,6 +3200,21 @@ void resetErrorTableStats(void) {
 
 /* ========================== Redis OP Array API ============================ */
 
+/* Pools bigger than this are released once the ops are freed, so that a
+ * single huge propagated command does not pin its memory forever. */
+#define REDIS_OP_ARGV_POOL_MAX 1024
+#define REDIS_OP_ARENA_SIZE 4096
+#define PROPAGATE_ARENA_STRING_MAX 64
+
+typedef struct redisOpArena {
+    struct redisOpArena *next;
+    size_t used;
+    char buf[REDIS_OP_ARENA_SIZE];
+} redisOpArena;
+
+/* Append an op to the array. The argument vector is copied into the pool of
+ * the array and a reference is taken on every argument, so the caller still
+ * owns 'argv' and its objects. */
 int redisOpArrayAppend(redisOpArray *oa, int dbid, robj **argv, int argc, int target) {
     redisOp *op;
     int prev_capacity = oa->capacity;
@@ -3103,15 +3227,39 @@ int redisOpArrayAppend(redisOpArray *oa, int dbid, robj **argv, int argc, int ta
 
     if (prev_capacity != oa->capacity)
         oa->ops = zrealloc(oa->ops,sizeof(redisOp)*oa->capacity);
+
+    if (oa->argv_used + argc > oa->argv_capacity) {
+        int capacity = oa->argv_capacity ? oa->argv_capacity : 64;
+        while (capacity < oa->argv_used + argc) capacity *= 2;
+
+        /* The ops point into the old pool: move them to the new one. */
+        robj **pool = zmalloc(sizeof(robj*)*capacity);
+        if (oa->argv_used) memcpy(pool,oa->argv,sizeof(robj*)*oa->argv_used);
+        for (int j = 0; j < oa->numops; j++)
+            oa->ops[j].argv = pool + (oa->ops[j].argv - oa->argv);
+        zfree(oa->argv);
+        oa->argv = pool;
+        oa->argv_capacity = capacity;
+    }
+
     op = oa->ops+oa->numops;
     op->dbid = dbid;
-    op->argv = argv;
+    op->argv = oa->argv+oa->argv_used;
     op->argc = argc;
     op->target = target;
+    for (int j = 0; j < argc; j++) {
+        op->argv[j] = argv[j];
+        incrRefCount(argv[j]);
+    }
+    oa->argv_used += argc;
     oa->numops++;
     return oa->numops;
 }
 
+/* Release the ops and everything allocated from the arena. Must be called
+ * at the end of every execution unit, even if no op was appended, since
+ * arena objects may have been created for commands that were not
+ * propagated after all. */
 void redisOpArrayFree(redisOpArray *oa) {
     while(oa->numops) {
         int j;
@@ -3121,10 +3269,74 @@ void redisOpArrayFree(redisOpArray *oa) {
         op = oa->ops+oa->numops;
         for (j = 0; j < op->argc; j++)
             decrRefCount(op->argv[j]);
-        zfree(op->argv);
     }
     /* no need to free the actual op array, we reuse the memory for future commands */
     serverAssert(!oa->numops);
+    oa->argv_used = 0;
+    if (oa->argv_capacity > REDIS_OP_ARGV_POOL_MAX) {
+        zfree(oa->argv);
+        oa->argv = NULL;
+        oa->argv_capacity = 0;
+    }
+
+    /* Keep only the current arena block around. */
+    if (oa->arena) {
+        redisOpArena *next = oa->arena->next;
+        while (next) {
+            redisOpArena *block = next;
+            next = block->next;
+            zfree(block);
+        }
+        oa->arena->next = NULL;
+        oa->arena->used = 0;
+    }
+}
+
+/* Create a string object that lives until the end of the current execution
+ * unit, to be used as argument of commands passed to alsoPropagate().
+ *
+ * Small strings are carved from the arena of server.also_propagate and
+ * marked as shared, so that incrRefCount() / decrRefCount() are no-ops and
+ * redisOpArrayFree() releases them all at once. Such objects must never be
+ * stored anywhere else (keyspace, client argv, ...). */
+robj *createPropagateStringObject(const char *ptr, size_t len) {
+    redisOpArray *oa = &server.also_propagate;
+
+    /* Not worth it for big strings: they would take a good part of a block. */
+    if (len > PROPAGATE_ARENA_STRING_MAX) return createStringObject(ptr,len);
+
+    size_t size = sizeof(robj)+sizeof(struct sdshdr8)+len+1;
+    size = (size+sizeof(void*)-1) & ~(sizeof(void*)-1);
+
+    /* The head of the chain is the block we allocate from. */
+    if (!oa->arena || oa->arena->used+size > REDIS_OP_ARENA_SIZE) {
+        redisOpArena *block = zmalloc(sizeof(*block));
+        block->next = oa->arena;
+        block->used = 0;
+        oa->arena = block;
+    }
+
+    robj *o = (robj*)(oa->arena->buf+oa->arena->used);
+    struct sdshdr8 *sh = (void*)(o+1);
+    oa->arena->used += size;
+
+    o->type = OBJ_STRING;
+    o->encoding = OBJ_ENCODING_EMBSTR;
+    o->ptr = sh+1;
+    o->refcount = OBJ_SHARED_REFCOUNT;
+    o->lru = 0;
+    sh->len = len;
+    sh->alloc = len;
+    sh->flags = SDS_TYPE_8;
+    memcpy(sh->buf,ptr,len);
+    sh->buf[len] = '\0';
+    return o;
+}
+
+robj *createPropagateStringObjectFromLongLong(long long value) {
+    char buf[LONG_STR_SIZE];
+    int len = ll2string(buf,sizeof(buf),value);
+    return createPropagateStringObject(buf,len);
 }
 
 /* ====================== Commands lookup and execution ===================== */
@@ -3267,10 +3479,27 @@ static void propagateNow(int dbid, robj **argv, int argc, int target) {
     serverAssert(!(isPausedActions(PAUSE_ACTION_REPLICA) &&
                    (!server.client_pause_in_transaction)));
 
-    if (server.aof_state != AOF_OFF && target & PROPAGATE_AOF)
-        feedAppendOnlyFile(dbid,argv,argc);
-    if (target & PROPAGATE_REPL)
+    int aof = server.aof_state != AOF_OFF && target & PROPAGATE_AOF;
+    int repl = target & PROPAGATE_REPL;
+
+    if (aof) {
+        /* Serialize the command once for both the AOF and the replication
+         * stream, reusing the same buffer across calls. */
+        sds cmd = catAppendOnlyGenericCommand(server.propagate_buf,argc,argv);
+        feedAppendOnlyFileProto(dbid,cmd,sdslen(cmd));
+        if (repl) replicationFeedSlavesProto(server.slaves,dbid,cmd,sdslen(cmd));
+        if (sdsalloc(cmd) > PROTO_REPLY_CHUNK_BYTES) {
+            sdsfree(cmd);
+            cmd = sdsempty();
+        } else {
+            sdsclear(cmd);
+        }
+        server.propagate_buf = cmd;
+    } else if (repl) {
+        /* Without AOF the objects are fed straight to the replication
+         * buffer, there is nothing to share. */
         replicationFeedSlaves(server.slaves,dbid,argv,argc);
+    }
 }
 
 /* Used inside commands to schedule the propagation of additional commands
@@ -3285,18 +3514,10 @@ static void propagateNow(int dbid, robj **argv, int argc, int target) {
  * stack allocated).  The function automatically increments ref count of
  * passed objects, so the caller does not need to. */
 void alsoPropagate(int dbid, robj **argv, int argc, int target) {
-    robj **argvcopy;
-    int j;
-
     if (!shouldPropagate(target))
         return;
 
-    argvcopy = zmalloc(sizeof(robj*)*argc);
-    for (j = 0; j < argc; j++) {
-        argvcopy[j] = argv[j];
-        incrRefCount(argv[j]);
-    }
-    redisOpArrayAppend(&server.also_propagate,dbid,argvcopy,argc,target);
+    redisOpArrayAppend(&server.also_propagate,dbid,argv,argc,target);
 }
 
 /* It is possible to call the function forceCommandPropagation() inside a
@@ -3355,8 +3576,12 @@ void updateCommandLatencyHistogram(struct hdr_histogram **latency_histogram, int
  * multiple separated commands. Note that alsoPropagate() is not affected
  * by CLIENT_PREVENT_PROP flag. */
 static void propagatePendingCommands(void) {
-    if (server.also_propagate.numops == 0)
+    if (server.also_propagate.numops == 0) {
+        /* Still release the arena: objects may have been created for
+         * commands that ended up not being propagated. */
+        redisOpArrayFree(&server.also_propagate);
         return;
+    }
 
     int j;
     redisOp *rop;
@@ -3517,6 +3742,7 @@ void call(client *c, int flags) {
 
     /* Call the command. */
     dirty = server.dirty;
+    int dbid = c->db->id;
     long long old_master_repl_offset = server.master_repl_offset;
     incrCommandStatsOnError(NULL, 0);
 
@@ -3560,6 +3786,7 @@ void call(client *c, int flags) {
     c->duration += duration;
     dirty = server.dirty-dirty;
     if (dirty < 0) dirty = 0;
+    if (server.execution_nesting == 0) dbIsolationAccount(real_cmd,dbid,duration);
 
     /* Update failed command calls if required. */
 
@@ -3582,10 +3809,17 @@ void call(client *c, int flags) {
      * c->cmd and c->lastcmd may be different, in case of MULTI-EXEC or
      * re-written commands such as EXPIRE, GEOADD, etc. */
 
+    /* Commands applied from our master are not sampled by the latency
+     * monitor, the slow log and the latency histograms, unless asked by
+     * replica-apply-latency-tracking: this is pure overhead on the replica
+     * apply path, the master already tracks them. */
+    int track_latency = update_command_stats &&
+        (!(c->flags & CLIENT_MASTER) || server.repl_apply_latency_tracking);
+
     /* Record the latency this command induced on the main thread.
      * unless instructed by the caller not to log. (happens when processing
      * a MULTI-EXEC from inside an AOF). */
-    if (update_command_stats) {
+    if (track_latency) {
         char *latency_event = (real_cmd->flags & CMD_FAST) ?
                                "fast-command" : "command";
         latencyAddSampleIfNeeded(latency_event,duration/1000);
@@ -3595,7 +3829,7 @@ void call(client *c, int flags) {
 
     /* Log the command into the Slow log if needed.
      * If the client is blocked we will handle slowlog when it is unblocked. */
-    if (update_command_stats && !(c->flags & CLIENT_BLOCKED))
+    if (track_latency && !(c->flags & CLIENT_BLOCKED))
         slowlogPushCurrentCommand(c, real_cmd, c->duration);
 
     /* Send the command to clients in MONITOR mode if applicable,
@@ -3619,7 +3853,7 @@ void call(client *c, int flags) {
     if (update_command_stats && !(c->flags & CLIENT_BLOCKED)) {
         real_cmd->calls++;
         real_cmd->microseconds += c->duration;
-        if (server.latency_tracking_enabled && !(c->flags & CLIENT_BLOCKED))
+        if (server.latency_tracking_enabled && track_latency)
             updateCommandLatencyHistogram(&(real_cmd->latency_histogram), c->duration*1000);
     }
 
@@ -3834,6 +4068,8 @@ uint64_t getCommandFlags(client *c) {
                c->cmd->proc == evalShaCommand || c->cmd->proc == evalShaRoCommand)
     {
         cmd_flags = evalGetCommandFlags(c, cmd_flags);
+    } else if (c->cmd->proc == xgatherCommand) {
+        cmd_flags = xgatherGetCommandFlags(c, cmd_flags);
     }
 
     return cmd_flags;
@@ -3966,11 +4202,13 @@ int processCommand(client *c) {
     /* If cluster is enabled perform the cluster redirection here.
      * However we don't perform the redirection if:
      * 1) The sender of this command is our master.
-     * 2) The command has no key arguments. */
+     * 2) The command has no key arguments.
+     * 3) The command is XGATHER, that reads the keys wherever they are. */
     if (server.cluster_enabled &&
         !mustObeyClient(c) &&
         !(!(c->cmd->flags&CMD_MOVABLE_KEYS) && c->cmd->key_specs_num == 0 &&
-          c->cmd->proc != execCommand))
+          c->cmd->proc != execCommand) &&
+        c->cmd->proc != xgatherCommand)
     {
         int error_code;
         clusterNode *n = getNodeByQuery(c,c->cmd,c->argv,c->argc,
@@ -4181,6 +4419,10 @@ int processCommand(client *c) {
         return C_OK;       
     }
 
+    /* Let the clients of the other databases run first if the database of
+     * this client used its share of the current event loop iteration. */
+    if (dbIsolationPostponeClient(c)) return C_OK;
+
     /* Exec the command */
     if (c->flags & CLIENT_MULTI &&
         c->cmd->proc != execCommand &&
@@ -5962,6 +6204,7 @@ sds genRedisInfoString(dict *section_dict, int all_sections, int everything) {
             "tracking_total_keys:%lld\r\n"
             "tracking_total_items:%lld\r\n"
             "tracking_total_prefixes:%lld\r\n"
+            "tracking_stream_meta_keys:%lld\r\n"
             "unexpected_error_replies:%lld\r\n"
             "total_error_replies:%lld\r\n"
             "dump_payload_sanitizations:%lld\r\n"
@@ -6017,6 +6260,7 @@ sds genRedisInfoString(dict *section_dict, int all_sections, int everything) {
             (unsigned long long) trackingGetTotalKeys(),
             (unsigned long long) trackingGetTotalItems(),
             (unsigned long long) trackingGetTotalPrefixes(),
+            (unsigned long long) trackingGetTotalStreamMetaKeys(),
             server.stat_unexpected_error_replies,
             server.stat_total_error_replies,
             server.stat_dump_payload_sanitizations,
@@ -6032,6 +6276,8 @@ sds genRedisInfoString(dict *section_dict, int all_sections, int everything) {
             getInstantaneousMetric(STATS_METRIC_EL_CYCLE),
             getInstantaneousMetric(STATS_METRIC_EL_DURATION));
         info = genRedisInfoStringACLStats(info);
+        info = genStreamTierInfoString(info);
+        info = genDbIsolationInfoString(info);
     }
 
     /* Replication */
@@ -6061,6 +6307,9 @@ sds genRedisInfoString(dict *section_dict, int all_sections, int everything) {
                 "master_sync_in_progress:%d\r\n"
                 "slave_read_repl_offset:%lld\r\n"
                 "slave_repl_offset:%lld\r\n"
+                "slave_apply_lag:%lld\r\n"
+                "slave_apply_batches:%lld\r\n"
+                "slave_apply_commands:%lld\r\n"
                 ,server.masterhost,
                 server.masterport,
                 (server.repl_state == REPL_STATE_CONNECTED) ?
@@ -6069,7 +6318,10 @@ sds genRedisInfoString(dict *section_dict, int all_sections, int everything) {
                 ((int)(server.unixtime-server.master->lastinteraction)) : -1,
                 server.repl_state == REPL_STATE_TRANSFER,
                 slave_read_repl_offset,
-                slave_repl_offset
+                slave_repl_offset,
+                slave_read_repl_offset - slave_repl_offset,
+                server.stat_repl_apply_batches,
+                server.stat_repl_apply_commands
             );
 
             if (server.repl_state == REPL_STATE_TRANSFER) {
@@ -6240,6 +6492,20 @@ sds genRedisInfoString(dict *section_dict, int all_sections, int everything) {
         }
     }
 
+    /* Cost of the serverCron() tasks */
+    if (all_sections || (dictFind(section_dict,"cronstats") != NULL)) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Cronstats\r\n");
+        for (j = 0; j < CRON_TASK_NUM; j++) {
+            cronTaskStats *ts = &server.cron_task_stats[j];
+            info = sdscatprintf(info,
+                "cronstat_%s:calls=%llu,usec=%llu,usec_per_call=%.2f,max_usec=%llu,over_budget=%llu,interrupted=%llu\r\n",
+                cronTaskName[j], ts->duration.cnt, ts->duration.sum,
+                (ts->duration.cnt == 0) ? 0 : ((float)ts->duration.sum / ts->duration.cnt),
+                ts->duration.max, ts->over_budget, ts->interrupted);
+        }
+    }
+
     /* Cluster */
     if (all_sections || (dictFind(section_dict,"cluster") != NULL)) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -7055,10 +7321,12 @@ struct redisTest {
     {"util", utilTest},
     {"endianconv", endianconvTest},
     {"crc64", crc64Test},
+    {"crc16", crc16Test},
     {"zmalloc", zmalloc_test},
     {"sds", sdsTest},
     {"dict", dictTest},
-    {"listpack", listpackTest}
+    {"listpack", listpackTest},
+    {"stream", streamTest}
 };
 redisTestProc *getTestProcByName(const char *name) {
     int numtests = sizeof(redisTests)/sizeof(struct redisTest);
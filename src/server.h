@@ -408,6 +408,8 @@ typedef enum blocking_type {
     BLOCKED_ZSET,    /* BZPOP et al. */
     BLOCKED_POSTPONE, /* Blocked by processCommand, re-try processing later. */
     BLOCKED_SHUTDOWN, /* SHUTDOWN. */
+    BLOCKED_STREAM_REPLY, /* XRANGE reply produced in slices. */
+    BLOCKED_STREAM_GATHER, /* XGATHER waiting for other nodes. */
     BLOCKED_NUM,      /* Number of blocked states. */
     BLOCKED_END       /* End of enumeration */
 } blocking_type;
@@ -526,6 +528,7 @@ typedef enum {
 #define REPL_DISKLESS_LOAD_DISABLED 0
 #define REPL_DISKLESS_LOAD_WHEN_DB_EMPTY 1
 #define REPL_DISKLESS_LOAD_SWAPDB 2
+#define REPL_DISKLESS_LOAD_SWAPDB_PER_DB 3
 
 /* TLS Client Authentication */
 #define TLS_CLIENT_AUTH_NO 0
@@ -662,6 +665,28 @@ typedef enum {
  * The actual resolution depends on server.hz. */
 #define run_with_period(_ms_) if (((_ms_) <= 1000/server.hz) || !(server.cronloops%((_ms_)/(1000/server.hz))))
 
+/* Like run_with_period() but shifted by '_phase_' cron loops, so that tasks
+ * with the same period don't all run in the same serverCron() tick. */
+#define run_with_period_phase(_ms_,_phase_) if (((_ms_) <= 1000/server.hz) || !((server.cronloops+(_phase_))%((_ms_)/(1000/server.hz))))
+
+/* Periodic tasks of serverCron() whose cost is reported by INFO cronstats. */
+typedef enum {
+    CRON_TASK_CLIENTS = 0,
+    CRON_TASK_DATABASES,
+    CRON_TASK_PERSISTENCE,
+    CRON_TASK_REPLICATION,
+    CRON_TASK_CLUSTER,
+    CRON_TASK_MODULES,
+    CRON_TASK_STREAM_TIER,
+    CRON_TASK_NUM
+} CronTask;
+
+typedef struct cronTaskStats {
+    durationStats duration;         /* Microseconds spent per run. */
+    unsigned long long over_budget; /* Runs longer than cron-task-budget. */
+    unsigned long long interrupted; /* Runs cut short by cron-task-budget. */
+} cronTaskStats;
+
 /* We can print the stacktrace, so our assert is defined this way: */
 #define serverAssertWithInfo(_c,_o,_e) ((_e)?(void)0 : (_serverAssertWithInfo(_c,_o,#_e,__FILE__,__LINE__),redis_unreachable()))
 #define serverAssert(_e) ((_e)?(void)0 : (_serverAssert(#_e,__FILE__,__LINE__),redis_unreachable()))
@@ -986,6 +1011,8 @@ typedef struct functionsLibCtx functionsLibCtx;
 typedef struct rdbLoadingCtx {
     redisDb* dbarray;
     functionsLibCtx* functions_lib_ctx;
+    void (*db_loaded)(int dbid); /* Optional: called when the loading moves
+                                    past the database 'dbid'. */
 } rdbLoadingCtx;
 
 /* Client MULTI/EXEC state */
@@ -993,6 +1020,7 @@ typedef struct multiCmd {
     robj **argv;
     int argv_len;
     int argc;
+    int slot;           /* Slot of the keys when queued, or -1. */
     struct redisCommand *cmd;
 } multiCmd;
 
@@ -1034,6 +1062,14 @@ typedef struct blockingState {
     void *async_rm_call_handle; /* RedisModuleAsyncRMCallPromise structure.
                                    which is opaque for the Redis core, only
                                    handled in module.c. */
+
+    /* BLOCKED_STREAM_REPLY */
+    void *stream_reply;         /* Position of the range reply, only handled
+                                   in t_stream.c. */
+
+    /* BLOCKED_STREAM_GATHER */
+    void *stream_gather;        /* The XGATHER op, only handled in
+                                   stream_gather.c. */
 } blockingState;
 
 /* The following structure represents a node in the server.ready_keys list,
@@ -1313,9 +1349,10 @@ struct sharedObjectsStruct {
     *unsubscribebulk, *psubscribebulk, *punsubscribebulk, *del, *unlink,
     *rpop, *lpop, *lpush, *rpoplpush, *lmove, *blmove, *zpopmin, *zpopmax,
     *emptyscan, *multi, *exec, *left, *right, *hset, *srem, *xgroup, *xclaim,  
+    *xadd, *xdel, *xdeadletter, *rpush,
     *script, *replconf, *eval, *persist, *set, *pexpireat, *pexpire, 
     *time, *pxat, *absttl, *retrycount, *force, *justid, *entriesread,
-    *lastid, *ping, *setid, *keepttl, *load, *createconsumer,
+    *lastid, *dlqid, *ping, *setid, *keepttl, *load, *createconsumer,
     *getack, *special_asterick, *special_equals, *default_username, *redacted,
     *ssubscribebulk,*sunsubscribebulk, *smessagebulk,
     *select[PROTO_SHARED_SELECT_CMDS],
@@ -1373,11 +1410,20 @@ typedef struct redisOp {
  *
  * int redisOpArrayAppend(redisOpArray *oa, int dbid, robj **argv, int argc, int target);
  * void redisOpArrayFree(redisOpArray *oa);
- */
+ *
+ * The argument vectors of all the ops are stored back to back in a single
+ * pool, and small string objects that are only needed for the propagation
+ * can be carved from an arena (see createPropagateStringObject()). Both
+ * are reused across execution units, so in the steady state propagating
+ * a command does not allocate. */
 typedef struct redisOpArray {
     redisOp *ops;
     int numops;
     int capacity;
+    robj **argv;                /* Pool holding the argv of all the ops. */
+    int argv_used;
+    int argv_capacity;
+    struct redisOpArena *arena; /* Objects released by redisOpArrayFree(). */
 } redisOpArray;
 
 /* This structure is returned by the getMemoryOverheadData() function in
@@ -1474,6 +1520,7 @@ typedef struct redisTLSContextConfig {
     int session_caching;
     int session_cache_size;
     int session_cache_timeout;
+    int ktls;                       /* Offload the TLS crypto to the kernel. */
 } redisTLSContextConfig;
 
 /*-----------------------------------------------------------------------------
@@ -1539,6 +1586,8 @@ struct redisServer {
                                    is enabled. */
     mode_t umask;               /* The umask value of the process on startup */
     int hz;                     /* serverCron() calls frequency in hertz */
+    long long cron_task_budget; /* Microseconds a serverCron() task that can
+                                   be split across ticks may take per tick. */
     int in_fork_child;          /* indication that this is a fork child */
     redisDb *db;
     dict *commands;             /* Command table */
@@ -1663,6 +1712,8 @@ struct redisServer {
     long long stat_sync_full;       /* Number of full resyncs with slaves. */
     long long stat_sync_partial_ok; /* Number of accepted PSYNC requests. */
     long long stat_sync_partial_err;/* Number of unaccepted PSYNC requests. */
+    long long stat_repl_apply_batches;  /* Batches of master commands applied. */
+    long long stat_repl_apply_commands; /* Master commands applied in batches. */
     list *slowlog;                  /* SLOWLOG list of commands */
     long long slowlog_entry_id;     /* SLOWLOG current entry ID */
     long long slowlog_log_slower_than; /* SLOWLOG time limit (to get logged) */
@@ -1709,6 +1760,7 @@ struct redisServer {
        but excluding read, write and AOF, which are counted by other sets of metrics. */
     monotime el_cron_duration; 
     durationStats duration_stats[EL_DURATION_TYPE_NUM];
+    cronTaskStats cron_task_stats[CRON_TASK_NUM];
 
     /* Configuration */
     int verbosity;                  /* Loglevel in redqueue.conf */
@@ -1756,6 +1808,8 @@ struct redisServer {
     int aof_flush_sleep;            /* Micros to sleep before flush. (used by tests) */
     int aof_rewrite_scheduled;      /* Rewrite once BGSAVE terminates. */
     sds aof_buf;      /* AOF buffer, written before entering the event loop */
+    sds propagate_buf; /* RESP of the command being propagated, shared
+                          by the AOF and the replication stream. */
     int aof_fd;       /* File descriptor of currently selected AOF file */
     int aof_selected_db; /* Currently selected DB in AOF */
     time_t aof_flush_postponed_start; /* UNIX time of postponed AOF flush */
@@ -1882,6 +1936,7 @@ struct redisServer {
     time_t repl_transfer_lastio; /* Unix time of the latest read, for timeout */
     int repl_serve_stale_data; /* Serve stale data when link is down? */
     int repl_slave_ro;          /* Slave is read only? */
+    int repl_apply_latency_tracking; /* Sample the latency of master commands? */
     int repl_slave_ignore_maxmemory;    /* If true slaves do not evict. */
     time_t repl_down_since; /* Unix time at which link with master went down */
     int repl_disable_tcp_nodelay;   /* Disable TCP_NODELAY after SYNC? */
@@ -1901,6 +1956,7 @@ struct redisServer {
     int repl_slave_lazy_flush;          /* Lazy FLUSHALL before loading DB? */
     /* Synchronous replication. */
     list *clients_waiting_acks;         /* Clients waiting in WAIT or WAITAOF. */
+    list *stream_reply_clients;   /* Clients receiving a range reply in slices. */
     int get_ack_from_slaves;            /* If true we send REPLCONF GETACK. */
     /* Limits */
     unsigned int maxclients;            /* Max number of simultaneous clients */
@@ -1923,6 +1979,8 @@ struct redisServer {
     /* Client side caching. */
     unsigned int tracking_clients;  /* # of clients with tracking enabled.*/
     size_t tracking_table_max_keys; /* Max number of keys in tracking table. */
+    long long tracking_stream_meta_delay; /* Max delay (ms) of the invalidation
+                                             of stream metadata, 0 disables. */
     list *tracking_pending_keys; /* tracking invalidation keys pending to flush */
     list *pending_push_messages; /* pending publish or other push messages to flush */
     /* Sort parameters - qsort_r() is only available under BSD so we
@@ -1941,7 +1999,19 @@ struct redisServer {
     size_t zset_max_listpack_value;
     size_t stream_node_max_bytes;
     long long stream_node_max_entries;
+    size_t stream_large_value_threshold; /* Values this big are stored out of
+                                            the listpack, 0 = never. */
+    long long stream_tier_age;  /* Nodes older than this (ms) go to disk. */
+    char *stream_tier_file;     /* Name of the tier file. */
+    unsigned long long stream_tier_memory_watermark; /* Tier only above this. */
+    unsigned long long stream_tier_disk_watermark;   /* Max tier file size. */
+    int stream_mmap_load;       /* Leave stream nodes in the mapped RDB. */
+    long long stream_reply_slice; /* Entries per slice of big range replies. */
+    long long db_isolation_slice; /* Usecs per database per event loop. */
+    int db_isolation_strict;      /* Refuse commands spanning databases. */
     unsigned int stream_delay_append_retry;
+    long long stream_idmp_window; /* Max age (ms) of idempotency keys. */
+    long long stream_idmp_max_keys; /* Max idempotency keys per stream. */
     /* List parameters */
     int list_max_listpack_size;
     int list_compress_depth;
@@ -2434,6 +2504,7 @@ extern dictType setDictType;
 extern dictType BenchmarkDictType;
 extern dictType zsetDictType;
 extern dictType dbDictType;
+extern dictType keylistDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
 extern dictType stringSetDictType;
@@ -2658,6 +2729,7 @@ void disableTracking(client *c);
 void trackingRememberKeys(client *tracking, client *executing);
 void trackingInvalidateKey(client *c, robj *keyobj, int bcast);
 void trackingHandlePendingKeyInvalidations(void);
+void trackingHandlePendingStreamMetaInvalidations(void);
 void trackingInvalidateKeysOnFlush(int async);
 void freeTrackingRadixTree(rax *rt);
 void freeTrackingRadixTreeAsync(rax *rt);
@@ -2665,6 +2737,7 @@ void trackingLimitUsedSlots(void);
 uint64_t trackingGetTotalItems(void);
 uint64_t trackingGetTotalKeys(void);
 uint64_t trackingGetTotalPrefixes(void);
+uint64_t trackingGetTotalStreamMetaKeys(void);
 void trackingBroadcastInvalidationMessages(void);
 int checkPrefixCollisionsOrReply(client *c, robj **prefix, size_t numprefix);
 
@@ -2768,7 +2841,9 @@ ssize_t syncReadLine(int fd, char *ptr, ssize_t size, long long timeout);
 
 /* Replication */
 void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc);
+void replicationFeedSlavesProto(list *slaves, int dictid, const char *cmd, size_t len);
 void replicationFeedStreamFromMasterStream(char *buf, size_t buflen);
+void replicationProxyAppliedMasterStream(client *c);
 void resetReplicationBuffer(void);
 void feedReplicationBuffer(char *buf, size_t len);
 void freeReplicaReferencedReplBuffer(client *replica);
@@ -2832,7 +2907,8 @@ int bg_unlink(const char *filename);
 
 /* AOF persistence */
 void flushAppendOnlyFile(int force);
-void feedAppendOnlyFile(int dictid, robj **argv, int argc);
+void feedAppendOnlyFileProto(int dictid, const char *cmd, size_t len);
+sds catAppendOnlyGenericCommand(sds dst, int argc, robj **argv);
 void aofRemoveTempFile(pid_t childpid);
 int rewriteAppendOnlyFileBackground(void);
 int loadAppendOnlyFiles(aofManifest *am);
@@ -3009,6 +3085,8 @@ int commandCheckArity(client *c, sds *err);
 int incrCommandStatsOnError(struct redisCommand *cmd, int flags);
 void call(client *c, int flags);
 void alsoPropagate(int dbid, robj **argv, int argc, int target);
+robj *createPropagateStringObject(const char *ptr, size_t len);
+robj *createPropagateStringObjectFromLongLong(long long value);
 void postExecutionUnitOperations(void);
 void redisOpArrayFree(redisOpArray *oa);
 void forceCommandPropagation(client *c, int flags);
@@ -3277,6 +3355,9 @@ int xreadGetKeys(struct redisCommand *cmd, robj **argv, int argc, getKeysResult
 int setGetKeys(struct redisCommand *cmd, robj **argv, int argc, getKeysResult *result);
 
 unsigned short crc16(const char *buf, int len);
+#ifdef REDIS_TEST
+int crc16Test(int argc, char *argv[], int flags);
+#endif
 
 /* Sentinel */
 void initSentinelConfig(void);
@@ -3314,6 +3395,7 @@ unsigned long evalMemory(void);
 dict* evalScriptsDict(void);
 unsigned long evalScriptsMemory(void);
 uint64_t evalGetCommandFlags(client *c, uint64_t orig_flags);
+uint64_t xgatherGetCommandFlags(client *c, uint64_t cmd_flags);
 uint64_t fcallGetCommandFlags(client *c, uint64_t orig_flags);
 int isInsideYieldingLongCommand(void);
 
@@ -3349,6 +3431,14 @@ void scanDatabaseForDeletedKeys(redisDb *emptied, redisDb *replaced_with);
 void totalNumberOfBlockingKeys(unsigned long *blocking_keys, unsigned long *bloking_keys_on_nokey);
 void blockedBeforeSleep(void);
 
+/* db_isolation.c -- Sharing the main thread between databases. */
+void dbIsolationInit(void);
+void dbIsolationAccount(struct redisCommand *cmd, int dbid, long long duration);
+int dbIsolationPostponeClient(client *c);
+void dbIsolationBeforeSleep(void);
+void dbIsolationResetStats(void);
+sds genDbIsolationInfoString(sds info);
+
 /* timeout.c -- Blocked clients timeout and connections timeout. */
 void addClientToTimeoutTable(client *c);
 void removeClientFromTimeoutTable(client *c);
@@ -3488,12 +3578,14 @@ void xrangeCommand(client *c);
 void xrevrangeCommand(client *c);
 void xlenCommand(client *c);
 void xreadCommand(client *c);
+void xgatherCommand(client *c);
 void xgroupCommand(client *c);
 void xsetidCommand(client *c);
 void xackCommand(client *c);
 void xpendingCommand(client *c);
 void xclaimCommand(client *c);
 void xautoclaimCommand(client *c);
+void xdeadletterCommand(client *c);
 void xinfoCommand(client *c);
 void xdelCommand(client *c);
 void xtrimCommand(client *c);
@@ -3541,6 +3633,7 @@ void killIOThreads(void);
 void killThreads(void);
 void makeThreadKillable(void);
 void swapMainDbWithTempDb(redisDb *tempDb);
+void swapMainDbRangeWithTempDb(redisDb *tempDb, int first, int last);
 
 /* Use macro for checking log level to avoid evaluating arguments in cases log
  * should be ignored due to low level. */
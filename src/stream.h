@@ -13,6 +13,15 @@ typedef struct streamID {
     uint64_t seq;       /* Sequence number. */
 } streamID;
 
+/* Idempotency keys of recent XADD IDEMPOTENT calls, used to return the
+ * original ID to producers retrying an append. Both trees hold the same
+ * keys: 'ids' is ordered by entry ID, so that the oldest keys are aged out
+ * first. */
+typedef struct streamIdmp {
+    rax *keys;              /* Idempotency key -> streamID of the entry. */
+    rax *ids;               /* Entry ID (128 bit big endian) -> sds key. */
+} streamIdmp;
+
 typedef struct stream {
     rax *rax;               /* The radix tree holding the stream. */
     uint64_t length;        /* Current number of elements inside this stream. */
@@ -21,8 +30,33 @@ typedef struct stream {
     streamID max_deleted_entry_id;  /* The maximal ID that was deleted. */
     uint64_t entries_added; /* All time count of elements added. */
     rax *cgroups;           /* Consumer groups dictionary: name -> streamCG */
+    streamIdmp *idmp;       /* Idempotency keys, NULL if never used. */
+    rax *blobs;             /* Out of line values: handle (64 bit big endian)
+                               -> sds. NULL if never used. */
+    uint64_t blobs_next;    /* Handle of the next out of line value. */
+    size_t blobs_bytes;     /* Memory used by the out of line values. */
+    uint64_t epoch;         /* Incremented every time the entries already in
+                               the nodes move, invalidating the consumer
+                               groups cursors. */
 } stream;
 
+/* A node of the radix tree moved to the tier file, see stream_tier.c. It
+ * takes the place of the listpack in the radix tree, and starts with a zero
+ * 32 bit size that no listpack can have, so that the two can be told apart
+ * with streamNodeIsStub(). */
+typedef struct streamNodeStub {
+    uint32_t zero;          /* Always zero. */
+    uint32_t bytes;         /* Size of the listpack. */
+    uint64_t offset;        /* Offset of the listpack in the tier file. */
+    int64_t entries;        /* Number of valid entries in the node. */
+    streamID first_id;      /* First valid entry. */
+    streamID last_id;       /* Last entry, possibly deleted. */
+} streamNodeStub;
+
+#define streamNodeIsStub(node) (lpBytes((unsigned char*)(node)) == 0)
+/* Flag of the stub offsets referencing the RDB file mapped at loading. */
+#define STREAM_STUB_MAPPED (1ULL<<63)
+
 /* We define an iterator to iterate stream items in an abstract way, without
  * caring about the radix tree + listpack representation. Technically speaking
  * the iterator is only used inside streamReplyWithRange(), so could just
@@ -44,13 +78,28 @@ typedef struct streamIterator {
     unsigned char *lp;      /* Current listpack. */
     unsigned char *lp_ele;  /* Current listpack cursor. */
     unsigned char *lp_flags; /* Current entry flags pointer. */
+    unsigned char *values_mask; /* Out of line values of the current entry,
+                                   one bit per value, NULL if none. */
+    int64_t value_idx;      /* Index of the value to emit next. */
     /* Buffers used to hold the string of lpGet() when the element is
      * integer encoded, so that there is no string representation of the
      * element inside the listpack itself. */
     unsigned char field_buf[LP_INTBUF_SIZE];
     unsigned char value_buf[LP_INTBUF_SIZE];
+    unsigned char mask_buf[LP_INTBUF_SIZE];
 } streamIterator;
 
+/* Position of the last entry delivered to a consumer group, so that the
+ * next read of new entries resumes from there instead of seeking it. It is
+ * valid as long as the group last_id is 'id' and the stream epoch didn't
+ * change. */
+typedef struct streamCGCursor {
+    uint64_t epoch;         /* Stream epoch when the cursor was saved. */
+    streamID id;            /* Last entry delivered. */
+    unsigned char nodekey[sizeof(streamID)]; /* Node holding the entry. */
+    uint32_t offset;        /* Offset of its lp-count field, 0 if unset. */
+} streamCGCursor;
+
 /* Consumer group. */
 typedef struct streamCG {
     streamID last_id;       /* Last delivered (not acknowledged) ID for this
@@ -70,6 +119,12 @@ typedef struct streamCG {
     rax *consumers;         /* A radix tree representing the consumers by name
                                and their associated representation in the form
                                of streamConsumer structures. */
+    streamCGCursor cursor;  /* Where to resume reading new entries. */
+    uint64_t max_deliveries; /* Entries delivered this many times are moved
+                                to the dead letter stream instead of being
+                                claimed again. 0 means disabled. */
+    robj *dlq_key;          /* Key of the dead letter stream, NULL if
+                               max_deliveries is 0. */
 } streamCG;
 
 /* A specific consumer in a consumer group.  */
@@ -128,6 +183,7 @@ streamConsumer *streamLookupConsumer(streamCG *cg, sds name);
 streamConsumer *streamCreateConsumer(streamCG *cg, sds name, robj *key, int dbid, int flags);
 streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id, long long entries_read);
 streamNACK *streamCreateNACK(streamConsumer *consumer);
+void streamEncodeID(void *buf, streamID *id);
 void streamDecodeID(void *buf, streamID *id);
 int streamCompareID(streamID *a, streamID *b);
 void streamFreeNACK(streamNACK *na);
@@ -138,6 +194,7 @@ robj *streamDup(robj *o);
 int streamValidateListpackIntegrity(unsigned char *lp, size_t size, int deep);
 int streamParseID(const robj *o, streamID *id);
 robj *createObjectFromStreamID(streamID *id);
+robj *createPropagateObjectFromStreamID(streamID *id);
 int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_id, streamID *use_id, int seq_given);
 int streamDeleteItem(stream *s, streamID *id);
 void streamGetEdgeID(stream *s, int first, int skip_tombstones, streamID *edge_id);
@@ -146,5 +203,47 @@ int64_t streamTrimByLength(stream *s, long long maxlen, int approx);
 int64_t streamTrimByID(stream *s, streamID minid, int approx);
 int streamHandleTimeoutItem(redisDb *db, robj *timeoutkey, robj *valueobj);
 void streamDeleteAllItemTimeout(client *c, redisDb *db, robj *streamkey);
+int streamIdmpLookup(stream *s, sds key, streamID *id);
+int streamIdmpAdd(stream *s, sds key, streamID *id);
+void streamIdmpAge(stream *s);
+size_t streamIdmpLength(stream *s);
+int streamBlobInsert(stream *s, uint64_t handle, sds blob);
+sds streamBlobLookup(stream *s, uint64_t handle);
+size_t streamBlobsLength(stream *s);
+int streamValidateBlobs(stream *s);
+int streamHasLargeValues(stream *s);
+void streamNodeDescribe(unsigned char *lp, streamID *master_id, streamNodeStub *stub);
+
+/* Tiered storage, see stream_tier.c */
+void streamTierInit(void);
+void streamTierCron(void);
+unsigned char *streamTierReadNode(streamNodeStub *stub);
+unsigned char *streamTierFaultIn(stream *s, unsigned char *nodekey);
+void streamTierFreeStub(streamNodeStub *stub);
+void streamTierWantRange(client *c, robj *key, stream *s, streamID *start, streamID *end, int rev, long long count);
+void streamTierWantPEL(client *c, robj *key, stream *s, rax *pel, streamID *start, long long count);
+int streamTierBlockClient(client *c);
+void streamTierResetStats(void);
+int streamTierMapRdb(int fd, size_t size);
+void streamTierMapRdbLoaded(void);
+unsigned char *streamTierMapped(off_t offset, size_t bytes);
+streamNodeStub *streamTierMapNode(unsigned char *lp, size_t bytes, streamID *master_id);
+void handleClientsWithStreamReplies(void);
+int streamRepliesReady(void);
+void unblockClientStreamReply(client *c);
+void streamFinishRangeReplies(redisDb *db, robj *key, stream *s);
+sds genStreamTierInfoString(sds info);
+
+/* Cluster wide reads, see stream_gather.c */
+void streamGatherInit(void);
+void streamGatherCron(void);
+void streamGatherReceive(const char *sender, uint64_t id, uint16_t flags, uint8_t resp, char *payload, uint32_t len);
+void streamGatherSignalKey(redisDb *db, robj *key);
+void handleStreamGatherWatches(void);
+void unblockClientStreamGather(client *c);
+
+#ifdef REDIS_TEST
+int streamTest(int argc, char *argv[], int flags);
+#endif
 
 #endif
@@ -0,0 +1,868 @@
+/* Cluster wide stream reads.
+ *
+ * XREAD and XREADGROUP require all their keys to hash to the same slot, so a
+ * consumer of many partitioned streams has to talk to every node owning one
+ * of the partitions. XGATHER takes the same arguments, but the keys can live
+ * anywhere in the cluster: the node serving the command groups the keys by
+ * owner, reads its own streams directly, and sends the other groups as
+ * GATHER requests over the cluster bus. Every owner executes the request as
+ * a plain XREAD / XREADGROUP with a fake client, and replies with the RESP
+ * reply of the read, so the requesting node only has to concatenate the
+ * stream arrays (or maps with RESP3) into a single reply.
+ *
+ * When BLOCK is given and an owner read nothing, it keeps the read as a
+ * "watch" on the keys: once one of them is signaled as ready, the read is
+ * executed again in beforeSleep() and, if it returns something, its reply is
+ * sent to the requesting node flagged as FIRED and the watch is dropped. The
+ * requesting node replies to its client as soon as it has both the replies
+ * of all the owners and at least one non empty one. Watches that are left
+ * behind (because the client timed out, disconnected, or other owners fired
+ * first) are dropped with a CANCEL message. Local reads use the same watches,
+ * without going through the bus.
+ *
+ * Since a CANCEL may never arrive, a remote watch is only a lease of the
+ * node timeout, that the requesting node renews with REFRESH messages while
+ * it waits. A watch whose lease expired, or whose requesting node failed or
+ * was forgotten, is dropped, so that it can't leak or feed the PEL of a
+ * consumer nobody reads for anymore.
+ *
+ * Owners that don't reply within the node timeout fail the command with a
+ * TRYAGAIN error, as well as owners that lost the slots meanwhile: this is
+ * the case where the client should retry. */
+
+#include "server.h"
+#include "cluster.h"
+#include "endianconv.h"
+
+/* The slot of a stream read by a blocking XGATHER, and its owner then. */
+typedef struct streamGatherSlot {
+    int slot;
+    char owner[CLUSTER_NAMELEN];
+} streamGatherSlot;
+
+/* An XGATHER command waiting for the replies of the owners. */
+typedef struct streamGatherOp {
+    uint64_t id;            /* Request ID, key of gather_ops. */
+    client *c;              /* Client that called XGATHER. */
+    int block;              /* Wait for data if nothing was read. */
+    int pending;            /* Owners that didn't reply yet. */
+    list *watching;         /* Names of the remote owners that may hold a
+                               watch for this request. */
+    streamGatherSlot *slots; /* Slots of the remote streams of a blocking
+                               request, checked while their owners watch. */
+    int numslots;
+    long long count;        /* Streams read so far. */
+    sds entries;            /* Their replies, concatenated. */
+    sds err;                /* First error reply of an owner, or NULL. */
+    mstime_t deadline;      /* Time limit for the owners to reply. */
+    mstime_t refreshed;     /* Last renewal of the leases of the watches. */
+} streamGatherOp;
+
+/* A read served for a requesting node, waiting for its streams to change. */
+typedef struct streamGatherWatch {
+    unsigned char rkey[CLUSTER_NAMELEN+8]; /* Origin node and request ID. */
+    uint64_t id;            /* Request ID. */
+    int local;              /* The origin is this node. */
+    int group;              /* The read is an XREADGROUP. */
+    int dbid;               /* Database of the streams. */
+    int resp;               /* RESP version of the reply. */
+    int argc;               /* The read, with '$' resolved. */
+    robj **argv;
+    int keys;               /* Index of the first key in argv. */
+    int numkeys;            /* Number of keys. */
+    mstime_t deadline;      /* When to drop the watch, 0 for never. */
+    mstime_t lease;         /* When to drop the watch unless the origin
+                               renews it, 0 for local watches. */
+    listNode *ready_node;   /* Node in gather_ready, or NULL. */
+} streamGatherWatch;
+
+static rax *gather_ops;             /* Ops of this node, by request ID. */
+static rax *gather_watches;         /* Watches, by origin and request ID. */
+static dict *gather_watched_keys;   /* Stream name -> list of watches. */
+static list *gather_ready;          /* Watches whose streams were signaled. */
+static client *gather_client;       /* Fake client executing the reads. */
+static uint64_t gather_next_id = 0; /* ID of the next op. */
+static char gather_noname[CLUSTER_NAMELEN]; /* Our name without cluster. */
+
+static void streamGatherOpReply(uint64_t id, const char *owner, uint16_t flags,
+                                const char *reply, size_t len);
+
+void streamGatherInit(void) {
+    gather_ops = raxNew();
+    gather_watches = raxNew();
+    gather_watched_keys = dictCreate(&keylistDictType);
+    gather_ready = listCreate();
+    memset(gather_noname,0,sizeof(gather_noname));
+}
+
+/* Name of this node as seen by the watches it holds for itself. */
+static const char *streamGatherMyName(void) {
+    return server.cluster_enabled ? server.cluster->myself->name : gather_noname;
+}
+
+/* ----------------------------------------------------------------------------
+ * Reads
+ * -------------------------------------------------------------------------- */
+
+/* Return the index of the first key of an XREAD / XREADGROUP argument
+ * vector, or -1 if it is not well formed. */
+static int streamGatherKeysIndex(int argc, robj **argv) {
+    for (int j = 1; j < argc; j++) {
+        char *o = argv[j]->ptr;
+        if (!strcasecmp(o,"GROUP")) {
+            j += 2;
+        } else if (!strcasecmp(o,"COUNT")) {
+            j++;
+        } else if (!strcasecmp(o,"STREAMS")) {
+            int streams = argc-j-1;
+            return (streams > 0 && (streams % 2) == 0) ? j+1 : -1;
+        }
+    }
+    return -1;
+}
+
+/* Return 1 if the reply of a read is a null array, that is, nothing was
+ * read. */
+static int streamGatherReplyIsEmpty(sds reply) {
+    return !strcmp(reply,"*-1\r\n") || !strcmp(reply,"_\r\n");
+}
+
+/* Execute a read with the fake client, returning its reply. */
+static sds streamGatherRead(int dbid, int resp, int argc, robj **argv) {
+    if (gather_client == NULL) {
+        gather_client = createClient(NULL);
+        gather_client->flags |= CLIENT_SCRIPT|CLIENT_DENY_BLOCKING;
+    }
+    client *c = gather_client;
+    selectDb(c,dbid);
+    c->resp = resp;
+    c->argc = argc;
+    c->argv = argv;
+    c->argv_len = argc;
+    c->cmd = c->lastcmd = c->realcmd = lookupCommand(argv,argc);
+    call(c,CMD_CALL_FULL);
+    postExecutionUnitOperations();
+
+    sds reply = sdsnewlen(c->buf,c->bufpos);
+    c->bufpos = 0;
+    while (listLength(c->reply)) {
+        clientReplyBlock *o = listNodeValue(listFirst(c->reply));
+        reply = sdscatlen(reply,o->buf,o->used);
+        listDelNode(c->reply,listFirst(c->reply));
+    }
+    c->reply_bytes = 0;
+    c->argc = 0;
+    c->argv = NULL;
+    c->argv_len = 0;
+    c->cmd = NULL;
+    return reply;
+}
+
+/* Return an error reply if the streams of a read are not all served by
+ * this node, otherwise NULL. */
+static sds streamGatherCheckSlots(robj **argv, int keys, int numkeys) {
+    if (!server.cluster_enabled) return NULL;
+    for (int j = keys; j < keys+numkeys; j++) {
+        sds key = argv[j]->ptr;
+        int slot = keyHashSlot(key,sdslen(key));
+        if (server.cluster->slots[slot] != server.cluster->myself)
+            return sdscatfmt(sdsempty(),
+                "-TRYAGAIN Slot %i is not served by the node anymore\r\n",slot);
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * Watches
+ * -------------------------------------------------------------------------- */
+
+static void streamGatherWatchKey(unsigned char *rkey, const char *origin, uint64_t id) {
+    memcpy(rkey,origin,CLUSTER_NAMELEN);
+    memcpy(rkey+CLUSTER_NAMELEN,&id,sizeof(id));
+}
+
+static void streamGatherFreeWatch(streamGatherWatch *w) {
+    raxRemove(gather_watches,w->rkey,sizeof(w->rkey),NULL);
+    for (int j = w->keys; j < w->keys+w->numkeys; j++) {
+        dictEntry *de = dictFind(gather_watched_keys,w->argv[j]);
+        if (de == NULL) continue;
+        list *l = dictGetVal(de);
+        listNode *ln;
+        while ((ln = listSearchKey(l,w)) != NULL) listDelNode(l,ln);
+        if (listLength(l) == 0) dictDelete(gather_watched_keys,w->argv[j]);
+    }
+    if (w->ready_node) listDelNode(gather_ready,w->ready_node);
+    for (int j = 0; j < w->argc; j++) decrRefCount(w->argv[j]);
+    zfree(w->argv);
+    zfree(w);
+}
+
+static void streamGatherRemoveWatch(const char *origin, uint64_t id) {
+    unsigned char rkey[CLUSTER_NAMELEN+8];
+    streamGatherWatchKey(rkey,origin,id);
+    void *w = raxFind(gather_watches,rkey,sizeof(rkey));
+    if (w != raxNotFound) streamGatherFreeWatch(w);
+}
+
+static void streamGatherAddWatch(const char *origin, uint64_t id, int local,
+                                 mstime_t deadline, int dbid, int resp,
+                                 int argc, robj **argv, int keys) {
+    streamGatherRemoveWatch(origin,id);
+
+    streamGatherWatch *w = zmalloc(sizeof(*w));
+    streamGatherWatchKey(w->rkey,origin,id);
+    w->id = id;
+    w->local = local;
+    w->group = !strcasecmp(argv[0]->ptr,"XREADGROUP");
+    w->dbid = dbid;
+    w->resp = resp;
+    w->argc = argc;
+    w->argv = zmalloc(sizeof(robj*)*argc);
+    for (int j = 0; j < argc; j++) {
+        w->argv[j] = argv[j];
+        incrRefCount(argv[j]);
+    }
+    w->keys = keys;
+    w->numkeys = (argc-keys)/2;
+    w->deadline = deadline;
+    w->lease = local ? 0 : mstime()+server.cluster_node_timeout;
+    w->ready_node = NULL;
+    raxInsert(gather_watches,w->rkey,sizeof(w->rkey),w,NULL);
+
+    for (int j = keys; j < keys+w->numkeys; j++) {
+        dictEntry *de = dictFind(gather_watched_keys,argv[j]);
+        if (de == NULL) {
+            incrRefCount(argv[j]);
+            dictAdd(gather_watched_keys,argv[j],listCreate());
+            de = dictFind(gather_watched_keys,argv[j]);
+        }
+        listAddNodeTail(dictGetVal(de),w);
+    }
+}
+
+/* Renew the lease of the watch of 'origin' for the request 'id'. */
+static void streamGatherRefreshWatch(const char *origin, uint64_t id) {
+    unsigned char rkey[CLUSTER_NAMELEN+8];
+    streamGatherWatchKey(rkey,origin,id);
+    streamGatherWatch *w = raxFind(gather_watches,rkey,sizeof(rkey));
+    if (w != raxNotFound) w->lease = mstime()+server.cluster_node_timeout;
+}
+
+/* Called by signalKeyAsReady() for every stream that may have changed:
+ * queue the watches of the key for handleStreamGatherWatches(). */
+void streamGatherSignalKey(redisDb *db, robj *key) {
+    if (dictSize(gather_watched_keys) == 0) return;
+    dictEntry *de = dictFind(gather_watched_keys,key);
+    if (de == NULL) return;
+
+    listIter li;
+    listNode *ln;
+    listRewind(dictGetVal(de),&li);
+    while ((ln = listNext(&li))) {
+        streamGatherWatch *w = listNodeValue(ln);
+        if (w->dbid != db->id || w->ready_node) continue;
+        listAddNodeTail(gather_ready,w);
+        w->ready_node = listLast(gather_ready);
+    }
+}
+
+/* Send the reply of a read to the requesting node. */
+static void streamGatherDeliver(const char *origin, uint64_t id, int local,
+                                uint16_t flags, int resp, sds reply) {
+    if (local)
+        streamGatherOpReply(id,origin,flags,reply,sdslen(reply));
+    else
+        clusterSendGather(origin,id,flags|CLUSTERMSG_GATHER_REPLY,resp,
+                          reply,sdslen(reply));
+}
+
+/* Called from beforeSleep(): execute again the reads of the watches whose
+ * streams were signaled, and deliver the ones that read something. */
+void handleStreamGatherWatches(void) {
+    if (listLength(gather_ready) == 0) return;
+
+    /* Consumer groups reads are writes, they wait for the pause to end. */
+    int paused = isPausedActions(PAUSE_ACTION_CLIENT_WRITE);
+    listIter li;
+    listNode *ln;
+    listRewind(gather_ready,&li);
+    while ((ln = listNext(&li))) {
+        streamGatherWatch *w = listNodeValue(ln);
+        if (paused && w->group) continue;
+        listDelNode(gather_ready,ln);
+        w->ready_node = NULL;
+
+        sds reply = streamGatherCheckSlots(w->argv,w->keys,w->numkeys);
+        if (reply == NULL) {
+            reply = streamGatherRead(w->dbid,w->resp,w->argc,w->argv);
+            if (streamGatherReplyIsEmpty(reply)) {
+                sdsfree(reply);
+                continue;
+            }
+        }
+
+        char origin[CLUSTER_NAMELEN];
+        memcpy(origin,w->rkey,CLUSTER_NAMELEN);
+        uint64_t id = w->id;
+        int local = w->local, resp = w->resp;
+        streamGatherFreeWatch(w);
+        streamGatherDeliver(origin,id,local,CLUSTERMSG_GATHER_FIRED,resp,reply);
+        sdsfree(reply);
+    }
+}
+
+/* Serve a read for the node 'origin'. If nothing was read and 'block' is
+ * true, the read is kept as a watch and *watching is set to 1. Return the
+ * reply of the read. */
+static sds streamGatherServe(const char *origin, uint64_t id, int local, int block,
+                             mstime_t deadline, int dbid, int resp,
+                             int argc, robj **argv, int *watching) {
+    int keys = streamGatherKeysIndex(argc,argv);
+    int numkeys = (argc-keys)/2;
+    *watching = 0;
+
+    sds reply = streamGatherCheckSlots(argv,keys,numkeys);
+    if (reply) return reply;
+
+    /* The watch must read what arrives after this read, not after the time
+     * it fires: resolve the '$' IDs of XREAD right away. */
+    if (block && !strcasecmp(argv[0]->ptr,"XREAD")) {
+        for (int j = keys; j < keys+numkeys; j++) {
+            robj **idarg = &argv[j+numkeys];
+            if (strcmp((*idarg)->ptr,"$")) continue;
+            robj *o = lookupKeyReadWithFlags(server.db+dbid,argv[j],
+                                             LOOKUP_NOEFFECTS);
+            streamID last = {0,0};
+            if (o && o->type == OBJ_STREAM) last = ((stream*)o->ptr)->last_id;
+            decrRefCount(*idarg);
+            *idarg = createObjectFromStreamID(&last);
+        }
+    }
+
+    reply = streamGatherRead(dbid,resp,argc,argv);
+    if (block && streamGatherReplyIsEmpty(reply)) {
+        streamGatherAddWatch(origin,id,local,deadline,dbid,resp,argc,argv,keys);
+        *watching = 1;
+    }
+    return reply;
+}
+
+/* ----------------------------------------------------------------------------
+ * Requests
+ * -------------------------------------------------------------------------- */
+
+/* Serialize a request as: block time (64 bit), argc (32 bit), and the
+ * arguments as length (32 bit) followed by the bytes, in network order. */
+static sds streamGatherEncodeRequest(mstime_t block, int argc, robj **argv) {
+    uint64_t block64 = htonu64((uint64_t)block);
+    uint32_t argc32 = htonl(argc);
+    sds payload = sdsnewlen(&block64,sizeof(block64));
+    payload = sdscatlen(payload,&argc32,sizeof(argc32));
+    for (int j = 0; j < argc; j++) {
+        uint32_t len = htonl(sdslen(argv[j]->ptr));
+        payload = sdscatlen(payload,&len,sizeof(len));
+        payload = sdscatsds(payload,argv[j]->ptr);
+    }
+    return payload;
+}
+
+/* Inverse of streamGatherEncodeRequest(). NULL is returned if the payload
+ * is malformed. */
+static robj **streamGatherDecodeRequest(char *p, uint32_t len, mstime_t *block, int *argc) {
+    uint64_t block64;
+    uint32_t argc32;
+    if (len < sizeof(block64)+sizeof(argc32)) return NULL;
+    memcpy(&block64,p,sizeof(block64));
+    memcpy(&argc32,p+sizeof(block64),sizeof(argc32));
+    p += sizeof(block64)+sizeof(argc32);
+    len -= sizeof(block64)+sizeof(argc32);
+    argc32 = ntohl(argc32);
+    if (argc32 == 0 || argc32 > len/sizeof(uint32_t)) return NULL;
+
+    robj **argv = zmalloc(sizeof(robj*)*argc32);
+    uint32_t j;
+    for (j = 0; j < argc32; j++) {
+        uint32_t arglen;
+        if (len < sizeof(arglen)) break;
+        memcpy(&arglen,p,sizeof(arglen));
+        arglen = ntohl(arglen);
+        p += sizeof(arglen);
+        len -= sizeof(arglen);
+        if (arglen > len) break;
+        argv[j] = createStringObject(p,arglen);
+        p += arglen;
+        len -= arglen;
+    }
+    if (j != argc32) {
+        while (j--) decrRefCount(argv[j]);
+        zfree(argv);
+        return NULL;
+    }
+    *block = (mstime_t)ntohu64(block64);
+    *argc = argc32;
+    return argv;
+}
+
+/* Return 1 if the arguments are a well formed XREAD / XREADGROUP. */
+static int streamGatherIsRead(int argc, robj **argv) {
+    struct redisCommand *cmd = lookupCommand(argv,argc);
+    if (cmd == NULL || cmd->proc != xreadCommand) return 0;
+    return streamGatherKeysIndex(argc,argv) != -1;
+}
+
+/* Called by the cluster bus when a GATHER message is received. */
+void streamGatherReceive(const char *sender, uint64_t id, uint16_t flags,
+                         uint8_t resp, char *payload, uint32_t len) {
+    if (flags & CLUSTERMSG_GATHER_REPLY) {
+        streamGatherOpReply(id,sender,flags,payload,len);
+        return;
+    }
+    if (flags & CLUSTERMSG_GATHER_CANCEL) {
+        streamGatherRemoveWatch(sender,id);
+        return;
+    }
+    if (flags & CLUSTERMSG_GATHER_REFRESH) {
+        streamGatherRefreshWatch(sender,id);
+        return;
+    }
+
+    mstime_t block;
+    int argc, watching = 0;
+    sds reply;
+    robj **argv = streamGatherDecodeRequest(payload,len,&block,&argc);
+    if (argv == NULL || !streamGatherIsRead(argc,argv) || (resp != 2 && resp != 3)) {
+        reply = sdsnew("-ERR Malformed XGATHER request\r\n");
+    } else if (!strcasecmp(argv[0]->ptr,"XREADGROUP") &&
+               isPausedActions(PAUSE_ACTION_CLIENT_WRITE))
+    {
+        reply = sdsnew("-TRYAGAIN Writes are paused on the node\r\n");
+    } else {
+        mstime_t deadline = block ? mstime()+block+server.cluster_node_timeout : 0;
+        reply = streamGatherServe(sender,id,0,flags & CLUSTERMSG_GATHER_BLOCK,
+                                  deadline,0,resp,argc,argv,&watching);
+    }
+    clusterSendGather(sender,id,
+        CLUSTERMSG_GATHER_REPLY|(watching ? CLUSTERMSG_GATHER_WATCHING : 0),
+        resp,reply,sdslen(reply));
+    sdsfree(reply);
+    if (argv) {
+        for (int j = 0; j < argc; j++) decrRefCount(argv[j]);
+        zfree(argv);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Ops
+ * -------------------------------------------------------------------------- */
+
+static streamGatherOp *streamGatherLookupOp(uint64_t id) {
+    void *op = raxFind(gather_ops,(unsigned char*)&id,sizeof(id));
+    return op == raxNotFound ? NULL : op;
+}
+
+static void streamGatherFreeOp(streamGatherOp *op) {
+    raxRemove(gather_ops,(unsigned char*)&op->id,sizeof(op->id),NULL);
+
+    /* Drop the watches left behind. */
+    listIter li;
+    listNode *ln;
+    listRewind(op->watching,&li);
+    while ((ln = listNext(&li)))
+        clusterSendGather(listNodeValue(ln),op->id,CLUSTERMSG_GATHER_CANCEL,0,NULL,0);
+    streamGatherRemoveWatch(streamGatherMyName(),op->id);
+
+    listRelease(op->watching);
+    zfree(op->slots);
+    sdsfree(op->entries);
+    sdsfree(op->err);
+    zfree(op);
+}
+
+/* Reply to the client of a complete op and free it. */
+static void streamGatherOpDone(streamGatherOp *op) {
+    client *c = op->c;
+    int had_errors = op->err != NULL;
+
+    if (op->err) {
+        addReplyErrorSds(c,sdsdup(op->err));
+    } else if (op->count == 0) {
+        addReplyNullArray(c);
+    } else {
+        if (c->resp == 2)
+            addReplyArrayLen(c,op->count);
+        else
+            addReplyMapLen(c,op->count);
+        addReplyProto(c,op->entries,sdslen(op->entries));
+    }
+
+    if (c->flags & CLIENT_BLOCKED) {
+        updateStatsOnUnblock(c,0,0,had_errors);
+        unblockClient(c,1);     /* Frees the op. */
+    } else {
+        streamGatherFreeOp(op);
+    }
+}
+
+/* Handle the reply of an owner to the op 'id'. */
+static void streamGatherOpReply(uint64_t id, const char *owner, uint16_t flags,
+                                const char *reply, size_t len) {
+    streamGatherOp *op = streamGatherLookupOp(id);
+    if (op == NULL) return;     /* Late reply. */
+
+    if (!(flags & CLUSTERMSG_GATHER_FIRED)) op->pending--;
+    if (!(flags & CLUSTERMSG_GATHER_WATCHING)) {
+        listIter li;
+        listNode *ln;
+        listRewind(op->watching,&li);
+        while ((ln = listNext(&li))) {
+            if (!memcmp(listNodeValue(ln),owner,CLUSTER_NAMELEN))
+                listDelNode(op->watching,ln);
+        }
+    }
+
+    if (len >= 3 && reply[0] == '-') {
+        /* Keep the first error, without the final CRLF. */
+        if (op->err == NULL) op->err = sdsnewlen(reply,len-2);
+    } else if (len && (reply[0] == '*' || reply[0] == '%')) {
+        /* An array (or map) of streams: append its elements. */
+        const char *crlf = memchr(reply,'\r',len);
+        long long n;
+        if (crlf && string2ll(reply+1,crlf-reply-1,&n) && n > 0) {
+            const char *body = crlf+2;
+            op->count += n;
+            op->entries = sdscatlen(op->entries,body,reply+len-body);
+        }
+    }
+
+    if (op->pending == 0 && (op->err || op->count || !op->block))
+        streamGatherOpDone(op);
+}
+
+/* Called by unblockClient() for clients blocked in XGATHER. */
+void unblockClientStreamGather(client *c) {
+    streamGatherFreeOp(c->bstate.stream_gather);
+    c->bstate.stream_gather = NULL;
+}
+
+/* Return the name of an owner watching for 'op' that failed, was forgotten,
+ * or doesn't serve the slots of its streams anymore, or NULL. */
+static sds streamGatherLostOwner(streamGatherOp *op) {
+    listIter li;
+    listNode *ln;
+    listRewind(op->watching,&li);
+    while ((ln = listNext(&li))) {
+        sds name = listNodeValue(ln);
+        clusterNode *n = clusterLookupNode(name,CLUSTER_NAMELEN);
+        if (n == NULL || nodeFailed(n)) return name;
+        for (int j = 0; j < op->numslots; j++) {
+            if (memcmp(op->slots[j].owner,name,CLUSTER_NAMELEN)) continue;
+            if (server.cluster->slots[op->slots[j].slot] != n) return name;
+        }
+    }
+    return NULL;
+}
+
+/* Called by clusterCron(): fail the ops whose owners didn't reply in time or
+ * were lost while watching, renew the leases of the watches of the waiting
+ * ops, and drop the watches their origin forgot. */
+void streamGatherCron(void) {
+    mstime_t now = mstime();
+    raxIterator ri;
+    list *expired = listCreate();
+
+    raxStart(&ri,gather_ops);
+    raxSeek(&ri,"^",NULL,0);
+    while (raxNext(&ri)) {
+        streamGatherOp *op = ri.data;
+        sds lost = NULL;
+        if (op->pending && op->deadline < now) {
+            listAddNodeTail(expired,op);
+            continue;
+        }
+
+        /* A watch that can't fire anymore would block the client forever. */
+        if (listLength(op->watching)) lost = streamGatherLostOwner(op);
+
+        /* Renew a few times per lease, so that a lost message is fine. */
+        if (lost == NULL && listLength(op->watching) &&
+            now - op->refreshed >= server.cluster_node_timeout/3)
+        {
+            listIter li;
+            listNode *ln;
+            listRewind(op->watching,&li);
+            while (lost == NULL && (ln = listNext(&li))) {
+                if (clusterSendGather(listNodeValue(ln),op->id,
+                        CLUSTERMSG_GATHER_REFRESH,0,NULL,0) == C_ERR)
+                    lost = listNodeValue(ln);
+            }
+            op->refreshed = now;
+        }
+        if (lost) {
+            if (op->err == NULL)
+                op->err = sdscatprintf(sdsempty(),
+                    "-TRYAGAIN Node %.40s is not reachable",lost);
+            listAddNodeTail(expired,op);
+        }
+    }
+    raxStop(&ri);
+    while (listLength(expired)) {
+        streamGatherOp *op = listNodeValue(listFirst(expired));
+        listDelNode(expired,listFirst(expired));
+        if (op->err == NULL)
+            op->err = sdsnew("-TRYAGAIN Some nodes didn't reply in time");
+        op->pending = 0;
+        streamGatherOpDone(op);
+    }
+
+    raxStart(&ri,gather_watches);
+    raxSeek(&ri,"^",NULL,0);
+    while (raxNext(&ri)) {
+        streamGatherWatch *w = ri.data;
+        int forgotten = 0;
+        if (!w->local) {
+            clusterNode *origin = clusterLookupNode((const char*)w->rkey,CLUSTER_NAMELEN);
+            forgotten = origin == NULL || nodeFailed(origin) || w->lease < now;
+        }
+        if (forgotten || (w->deadline && w->deadline < now))
+            listAddNodeTail(expired,w);
+    }
+    raxStop(&ri);
+    while (listLength(expired)) {
+        streamGatherFreeWatch(listNodeValue(listFirst(expired)));
+        listDelNode(expired,listFirst(expired));
+    }
+    listRelease(expired);
+}
+
+/* Build the XREAD / XREADGROUP reading the streams of the XGATHER called by
+ * 'c' that are owned by 'owner' (all of them if 'owners' is NULL). */
+static robj **streamGatherBuildRead(client *c, robj *group, robj *consumer,
+                                    robj *count, int noack, int streams,
+                                    int numstreams, clusterNode **owners,
+                                    clusterNode *owner, int *argc) {
+    robj **argv = zmalloc(sizeof(robj*)*(7+numstreams*2));
+    int j = 0;
+
+    argv[j++] = createStringObject(group ? "XREADGROUP" : "XREAD",
+                                   group ? 10 : 5);
+    if (group) {
+        argv[j++] = createStringObject("GROUP",5);
+        argv[j++] = getDecodedObject(group);
+        argv[j++] = getDecodedObject(consumer);
+    }
+    if (count) {
+        argv[j++] = createStringObject("COUNT",5);
+        argv[j++] = getDecodedObject(count);
+    }
+    if (noack) argv[j++] = createStringObject("NOACK",5);
+    argv[j++] = createStringObject("STREAMS",7);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k < numstreams; k++) {
+            if (owners && owners[k] != owner) continue;
+            argv[j++] = getDecodedObject(c->argv[streams+k+pass*numstreams]);
+        }
+    }
+    *argc = j;
+    return argv;
+}
+
+static void streamGatherFreeArgv(robj **argv, int argc) {
+    for (int j = 0; j < argc; j++) decrRefCount(argv[j]);
+    zfree(argv);
+}
+
+/* XGATHER only writes when reading through a consumer group: called by
+ * getCommandFlags() so that the GROUP form is refused where writes are
+ * (read only replicas, OOM, min-replicas), while the plain form is not. */
+uint64_t xgatherGetCommandFlags(client *c, uint64_t cmd_flags) {
+    for (int i = 1; i < c->argc; i++) {
+        char *o = c->argv[i]->ptr;
+        if (!strcasecmp(o,"STREAMS")) break;
+        if (!strcasecmp(o,"GROUP"))
+            return (cmd_flags & ~CMD_READONLY) | CMD_WRITE;
+    }
+    return cmd_flags;
+}
+
+/* XGATHER [GROUP group consumer] [COUNT count] [BLOCK milliseconds] [NOACK]
+ *         STREAMS key [key ...] id [id ...] */
+void xgatherCommand(client *c) {
+    robj *group = NULL, *consumer = NULL, *count = NULL;
+    mstime_t timeout = -1;  /* -1 means, no BLOCK argument given. */
+    int noack = 0, streams = 0, numstreams = 0;
+
+    for (int i = 1; i < c->argc; i++) {
+        int moreargs = c->argc-i-1;
+        char *o = c->argv[i]->ptr;
+        if (!strcasecmp(o,"BLOCK") && moreargs) {
+            i++;
+            if (getTimeoutFromObjectOrReply(c,c->argv[i],&timeout,
+                UNIT_MILLISECONDS) != C_OK) return;
+        } else if (!strcasecmp(o,"COUNT") && moreargs) {
+            long long n;
+            i++;
+            if (getLongLongFromObjectOrReply(c,c->argv[i],&n,NULL) != C_OK)
+                return;
+            count = c->argv[i];
+        } else if (!strcasecmp(o,"STREAMS") && moreargs) {
+            streams = i+1;
+            numstreams = c->argc-streams;
+            if ((numstreams % 2) != 0) {
+                addReplyError(c,"Unbalanced 'xgather' list of streams: "
+                                "for each stream key an ID must be specified.");
+                return;
+            }
+            numstreams /= 2;
+            break;
+        } else if (!strcasecmp(o,"GROUP") && moreargs >= 2) {
+            group = c->argv[i+1];
+            consumer = c->argv[i+2];
+            i += 2;
+        } else if (!strcasecmp(o,"NOACK")) {
+            noack = 1;
+        } else {
+            addReplyErrorObject(c,shared.syntaxerr);
+            return;
+        }
+    }
+    if (streams == 0) {
+        addReplyErrorObject(c,shared.syntaxerr);
+        return;
+    }
+    if (noack && group == NULL) {
+        addReplyError(c,"The NOACK option is only supported with GROUP");
+        return;
+    }
+
+    /* The reads are executed on behalf of the user by other clients: check
+     * that the user could execute them. */
+    int argc, argpos;
+    robj **argv = streamGatherBuildRead(c,group,consumer,count,noack,streams,
+                                        numstreams,NULL,NULL,&argc);
+    struct redisCommand *cmd = lookupCommand(argv,argc);
+    int acl_retval = ACLCheckAllUserCommandPerm(c->user,cmd,argv,argc,&argpos);
+    if (acl_retval != ACL_OK) {
+        addACLLogEntry(c,acl_retval,ACL_LOG_CTX_TOPLEVEL,argpos,NULL,
+            sdsdup(acl_retval == ACL_DENIED_CMD ? cmd->fullname : argv[argpos]->ptr));
+        sds msg = getAclErrorMessage(acl_retval,c->user,cmd,argv[argpos]->ptr,0);
+        addReplyErrorFormat(c,"-NOPERM %s",msg);
+        sdsfree(msg);
+        streamGatherFreeArgv(argv,argc);
+        return;
+    }
+    streamGatherFreeArgv(argv,argc);
+
+    /* Group the streams by owner, NULL standing for this node. */
+    clusterNode **owners = zmalloc(sizeof(clusterNode*)*numstreams);
+    int remote = 0, local = 0;
+    for (int j = 0; j < numstreams; j++) {
+        owners[j] = NULL;
+        if (server.cluster_enabled) {
+            sds key = c->argv[streams+j]->ptr;
+            int slot = keyHashSlot(key,sdslen(key));
+            clusterNode *n = server.cluster->slots[slot];
+            if (n == NULL) {
+                addReplyErrorSds(c,sdscatfmt(sdsempty(),
+                    "-CLUSTERDOWN Hash slot %i not served",slot));
+                zfree(owners);
+                return;
+            }
+            if (n != server.cluster->myself) owners[j] = n;
+        }
+        if (owners[j]) remote = 1; else local = 1;
+    }
+    if (remote && (c->flags & CLIENT_DENY_BLOCKING)) {
+        addReplyError(c,"XGATHER can only read the streams of other nodes "
+                        "from a regular client");
+        zfree(owners);
+        return;
+    }
+
+    streamGatherOp *op = zmalloc(sizeof(*op));
+    op->id = gather_next_id++;
+    op->c = c;
+    op->block = timeout != -1 && !(c->flags & CLIENT_DENY_BLOCKING);
+    op->pending = 0;
+    op->watching = listCreate();
+    listSetFreeMethod(op->watching,(void (*)(void*))sdsfree);
+    op->slots = NULL;
+    op->numslots = 0;
+    if (op->block && remote) {
+        op->slots = zmalloc(sizeof(streamGatherSlot)*numstreams);
+        for (int j = 0; j < numstreams; j++) {
+            if (owners[j] == NULL) continue;
+            sds key = c->argv[streams+j]->ptr;
+            op->slots[op->numslots].slot = keyHashSlot(key,sdslen(key));
+            memcpy(op->slots[op->numslots].owner,owners[j]->name,CLUSTER_NAMELEN);
+            op->numslots++;
+        }
+    }
+    op->count = 0;
+    op->entries = sdsempty();
+    op->err = NULL;
+    op->deadline = mstime()+server.cluster_node_timeout;
+    op->refreshed = mstime();
+    raxInsert(gather_ops,(unsigned char*)&op->id,sizeof(op->id),op,NULL);
+    uint64_t id = op->id;
+
+    /* Ask the other owners first, so that they work while we read our own
+     * streams. The block time is sent relative to now, 0 meaning forever. */
+    mstime_t block = 0;
+    if (op->block && timeout) {
+        block = timeout-commandTimeSnapshot();
+        if (block <= 0) block = 1;
+    }
+    for (int j = 0; j < numstreams && op->err == NULL; j++) {
+        clusterNode *owner = owners[j];
+        if (owner == NULL) continue;
+        int seen = 0;
+        for (int k = 0; k < j && !seen; k++) seen = owners[k] == owner;
+        if (seen) continue;
+
+        argv = streamGatherBuildRead(c,group,consumer,count,noack,streams,
+                                     numstreams,owners,owner,&argc);
+        sds payload = streamGatherEncodeRequest(block,argc,argv);
+        if (clusterSendGather(owner->name,id,
+                op->block ? CLUSTERMSG_GATHER_BLOCK : 0,c->resp,
+                payload,sdslen(payload)) == C_OK)
+        {
+            op->pending++;
+            if (op->block)
+                listAddNodeTail(op->watching,sdsnewlen(owner->name,CLUSTER_NAMELEN));
+        } else {
+            op->err = sdscatprintf(sdsempty(),
+                "-TRYAGAIN Node %.40s is not reachable",owner->name);
+        }
+        sdsfree(payload);
+        streamGatherFreeArgv(argv,argc);
+    }
+
+    /* Our own streams. */
+    if (local && op->err == NULL) {
+        int watching;
+        argv = streamGatherBuildRead(c,group,consumer,count,noack,streams,
+                                     numstreams,owners,NULL,&argc);
+        op->pending++;
+        sds reply = streamGatherServe(streamGatherMyName(),id,1,op->block,0,
+                                      c->db->id,c->resp,argc,argv,&watching);
+        streamGatherFreeArgv(argv,argc);
+        streamGatherOpReply(id,streamGatherMyName(),
+                            watching ? CLUSTERMSG_GATHER_WATCHING : 0,
+                            reply,sdslen(reply));
+        sdsfree(reply);
+    } else if (op->err) {
+        op->pending = 0;
+        streamGatherOpDone(op);
+    }
+    zfree(owners);
+
+    /* The reads propagate themselves. */
+    preventCommandPropagation(c);
+
+    /* Wait for the other owners, or for data. */
+    if ((op = streamGatherLookupOp(id)) != NULL) {
+        c->bstate.timeout = op->block ? timeout : 0;
+        c->bstate.stream_gather = op;
+        blockClient(c,BLOCKED_STREAM_GATHER);
+    }
+}
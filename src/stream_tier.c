@@ -0,0 +1,686 @@
+/* Stream tiered storage.
+ *
+ * The radix tree nodes of a stream that only hold entries older than
+ * stream-tiering-age milliseconds are "spilled" by serverCron() to a local
+ * file: the listpack is appended to the file and replaced in the radix tree
+ * by a small streamNodeStub (see stream.h) remembering where the listpack
+ * lives, together with the few facts (entries count, first and last ID) that
+ * trimming and XINFO need without reading the node back.
+ *
+ * Reading a spilled node back is a "fault". Commands that only read streams
+ * (XRANGE, XREVRANGE, XREAD, XREADGROUP history, XCLAIM, XAUTOCLAIM, XINFO)
+ * declare the nodes they are going to touch before doing anything else: if
+ * some of them are spilled, the reads are handed to the bio_stream_tier
+ * thread and the client is postponed, the command being executed again from
+ * scratch once all the nodes it needed are back in memory. The server keeps
+ * serving the other clients in the meantime. Everything else that finds a
+ * stub in its way (write commands, MULTI, scripts, persistence) reads the
+ * node synchronously with streamTierFaultIn().
+ *
+ * The file is just a cache of the memory contents: it is truncated when it
+ * is first used, it is never read at startup, and its space is only
+ * reclaimed by truncating it again once no stub references it.
+ *
+ * The same stubs are used by stream-mmap-load: the RDB file being loaded is
+ * mapped in memory, and the uncompressed nodes it holds are not read but
+ * replaced by stubs pointing to the mapping (their offset is flagged with
+ * STREAM_STUB_MAPPED), so that the loading does not copy them. The file
+ * is still read sequentially for its checksum. A node is copied from the
+ * mapping and deeply validated the first time it is accessed, exactly like a
+ * fault from the tier file, and the mapping is released once no stub
+ * references it. */
+
+#include "server.h"
+#include "bio.h"
+#include "atomicvar.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* A node read back by the bio_stream_tier thread. */
+typedef struct streamTierFault {
+    uint64_t offset;        /* Offset of the node in the tier file. */
+    uint32_t bytes;         /* Size of the node. */
+    int dbid;               /* Database of the stream. */
+    sds key;                /* Name of the stream. */
+    unsigned char nodekey[sizeof(streamID)]; /* Radix tree key of the node. */
+    list *clients;          /* IDs of the clients waiting for the node. */
+    monotime start;         /* When the fault was submitted. */
+    unsigned char *lp;      /* The node, filled by the bio thread. */
+} streamTierFault;
+
+/* A node that was faulted in, not spilled again before stream-tiering-age
+ * milliseconds elapsed, otherwise it would be spilled right away since the
+ * entries it holds are old by definition. */
+typedef struct streamTierResident {
+    unsigned char *lp;
+    mstime_t since;
+} streamTierResident;
+
+static int tier_fd = -1;                /* The tier file, opened lazily. */
+static time_t tier_open_failed = 0;     /* Time of the last failed open. */
+static uint64_t tier_file_size = 0;     /* Offset of the next spill. */
+static redisAtomic size_t tier_live_nodes = 0;  /* Stubs in the keyspace. */
+static redisAtomic size_t tier_live_bytes = 0;  /* Bytes they reference. */
+static rax *tier_faults;                /* Faults in flight, by offset. */
+static list *tier_wanted;               /* Faults the current command needs. */
+static rax *tier_resident_index;        /* Recently faulted nodes, by pointer. */
+static list *tier_resident;             /* Same, in fault order. */
+static int tier_pipe[2] = {-1,-1};      /* Wakes up the main thread. */
+static pthread_mutex_t tier_done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static list *tier_done;                 /* Faults completed by the bio thread. */
+
+/* Spill cron scanning position. */
+static int tier_scan_db = 0;
+static unsigned long tier_scan_cursor = 0;
+
+/* The RDB file mapped by stream-mmap-load. */
+static unsigned char *tier_map = NULL;
+static size_t tier_map_size = 0;
+static redisAtomic size_t tier_map_live_nodes = 0;   /* Stubs in the keyspace. */
+
+static long long tier_stat_spills = 0;
+static long long tier_stat_hits = 0;
+static long long tier_stat_misses = 0;
+static long long tier_stat_sync_faults = 0;
+static durationStats tier_stat_fault_latency;
+
+/* Time budget of a single streamTierCron() call, in microseconds. */
+#define STREAM_TIER_CRON_BUDGET 1000
+/* Seconds to wait before retrying to open the tier file. */
+#define STREAM_TIER_OPEN_RETRY 60
+
+static int streamTierEnabled(void) {
+    return server.stream_tier_age > 0;
+}
+
+static void streamTierAddLatency(monotime duration) {
+    tier_stat_fault_latency.cnt++;
+    tier_stat_fault_latency.sum += duration;
+    if (duration > tier_stat_fault_latency.max)
+        tier_stat_fault_latency.max = duration;
+}
+
+/* Read the spilled node described by 'stub' and return it as a newly
+ * allocated listpack. This is called by the main thread, the bio thread and
+ * the child processes, the tier file is never written where a live stub
+ * points to so no locking is needed. */
+unsigned char *streamTierReadNode(streamNodeStub *stub) {
+    unsigned char *lp = zmalloc(stub->bytes);
+    if (stub->offset & STREAM_STUB_MAPPED) {
+        /* Only the header of the node was checked at loading, and the file
+         * may have changed since then. */
+        memcpy(lp,tier_map+(stub->offset & ~STREAM_STUB_MAPPED),stub->bytes);
+        if (!streamValidateListpackIntegrity(lp,stub->bytes,1)) {
+            serverPanic("Corrupted stream node in the mapped RDB file "
+                        "at offset %llu",
+                        (unsigned long long)(stub->offset & ~STREAM_STUB_MAPPED));
+        }
+        return lp;
+    }
+
+    size_t done = 0;
+    while (done < stub->bytes) {
+        ssize_t nread = pread(tier_fd,lp+done,stub->bytes-done,
+                              stub->offset+done);
+        if (nread <= 0) {
+            serverPanic("Can't read stream node from the tier file '%s' "
+                        "at offset %llu: %s", server.stream_tier_file,
+                        (unsigned long long)stub->offset,
+                        nread == 0 ? "unexpected end of file" : strerror(errno));
+        }
+        done += nread;
+    }
+    return lp;
+}
+
+/* Release a stub, possibly from the lazyfree thread. */
+void streamTierFreeStub(streamNodeStub *stub) {
+    if (stub->offset & STREAM_STUB_MAPPED) {
+        atomicDecr(tier_map_live_nodes,1);
+    } else {
+        atomicDecr(tier_live_nodes,1);
+        atomicDecr(tier_live_bytes,stub->bytes);
+    }
+    zfree(stub);
+}
+
+/* Don't spill 'lp' again before stream-tiering-age milliseconds. */
+static void streamTierMarkResident(unsigned char *lp) {
+    streamTierResident *r = zmalloc(sizeof(*r));
+    r->lp = lp;
+    r->since = mstime();
+    listAddNodeTail(tier_resident,r);
+    raxInsert(tier_resident_index,(unsigned char*)&lp,sizeof(lp),
+              listLast(tier_resident),NULL);
+}
+
+/* Forget the faulted nodes that are resident for long enough. */
+static void streamTierExpireResident(mstime_t now) {
+    listNode *ln;
+    while ((ln = listFirst(tier_resident)) != NULL) {
+        streamTierResident *r = listNodeValue(ln);
+        if (now - r->since < server.stream_tier_age) break;
+        raxRemove(tier_resident_index,(unsigned char*)&r->lp,sizeof(r->lp),NULL);
+        listDelNode(tier_resident,ln);
+    }
+}
+
+/* Read back synchronously the spilled node stored at 'nodekey' of the
+ * stream 's', replace its stub with it, and return the node. */
+unsigned char *streamTierFaultIn(stream *s, unsigned char *nodekey) {
+    streamNodeStub *stub = raxFind(s->rax,nodekey,sizeof(streamID));
+    serverAssert(stub != raxNotFound && streamNodeIsStub(stub));
+
+    monotime start = getMonotonicUs();
+    unsigned char *lp = streamTierReadNode(stub);
+    raxInsert(s->rax,nodekey,sizeof(streamID),lp,NULL);
+    streamTierFreeStub(stub);
+    streamTierMarkResident(lp);
+    streamTierAddLatency(getMonotonicUs()-start);
+    tier_stat_misses++;
+    tier_stat_sync_faults++;
+    return lp;
+}
+
+/* ----------------------------------------------------------------------------
+ * Asynchronous faults
+ * --------------------------------------------------------------------------*/
+
+/* Executed by the bio_stream_tier thread. */
+static void streamTierFaultJob(void *privdata) {
+    streamTierFault *f = privdata;
+    streamNodeStub stub = {0};
+    stub.offset = f->offset;
+    stub.bytes = f->bytes;
+    f->lp = streamTierReadNode(&stub);
+
+    pthread_mutex_lock(&tier_done_mutex);
+    listAddNodeTail(tier_done,f);
+    pthread_mutex_unlock(&tier_done_mutex);
+    if (write(tier_pipe[1],"A",1) != 1) {
+        /* Pipe is non-blocking, write() may fail if it's full: the main
+         * thread will drain it and find our fault anyway. */
+    }
+}
+
+static void streamTierFreeFault(streamTierFault *f) {
+    sdsfree(f->key);
+    listRelease(f->clients);
+    zfree(f);
+}
+
+/* Install in its stream the node read by the bio thread, if the stream still
+ * references it, and wake up the clients that were waiting for it. */
+static void streamTierFaultDone(streamTierFault *f) {
+    uint64_t offset = htonu64(f->offset);
+    raxRemove(tier_faults,(unsigned char*)&offset,sizeof(offset),NULL);
+    streamTierAddLatency(getMonotonicUs()-f->start);
+
+    int installed = 0;
+    dictEntry *de = dictFind(server.db[f->dbid].dict,f->key);
+    robj *o = de ? dictGetVal(de) : NULL;
+    if (o && o->type == OBJ_STREAM) {
+        stream *s = o->ptr;
+        streamNodeStub *stub = raxFind(s->rax,f->nodekey,sizeof(f->nodekey));
+        /* Offsets are never reused while a fault is in flight, so finding
+         * a stub with the same offset means finding the same node. */
+        if (stub != raxNotFound && streamNodeIsStub(stub) &&
+            stub->offset == f->offset)
+        {
+            raxInsert(s->rax,f->nodekey,sizeof(f->nodekey),f->lp,NULL);
+            streamTierFreeStub(stub);
+            streamTierMarkResident(f->lp);
+            installed = 1;
+        }
+    }
+    if (!installed) lpFree(f->lp);
+
+    listIter li;
+    listNode *ln;
+    listRewind(f->clients,&li);
+    while ((ln = listNext(&li))) {
+        client *c = lookupClientByID(*(uint64_t*)listNodeValue(ln));
+        if (c && c->flags & CLIENT_BLOCKED && c->bstate.btype == BLOCKED_POSTPONE)
+            unblockClient(c,1);
+    }
+    streamTierFreeFault(f);
+}
+
+static void streamTierPipeReadable(aeEventLoop *el, int fd, void *privdata, int mask) {
+    UNUSED(el);
+    UNUSED(privdata);
+    UNUSED(mask);
+
+    char buf[128];
+    while (read(fd,buf,sizeof(buf)) == sizeof(buf));
+
+    pthread_mutex_lock(&tier_done_mutex);
+    list *done = tier_done;
+    tier_done = listCreate();
+    pthread_mutex_unlock(&tier_done_mutex);
+
+    listIter li;
+    listNode *ln;
+    listRewind(done,&li);
+    while ((ln = listNext(&li))) streamTierFaultDone(listNodeValue(ln));
+    listRelease(done);
+}
+
+/* Return 1 if the command of 'c' can wait for its nodes to be faulted in,
+ * to be executed again later. */
+static int streamTierCanBlock(client *c) {
+    if ((!streamTierEnabled() && !tier_map) || server.loading) return 0;
+    if (c->flags & (CLIENT_DENY_BLOCKING|CLIENT_MULTI|CLIENT_MASTER|CLIENT_MODULE))
+        return 0;
+    if (c->id == CLIENT_ID_AOF || server.execution_nesting > 1) return 0;
+    return 1;
+}
+
+/* The current command of 'c' is going to read the node stored at 'nodekey'
+ * of the stream 'key': if it is spilled, fault it in. Return the number of
+ * valid entries in the node. */
+static int64_t streamTierWantNode(client *c, robj *key, void *node, unsigned char *nodekey) {
+    if (!streamNodeIsStub(node)) {
+        long long entries;
+        tier_stat_hits++;
+        lpGetValue(lpFirst(node),NULL,&entries);
+        return entries;
+    }
+
+    streamNodeStub *stub = node;
+    uint64_t offset = htonu64(stub->offset);
+    streamTierFault *f = raxFind(tier_faults,(unsigned char*)&offset,sizeof(offset));
+    if (f == raxNotFound) {
+        f = zmalloc(sizeof(*f));
+        f->offset = stub->offset;
+        f->bytes = stub->bytes;
+        f->dbid = c->db->id;
+        f->key = sdsdup(key->ptr);
+        memcpy(f->nodekey,nodekey,sizeof(f->nodekey));
+        f->clients = listCreate();
+        listSetFreeMethod(f->clients,zfree);
+        f->start = getMonotonicUs();
+        f->lp = NULL;
+        raxInsert(tier_faults,(unsigned char*)&offset,sizeof(offset),f,NULL);
+        bioCreateStreamTierJob(streamTierFaultJob,f);
+        tier_stat_misses++;
+    }
+    listAddNodeTail(tier_wanted,f);
+    return stub->entries;
+}
+
+/* Declare that the current command of 'c' is going to read up to 'count'
+ * entries (0 means all of them) of the stream 'key' between 'start' and
+ * 'end' (NULL meaning the stream edges), like streamIteratorStart() does.
+ * Must be followed by a call to streamTierBlockClient(). */
+void streamTierWantRange(client *c, robj *key, stream *s, streamID *start, streamID *end, int rev, long long count) {
+    if (!streamTierCanBlock(c) || raxSize(s->rax) == 0) return;
+
+    unsigned char start_key[sizeof(streamID)], end_key[sizeof(streamID)];
+    if (start) streamEncodeID(start_key,start);
+    else memset(start_key,0,sizeof(start_key));
+    if (end) streamEncodeID(end_key,end);
+    else memset(end_key,0xff,sizeof(end_key));
+
+    raxIterator ri;
+    raxStart(&ri,s->rax);
+    if (!rev) {
+        raxSeek(&ri,"<=",start_key,sizeof(start_key));
+        if (raxEOF(&ri)) raxSeek(&ri,"^",NULL,0);
+    } else {
+        raxSeek(&ri,"<=",end_key,sizeof(end_key));
+        if (raxEOF(&ri)) raxSeek(&ri,"$",NULL,0);
+    }
+
+    /* The first node may only hold entries outside the range, so it does
+     * not count towards 'count'. */
+    long long seen = 0;
+    int first = 1;
+    while (rev ? raxPrev(&ri) : raxNext(&ri)) {
+        if (!rev && memcmp(ri.key,end_key,sizeof(end_key)) > 0) break;
+        int64_t entries = streamTierWantNode(c,key,ri.data,ri.key);
+        if (rev && memcmp(ri.key,start_key,sizeof(start_key)) <= 0) break;
+        if (!first) seen += entries;
+        first = 0;
+        if (count && seen >= count) break;
+    }
+    raxStop(&ri);
+}
+
+/* Like streamTierWantRange() for the first 'count' entries of the PEL 'pel'
+ * starting at 'start'. */
+void streamTierWantPEL(client *c, robj *key, stream *s, rax *pel, streamID *start, long long count) {
+    if (!streamTierCanBlock(c) || raxSize(s->rax) == 0) return;
+
+    unsigned char start_key[sizeof(streamID)];
+    streamEncodeID(start_key,start);
+
+    raxIterator pi, ri;
+    raxStart(&pi,pel);
+    raxStart(&ri,s->rax);
+    raxSeek(&pi,">=",start_key,sizeof(start_key));
+    void *last = NULL;
+    long long seen = 0;
+    while ((!count || seen++ < count) && raxNext(&pi)) {
+        raxSeek(&ri,"<=",pi.key,pi.key_len);
+        if (!raxNext(&ri) || ri.data == last) continue;
+        streamTierWantNode(c,key,ri.data,ri.key);
+        last = ri.data;
+    }
+    raxStop(&ri);
+    raxStop(&pi);
+}
+
+/* If some of the nodes declared by streamTierWant*() are being faulted in,
+ * postpone the client and return 1: the caller should return without doing
+ * anything, the command will be executed again once the nodes are in memory.
+ * Otherwise return 0. */
+int streamTierBlockClient(client *c) {
+    if (listLength(tier_wanted) == 0) return 0;
+
+    listIter li;
+    listNode *ln;
+    listRewind(tier_wanted,&li);
+    while ((ln = listNext(&li))) {
+        streamTierFault *f = listNodeValue(ln);
+        listNode *last = listLast(f->clients);
+        if (last && *(uint64_t*)listNodeValue(last) == c->id) continue;
+        uint64_t *id = zmalloc(sizeof(*id));
+        *id = c->id;
+        listAddNodeTail(f->clients,id);
+    }
+    listEmpty(tier_wanted);
+    blockPostponeClient(c);
+    return 1;
+}
+
+/* ----------------------------------------------------------------------------
+ * Mapped RDB loading
+ * --------------------------------------------------------------------------*/
+
+/* Release the mapped RDB file if no stub references it anymore. */
+static void streamTierUnmapIfUnused(void) {
+    size_t live_nodes;
+    atomicGet(tier_map_live_nodes,live_nodes);
+    if (!tier_map || live_nodes || raxSize(tier_faults)) return;
+
+    munmap(tier_map,tier_map_size);
+    tier_map = NULL;
+    tier_map_size = 0;
+}
+
+/* Map the RDB file 'fd' of 'size' bytes that is going to be loaded, so that
+ * its nodes can be adopted by streamTierMapNode(). Returns C_ERR if the file
+ * can't be mapped, or if the file mapped by a previous loading is still in
+ * use. */
+int streamTierMapRdb(int fd, size_t size) {
+    streamTierUnmapIfUnused();
+    if (tier_map || size == 0) return C_ERR;
+
+    void *map = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+    if (map == MAP_FAILED) {
+        serverLog(LL_WARNING,"Can't map the RDB file, loading it normally: %s",
+                  strerror(errno));
+        return C_ERR;
+    }
+    /* The whole file is read sequentially to verify its checksum. */
+    madvise(map,size,MADV_SEQUENTIAL);
+    tier_map = map;
+    tier_map_size = size;
+    return C_OK;
+}
+
+/* Called once the mapped RDB file was loaded. */
+void streamTierMapRdbLoaded(void) {
+    /* From now on nodes are copied as they are accessed. */
+    if (tier_map) madvise(tier_map,tier_map_size,MADV_RANDOM);
+    streamTierUnmapIfUnused();
+}
+
+/* Return the address of the 'bytes' bytes at 'offset' in the mapped RDB
+ * file, or NULL if they are not all mapped. */
+unsigned char *streamTierMapped(off_t offset, size_t bytes) {
+    if (!tier_map || offset < 0 || (size_t)offset > tier_map_size ||
+        bytes > tier_map_size - offset) return NULL;
+    return tier_map+offset;
+}
+
+/* Return a stub for the node 'lp' of 'bytes' bytes, with the given master
+ * ID, found in the mapped RDB file. */
+streamNodeStub *streamTierMapNode(unsigned char *lp, size_t bytes, streamID *master_id) {
+    streamNodeStub *stub = zmalloc(sizeof(*stub));
+    streamNodeDescribe(lp,master_id,stub);
+    stub->zero = 0;
+    stub->bytes = bytes;
+    stub->offset = (uint64_t)(lp-tier_map) | STREAM_STUB_MAPPED;
+    atomicIncr(tier_map_live_nodes,1);
+    return stub;
+}
+
+/* ----------------------------------------------------------------------------
+ * Spilling
+ * --------------------------------------------------------------------------*/
+
+static int streamTierOpen(void) {
+    if (tier_fd != -1) return C_OK;
+    if (tier_open_failed && server.unixtime - tier_open_failed < STREAM_TIER_OPEN_RETRY)
+        return C_ERR;
+
+    tier_fd = open(server.stream_tier_file,O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+    if (tier_fd == -1) {
+        serverLog(LL_WARNING,"Can't open the stream tier file '%s': %s",
+                  server.stream_tier_file, strerror(errno));
+        tier_open_failed = server.unixtime;
+        return C_ERR;
+    }
+    tier_open_failed = 0;
+    tier_file_size = 0;
+    return C_OK;
+}
+
+/* Append 'lp' to the tier file and return its offset, or -1 on error. */
+static long long streamTierWrite(unsigned char *lp, size_t bytes) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t nwritten = pwrite(tier_fd,lp+done,bytes-done,tier_file_size+done);
+        if (nwritten <= 0) {
+            serverLog(LL_WARNING,"Can't write to the stream tier file '%s': %s",
+                      server.stream_tier_file, strerror(errno));
+            return -1;
+        }
+        done += nwritten;
+    }
+    long long offset = tier_file_size;
+    tier_file_size += bytes;
+    return offset;
+}
+
+typedef struct streamTierScanData {
+    mstime_t cold;          /* Entries older than this are cold. */
+    monotime deadline;      /* End of the time budget. */
+    int stop;               /* Set when the budget or the disk is exhausted. */
+} streamTierScanData;
+
+/* Spill the cold nodes of the stream 'o', never the last node that receives
+ * the new entries. */
+static void streamTierSpillStream(robj *o, streamTierScanData *sd) {
+    stream *s = o->ptr;
+    if (raxSize(s->rax) < 2) return;
+
+    raxIterator ri;
+    raxStart(&ri,s->rax);
+    raxSeek(&ri,"^",NULL,0);
+    uint64_t left = raxSize(s->rax);
+    while (--left && raxNext(&ri)) {
+        unsigned char *lp = ri.data;
+        if (streamNodeIsStub(lp)) continue;
+        if (raxFind(tier_resident_index,(unsigned char*)&lp,sizeof(lp)) != raxNotFound)
+            continue;
+
+        streamID master_id;
+        streamNodeStub *stub = zmalloc(sizeof(*stub));
+        streamDecodeID(ri.key,&master_id);
+        streamNodeDescribe(lp,&master_id,stub);
+        /* Nodes are sorted: once a node is not cold, the next aren't. */
+        if ((mstime_t)stub->last_id.ms >= sd->cold) {
+            zfree(stub);
+            break;
+        }
+
+        size_t bytes = lpBytes(lp);
+        if (server.stream_tier_disk_watermark &&
+            tier_file_size + bytes > server.stream_tier_disk_watermark)
+        {
+            zfree(stub);
+            sd->stop = 1;
+            break;
+        }
+        long long offset = streamTierWrite(lp,bytes);
+        if (offset == -1) {
+            zfree(stub);
+            sd->stop = 1;
+            break;
+        }
+        stub->zero = 0;
+        stub->bytes = bytes;
+        stub->offset = offset;
+        raxInsert(s->rax,ri.key,ri.key_len,stub,NULL);
+        lpFree(lp);
+        atomicIncr(tier_live_nodes,1);
+        atomicIncr(tier_live_bytes,bytes);
+        tier_stat_spills++;
+
+        if (getMonotonicUs() >= sd->deadline) {
+            sd->stop = 1;
+            break;
+        }
+    }
+    raxStop(&ri);
+}
+
+static void streamTierScanCallback(void *privdata, const dictEntry *de) {
+    streamTierScanData *sd = privdata;
+    robj *o = dictGetVal(de);
+    if (sd->stop || o->type != OBJ_STREAM) return;
+    streamTierSpillStream(o,sd);
+}
+
+/* Called by serverCron() to spill the cold stream nodes, incrementally
+ * scanning the keyspace. */
+void streamTierCron(void) {
+    if (tier_resident) streamTierExpireResident(mstime());
+    streamTierUnmapIfUnused();
+
+    /* Reclaim the file space once no stub references it. */
+    size_t live_nodes;
+    atomicGet(tier_live_nodes,live_nodes);
+    if (tier_fd != -1 && tier_file_size && live_nodes == 0 &&
+        raxSize(tier_faults) == 0 && !hasActiveChildProcess())
+    {
+        if (ftruncate(tier_fd,0) == -1) {
+            serverLog(LL_WARNING,"Can't truncate the stream tier file '%s': %s",
+                      server.stream_tier_file, strerror(errno));
+        } else {
+            tier_file_size = 0;
+        }
+    }
+
+    /* Clients just unblocked by a fault didn't run yet: spilling the nodes
+     * they need would make them fault again. Spilling while a child is
+     * active would only trigger copy on write. */
+    if (!streamTierEnabled() || listLength(server.unblocked_clients) ||
+        hasActiveChildProcess()) return;
+    if (server.stream_tier_memory_watermark &&
+        zmalloc_used_memory() <= server.stream_tier_memory_watermark) return;
+    if (streamTierOpen() == C_ERR) return;
+
+    streamTierScanData sd;
+    sd.cold = mstime() - server.stream_tier_age;
+    sd.deadline = getMonotonicUs() + STREAM_TIER_CRON_BUDGET;
+    sd.stop = 0;
+
+    int dbs_done = 0;
+    while (!sd.stop && dbs_done < server.dbnum) {
+        if (tier_scan_db >= server.dbnum) tier_scan_db = 0;
+        dict *d = server.db[tier_scan_db].dict;
+        if (dictSize(d)) {
+            do {
+                tier_scan_cursor = dictScan(d,tier_scan_cursor,
+                                            streamTierScanCallback,&sd);
+            } while (tier_scan_cursor && !sd.stop &&
+                     getMonotonicUs() < sd.deadline);
+        } else {
+            tier_scan_cursor = 0;
+        }
+        if (tier_scan_cursor) break;
+        tier_scan_db++;
+        dbs_done++;
+        if (getMonotonicUs() >= sd.deadline) break;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Initialization and INFO
+ * --------------------------------------------------------------------------*/
+
+void streamTierInit(void) {
+    tier_faults = raxNew();
+    tier_wanted = listCreate();
+    tier_resident_index = raxNew();
+    tier_resident = listCreate();
+    listSetFreeMethod(tier_resident,zfree);
+    tier_done = listCreate();
+
+    if (anetPipe(tier_pipe,O_CLOEXEC|O_NONBLOCK,O_CLOEXEC|O_NONBLOCK) == -1) {
+        serverLog(LL_WARNING,
+            "Can't create the pipe for stream tiering: %s", strerror(errno));
+        exit(1);
+    }
+    if (aeCreateFileEvent(server.el,tier_pipe[0],AE_READABLE,
+        streamTierPipeReadable,NULL) == AE_ERR) {
+            serverPanic(
+                "Error registering the readable event for the stream tier pipe.");
+    }
+}
+
+void streamTierResetStats(void) {
+    tier_stat_spills = 0;
+    tier_stat_hits = 0;
+    tier_stat_misses = 0;
+    tier_stat_sync_faults = 0;
+    memset(&tier_stat_fault_latency,0,sizeof(tier_stat_fault_latency));
+}
+
+sds genStreamTierInfoString(sds info) {
+    size_t live_nodes, live_bytes, map_live_nodes;
+    atomicGet(tier_live_nodes,live_nodes);
+    atomicGet(tier_live_bytes,live_bytes);
+    atomicGet(tier_map_live_nodes,map_live_nodes);
+    return sdscatprintf(info,
+        "stream_tier_nodes:%zu\r\n"
+        "stream_tier_bytes:%zu\r\n"
+        "stream_tier_file_bytes:%llu\r\n"
+        "stream_tier_mapped_nodes:%zu\r\n"
+        "stream_tier_mapped_bytes:%zu\r\n"
+        "stream_tier_spills:%lld\r\n"
+        "stream_tier_hits:%lld\r\n"
+        "stream_tier_misses:%lld\r\n"
+        "stream_tier_sync_faults:%lld\r\n"
+        "stream_tier_pending_faults:%llu\r\n"
+        "stream_tier_fault_usec:%llu\r\n"
+        "stream_tier_fault_max_usec:%llu\r\n",
+        live_nodes,
+        live_bytes,
+        (unsigned long long)tier_file_size,
+        map_live_nodes,
+        tier_map_size,
+        tier_stat_spills,
+        tier_stat_hits,
+        tier_stat_misses,
+        tier_stat_sync_faults,
+        (unsigned long long)(tier_faults ? raxSize(tier_faults) : 0),
+        tier_stat_fault_latency.sum,
+        tier_stat_fault_latency.max);
+}
@@ -28,6 +28,7 @@
  */
 
 #include "server.h"
+#include "cluster.h"
 #include "endianconv.h"
 #include "stream.h"
 
@@ -37,6 +38,7 @@
 #define STREAM_ITEM_FLAG_NONE 0             /* No special flags. */
 #define STREAM_ITEM_FLAG_DELETED (1<<0)     /* Entry is deleted. Skip it. */
 #define STREAM_ITEM_FLAG_SAMEFIELDS (1<<1)  /* Same fields as master entry. */
+#define STREAM_ITEM_FLAG_LARGEVALUES (1<<2) /* Some values are out of line. */
 
 /* For stream commands that require multiple IDs
  * when the number of IDs is less than 'STREAMID_STATIC_VECTOR_LEN',
@@ -53,11 +55,23 @@
  * will return NULL. */
 #define STREAM_LISTPACK_MAX_SIZE (1<<30)
 
+/* True if the value 'v' should be stored out of the listpacks, see the
+ * "Out of line values" section. */
+#define streamValueIsLarge(v) (server.stream_large_value_threshold && \
+                               sdslen(v) >= server.stream_large_value_threshold)
+
+/* True if the value 'j' of an entry is out of line according to its values
+ * mask. */
+#define streamValueIsOutOfLine(mask,j) ((mask)[(j)/8] & (1<<((j)%8)))
+
 void streamFreeCG(streamCG *cg);
 void streamFreeNACK(streamNACK *na);
 size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamConsumer *consumer);
 int streamParseStrictIDOrReply(client *c, robj *o, streamID *id, uint64_t missing_seq, int *seq_given);
 int streamParseIDOrReply(client *c, robj *o, streamID *id, uint64_t missing_seq);
+static uint64_t streamBlobAdd(stream *s, sds value);
+static unsigned char *streamReleaseEntryBlobs(stream *s, unsigned char *lp, unsigned char **pp, int64_t master_fields_count);
+static void streamFreeNodeBlobs(stream *s, unsigned char *lp);
 
 /* -----------------------------------------------------------------------
  * Low level stream encoding: a radix tree of listpacks.
@@ -76,14 +90,35 @@ stream *streamNew(void) {
     s->max_deleted_entry_id.ms = 0;
     s->entries_added = 0;
     s->cgroups = NULL; /* Created on demand to save memory when not used. */
+    s->idmp = NULL; /* Created on demand as well. */
+    s->blobs = NULL; /* Created on demand as well. */
+    s->blobs_next = 0;
+    s->blobs_bytes = 0;
+    s->epoch = 0;
     return s;
 }
 
+/* Free a node of the radix tree, either a listpack or a stub of a node
+ * moved to the tier file. */
+static void streamFreeNode(void *node) {
+    if (streamNodeIsStub(node))
+        streamTierFreeStub(node);
+    else
+        lpFree(node);
+}
+
 /* Free a stream, including the listpacks stored inside the radix tree. */
 void freeStream(stream *s) {
-    raxFreeWithCallback(s->rax,(void(*)(void*))lpFree);
+    raxFreeWithCallback(s->rax,streamFreeNode);
     if (s->cgroups)
         raxFreeWithCallback(s->cgroups,(void(*)(void*))streamFreeCG);
+    if (s->idmp) {
+        raxFreeWithCallback(s->idmp->keys,zfree);
+        raxFreeWithCallback(s->idmp->ids,(void(*)(void*))sdsfree);
+        zfree(s->idmp);
+    }
+    if (s->blobs)
+        raxFreeWithCallback(s->blobs,(void(*)(void*))sdsfree);
     zfree(s);
 }
 
@@ -181,9 +216,15 @@ robj *streamDup(robj *o) {
     /* Get a reference to the listpack node. */
     while (raxNext(&ri)) {
         lp = ri.data;
-        lp_bytes = lpBytes(lp);
-        unsigned char *new_lp = zmalloc(lp_bytes);
-        memcpy(new_lp, lp, lp_bytes);
+        unsigned char *new_lp;
+        if (streamNodeIsStub(lp)) {
+            /* The copy gets the node in memory. */
+            new_lp = streamTierReadNode(ri.data);
+        } else {
+            lp_bytes = lpBytes(lp);
+            new_lp = zmalloc(lp_bytes);
+            memcpy(new_lp, lp, lp_bytes);
+        }
         memcpy(rax_key, ri.key, sizeof(rax_key));
         raxInsert(new_s->rax, (unsigned char *)&rax_key, sizeof(rax_key),
                   new_lp, NULL);
@@ -195,6 +236,32 @@ robj *streamDup(robj *o) {
     new_s->entries_added = s->entries_added;
     raxStop(&ri);
 
+    /* Idempotency keys */
+    if (s->idmp) {
+        raxStart(&ri,s->idmp->ids);
+        raxSeek(&ri,"^",NULL,0);
+        while (raxNext(&ri)) {
+            streamID id;
+            streamDecodeID(ri.key,&id);
+            streamIdmpAdd(new_s,ri.data,&id);
+        }
+        raxStop(&ri);
+    }
+
+    /* Out of line values. The copy gets its own blobs: the handles inside
+     * the listpacks stay valid since they are copied verbatim. */
+    if (s->blobs) {
+        raxStart(&ri,s->blobs);
+        raxSeek(&ri,"^",NULL,0);
+        while (raxNext(&ri)) {
+            uint64_t handle;
+            memcpy(&handle,ri.key,sizeof(handle));
+            streamBlobInsert(new_s,ntohu64(handle),sdsdup(ri.data));
+        }
+        raxStop(&ri);
+        new_s->blobs_next = s->blobs_next;
+    }
+
     if (s->cgroups == NULL) return sobj;
 
     /* Consumer Groups */
@@ -208,6 +275,8 @@ robj *streamDup(robj *o) {
                                           cg->entries_read);
 
         serverAssert(new_cg != NULL);
+        new_cg->max_deliveries = cg->max_deliveries;
+        if (cg->dlq_key) new_cg->dlq_key = createStringObject(cg->dlq_key->ptr,sdslen(cg->dlq_key->ptr));
 
         /* Consumer Group PEL */
         raxIterator ri_cg_pel;
@@ -345,6 +414,60 @@ int lpGetEdgeStreamID(unsigned char *lp, int first, streamID *master_id, streamI
    return 1;
 }
 
+/* Return the flags field of the first entry of the listpack 'lp', or NULL
+ * if there are no entries. The number of fields of the master entry is
+ * stored at 'master_fields_count', to be passed to lpNextStreamEntry(). */
+static unsigned char *lpFirstStreamEntry(unsigned char *lp, int64_t *master_fields_count) {
+    unsigned char *p = lpFirst(lp);
+    p = lpNext(lp,p); /* Skip deleted count. */
+    p = lpNext(lp,p); /* Seek num fields. */
+    *master_fields_count = lpGetInteger(p);
+    p = lpNext(lp,p); /* Skip num fields. */
+    for (int64_t j = 0; j < *master_fields_count; j++)
+        p = lpNext(lp,p); /* Skip all master fields. */
+    return lpNext(lp,p); /* Skip the zero master entry terminator. */
+}
+
+/* Return the flags field of the entry following the one at 'p', or NULL
+ * if it was the last one. */
+static unsigned char *lpNextStreamEntry(unsigned char *lp, unsigned char *p, int64_t master_fields_count) {
+    int64_t flags = lpGetInteger(p);
+    int64_t to_skip = 3; /* flags + ms-diff + seq-diff. */
+    if (flags & STREAM_ITEM_FLAG_SAMEFIELDS) {
+        to_skip += master_fields_count;
+    } else {
+        unsigned char *nf = lpNext(lp,lpNext(lp,lpNext(lp,p)));
+        to_skip += 1 + lpGetInteger(nf)*2;
+    }
+    if (flags & STREAM_ITEM_FLAG_LARGEVALUES) to_skip++; /* Values mask. */
+    while (to_skip--) p = lpNext(lp,p);
+    return lpNext(lp,p); /* Skip the lp-count field. */
+}
+
+/* Fill the fields of 'stub' describing the content of the node 'lp', whose
+ * master entry ID is 'master_id'. Used when the node is moved to the tier
+ * file, so that trimming can drop it without reading it back. */
+void streamNodeDescribe(unsigned char *lp, streamID *master_id, streamNodeStub *stub) {
+    stub->entries = lpGetInteger(lpFirst(lp));
+    lpGetEdgeStreamID(lp,0,master_id,&stub->last_id);
+
+    /* The first entry not marked as deleted. */
+    int64_t master_fields_count;
+    unsigned char *p = lpFirstStreamEntry(lp,&master_fields_count);
+    stub->first_id = stub->last_id;
+    while (p) {
+        int64_t flags = lpGetInteger(p);
+        if (!(flags & STREAM_ITEM_FLAG_DELETED)) {
+            unsigned char *e = lpNext(lp,p);
+            stub->first_id.ms = master_id->ms + lpGetInteger(e);
+            e = lpNext(lp,e);
+            stub->first_id.seq = master_id->seq + lpGetInteger(e);
+            break;
+        }
+        p = lpNextStreamEntry(lp,p,master_fields_count);
+    }
+}
+
 /* Debugging function to log the full content of a listpack. Useful
  * for development and debugging. */
 void streamLogListpackContent(unsigned char *lp) {
@@ -393,6 +516,20 @@ int streamCompareID(streamID *a, streamID *b) {
  * set the'skip_tombstones' argument to 1. */
 void streamGetEdgeID(stream *s, int first, int skip_tombstones, streamID *edge_id)
 {
+    /* If the first node is on disk its stub knows the first valid entry, so
+     * there is no need to read it back. */
+    if (first && skip_tombstones && raxSize(s->rax)) {
+        raxIterator ri;
+        raxStart(&ri,s->rax);
+        raxSeek(&ri,"^",NULL,0);
+        raxNext(&ri);
+        raxStop(&ri);
+        if (streamNodeIsStub(ri.data)) {
+            *edge_id = ((streamNodeStub*)ri.data)->first_id;
+            return;
+        }
+    }
+
     streamIterator si;
     int64_t numfields;
     streamIteratorStart(&si,s,NULL,NULL,!first);
@@ -464,8 +601,14 @@ int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_
      * can only host up to 32bit length strings, and also a total listpack size
      * can't be bigger than 32bit length. */
     size_t totelelen = 0;
+    int64_t large_values = 0;
     for (int64_t i = 0; i < numfields*2; i++) {
         sds ele = argv[i]->ptr;
+        /* Values stored out of line don't count for the node size. */
+        if (i % 2 && streamValueIsLarge(ele)) {
+            large_values++;
+            continue;
+        }
         totelelen += sdslen(ele);
     }
     if (totelelen > STREAM_LISTPACK_MAX_SIZE) {
@@ -482,8 +625,11 @@ int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_
     unsigned char *lp = NULL;   /* Tail listpack pointer. */
 
     if (!raxEOF(&ri)) {
-        /* Get a reference to the tail node listpack. */
+        /* Get a reference to the tail node listpack. The tail node is never
+         * moved to disk, but it may become the tail after the newer nodes
+         * are deleted. */
         lp = ri.data;
+        if (streamNodeIsStub(lp)) lp = streamTierFaultIn(s,ri.key);
         lp_bytes = lpBytes(lp);
     }
     raxStop(&ri);
@@ -589,7 +735,10 @@ int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_
 
         /* Update count and skip the deleted fields. */
         int64_t count = lpGetInteger(lp_ele);
+        size_t lp_bytes_before = lpBytes(lp);
         lp = lpReplaceInteger(lp,&lp_ele,count+1);
+        /* A count taking more bytes moves the entries. */
+        if (lpBytes(lp) != lp_bytes_before) s->epoch++;
         lp_ele = lpNext(lp,lp_ele); /* seek deleted. */
         lp_ele = lpNext(lp,lp_ele); /* seek master entry num fields. */
 
@@ -636,18 +785,35 @@ int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_
      * that compose the entry, so that it's possible to travel the entry
      * in reverse order: we can just start from the end of the listpack, read
      * the entry, and jump back N times to seek the "flags" field to read
-     * the stream full entry. */
+     * the stream full entry.
+     *
+     * Entries with values stored out of line also have the values mask
+     * before the fields, see the "Out of line values" section. */
+    unsigned char *mask = NULL;
+    if (large_values) {
+        flags |= STREAM_ITEM_FLAG_LARGEVALUES;
+        mask = zcalloc((numfields+7)/8);
+        for (int64_t i = 0; i < numfields; i++) {
+            if (streamValueIsLarge((sds)argv[i*2+1]->ptr))
+                mask[i/8] |= 1<<(i%8);
+        }
+    }
     lp = lpAppendInteger(lp,flags);
     lp = lpAppendInteger(lp,id.ms - master_id.ms);
     lp = lpAppendInteger(lp,id.seq - master_id.seq);
     if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS))
         lp = lpAppendInteger(lp,numfields);
+    if (mask) lp = lpAppend(lp,mask,(numfields+7)/8);
     for (int64_t i = 0; i < numfields; i++) {
         sds field = argv[i*2]->ptr, value = argv[i*2+1]->ptr;
         if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS))
             lp = lpAppend(lp,(unsigned char*)field,sdslen(field));
-        lp = lpAppend(lp,(unsigned char*)value,sdslen(value));
+        if (mask && streamValueIsOutOfLine(mask,i))
+            lp = lpAppendInteger(lp,streamBlobAdd(s,value));
+        else
+            lp = lpAppend(lp,(unsigned char*)value,sdslen(value));
     }
+    zfree(mask);
     /* Compute and store the lp-count field. */
     int64_t lp_count = numfields;
     lp_count += 3; /* Add the 3 fixed fields flags + ms-diff + seq-diff. */
@@ -656,6 +822,7 @@ int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_
          * the values, and an additional num-fields field. */
         lp_count += numfields+1;
     }
+    if (flags & STREAM_ITEM_FLAG_LARGEVALUES) lp_count++; /* Values mask. */
     lp = lpAppendInteger(lp,lp_count);
 
     /* Insert back into the tree in order to update the listpack pointer. */
@@ -675,6 +842,7 @@ typedef struct {
     int id_given; /* Was an ID different than "*" specified? for XADD only. */
     int seq_given; /* Was an ID different than "ms-*" specified? for XADD only. */
     int no_mkstream; /* if set to 1 do not create new stream */
+    robj *idmp_key; /* Idempotency key, NULL if not given. */
     long long delay; /* Delay in milliseconds */
     long long expire; /* Expiration in milliseconds */
 
@@ -747,6 +915,8 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
 
     if (trim_strategy == TRIM_STRATEGY_NONE)
         return 0;
+    if (trim_strategy != TRIM_STRATEGY_MAXLEN || s->length > maxlen)
+        streamFinishRangeReplies(NULL,NULL,s);
 
     raxIterator ri;
     raxStart(&ri,s->rax);
@@ -758,8 +928,17 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
         if (trim_strategy == TRIM_STRATEGY_MAXLEN && s->length <= maxlen)
             break;
 
-        unsigned char *lp = ri.data, *p = lpFirst(lp);
-        int64_t entries = lpGetInteger(p);
+        /* Nodes on disk can be removed without reading them back, unless
+         * the out of line values of their entries have to be freed. */
+        unsigned char *lp = ri.data, *p;
+        streamNodeStub *stub = NULL;
+        if (streamNodeIsStub(lp)) {
+            if (streamBlobsLength(s))
+                lp = streamTierFaultIn(s,ri.key);
+            else
+                stub = ri.data;
+        }
+        int64_t entries = stub ? stub->entries : lpGetInteger(lpFirst(lp));
 
         /* Check if we exceeded the amount of work we could do */
         if (limit && (deleted + entries) > limit)
@@ -775,14 +954,22 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
         } else {
             /* Read last ID. */
             streamID last_id = {0,0};
-            lpGetEdgeStreamID(lp, 0, &master_id, &last_id);
+            if (stub)
+                last_id = stub->last_id;
+            else
+                lpGetEdgeStreamID(lp, 0, &master_id, &last_id);
 
             /* We can remove the entire node id its last ID < 'id' */
             remove_node = streamCompareID(&last_id, id) < 0;
         }
 
         if (remove_node) {
-            lpFree(lp);
+            if (stub) {
+                streamTierFreeStub(stub);
+            } else {
+                streamFreeNodeBlobs(s,lp);
+                lpFree(lp);
+            }
             raxRemove(s->rax,ri.key,ri.key_len,NULL);
             raxSeek(&ri,">=",ri.key,ri.key_len);
             s->length -= entries;
@@ -798,7 +985,9 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
 
         /* Now we have to trim entries from within 'lp' */
         int64_t deleted_from_lp = 0;
+        if (stub) lp = streamTierFaultIn(s,ri.key);
 
+        p = lpFirst(lp);
         p = lpNext(lp, p); /* Skip deleted field. */
         p = lpNext(lp, p); /* Skip num-of-fields in the master entry. */
 
@@ -848,14 +1037,19 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
                 p = lpNext(lp,p); /* Skip num-fields. */
                 to_skip *= 2; /* Fields and values. */
             }
+            if (flags & STREAM_ITEM_FLAG_LARGEVALUES) to_skip++; /* Mask. */
 
             while(to_skip--) p = lpNext(lp,p); /* Skip the whole entry. */
             p = lpNext(lp,p); /* Skip the final lp-count field. */
 
             /* Mark the entry as deleted. */
             if (!(flags & STREAM_ITEM_FLAG_DELETED)) {
+                /* Dropping the values mask shrinks the entry. */
                 intptr_t delta = p - lp;
-                flags |= STREAM_ITEM_FLAG_DELETED;
+                size_t oldbytes = lpBytes(lp);
+                lp = streamReleaseEntryBlobs(s,lp,&pcopy,master_fields_count);
+                delta -= oldbytes - lpBytes(lp);
+                flags = lpGetInteger(pcopy) | STREAM_ITEM_FLAG_DELETED;
                 lp = lpReplaceInteger(lp, &pcopy, flags);
                 deleted_from_lp++;
                 s->length--;
@@ -889,6 +1083,7 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
                   node, so no need to go to the next node. */
     }
     raxStop(&ri);
+    if (deleted) s->epoch++;
 
     /* Update the stream's first ID after the trimming. */
     if (s->length == 0) {
@@ -939,7 +1134,6 @@ static int streamParseAddOrTrimArgsOrReply(client *c, streamAddTrimArgs *args, i
     int i = 2; /* This is the first argument position where we could
                   find an option, or the ID. */
     int limit_given = 0;
-    char buf[LONG_STR_SIZE] = {0};
     robj *expireArg = NULL;
     for (; i < c->argc; i++) {
         int moreargs = (c->argc-1) - i; /* Number of additional arguments. */
@@ -1011,6 +1205,9 @@ static int streamParseAddOrTrimArgsOrReply(client *c, streamAddTrimArgs *args, i
             i++;
         } else if (xadd && !strcasecmp(opt,"nomkstream")) {
             args->no_mkstream = 1;
+        } else if (xadd && !strcasecmp(opt,"idempotent") && moreargs) {
+            args->idmp_key = c->argv[i+1];
+            i++;
         } else if (!strcasecmp(opt,"ex") && moreargs) {
             /* Check expiration time if set before. */
             if (args->expire > 0) {
@@ -1025,13 +1222,10 @@ static int streamParseAddOrTrimArgsOrReply(client *c, streamAddTrimArgs *args, i
                 addReplyError(c,"The EX argument must be >= 0.");
                 return -1;
             }
-            expireArg = createObject(OBJ_STRING, sdsnew("PXAT"));
             args->expire = args->expire * 1000 + commandTimeSnapshot();
-            rewriteClientCommandArgument(c, i, expireArg);
-            decrRefCount(expireArg);
+            rewriteClientCommandArgument(c, i, shared.pxat);
             i++;
-            ll2string(buf, sizeof(buf), args->expire);
-            expireArg = createObject(OBJ_STRING, sdsnew((const char *) buf));
+            expireArg = createStringObjectFromLongLong(args->expire);
             rewriteClientCommandArgument(c, i, expireArg);
             decrRefCount(expireArg);
         } else if (!strcasecmp(opt,"exat") && moreargs) {
@@ -1048,13 +1242,10 @@ static int streamParseAddOrTrimArgsOrReply(client *c, streamAddTrimArgs *args, i
                 addReplyError(c,"The EXAT argument must be >= 0.");
                 return -1;
             }
-            expireArg = createObject(OBJ_STRING, sdsnew("PXAT"));
             args->expire *= 1000;
-            rewriteClientCommandArgument(c, i, expireArg);
-            decrRefCount(expireArg);
+            rewriteClientCommandArgument(c, i, shared.pxat);
             i++;
-            ll2string(buf, sizeof(buf), args->expire);
-            expireArg = createObject(OBJ_STRING, sdsnew((const char *) buf));
+            expireArg = createStringObjectFromLongLong(args->expire);
             rewriteClientCommandArgument(c, i, expireArg);
             decrRefCount(expireArg);
         } else if (!strcasecmp(opt,"px") && moreargs) {
@@ -1071,13 +1262,10 @@ static int streamParseAddOrTrimArgsOrReply(client *c, streamAddTrimArgs *args, i
                 addReplyError(c,"The PX argument must be >= 0.");
                 return -1;
             }
-            expireArg = createObject(OBJ_STRING, sdsnew("PXAT"));
             args->expire += commandTimeSnapshot();
-            rewriteClientCommandArgument(c, i, expireArg);
-            decrRefCount(expireArg);
+            rewriteClientCommandArgument(c, i, shared.pxat);
             i++;
-            ll2string(buf, sizeof(buf), args->expire);
-            expireArg = createObject(OBJ_STRING, sdsnew((const char *) buf));
+            expireArg = createStringObjectFromLongLong(args->expire);
             rewriteClientCommandArgument(c, i, expireArg);
             decrRefCount(expireArg);
         } else if (!strcasecmp(opt,"pxat") && moreargs) {
@@ -1313,6 +1501,60 @@ void streamIteratorStart(streamIterator *si, stream *s, streamID *start, streamI
     si->skip_tombstones = 1;    /* By default tombstones aren't emitted. */
 }
 
+/* Like streamIteratorStart() for a forward iteration from 'start' to 'end',
+ * where 'start' is the ID following the last one delivered to the group
+ * 'cg': the iterator is positioned using the cursor of the group, without
+ * seeking 'start' inside the node. Return 0 if the cursor can't be used, in
+ * which case the iterator must be started with streamIteratorStart(). */
+static int streamIteratorStartFromCursor(streamIterator *si, stream *s, streamCG *cg, streamID *start, streamID *end) {
+    streamCGCursor *cur = &cg->cursor;
+    if (cur->offset == 0 || cur->epoch != s->epoch ||
+        streamCompareID(&cur->id,&cg->last_id) != 0) return 0;
+    streamID next = cur->id;
+    if (streamIncrID(&next) != C_OK || streamCompareID(&next,start) != 0)
+        return 0;
+
+    raxStart(&si->ri,s->rax);
+    raxSeek(&si->ri,"=",cur->nodekey,sizeof(cur->nodekey));
+    if (!raxNext(&si->ri) || streamNodeIsStub(si->ri.data)) {
+        raxStop(&si->ri);
+        return 0;
+    }
+
+    /* Set up the current node like streamIteratorGetID() does. */
+    si->lp = si->ri.data;
+    streamDecodeID(si->ri.key,&si->master_id);
+    unsigned char *p = lpFirst(si->lp);     /* Seek items count */
+    p = lpNext(si->lp,p);                   /* Seek deleted count. */
+    p = lpNext(si->lp,p);                   /* Seek num fields. */
+    si->master_fields_count = lpGetInteger(p);
+    si->master_fields_start = lpNext(si->lp,p);
+    /* The lp-count field of the last entry delivered: the next call to
+     * streamIteratorGetID() seeks the entry after it. */
+    si->lp_ele = si->lp + cur->offset;
+
+    streamEncodeID(si->start_key,start);
+    if (end) {
+        streamEncodeID(si->end_key,end);
+    } else {
+        si->end_key[0] = UINT64_MAX;
+        si->end_key[1] = UINT64_MAX;
+    }
+    si->stream = s;
+    si->rev = 0;
+    si->skip_tombstones = 1;
+    return 1;
+}
+
+/* Remember in the cursor of the group 'cg' that the entry 'id', whose
+ * lp-count field is at 'lp_ele', was the last one delivered. */
+static void streamSaveCGCursor(stream *s, streamCG *cg, streamIterator *si, unsigned char *lp_ele, streamID *id) {
+    cg->cursor.epoch = s->epoch;
+    cg->cursor.id = *id;
+    memcpy(cg->cursor.nodekey,si->ri.key,sizeof(cg->cursor.nodekey));
+    cg->cursor.offset = lp_ele - si->lp;
+}
+
 /* Return 1 and store the current item ID at 'id' if there are still
  * elements within the iteration range, otherwise return 0 in order to
  * signal the iteration terminated. */
@@ -1327,8 +1569,12 @@ int streamIteratorGetID(streamIterator *si, streamID *id, int64_t *numfields) {
             serverAssert(si->ri.key_len == sizeof(streamID));
             /* Get the master ID. */
             streamDecodeID(si->ri.key,&si->master_id);
-            /* Get the master fields count. */
+            /* Get the master fields count. Nodes on disk are read back
+             * synchronously: the commands that can afford waiting already
+             * did it calling streamTierBlockClient(). */
             si->lp = si->ri.data;
+            if (streamNodeIsStub(si->lp))
+                si->lp = streamTierFaultIn(si->stream,si->ri.key);
             si->lp_ele = lpFirst(si->lp);           /* Seek items count */
             si->lp_ele = lpNext(si->lp,si->lp_ele); /* Seek deleted count. */
             si->lp_ele = lpNext(si->lp,si->lp_ele); /* Seek num fields. */
@@ -1407,6 +1653,15 @@ int streamIteratorGetID(streamIterator *si, streamID *id, int64_t *numfields) {
             }
             serverAssert(*numfields>=0);
 
+            /* Then the mask of the values stored out of line, if any. */
+            si->values_mask = NULL;
+            si->value_idx = 0;
+            if (flags & STREAM_ITEM_FLAG_LARGEVALUES) {
+                int64_t masklen;
+                si->values_mask = lpGet(si->lp_ele,&masklen,si->mask_buf);
+                si->lp_ele = lpNext(si->lp,si->lp_ele);
+            }
+
             /* If current >= start, and the entry is not marked as
              * deleted or tombstones are included, emit it. */
             if (!si->rev) {
@@ -1448,6 +1703,8 @@ int streamIteratorGetID(streamIterator *si, streamID *id, int64_t *numfields) {
                 /* If the entry was not flagged SAMEFIELD we also read the
                  * number of fields, so go back one more. */
                 if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS)) prev_times++;
+                /* The same for the values mask. */
+                if (flags & STREAM_ITEM_FLAG_LARGEVALUES) prev_times++;
                 while(prev_times--) si->lp_ele = lpPrev(si->lp,si->lp_ele);
             }
         }
@@ -1470,7 +1727,15 @@ void streamIteratorGetField(streamIterator *si, unsigned char **fieldptr, unsign
         *fieldptr = lpGet(si->lp_ele,fieldlen,si->field_buf);
         si->lp_ele = lpNext(si->lp,si->lp_ele);
     }
-    *valueptr = lpGet(si->lp_ele,valuelen,si->value_buf);
+    if (si->values_mask && streamValueIsOutOfLine(si->values_mask,si->value_idx)) {
+        sds blob = streamBlobLookup(si->stream,lpGetInteger(si->lp_ele));
+        serverAssert(blob != NULL);
+        *valueptr = (unsigned char*)blob;
+        *valuelen = sdslen(blob);
+    } else {
+        *valueptr = lpGet(si->lp_ele,valuelen,si->value_buf);
+    }
+    si->value_idx++;
     si->lp_ele = lpNext(si->lp,si->lp_ele);
 }
 
@@ -1492,7 +1757,11 @@ void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
      * deleted by flagging it, and also incrementing the count of the
      * deleted entries in the listpack header.
      *
-     * We start flagging: */
+     * We start finishing the range replies in progress, that promised this
+     * entry, and freeing the values stored out of line, then flagging: */
+    streamFinishRangeReplies(NULL,NULL,si->stream);
+    lp = streamReleaseEntryBlobs(si->stream,lp,&si->lp_flags,si->master_fields_count);
+    si->stream->epoch++;
     int64_t flags = lpGetInteger(si->lp_flags);
     flags |= STREAM_ITEM_FLAG_DELETED;
     lp = lpReplaceInteger(lp,&si->lp_flags,flags);
@@ -1558,6 +1827,19 @@ int streamEntryExists(stream *s, streamID *id) {
     return 1;
 }
 
+/* Return 1 if `s` has at least one entry (not marked as deleted) in the
+ * inclusive range `start`..`end`. Only the first entry of the range is
+ * visited, so this is cheap even for very large ranges. */
+int streamRangeHasEntries(stream *s, streamID *start, streamID *end) {
+    streamIterator si;
+    streamIteratorStart(&si,s,start,end,0);
+    streamID myid;
+    int64_t numfields;
+    int found = streamIteratorGetID(&si,&myid,&numfields);
+    streamIteratorStop(&si);
+    return found;
+}
+
 /* Delete the specified item ID from the stream, returning 1 if the item
  * was deleted 0 otherwise (if it does not exist). */
 int streamDeleteItem(stream *s, streamID *id) {
@@ -1616,6 +1898,16 @@ robj *createObjectFromStreamID(streamID *id) {
     return createObject(OBJ_STRING, createStreamIDString(id));
 }
 
+/* Like createObjectFromStreamID() but the object lives in the propagation
+ * arena, see createPropagateStringObject(). */
+robj *createPropagateObjectFromStreamID(streamID *id) {
+    char buf[STREAM_ID_STR_LEN];
+    int len = ull2string(buf,sizeof(buf),id->ms);
+    buf[len++] = '-';
+    len += ull2string(buf+len,sizeof(buf)-len,id->seq);
+    return createPropagateStringObject(buf,len);
+}
+
 /* Returns non-zero if the ID is 0-0. */
 int streamIDEqZero(streamID *id) {
     return !(id->ms || id->seq);
@@ -1777,20 +2069,17 @@ void streamPropagateXCLAIM(client *c, robj *key, streamCG *group, robj *groupnam
     argv[4] = shared.integers[0];
     argv[5] = id;
     argv[6] = shared.time;
-    argv[7] = createStringObjectFromLongLong(nack->delivery_time);
+    argv[7] = createPropagateStringObjectFromLongLong(nack->delivery_time);
     argv[8] = shared.retrycount;
-    argv[9] = createStringObjectFromLongLong(nack->delivery_count);
+    argv[9] = createPropagateStringObjectFromLongLong(nack->delivery_count);
     argv[10] = shared.force;
     argv[11] = shared.justid;
     argv[12] = shared.lastid;
-    argv[13] = createObjectFromStreamID(&group->last_id);
+    argv[13] = createPropagateObjectFromStreamID(&group->last_id);
 
     alsoPropagate(c->db->id,argv,14,PROPAGATE_AOF|PROPAGATE_REPL);
 
     decrRefCount(argv[3]);
-    decrRefCount(argv[7]);
-    decrRefCount(argv[9]);
-    decrRefCount(argv[13]);
 }
 
 /* We need this when we want to propagate the new last-id of a consumer group
@@ -1805,14 +2094,11 @@ void streamPropagateGroupID(client *c, robj *key, streamCG *group, robj *groupna
     argv[1] = shared.setid;
     argv[2] = key;
     argv[3] = groupname;
-    argv[4] = createObjectFromStreamID(&group->last_id);
+    argv[4] = createPropagateObjectFromStreamID(&group->last_id);
     argv[5] = shared.entriesread;
-    argv[6] = createStringObjectFromLongLong(group->entries_read);
+    argv[6] = createPropagateStringObjectFromLongLong(group->entries_read);
 
     alsoPropagate(c->db->id,argv,7,PROPAGATE_AOF|PROPAGATE_REPL);
-
-    decrRefCount(argv[4]);
-    decrRefCount(argv[6]);
 }
 
 /* We need this when we want to propagate creation of consumer that was created
@@ -1907,7 +2193,9 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
 
     if (!(flags & STREAM_RWR_RAWENTRIES))
         arraylen_ptr = addReplyDeferredLen(c);
-    streamIteratorStart(&si,s,start,end,rev);
+    /* Consumers reading new entries resume where the group stopped. */
+    if (!group || rev || !streamIteratorStartFromCursor(&si,s,group,start,end))
+        streamIteratorStart(&si,s,start,end,rev);
     while(streamIteratorGetID(&si,&id,&numfields)) {
         /* Update the group last_id if needed. */
         if (group && streamCompareID(&id,&group->last_id) > 0) {
@@ -1943,6 +2231,10 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
             addReplyBulkCBuffer(c,value,value_len);
         }
 
+        /* The iterator now points to the lp-count field of the entry. */
+        if (group && !rev && streamCompareID(&id,&group->last_id) == 0)
+            streamSaveCGCursor(s,group,&si,si.lp_ele,&id);
+
         /* If a group is passed, we need to create an entry in the
          * PEL (pending entries list) of this group *and* this consumer.
          *
@@ -2055,6 +2347,276 @@ size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start
     return arraylen;
 }
 
+/* -----------------------------------------------------------------------
+ * Idempotent producers
+ * ----------------------------------------------------------------------- */
+
+/* Lookup the idempotency key 'key' in the stream 's'. If found, the ID of
+ * the entry appended with such key is stored in 'id' and 1 is returned,
+ * otherwise 0 is returned. */
+int streamIdmpLookup(stream *s, sds key, streamID *id) {
+    if (s->idmp == NULL) return 0;
+    streamID *found = raxFind(s->idmp->keys,(unsigned char*)key,sdslen(key));
+    if (found == raxNotFound) return 0;
+    *id = *found;
+    return 1;
+}
+
+/* Remember that the entry 'id' was appended to 's' with the idempotency key
+ * 'key'. Returns 0 if the key or the ID were already known, in that case
+ * nothing is done, otherwise 1 is returned. */
+int streamIdmpAdd(stream *s, sds key, streamID *id) {
+    if (s->idmp == NULL) {
+        s->idmp = zmalloc(sizeof(*s->idmp));
+        s->idmp->keys = raxNew();
+        s->idmp->ids = raxNew();
+    }
+
+    unsigned char buf[sizeof(streamID)];
+    streamEncodeID(buf,id);
+    if (raxFind(s->idmp->keys,(unsigned char*)key,sdslen(key)) != raxNotFound ||
+        raxFind(s->idmp->ids,buf,sizeof(buf)) != raxNotFound)
+    {
+        return 0;
+    }
+
+    streamID *copy = zmalloc(sizeof(*copy));
+    *copy = *id;
+    raxInsert(s->idmp->keys,(unsigned char*)key,sdslen(key),copy,NULL);
+    raxInsert(s->idmp->ids,buf,sizeof(buf),sdsdup(key),NULL);
+    return 1;
+}
+
+/* Forget the idempotency keys of 's' whose entry ID is older than
+ * stream-idempotency-window milliseconds compared to the last ID of the
+ * stream, and the oldest ones in excess of stream-idempotency-max-keys.
+ * Only the stream IDs are used as a clock, so that the masters, the
+ * replicas and the AOF agree on the keys being remembered. */
+void streamIdmpAge(stream *s) {
+    if (s->idmp == NULL) return;
+
+    raxIterator ri;
+    raxStart(&ri,s->idmp->ids);
+    raxSeek(&ri,"^",NULL,0);
+    while (raxNext(&ri)) {
+        streamID id;
+        streamDecodeID(ri.key,&id);
+        if ((unsigned long long)raxSize(s->idmp->ids) <=
+            (unsigned long long)server.stream_idmp_max_keys &&
+            (s->last_id.ms <= id.ms ||
+             s->last_id.ms - id.ms <= (uint64_t)server.stream_idmp_window))
+        {
+            break;
+        }
+
+        sds key = ri.data;
+        void *old;
+        raxRemove(s->idmp->keys,(unsigned char*)key,sdslen(key),&old);
+        zfree(old);
+        raxRemove(s->idmp->ids,ri.key,ri.key_len,NULL);
+        sdsfree(key);
+        raxSeek(&ri,"^",NULL,0);
+    }
+    raxStop(&ri);
+}
+
+/* Return the number of idempotency keys remembered by 's'. */
+size_t streamIdmpLength(stream *s) {
+    return s->idmp ? raxSize(s->idmp->ids) : 0;
+}
+
+/* -----------------------------------------------------------------------
+ * Out of line values
+ * ----------------------------------------------------------------------- */
+
+/* Values of at least stream-large-value-threshold bytes are not copied
+ * inside the listpacks: every value is stored once in the 'blobs' tree of
+ * the stream, and the entry references it by a 64 bit handle, stored as a
+ * listpack integer in place of the value. Such entries are flagged with
+ * STREAM_ITEM_FLAG_LARGEVALUES and have an additional element, right before
+ * the values, with a bitmap telling which values are handles:
+ *
+ * +-----+--------+----------+-----------+-------+-------+-/-+--------+
+ * |flags|entry-id|num-fields|values-mask|field-1|value-1|...|lp-count|
+ * +-----+--------+----------+-----------+-------+-------+-/-+--------+
+ *
+ * The bitmap is a string of ceil(num-fields/8) bytes, the value N is out of
+ * line if the bit N%8 of the byte N/8 is set. The handles are never reused,
+ * and a blob is owned by exactly one entry, that frees it once deleted. */
+
+/* Insert the value 'blob' with the given handle, taking ownership of it.
+ * Returns 0 if the handle is already used, in that case nothing is done. */
+int streamBlobInsert(stream *s, uint64_t handle, sds blob) {
+    if (s->blobs == NULL) s->blobs = raxNew();
+    uint64_t key = htonu64(handle);
+    if (!raxTryInsert(s->blobs,(unsigned char*)&key,sizeof(key),blob,NULL))
+        return 0;
+    s->blobs_bytes += sdsAllocSize(blob);
+    if (handle >= s->blobs_next) s->blobs_next = handle+1;
+    return 1;
+}
+
+/* Store a copy of 'value' out of line, and return its new handle. */
+static uint64_t streamBlobAdd(stream *s, sds value) {
+    uint64_t handle = s->blobs_next;
+    serverAssert(streamBlobInsert(s,handle,sdsdup(value)));
+    return handle;
+}
+
+/* Return the value with the given handle, or NULL if there is no such
+ * value. */
+sds streamBlobLookup(stream *s, uint64_t handle) {
+    if (s->blobs == NULL) return NULL;
+    uint64_t key = htonu64(handle);
+    void *blob = raxFind(s->blobs,(unsigned char*)&key,sizeof(key));
+    return blob == raxNotFound ? NULL : blob;
+}
+
+/* Free the value with the given handle. */
+static void streamBlobDel(stream *s, uint64_t handle) {
+    uint64_t key = htonu64(handle);
+    void *blob;
+    serverAssert(s->blobs &&
+                 raxRemove(s->blobs,(unsigned char*)&key,sizeof(key),&blob));
+    s->blobs_bytes -= sdsAllocSize(blob);
+    sdsfree(blob);
+}
+
+/* Return the number of out of line values of 's'. */
+size_t streamBlobsLength(stream *s) {
+    return s->blobs ? raxSize(s->blobs) : 0;
+}
+
+/* Return 1 if every live entry of 's' references existing out of line values,
+ * and every out of line value is referenced, otherwise 0. Used to validate
+ * the streams loaded from untrusted payloads. */
+int streamValidateBlobs(stream *s) {
+    streamIterator si;
+    streamID id;
+    int64_t numfields;
+    size_t refs = 0;
+
+    streamIteratorStart(&si,s,NULL,NULL,0);
+    while (streamIteratorGetID(&si,&id,&numfields)) {
+        for (int64_t j = 0; j < numfields; j++) {
+            if (!(si.entry_flags & STREAM_ITEM_FLAG_SAMEFIELDS))
+                si.lp_ele = lpNext(si.lp,si.lp_ele); /* Skip the field. */
+            if (si.values_mask && streamValueIsOutOfLine(si.values_mask,j)) {
+                if (streamBlobLookup(s,lpGetInteger(si.lp_ele)) == NULL) {
+                    streamIteratorStop(&si);
+                    return 0;
+                }
+                refs++;
+            }
+            si.lp_ele = lpNext(si.lp,si.lp_ele); /* Skip the value. */
+        }
+    }
+    streamIteratorStop(&si);
+    return refs == streamBlobsLength(s);
+}
+
+/* Return 1 if some entry of 's', even deleted, is flagged with
+ * STREAM_ITEM_FLAG_LARGEVALUES, otherwise 0. Used to validate the streams
+ * loaded from the RDB types that can't hold out of line values. */
+int streamHasLargeValues(stream *s) {
+    raxIterator ri;
+    int found = 0;
+
+    raxStart(&ri,s->rax);
+    raxSeek(&ri,"^",NULL,0);
+    while (!found && raxNext(&ri)) {
+        unsigned char *lp = ri.data;
+        int64_t master_fields_count;
+        unsigned char *p = lpFirstStreamEntry(lp,&master_fields_count);
+        while (p && !found) {
+            found = (lpGetInteger(p) & STREAM_ITEM_FLAG_LARGEVALUES) != 0;
+            p = lpNextStreamEntry(lp,p,master_fields_count);
+        }
+    }
+    raxStop(&ri);
+    return found;
+}
+
+/* Free the out of line values of the entry whose flags are at 'p', inside
+ * the listpack 'lp' having 'master_fields_count' master fields. */
+static void streamFreeEntryBlobs(stream *s, unsigned char *lp, unsigned char *p, int64_t master_fields_count) {
+    int64_t flags = lpGetInteger(p);
+    if (!(flags & STREAM_ITEM_FLAG_LARGEVALUES)) return;
+
+    p = lpNext(lp,p); /* Skip flags. */
+    p = lpNext(lp,p); /* Skip ID ms delta. */
+    p = lpNext(lp,p); /* Skip ID seq delta. */
+    int64_t numfields = master_fields_count;
+    if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS)) {
+        numfields = lpGetInteger(p);
+        p = lpNext(lp,p); /* Skip num-fields. */
+    }
+
+    unsigned char buf[LP_INTBUF_SIZE];
+    int64_t masklen;
+    unsigned char *mask = lpGet(p,&masklen,buf);
+    p = lpNext(lp,p); /* Skip the values mask. */
+    for (int64_t j = 0; j < numfields; j++) {
+        if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS))
+            p = lpNext(lp,p); /* Skip the field. */
+        if (streamValueIsOutOfLine(mask,j))
+            streamBlobDel(s,lpGetInteger(p));
+        p = lpNext(lp,p); /* Skip the value. */
+    }
+}
+
+/* Like streamFreeEntryBlobs(), for the entry at '*pp' that is about to be
+ * marked as deleted: the entry also becomes a plain one, without values mask
+ * nor STREAM_ITEM_FLAG_LARGEVALUES, so that the deleted entries never need
+ * the RDB type of the out of line values (see rdbStreamType()). The handles
+ * left in place of the values are just integers.
+ *
+ * Returns the listpack, that may be reallocated, with '*pp' pointing to the
+ * flags of the entry again. */
+static unsigned char *streamReleaseEntryBlobs(stream *s, unsigned char *lp, unsigned char **pp, int64_t master_fields_count) {
+    unsigned char *p = *pp;
+    int64_t flags = lpGetInteger(p);
+    if (!(flags & STREAM_ITEM_FLAG_LARGEVALUES)) return lp;
+    streamFreeEntryBlobs(s,lp,p,master_fields_count);
+
+    size_t flags_offset = p-lp;
+    p = lpNext(lp,p); /* Skip flags. */
+    p = lpNext(lp,p); /* Skip ID ms delta. */
+    p = lpNext(lp,p); /* Skip ID seq delta. */
+    int64_t to_skip = master_fields_count;
+    if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS)) {
+        to_skip = lpGetInteger(p)*2;
+        p = lpNext(lp,p); /* Skip num-fields. */
+    }
+    size_t mask_offset = p-lp;
+    p = lpNext(lp,p); /* Skip the values mask. */
+    while (to_skip--) p = lpNext(lp,p);
+
+    /* Going backward, so that the offsets stay valid: the lp-count field
+     * first, then the mask and the flags. */
+    lp = lpReplaceInteger(lp,&p,lpGetInteger(p)-1);
+    lp = lpDelete(lp,lp+mask_offset,NULL);
+    p = lp+flags_offset;
+    lp = lpReplaceInteger(lp,&p,flags & ~STREAM_ITEM_FLAG_LARGEVALUES);
+    *pp = p;
+    return lp;
+}
+
+/* Free the out of line values of all the entries of the listpack 'lp'
+ * that are not already deleted. Called before removing a whole node. */
+static void streamFreeNodeBlobs(stream *s, unsigned char *lp) {
+    if (streamBlobsLength(s) == 0) return;
+
+    int64_t master_fields_count;
+    unsigned char *p = lpFirstStreamEntry(lp,&master_fields_count);
+    while (p) {
+        int64_t flags = lpGetInteger(p);
+        if (!(flags & STREAM_ITEM_FLAG_DELETED))
+            streamFreeEntryBlobs(s,lp,p,master_fields_count);
+        p = lpNextStreamEntry(lp,p,master_fields_count);
+    }
+}
+
 /* -----------------------------------------------------------------------
  * Stream commands implementation
  * ----------------------------------------------------------------------- */
@@ -2275,24 +2837,19 @@ static int streamSetItemExpire(client *c, redisDb *db, robj *key, int stream_dbi
         robj *timeout_object = createObject(OBJ_STRING, value);
         dbAdd(db, key_object, timeout_object);
         /* Propagate as SET expire timer key for AOF/replication propagation. */
-        argv[0] = createObject(OBJ_STRING, sdsnew("SET"));
+        argv[0] = shared.set;
         argv[1] = key_object;
         argv[2] = timeout_object;
         alsoPropagate(db->id, argv, 3, PROPAGATE_AOF|PROPAGATE_REPL);
-        decrRefCount(argv[0]);
     }
     setExpire(c, db, key_object, timeoutAt);
     signalModifiedKey(c, db, key_object);
     notifyKeyspaceEvent(NOTIFY_STREAM, "expire", key_object, db->id);
     /* Propagate as PEXPIREAT expirae timer key for AOF/replication propagation. */
-    char buf[LONG_STR_SIZE] = {0};
-    ll2string(buf, sizeof(buf), timeoutAt);
-    argv[0] = createObject(OBJ_STRING, sdsnew("PEXPIREAT"));
+    argv[0] = shared.pexpireat;
     argv[1] = key_object;
-    argv[2] = createObject(OBJ_STRING, sdsnew((const char *) buf));
+    argv[2] = createPropagateStringObjectFromLongLong(timeoutAt);
     alsoPropagate(db->id, argv, 3, PROPAGATE_AOF | PROPAGATE_REPL);
-    decrRefCount(argv[0]);
-    decrRefCount(argv[2]);
     decrRefCount(key_object);
     server.dirty++;
     return C_OK;
@@ -2325,7 +2882,7 @@ static int streamSetItemDelay(client *c, redisDb *db, int delay_option, int fiel
     int argc = numdata + 2;
     robj **argv = (robj **) zmalloc(argc * sizeof(robj *));
     robj *lobj = createListListpackObject();
-    argv[0] = createObject(OBJ_STRING, sdsnew("RPUSH"));
+    argv[0] = shared.rpush;
     argv[1] = data_object;
     listTypeTryConversionAppend(lobj, c->argv, field_pos, (field_pos + numdata - 1), NULL, NULL);
     for (int i = 0; i < numdata; i++) {
@@ -2341,7 +2898,6 @@ static int streamSetItemDelay(client *c, redisDb *db, int delay_option, int fiel
     /* Propagate as RPUSH a list with delay item data for
      * AOF/replication propagation. */
     alsoPropagate(db->id, argv, argc, PROPAGATE_AOF | PROPAGATE_REPL);
-    decrRefCount(argv[0]);
     server.dirty++;
 
     /* Add expiration key as delay timer. */
@@ -2352,20 +2908,15 @@ static int streamSetItemDelay(client *c, redisDb *db, int delay_option, int fiel
     signalModifiedKey(c, db, key_object);
     notifyKeyspaceEvent(NOTIFY_STREAM, "expire", key_object, db->id);
     /* Propagate as SET delay timer key for AOF/replication propagation. */
-    argv[0] = createObject(OBJ_STRING, sdsnew("SET"));
+    argv[0] = shared.set;
     argv[1] = key_object;
     argv[2] = timeout_object;
     alsoPropagate(db->id, argv, 3, PROPAGATE_AOF | PROPAGATE_REPL);
-    decrRefCount(argv[0]);
     /* Propagate as PEXPIREAT delay timer key for AOF/replication propagation. */
-    char buf[LONG_STR_SIZE] = {0};
-    ll2string(buf, sizeof(buf), timeout_at);
-    argv[0] = createObject(OBJ_STRING, sdsnew("PEXPIREAT"));
+    argv[0] = shared.pexpireat;
     argv[1] = key_object;
-    argv[2] = createObject(OBJ_STRING, sdsnew((const char *) buf));
+    argv[2] = createPropagateStringObjectFromLongLong(timeout_at);
     alsoPropagate(db->id, argv, 3, PROPAGATE_AOF | PROPAGATE_REPL);
-    decrRefCount(argv[0]);
-    decrRefCount(argv[2]);
     zfree(argv);
     server.dirty++;
     ok = 1;
@@ -2440,6 +2991,16 @@ void xaddCommand(client *c) {
     s = o->ptr;
     parsed_args.streamkey = c->argv[1];
 
+    /* If this is the retry of an append that already happened, just reply
+     * with the ID of the original entry, the stream is not modified. */
+    streamID id;
+    if (parsed_args.idmp_key &&
+        streamIdmpLookup(s,parsed_args.idmp_key->ptr,&id))
+    {
+        addReplyStreamID(c,&id);
+        return;
+    }
+
     /* Return ASAP if the stream has reached the last possible ID */
     if (s->last_id.ms == UINT64_MAX && s->last_id.seq == UINT64_MAX) {
         addReplyError(c,"The stream has exhausted the last possible ID, "
@@ -2449,7 +3010,6 @@ void xaddCommand(client *c) {
 
     /* Append using the low level function and return the ID. */
     errno = 0;
-    streamID id;
     if (streamAppendItem(s,c->argv+field_pos,(c->argc-field_pos)/2,
         &id,parsed_args.id_given ? &parsed_args.id : NULL,parsed_args.seq_given) == C_ERR)
     {
@@ -2462,6 +3022,11 @@ void xaddCommand(client *c) {
         return;
     }
 
+    if (parsed_args.idmp_key) {
+        streamIdmpAdd(s,parsed_args.idmp_key->ptr,&id);
+        streamIdmpAge(s);
+    }
+
     /* If stream item expiration given and greater than 0,
      * set expiration on current item. */
     if (parsed_args.expire > 0) {
@@ -2547,6 +3112,270 @@ void xdelayCommand(client *c) {
     preventCommandPropagation(c);
 }
 
+/* Return the number of entries of 's' between 'start' and 'end' inclusive.
+ * Only the nodes at the edges of the range are scanned, the entries of the
+ * others being counted from their header. */
+static uint64_t streamRangeLength(stream *s, streamID *start, streamID *end) {
+    unsigned char start_key[sizeof(streamID)];
+    streamEncodeID(start_key,start);
+
+    raxIterator ri;
+    raxStart(&ri,s->rax);
+    raxSeek(&ri,"<=",start_key,sizeof(start_key));
+    if (raxEOF(&ri)) raxSeek(&ri,"^",NULL,0);
+
+    uint64_t len = 0;
+    while (raxNext(&ri)) {
+        streamID master_id, last_id;
+        streamDecodeID(ri.key,&master_id);
+        if (streamCompareID(&master_id,end) > 0) break;
+
+        unsigned char *lp = ri.data;
+        if (streamNodeIsStub(lp)) {
+            streamNodeStub *stub = ri.data;
+            if (streamCompareID(&stub->first_id,start) >= 0 &&
+                streamCompareID(&stub->last_id,end) <= 0)
+            {
+                len += stub->entries;
+                continue;
+            }
+            lp = streamTierFaultIn(s,ri.key);
+        }
+
+        /* Entries are never smaller than the master entry ID. */
+        lpGetEdgeStreamID(lp,0,&master_id,&last_id);
+        if (streamCompareID(&master_id,start) >= 0 &&
+            streamCompareID(&last_id,end) <= 0)
+        {
+            len += lpGetInteger(lpFirst(lp));
+            continue;
+        }
+
+        int64_t master_fields_count;
+        unsigned char *p = lpFirstStreamEntry(lp,&master_fields_count);
+        while (p) {
+            int64_t flags = lpGetInteger(p);
+            if (!(flags & STREAM_ITEM_FLAG_DELETED)) {
+                streamID id;
+                unsigned char *e = lpNext(lp,p);
+                id.ms = master_id.ms + lpGetInteger(e);
+                e = lpNext(lp,e);
+                id.seq = master_id.seq + lpGetInteger(e);
+                if (streamCompareID(&id,start) >= 0 &&
+                    streamCompareID(&id,end) <= 0) len++;
+            }
+            p = lpNextStreamEntry(lp,p,master_fields_count);
+        }
+    }
+    raxStop(&ri);
+    return len;
+}
+
+/* What is left to send of a range reply produced in slices. */
+typedef struct streamRangeReply {
+    robj *key;              /* The stream, looked up again at every slice. */
+    stream *s;              /* The stream when the command was called, only
+                               compared by streamFinishRangeReplies(). */
+    streamID start;         /* Range still to be emitted. */
+    streamID end;
+    int rev;                /* Entries are emitted from 'end' to 'start'. */
+    uint64_t remaining;     /* Entries promised but not emitted yet. */
+    monotime reply_us;      /* Time spent producing the slices. */
+    listNode *node;         /* Node in server.stream_reply_clients. */
+} streamRangeReply;
+
+/* Emit the next slice, of at most stream-reply-slice-entries entries, of the
+ * range reply of the client 'c', or everything left if 'all' is true.
+ * Return 1 once the reply is complete. */
+static int streamReplyNextSlice(client *c, int all) {
+    streamRangeReply *sr = c->bstate.stream_reply;
+    uint64_t slice = sr->remaining;
+    if (!all && server.stream_reply_slice &&
+        (uint64_t)server.stream_reply_slice < slice)
+    {
+        slice = server.stream_reply_slice;
+    }
+
+    /* The key is not looked up with lookupKeyRead(): a key logically expired
+     * still holds the entries promised, while deleting it here would call
+     * streamFinishRangeReplies() for this very reply. */
+    uint64_t emitted = 0;
+    int exhausted = 1;
+    dictEntry *de = dictFind(c->db->dict,sr->key->ptr);
+    robj *o = de ? dictGetVal(de) : NULL;
+    if (o && o->type == OBJ_STREAM) {
+        streamIterator si;
+        int64_t numfields;
+        streamID id;
+
+        exhausted = 0;
+        streamIteratorStart(&si,o->ptr,&sr->start,&sr->end,sr->rev);
+        while (emitted < slice) {
+            if (!streamIteratorGetID(&si,&id,&numfields)) {
+                exhausted = 1;
+                break;
+            }
+            addReplyArrayLen(c,2);
+            addReplyStreamID(c,&id);
+            addReplyArrayLen(c,numfields*2);
+            while(numfields--) {
+                unsigned char *key, *value;
+                int64_t key_len, value_len;
+                streamIteratorGetField(&si,&key,&value,&key_len,&value_len);
+                addReplyBulkCBuffer(c,key,key_len);
+                addReplyBulkCBuffer(c,value,value_len);
+            }
+            emitted++;
+        }
+        streamIteratorStop(&si);
+
+        /* The next slice starts right after the last entry emitted. */
+        if (emitted && !exhausted) {
+            if (sr->rev) {
+                sr->end = id;
+                if (streamDecrID(&sr->end) != C_OK) exhausted = 1;
+            } else {
+                sr->start = id;
+                if (streamIncrID(&sr->start) != C_OK) exhausted = 1;
+            }
+        }
+    }
+    sr->remaining -= emitted;
+
+    /* The array length was sent upfront, and the reply is finished before
+     * the stream loses entries (see streamFinishRangeReplies()), so the range
+     * can't run out of entries. Should it happen anyway, close the connection
+     * rather than sending a reply shorter than promised. */
+    if (exhausted && sr->remaining) {
+        serverLog(LL_WARNING,"Closing a client whose XRANGE reply lost "
+                             "%llu entries", (unsigned long long)sr->remaining);
+        freeClientAsync(c);
+        sr->remaining = 0;
+    }
+    return sr->remaining == 0;
+}
+
+/* Reply to XRANGE / XREVRANGE a slice at a time if the range holds more than
+ * stream-reply-slice-entries entries: the array length is sent right away,
+ * then the client is blocked and handleClientsWithStreamReplies() produces a
+ * new slice every time the previous one was written to the socket. This way
+ * a huge range neither stalls the server nor fills the output buffer.
+ *
+ * The reply is bound to the range as it is when the command is called:
+ * entries added later are not part of it, and before entries of the stream,
+ * or the stream itself, are deleted, what is left of the reply is emitted
+ * at once by streamFinishRangeReplies().
+ *
+ * Clients that may receive push messages (RESP3, tracking, Pub/Sub) always
+ * get the reply at once, since a push landing between two slices would end
+ * up inside the array.
+ *
+ * Return 1 if the reply is produced in slices, or 0 if the caller should
+ * reply at once, because the range is small or the client can't block. */
+static int streamReplyWithRangeInSlices(client *c, stream *s, streamID *start, streamID *end, long long count, int rev) {
+    if (!server.stream_reply_slice || (count && count <= server.stream_reply_slice))
+        return 0;
+    if (c->flags & (CLIENT_DENY_BLOCKING|CLIENT_MASTER|CLIENT_MODULE)) return 0;
+    if (c->resp > 2 || c->flags & (CLIENT_TRACKING|CLIENT_PUBSUB)) return 0;
+
+    streamID range_end = *end;
+    if (streamCompareID(&range_end,&s->last_id) > 0) range_end = s->last_id;
+    uint64_t len = streamRangeLength(s,start,&range_end);
+    if (count && len > (uint64_t)count) len = count;
+    if (len <= (uint64_t)server.stream_reply_slice) return 0;
+
+    streamRangeReply *sr = zmalloc(sizeof(*sr));
+    sr->key = createStringObject(c->argv[1]->ptr,sdslen(c->argv[1]->ptr));
+    sr->s = s;
+    sr->start = *start;
+    sr->end = range_end;
+    sr->rev = rev;
+    sr->remaining = len;
+    sr->reply_us = 0;
+
+    c->bstate.stream_reply = sr;
+    addReplyArrayLen(c,len);
+    streamReplyNextSlice(c,0);
+    c->bstate.timeout = 0;
+    blockClient(c,BLOCKED_STREAM_REPLY);
+    listAddNodeTail(server.stream_reply_clients,c);
+    sr->node = listLast(server.stream_reply_clients);
+    return 1;
+}
+
+/* Called from beforeSleep(): produce the next slice of the range replies
+ * whose previous slice was fully written to the socket, unblocking the
+ * clients whose reply is complete. */
+void handleClientsWithStreamReplies(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.stream_reply_clients,&li);
+    while ((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (c->flags & CLIENT_CLOSE_ASAP || clientHasPendingReplies(c))
+            continue; /* Still writing the previous slice. */
+
+        streamRangeReply *sr = c->bstate.stream_reply;
+        monotime slice_start = getMonotonicUs();
+        int done = streamReplyNextSlice(c,0);
+        sr->reply_us += getMonotonicUs()-slice_start;
+        if (done) {
+            updateStatsOnUnblock(c,0,sr->reply_us,0);
+            unblockClient(c,1);
+        }
+    }
+}
+
+/* Emit at once what is left of the range replies produced in slices in the
+ * database 'db', of the key 'key' or of the stream 's', each of them
+ * ignored when NULL. Called before the stream loses entries or is deleted,
+ * so that the replies are made of the entries promised upfront. */
+void streamFinishRangeReplies(redisDb *db, robj *key, stream *s) {
+    if (listLength(server.stream_reply_clients) == 0) return;
+
+    listIter li;
+    listNode *ln;
+    listRewind(server.stream_reply_clients,&li);
+    while ((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        streamRangeReply *sr = c->bstate.stream_reply;
+        if ((db && c->db != db) || (s && sr->s != s) ||
+            (key && !equalStringObjects(sr->key,key))) continue;
+
+        monotime start = getMonotonicUs();
+        streamReplyNextSlice(c,1);
+        sr->reply_us += getMonotonicUs()-start;
+        updateStatsOnUnblock(c,0,sr->reply_us,0);
+        unblockClient(c,1);
+    }
+}
+
+/* Return 1 if some client is ready to receive the next slice of its range
+ * reply, that is, its output buffer was drained. */
+int streamRepliesReady(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.stream_reply_clients,&li);
+    while ((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (!(c->flags & CLIENT_CLOSE_ASAP) && !clientHasPendingReplies(c))
+            return 1;
+    }
+    return 0;
+}
+
+/* Release the range reply state of a client blocked in BLOCKED_STREAM_REPLY,
+ * either because the reply is complete or because the client is freed. */
+void unblockClientStreamReply(client *c) {
+    streamRangeReply *sr = c->bstate.stream_reply;
+    listDelNode(server.stream_reply_clients,sr->node);
+    decrRefCount(sr->key);
+    zfree(sr);
+    c->bstate.stream_reply = NULL;
+}
+
 /* XRANGE/XREVRANGE actual implementation.
  * The 'start' and 'end' IDs are parsed as follows:
  *   Incomplete 'start' has its sequence set to 0, and 'end' to UINT64_MAX.
@@ -2603,6 +3432,14 @@ void xrangeGenericCommand(client *c, int rev) {
         addReplyNullArray(c);
     } else {
         if (count == -1) count = 0;
+        /* Wait for the nodes on disk to be read back, if any. A reply
+         * produced in slices only needs the nodes of the first one. */
+        long long want = count;
+        if (server.stream_reply_slice && (!want || want > server.stream_reply_slice))
+            want = server.stream_reply_slice;
+        streamTierWantRange(c,c->argv[1],s,&startid,&endid,rev,want);
+        if (streamTierBlockClient(c)) return;
+        if (streamReplyWithRangeInSlices(c,s,&startid,&endid,count,rev)) return;
         streamReplyWithRange(c,s,&startid,&endid,count,rev,NULL,NULL,0,NULL);
     }
 }
@@ -2640,6 +3477,8 @@ void xreadCommand(client *c) {
     int streams_count = 0;
     int streams_arg = 0;
     int noack = 0;          /* True if NOACK option was specified. */
+    int watermark = 0;      /* True if WATERMARK option was specified. */
+    uint64_t watermark_ms = UINT64_MAX;
     streamID static_ids[STREAMID_STATIC_VECTOR_LEN];
     streamID *ids = static_ids;
     streamCG **groups = NULL;
@@ -2696,6 +3535,13 @@ void xreadCommand(client *c) {
                 return;
             }
             noack = 1;
+        } else if (!strcasecmp(o,"WATERMARK")) {
+            if (xreadgroup) {
+                addReplyError(c,"The WATERMARK option is only supported by "
+                                "XREAD. You called XREADGROUP instead.");
+                return;
+            }
+            watermark = 1;
         } else {
             addReplyErrorObject(c,shared.syntaxerr);
             return;
@@ -2730,6 +3576,17 @@ void xreadCommand(client *c) {
         if (checkType(c,o,OBJ_STREAM)) goto cleanup;
         streamCG *group = NULL;
 
+        /* With WATERMARK the read is bounded by the smallest millisecond
+         * part of the last ID among all the requested streams: a stream
+         * can't receive new entries with IDs smaller than its last ID, so
+         * every entry with a millisecond time below the watermark is final
+         * in all the streams, and the reply is a consistent cut. A missing
+         * stream has 0-0 as last ID and holds the watermark back. */
+        if (watermark) {
+            uint64_t last_ms = o ? ((stream*)o->ptr)->last_id.ms : 0;
+            if (last_ms < watermark_ms) watermark_ms = last_ms;
+        }
+
         /* If a group was specified, than we need to be sure that the
          * key and group actually exist. */
         if (groupname) {
@@ -2780,10 +3637,43 @@ void xreadCommand(client *c) {
             goto cleanup;
     }
 
+    /* The inclusive end of the range served with WATERMARK is the last
+     * possible ID before the watermark. */
+    streamID wm_end = {0,0};
+    if (watermark && watermark_ms) {
+        wm_end.ms = watermark_ms-1;
+        wm_end.seq = UINT64_MAX;
+    }
+
+    /* Before serving anything, wait for the nodes on disk that are going to
+     * be read to be read back, if any. The command is executed again from
+     * scratch once they are in memory. */
+    for (int i = 0; i < streams_count; i++) {
+        robj *key = c->argv[streams_arg+i];
+        robj *o = lookupKeyReadWithFlags(c->db,key,
+            LOOKUP_NOTOUCH|LOOKUP_NONOTIFY|LOOKUP_NOSTATS);
+        if (o == NULL) continue;
+        streamID start = ids[i];
+        if (groups && (start.ms != UINT64_MAX || start.seq != UINT64_MAX)) {
+            /* History of the consumer. */
+            streamConsumer *consumer =
+                streamLookupConsumer(groups[i],consumername->ptr);
+            if (consumer)
+                streamTierWantPEL(c,key,o->ptr,consumer->pel,&start,count);
+            continue;
+        }
+        if (groups) start = groups[i]->last_id;
+        if (streamIncrID(&start) != C_OK) continue;
+        streamTierWantRange(c,key,o->ptr,&start,watermark ? &wm_end : NULL,0,count);
+    }
+    if (streamTierBlockClient(c)) goto cleanup;
+
     /* Try to serve the client synchronously. */
     size_t arraylen = 0;
     void *arraylen_ptr = NULL;
     for (int i = 0; i < streams_count; i++) {
+        /* Nothing can be served below a zero watermark. */
+        if (watermark && watermark_ms == 0) break;
         robj *o = lookupKeyRead(c->db,c->argv[streams_arg+i]);
         if (o == NULL) continue;
         stream *s = o->ptr;
@@ -2826,6 +3716,16 @@ void xreadCommand(client *c) {
                                                     consumer->name);
             }
             consumer->seen_time = commandTimeSnapshot();
+        } else if (watermark) {
+            /* Serve only if there is at least one entry between the
+             * requested ID and the watermark. */
+            streamID start = *gt;
+            if (s->length && streamCompareID(gt,&wm_end) < 0 &&
+                streamIncrID(&start) == C_OK &&
+                streamRangeHasEntries(s,&start,&wm_end))
+            {
+                serve_synchronously = 1;
+            }
         } else if (s->length) {
             /* For consumers without a group, we serve synchronously if we can
              * actually provide at least one item from the stream. */
@@ -2853,7 +3753,7 @@ void xreadCommand(client *c) {
             int flags = 0;
             if (noack) flags |= STREAM_RWR_NOACK;
             if (serve_history) flags |= STREAM_RWR_HISTORY;
-            streamReplyWithRange(c,s,&start,NULL,count,0,
+            streamReplyWithRange(c,s,&start,watermark ? &wm_end : NULL,count,0,
                                  groups ? groups[i] : NULL,
                                  consumer, flags, &spi);
             if (groups) server.dirty++;
@@ -2953,6 +3853,9 @@ streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id, lo
     cg->consumers = raxNew();
     cg->last_id = *id;
     cg->entries_read = entries_read;
+    memset(&cg->cursor,0,sizeof(cg->cursor));
+    cg->max_deliveries = 0;
+    cg->dlq_key = NULL;
     raxInsert(s->cgroups,(unsigned char*)name,namelen,cg,NULL);
     return cg;
 }
@@ -2961,6 +3864,7 @@ streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id, lo
 void streamFreeCG(streamCG *cg) {
     raxFreeWithCallback(cg->pel,(void(*)(void*))streamFreeNACK);
     raxFreeWithCallback(cg->consumers,(void(*)(void*))streamFreeConsumer);
+    if (cg->dlq_key) decrRefCount(cg->dlq_key);
     zfree(cg);
 }
 
@@ -3034,7 +3938,8 @@ void streamDelConsumer(streamCG *cg, streamConsumer *consumer) {
  * XGROUP SETID <key> <groupname> <id or $> [ENTRIESREAD entries_read]
  * XGROUP DESTROY <key> <groupname>
  * XGROUP CREATECONSUMER <key> <groupname> <consumer>
- * XGROUP DELCONSUMER <key> <groupname> <consumername> */
+ * XGROUP DELCONSUMER <key> <groupname> <consumername>
+ * XGROUP SETDLQ <key> <groupname> <dlqkey> <max-deliveries> */
 void xgroupCommand(client *c) {
     stream *s = NULL;
     sds grpname = NULL;
@@ -3047,9 +3952,10 @@ void xgroupCommand(client *c) {
     /* Everything but the "HELP" option requires a key and group name. */
     if (c->argc >= 4) {
         /* Parse optional arguments for CREATE and SETID */
-        int i = 5;
         int create_subcmd = !strcasecmp(opt,"CREATE");
         int setid_subcmd = !strcasecmp(opt,"SETID");
+        int setdlq_subcmd = !strcasecmp(opt,"SETDLQ");
+        int i = setdlq_subcmd ? 6 : 5;
         while (i < c->argc) {
             if (create_subcmd && !strcasecmp(c->argv[i]->ptr,"MKSTREAM")) {
                 mkstream = 1;
@@ -3091,7 +3997,8 @@ void xgroupCommand(client *c) {
         if ((cg = streamLookupCG(s,grpname)) == NULL &&
             (!strcasecmp(opt,"SETID") ||
              !strcasecmp(opt,"CREATECONSUMER") ||
-             !strcasecmp(opt,"DELCONSUMER")))
+             !strcasecmp(opt,"DELCONSUMER") ||
+             !strcasecmp(opt,"SETDLQ")))
         {
             addReplyErrorFormat(c, "-NOGROUP No such consumer group '%s' "
                                    "for key name '%s'",
@@ -3117,6 +4024,9 @@ void xgroupCommand(client *c) {
 "    Remove the specified group.",
 "SETID <key> <groupname> <id|$> [ENTRIESREAD entries_read]",
 "    Set the current group ID and entries_read counter.",
+"SETDLQ <key> <groupname> <dlqkey> <max-deliveries>",
+"    Move the entries delivered max-deliveries times to the stream at dlqkey",
+"    when they are claimed again. A max-deliveries of 0 disables it.",
 NULL
         };
         addReplyHelp(c, help);
@@ -3193,6 +4103,32 @@ NULL
                                 c->argv[2],c->db->id);
         }
         addReplyLongLong(c,pending);
+    } else if (!strcasecmp(opt,"SETDLQ") && c->argc == 6) {
+        long max_deliveries;
+        if (getRangeLongFromObjectOrReply(c,c->argv[5],0,LONG_MAX,&max_deliveries,
+            "max-deliveries must be zero or positive") != C_OK) return;
+        if (!sdscmp(c->argv[2]->ptr,c->argv[4]->ptr)) {
+            addReplyError(c,"The dead letter stream must be a different key");
+            return;
+        }
+        if (server.cluster_enabled &&
+            keyHashSlot(c->argv[2]->ptr,sdslen(c->argv[2]->ptr)) !=
+            keyHashSlot(c->argv[4]->ptr,sdslen(c->argv[4]->ptr)))
+        {
+            addReplyError(c,"The dead letter stream must be in the same slot");
+            return;
+        }
+        robj *dlq = lookupKeyRead(c->db,c->argv[4]);
+        if (dlq && checkType(c,dlq,OBJ_STREAM)) return;
+
+        if (cg->dlq_key) decrRefCount(cg->dlq_key);
+        cg->dlq_key = NULL;
+        cg->max_deliveries = max_deliveries;
+        if (max_deliveries)
+            cg->dlq_key = createStringObject(c->argv[4]->ptr,sdslen(c->argv[4]->ptr));
+        addReply(c,shared.ok);
+        server.dirty++;
+        notifyKeyspaceEvent(NOTIFY_STREAM,"xgroup-setdlq",c->argv[2],c->db->id);
     } else {
         addReplySubcommandSyntaxError(c);
     }
@@ -3514,6 +4450,115 @@ void xpendingCommand(client *c) {
     }
 }
 
+/* Return 1 if the entries of 'group' of the stream at 'key' delivered
+ * max_deliveries times can be moved to its dead letter stream, that is, if it
+ * is configured, the user may write it, in cluster mode it lives in the slot
+ * of 'key', and it is either empty or holds a stream. Otherwise the entries
+ * are claimed as usual. */
+static int streamCanDeadLetter(client *c, robj *key, streamCG *group) {
+    if (group->max_deliveries == 0) return 0;
+    sds dlqkey = group->dlq_key->ptr;
+    if (ACLUserCheckKeyPerm(c->user,dlqkey,sdslen(dlqkey),CMD_KEY_INSERT) != ACL_OK)
+        return 0;
+    if (server.cluster_enabled &&
+        keyHashSlot(dlqkey,sdslen(dlqkey)) != keyHashSlot(key->ptr,sdslen(key->ptr)))
+        return 0;
+    robj *o = lookupKeyWrite(c->db,group->dlq_key);
+    return o == NULL || o->type == OBJ_STREAM;
+}
+
+/* Move the entries 'ids' of the stream 's' at 'key' that are pending in
+ * 'group' to the stream at 'dlqkey', creating it if needed, and acknowledge
+ * them. IDs that are not pending or no longer exist are skipped. The caller
+ * must make sure that 'dlqkey' is empty or holds a stream.
+ *
+ * The moved entries get consecutive IDs in the dead letter stream, starting
+ * at 'dlq_id' if not NULL or at the next auto generated ID otherwise. This
+ * way the whole move, copies and acknowledges, is propagated as just
+ *
+ *  XDEADLETTER <key> <group> <dlqkey> DLQID <first-new-id> <id> ... <id>
+ *
+ * without the entries content. The number of entries moved is returned. */
+long long streamDeadLetter(client *c, robj *key, stream *s, streamCG *group, robj *groupname, robj *dlqkey, streamID *ids, long count, streamID *dlq_id) {
+    robj *dlqobj = lookupKeyWrite(c->db,dlqkey);
+    int created = 0;
+    if (dlqobj == NULL) {
+        dlqobj = createStreamObject();
+        dbAdd(c->db,dlqkey,dlqobj);
+        created = 1;
+    }
+    stream *dlq = dlqobj->ptr;
+
+    robj **argv = zmalloc(sizeof(robj*)*(6+count));
+    streamID first, next;
+    long long moved = 0;
+    for (long i = 0; i < count; i++) {
+        unsigned char buf[sizeof(streamID)];
+        streamEncodeID(buf,&ids[i]);
+        streamNACK *nack = raxFind(group->pel,buf,sizeof(buf));
+        if (nack == raxNotFound) continue;
+
+        /* Copy the fields of the entry, if it still exists. */
+        streamIterator si;
+        streamID id;
+        int64_t numfields;
+        streamIteratorStart(&si,s,&ids[i],&ids[i],0);
+        if (!streamIteratorGetID(&si,&id,&numfields)) {
+            streamIteratorStop(&si);
+            continue;
+        }
+        robj **fields = zmalloc(sizeof(robj*)*numfields*2);
+        for (int64_t j = 0; j < numfields; j++) {
+            unsigned char *field, *value;
+            int64_t field_len, value_len;
+            streamIteratorGetField(&si,&field,&value,&field_len,&value_len);
+            fields[j*2] = createStringObject((char*)field,field_len);
+            fields[j*2+1] = createStringObject((char*)value,value_len);
+        }
+        streamIteratorStop(&si);
+
+        streamID added;
+        streamID *use_id = moved ? &next : dlq_id;
+        int retval = streamAppendItem(dlq,fields,numfields,&added,use_id,use_id != NULL);
+        for (int64_t j = 0; j < numfields*2; j++) decrRefCount(fields[j]);
+        zfree(fields);
+        /* The dead letter stream can only fail to take the entry if its
+         * IDs are exhausted: leave the rest pending. */
+        if (retval == C_ERR) break;
+        if (moved == 0) first = added;
+        next = added;
+        streamIncrID(&next);
+
+        raxRemove(group->pel,buf,sizeof(buf),NULL);
+        raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
+        streamFreeNACK(nack);
+        argv[6+moved] = createPropagateObjectFromStreamID(&id);
+        moved++;
+    }
+
+    if (moved) {
+        argv[0] = shared.xdeadletter;
+        argv[1] = key;
+        argv[2] = groupname;
+        argv[3] = dlqkey;
+        argv[4] = shared.dlqid;
+        argv[5] = createPropagateObjectFromStreamID(&first);
+        alsoPropagate(c->db->id,argv,6+moved,PROPAGATE_AOF|PROPAGATE_REPL);
+        for (long long j = 5; j < 6+moved; j++) decrRefCount(argv[j]);
+
+        signalModifiedKey(c,c->db,key);
+        signalModifiedKey(c,c->db,dlqkey);
+        notifyKeyspaceEvent(NOTIFY_STREAM,"xdeadletter",key,c->db->id);
+        notifyKeyspaceEvent(NOTIFY_STREAM,"xadd",dlqkey,c->db->id);
+        signalKeyAsReady(c->db,dlqkey,OBJ_STREAM);
+        server.dirty += moved;
+    } else if (created) {
+        dbDelete(c->db,dlqkey);
+    }
+    zfree(argv);
+    return moved;
+}
+
 /* XCLAIM <key> <group> <consumer> <min-idle-time> <ID-1> <ID-2>
  *        [IDLE <milliseconds>] [TIME <mstime>] [RETRYCOUNT <count>]
  *        [FORCE] [JUSTID]
@@ -3577,6 +4622,11 @@ void xpendingCommand(client *c) {
  *      to the consumer, is also used in order to update the group current
  *      ID.
  *
+ * If the group has a dead letter stream (see XGROUP SETDLQ), the entries
+ * that were already delivered max-deliveries times are moved there and
+ * acknowledged instead of being claimed, unless RETRYCOUNT or JUSTID are
+ * given, since then the delivery counter is not incremented.
+ *
  * The command returns an array of messages that the user
  * successfully claimed, so that the caller is able to understand
  * what messages it is now in charge of. */
@@ -3660,6 +4710,13 @@ void xclaimCommand(client *c) {
         }
     }
 
+    /* Wait for the nodes on disk holding the entries to be read back, if
+     * any. This must happen before touching the group, since the command is
+     * executed again from scratch. */
+    for (int j = 5; j <= last_id_arg; j++)
+        streamTierWantRange(c,c->argv[1],o->ptr,&ids[j-5],&ids[j-5],0,1);
+    if (streamTierBlockClient(c)) goto cleanup;
+
     if (streamCompareID(&last_id,&group->last_id) > 0) {
         group->last_id = last_id;
         propagate_last_id = 1;
@@ -3688,6 +4745,9 @@ void xclaimCommand(client *c) {
     }
     consumer->seen_time = commandTimeSnapshot();
 
+    int dead_letter = retrycount < 0 && !justid && streamCanDeadLetter(c,c->argv[1],group);
+    int dead_count = 0;
+
     void *arraylenptr = addReplyDeferredLen(c);
     size_t arraylen = 0;
     for (int j = 5; j <= last_id_arg; j++) {
@@ -3737,6 +4797,16 @@ void xclaimCommand(client *c) {
                 if (this_idle < minidle) continue;
             }
 
+            /* Entries delivered too many times go to the dead letter
+             * stream. Their IDs are collected at the start of the IDs
+             * vector, whose slots up to this one were already consumed. */
+            if (dead_letter && nack->consumer &&
+                nack->delivery_count >= group->max_deliveries)
+            {
+                ids[dead_count++] = id;
+                continue;
+            }
+
             if (nack->consumer != consumer) {
                 /* Remove the entry from the old consumer.
                  * Note that nack->consumer is NULL if we created the
@@ -3773,6 +4843,10 @@ void xclaimCommand(client *c) {
             server.dirty++;
         }
     }
+    if (dead_count) {
+        streamDeadLetter(c,c->argv[1],o->ptr,group,c->argv[2],group->dlq_key,
+                         ids,dead_count,NULL);
+    }
     if (propagate_last_id) {
         streamPropagateGroupID(c,c->argv[1],group,c->argv[2]);
         server.dirty++;
@@ -3796,6 +4870,10 @@ cleanup:
  * This command creates the consumer as side effect if it does not yet
  * exists. Moreover the command reset the idle time of the message to 0.
  *
+ * Like XCLAIM, unless JUSTID is given, the entries already delivered the
+ * group max-deliveries times are moved to its dead letter stream instead
+ * of being claimed. They count against <count>.
+ *
  * The command returns an array of messages that the user
  * successfully claimed, so that the caller is able to understand
  * what messages it is now in charge of. */
@@ -3855,12 +4933,28 @@ void xautoclaimCommand(client *c) {
         return;
     }
 
+    /* Wait for the nodes on disk holding the entries to be read back, if
+     * any. */
+    streamTierWantPEL(c,c->argv[1],o->ptr,group->pel,&startid,count);
+    if (streamTierBlockClient(c)) return;
+
     streamID *deleted_ids = ztrymalloc(count * sizeof(streamID));
     if (!deleted_ids) {
         addReplyError(c, "Insufficient memory, failed allocating transient memory, COUNT too high.");
         return;
     }
 
+    int dead_letter = !justid && streamCanDeadLetter(c,c->argv[1],group);
+    streamID *dead_ids = NULL;
+    if (dead_letter) {
+        dead_ids = ztrymalloc(count * sizeof(streamID));
+        if (!dead_ids) {
+            zfree(deleted_ids);
+            addReplyError(c, "Insufficient memory, failed allocating transient memory, COUNT too high.");
+            return;
+        }
+    }
+
     /* Do the actual claiming. */
     streamConsumer *consumer = streamLookupConsumer(group,c->argv[3]->ptr);
     if (consumer == NULL) {
@@ -3882,6 +4976,7 @@ void xautoclaimCommand(client *c) {
     size_t arraylen = 0;
     mstime_t now = commandTimeSnapshot();
     int deleted_id_num = 0;
+    long dead_id_num = 0;
     while (attempts-- && count && raxNext(&ri)) {
         streamNACK *nack = ri.data;
 
@@ -3912,6 +5007,14 @@ void xautoclaimCommand(client *c) {
                 continue;
         }
 
+        /* Entries delivered too many times go to the dead letter stream
+         * once we are done iterating the PEL. */
+        if (dead_letter && nack->delivery_count >= group->max_deliveries) {
+            dead_ids[dead_id_num++] = id;
+            count--;
+            continue;
+        }
+
         if (nack->consumer != consumer) {
             /* Remove the entry from the old consumer.
              * Note that nack->consumer is NULL if we created the
@@ -3961,6 +5064,12 @@ void xautoclaimCommand(client *c) {
     }
     raxStop(&ri);
 
+    if (dead_id_num) {
+        streamDeadLetter(c,c->argv[1],o->ptr,group,c->argv[2],group->dlq_key,
+                         dead_ids,dead_id_num,NULL);
+    }
+    zfree(dead_ids);
+
     setDeferredArrayLen(c,arraylenptr,arraylen);
     setDeferredReplyStreamID(c,endidptr,&endid);
 
@@ -3973,6 +5082,91 @@ void xautoclaimCommand(client *c) {
     preventCommandPropagation(c);
 }
 
+/* XDEADLETTER <key> <group> <dlqkey> [DLQID <id>] <ID-1> ... <ID-N>
+ *
+ * Moves the specified pending entries of the consumer group to the stream
+ * at <dlqkey>, creating it if needed, and acknowledges them. The entries
+ * are copied as they are under new IDs: the first one is <id> if DLQID is
+ * given, otherwise it is auto generated, and the next ones are consecutive.
+ * IDs that are not pending in the group, or no longer exist in the stream,
+ * are skipped.
+ *
+ * This is also how XCLAIM and XAUTOCLAIM propagate the entries they move
+ * to the dead letter stream of the group.
+ *
+ * The command returns the number of entries moved. */
+void xdeadletterCommand(client *c) {
+    streamCG *group = NULL;
+    streamID dlq_id;
+    int dlq_id_given = 0;
+    int first_id_arg = 4;
+
+    if (!strcasecmp(c->argv[4]->ptr,"DLQID") && c->argc > 6) {
+        if (streamParseStrictIDOrReply(c,c->argv[5],&dlq_id,0,NULL) != C_OK)
+            return;
+        if (streamIDEqZero(&dlq_id)) {
+            addReplyError(c,"The ID specified in XDEADLETTER must be greater than 0-0");
+            return;
+        }
+        dlq_id_given = 1;
+        first_id_arg = 6;
+    }
+
+    /* Parse the IDs first, in order to execute the command in a "all or
+     * nothing" fashion like XACK. */
+    streamID static_ids[STREAMID_STATIC_VECTOR_LEN];
+    streamID *ids = static_ids;
+    int id_count = c->argc-first_id_arg;
+    if (id_count > STREAMID_STATIC_VECTOR_LEN)
+        ids = zmalloc(sizeof(streamID)*id_count);
+    for (int j = first_id_arg; j < c->argc; j++) {
+        if (streamParseStrictIDOrReply(c,c->argv[j],&ids[j-first_id_arg],0,NULL) != C_OK)
+            goto cleanup;
+    }
+
+    if (!sdscmp(c->argv[1]->ptr,c->argv[3]->ptr)) {
+        addReplyError(c,"The dead letter stream must be a different key");
+        goto cleanup;
+    }
+
+    robj *dlq = lookupKeyWrite(c->db,c->argv[3]);
+    if (dlq) {
+        if (checkType(c,dlq,OBJ_STREAM)) goto cleanup;
+        stream *s = dlq->ptr;
+        if (dlq_id_given && streamCompareID(&dlq_id,&s->last_id) <= 0) {
+            addReplyError(c,"The ID specified in XDEADLETTER is equal or smaller "
+                            "than the target stream top item");
+            goto cleanup;
+        }
+    }
+
+    robj *o = lookupKeyWrite(c->db,c->argv[1]);
+    if (o) {
+        if (checkType(c,o,OBJ_STREAM)) goto cleanup;
+        group = streamLookupCG(o->ptr,c->argv[2]->ptr);
+    }
+
+    /* No key or group? Nothing to move. */
+    if (o == NULL || group == NULL) {
+        addReply(c,shared.czero);
+        goto cleanup;
+    }
+
+    /* Wait for the nodes on disk holding the entries to be read back, if
+     * any. */
+    for (int j = 0; j < id_count; j++)
+        streamTierWantRange(c,c->argv[1],o->ptr,&ids[j],&ids[j],0,1);
+    if (streamTierBlockClient(c)) goto cleanup;
+
+    long long moved = streamDeadLetter(c,c->argv[1],o->ptr,group,c->argv[2],
+                                       c->argv[3],ids,id_count,
+                                       dlq_id_given ? &dlq_id : NULL);
+    addReplyLongLong(c,moved);
+    preventCommandPropagation(c);
+cleanup:
+    if (ids != static_ids) zfree(ids);
+}
+
 /* XDEL <key> [<ID1> <ID2> ... <IDN>]
  *
  * Removes the specified entries from the stream. Returns the number
@@ -4135,6 +5329,15 @@ void xinfoReplyWithStreamInfo(client *c, stream *s) {
         }
     }
 
+    /* Fault in the spilled nodes holding the entries we are going to show. */
+    if (full) {
+        streamTierWantRange(c,c->argv[2],s,NULL,NULL,0,count);
+    } else {
+        streamTierWantRange(c,c->argv[2],s,NULL,NULL,0,1);
+        streamTierWantRange(c,c->argv[2],s,NULL,NULL,1,1);
+    }
+    if (streamTierBlockClient(c)) return;
+
     addReplyMapLen(c,full ? 9 : 10);
     addReplyBulkCString(c,"length");
     addReplyLongLong(c,s->length);
@@ -4386,7 +5589,7 @@ NULL
         raxSeek(&ri,"^",NULL,0);
         while(raxNext(&ri)) {
             streamCG *cg = ri.data;
-            addReplyMapLen(c,6);
+            addReplyMapLen(c,8);
             addReplyBulkCString(c,"name");
             addReplyBulkCBuffer(c,ri.key,ri.key_len);
             addReplyBulkCString(c,"consumers");
@@ -4403,6 +5606,14 @@ NULL
             }
             addReplyBulkCString(c,"lag");
             streamReplyWithCGLag(c,s,cg);
+            addReplyBulkCString(c,"max-deliveries");
+            addReplyLongLong(c,cg->max_deliveries);
+            addReplyBulkCString(c,"dead-letter-key");
+            if (cg->dlq_key) {
+                addReplyBulk(c,cg->dlq_key);
+            } else {
+                addReplyNull(c);
+            }
         }
         raxStop(&ri);
     } else if (!strcasecmp(opt,"STREAM")) {
@@ -4679,17 +5890,29 @@ int streamValidateListpackIntegrity(unsigned char *lp, size_t size, int deep) {
             fields = lpGetIntegerIfValid(p, &valid_record);
             if (!valid_record) return 0;
             p = next; if (!lpValidateNext(lp, &next, size)) return 0;
-
-            /* the field names */
-            for (int64_t j = 0; j < fields; j++) {
-                p = next; if (!lpValidateNext(lp, &next, size)) return 0;
-            }
-
             extra_fields += fields + 1;
         }
 
-        /* the values */
+        /* values-mask */
+        unsigned char *mask = NULL, maskbuf[LP_INTBUF_SIZE];
+        if (flags & STREAM_ITEM_FLAG_LARGEVALUES) {
+            int64_t masklen;
+            mask = lpGet(p, &masklen, maskbuf);
+            if (fields < 0 || masklen != (fields+7)/8) return 0;
+            p = next; if (!lpValidateNext(lp, &next, size)) return 0;
+            extra_fields++;
+        }
+
+        /* the field names and the values */
         for (int64_t j = 0; j < fields; j++) {
+            if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS)) {
+                p = next; if (!lpValidateNext(lp, &next, size)) return 0;
+            }
+            /* out of line values are handles */
+            if (mask && streamValueIsOutOfLine(mask, j)) {
+                lpGetIntegerIfValid(p, &valid_record);
+                if (!valid_record) return 0;
+            }
             p = next; if (!lpValidateNext(lp, &next, size)) return 0;
         }
 
@@ -4718,12 +5941,10 @@ int streamExpireItem(redisDb *db, robj *keyobj, streamID *id) {
     /* Rewrite as XDEL using the ID argument of the stream for
      * AOF/replication propagation. */
     robj *argv[3];
-    argv[0] = createObject(OBJ_STRING, sdsnew("XDEL"));
+    argv[0] = shared.xdel;
     argv[1] = keyobj;
-    argv[2] = createObject(OBJ_STRING, createStreamIDString(id));
+    argv[2] = createPropagateObjectFromStreamID(id);
     alsoPropagate(db->id, argv, 3, PROPAGATE_AOF | PROPAGATE_REPL);
-    decrRefCount(argv[0]);
-    decrRefCount(argv[2]);
     server.dirty++;
 
     return r;
@@ -4855,13 +6076,11 @@ int streamHandleTimeoutItem(redisDb *db, robj *timeoutkey, robj *valueobj) {
             expire += commandTimeSnapshot();
         }
         robj **argv = zmalloc(argc * sizeof(robj *));
-        argv[0] = createObject(OBJ_STRING, sdsnew("XADD"));
+        argv[0] = shared.xadd;
         argv[1] = keyobj;
         if (expire > 0) {
-            char buf[LONG_STR_SIZE] = {0};
-            ll2string(buf, sizeof(buf), expire);
-            argv[2] = createObject(OBJ_STRING, sdsnew("PXAT"));
-            argv[3] = createObject(OBJ_STRING, sdsnew((const char *) buf));
+            argv[2] = shared.pxat;
+            argv[3] = createStringObjectFromLongLong(expire);
             argv[4] = createObject(OBJ_STRING, sdsnew("*"));
             for (uint64_t i = 0; i < numdata; i++) {
                 /* Pop list data from head. */
@@ -4897,13 +6116,13 @@ int streamHandleTimeoutItem(redisDb *db, robj *timeoutkey, robj *valueobj) {
         /* When done append delay item, propagate as DEL delay item data stored list for
          * AOF/replication propagation. */
         robj *delargv[2];
-        delargv[0] = createObject(OBJ_STRING, sdsnew("DEL"));
+        delargv[0] = shared.del;
         delargv[1] = list_keyobj;
         alsoPropagate(db->id, delargv, 2, PROPAGATE_AOF | PROPAGATE_REPL);
-        decrRefCount(delargv[0]);
 
-        /* Free the delay item data. */
-        for (uint64_t i = 0; i < argc; i++) {
+        /* Free the delay item data, the command and PXAT names are shared. */
+        for (uint64_t i = 1; i < argc; i++) {
+            if (expire > 0 && i == 2) continue;
             decrRefCount(argv[i]);
         }
         zfree(argv);
@@ -4950,3 +6169,326 @@ void streamDeleteAllItemTimeout(client *c, redisDb *db, robj *streamkey) {
     sdsfree(pattern);
     dictReleaseIterator(di);
 }
+
+#ifdef REDIS_TEST
+#include "testhelp.h"
+
+/* -----------------------------------------------------------------------
+ * Microbenchmarks of the stream internals.
+ *
+ * ./redqueue-server test stream [--accurate]
+ *
+ * Every primitive is measured against a few node sizes (the values of
+ * stream-node-max-entries / stream-node-max-bytes), field counts and PEL
+ * sizes, and reported as ns/op and as the memory allocated (or released,
+ * when negative) per operation, according to zmalloc_used_memory().
+ * ----------------------------------------------------------------------- */
+
+void createSharedObjects(void);
+
+typedef struct {
+    long long start_us;
+    size_t start_mem;
+} streamBench;
+
+static void streamBenchStart(streamBench *b) {
+    b->start_mem = zmalloc_used_memory();
+    b->start_us = ustime();
+}
+
+static void streamBenchEnd(streamBench *b, const char *what, long long ops) {
+    long long elapsed = ustime()-b->start_us;
+    double mem = (double)zmalloc_used_memory()-(double)b->start_mem;
+    if (ops == 0) ops = 1;
+    printf("    %-28s %10lld ops %10.1f ns/op %10.1f bytes/op\n",
+           what, ops, (double)elapsed*1000/ops, mem/ops);
+}
+
+/* Build a stream of 'count' entries with 'numfields' fields each. The IDs
+ * are all in the same millisecond so that the trimming by ID can be driven
+ * by the sequence alone. */
+static stream *streamBenchCreate(long long count, int numfields) {
+    stream *s = streamNew();
+    robj **argv = zmalloc(sizeof(robj*)*numfields*2);
+    for (int j = 0; j < numfields; j++) {
+        argv[j*2] = createObject(OBJ_STRING,sdscatprintf(sdsempty(),"field-%d",j));
+        argv[j*2+1] = createObject(OBJ_STRING,sdsnew("value-0123456789"));
+    }
+    for (long long j = 0; j < count; j++) {
+        streamID id = {1,j+1};
+        assert(streamAppendItem(s,argv,numfields,NULL,&id,1) == C_OK);
+    }
+    for (int j = 0; j < numfields*2; j++) decrRefCount(argv[j]);
+    zfree(argv);
+    return s;
+}
+
+/* A client that is not connected: replies accumulate in its buffers. */
+static client *streamBenchCreateClient(void) {
+    client *c = zcalloc(sizeof(*c));
+    c->buf = zmalloc_usable(PROTO_REPLY_CHUNK_BYTES,&c->buf_usable_size);
+    c->reply = listCreate();
+    listSetFreeMethod(c->reply,freeClientReplyValue);
+    c->flags = CLIENT_SCRIPT;
+    c->resp = 2;
+    return c;
+}
+
+static size_t streamBenchReplyBytes(client *c) {
+    size_t bytes = c->bufpos;
+    listIter li;
+    listNode *ln;
+    listRewind(c->reply,&li);
+    while ((ln = listNext(&li))) {
+        clientReplyBlock *block = listNodeValue(ln);
+        if (block) bytes += block->used;
+    }
+    return bytes;
+}
+
+static void streamBenchResetClient(client *c) {
+    listEmpty(c->reply);
+    c->reply_bytes = 0;
+    c->bufpos = 0;
+}
+
+static void streamBenchFreeClient(client *c) {
+    listRelease(c->reply);
+    zfree(c->buf);
+    zfree(c);
+}
+
+static void streamBenchAppend(long long count, int numfields) {
+    streamBench b;
+    robj **argv = zmalloc(sizeof(robj*)*numfields*2);
+    for (int j = 0; j < numfields; j++) {
+        argv[j*2] = createObject(OBJ_STRING,sdscatprintf(sdsempty(),"field-%d",j));
+        argv[j*2+1] = createObject(OBJ_STRING,sdsnew("value-0123456789"));
+    }
+    stream *s = streamNew();
+    streamBenchStart(&b);
+    for (long long j = 0; j < count; j++) {
+        streamID id = {1,j+1};
+        streamAppendItem(s,argv,numfields,NULL,&id,1);
+    }
+    streamBenchEnd(&b,"streamAppendItem",count);
+    assert(s->length == (uint64_t)count);
+    printf("    %-28s %10llu nodes\n","",
+           (unsigned long long)raxSize(s->rax));
+    freeStream(s);
+    for (int j = 0; j < numfields*2; j++) decrRefCount(argv[j]);
+    zfree(argv);
+}
+
+static void streamBenchIterate(stream *s) {
+    streamBench b;
+    streamIterator si;
+    streamID id;
+    int64_t numfields;
+
+    /* The fields of every entry must be consumed before moving to the next
+     * one, the iterator depends on it, especially in reverse order. */
+    for (int rev = 0; rev <= 1; rev++) {
+        long long ops = 0;
+        streamBenchStart(&b);
+        streamIteratorStart(&si,s,NULL,NULL,rev);
+        while (streamIteratorGetID(&si,&id,&numfields)) {
+            while (numfields--) {
+                unsigned char *field, *value;
+                int64_t field_len, value_len;
+                streamIteratorGetField(&si,&field,&value,&field_len,&value_len);
+            }
+            ops++;
+        }
+        streamIteratorStop(&si);
+        streamBenchEnd(&b,rev ? "streamIteratorGetID (rev)" :
+                                "streamIteratorGetID",ops);
+        assert(ops == (long long)s->length);
+    }
+}
+
+static void streamBenchTrim(long long count, int numfields) {
+    streamBench b;
+    long long step = count/100;
+
+    for (int approx = 0; approx <= 1; approx++) {
+        stream *s = streamBenchCreate(count,numfields);
+        long long deleted = 0;
+        streamBenchStart(&b);
+        for (long long maxlen = count-step; maxlen >= 0; maxlen -= step)
+            deleted += streamTrimByLength(s,maxlen,approx);
+        streamBenchEnd(&b,approx ? "streamTrim (MAXLEN ~)" :
+                                   "streamTrim (MAXLEN)",deleted);
+        freeStream(s);
+    }
+
+    stream *s = streamBenchCreate(count,numfields);
+    long long deleted = 0;
+    streamBenchStart(&b);
+    for (long long seq = step; seq <= count; seq += step) {
+        streamID minid = {1,seq+1};
+        deleted += streamTrimByID(s,minid,0);
+    }
+    streamBenchEnd(&b,"streamTrim (MINID)",deleted);
+    freeStream(s);
+}
+
+static void streamBenchReply(stream *s, client *c, size_t count) {
+    streamBench b;
+    streamID start = {1,1}, end = {UINT64_MAX,UINT64_MAX};
+    long long ops = 0;
+    size_t bytes = 0;
+    char what[64];
+
+    snprintf(what,sizeof(what),"streamReplyWithRange (%zu)",count);
+    streamBenchStart(&b);
+    while (1) {
+        size_t emitted = streamReplyWithRange(c,s,&start,&end,count,0,
+                                              NULL,NULL,0,NULL);
+        if (emitted == 0) break;
+        ops += emitted;
+        bytes += streamBenchReplyBytes(c);
+        streamBenchResetClient(c);
+        start.seq += emitted;
+    }
+    streamBenchEnd(&b,what,ops);
+    printf("    %-28s %10.1f reply bytes/op\n","",(double)bytes/(ops ? ops : 1));
+    streamBenchResetClient(c);
+}
+
+static void streamBenchPEL(long long pelsize) {
+    streamBench b;
+    stream *s = streamNew();
+    streamID id = {0,0};
+    streamCG *cg = streamCreateCG(s,"group",5,&id,0);
+    sds name = sdsnew("consumer");
+    streamConsumer *consumer = streamCreateConsumer(cg,name,NULL,0,
+                                            SCC_NO_NOTIFY|SCC_NO_DIRTIFY);
+    sdsfree(name);
+    unsigned char buf[sizeof(streamID)];
+
+    /* NACK creation as done by XREADGROUP. */
+    streamBenchStart(&b);
+    for (long long j = 0; j < pelsize; j++) {
+        id.ms = 1;
+        id.seq = j+1;
+        streamEncodeID(buf,&id);
+        streamNACK *nack = streamCreateNACK(consumer);
+        raxTryInsert(cg->pel,buf,sizeof(buf),nack,NULL);
+        raxTryInsert(consumer->pel,buf,sizeof(buf),nack,NULL);
+    }
+    streamBenchEnd(&b,"PEL insert",pelsize);
+
+    /* Random lookups as done by XCLAIM. */
+    streamBenchStart(&b);
+    for (long long j = 0; j < pelsize; j++) {
+        id.ms = 1;
+        id.seq = (rand() % pelsize)+1;
+        streamEncodeID(buf,&id);
+        assert(raxFind(cg->pel,buf,sizeof(buf)) != raxNotFound);
+    }
+    streamBenchEnd(&b,"PEL lookup",pelsize);
+
+    /* Scan of the idle entries as done by XAUTOCLAIM / XPENDING. */
+    raxIterator ri;
+    long long scanned = 0;
+    streamBenchStart(&b);
+    raxStart(&ri,cg->pel);
+    raxSeek(&ri,"^",NULL,0);
+    while (raxNext(&ri)) {
+        streamNACK *nack = ri.data;
+        if (nack->delivery_count) scanned++;
+    }
+    raxStop(&ri);
+    streamBenchEnd(&b,"PEL scan",scanned);
+
+    /* Acknowledge in order, as done by XACK. */
+    streamBenchStart(&b);
+    for (long long j = 0; j < pelsize; j++) {
+        id.ms = 1;
+        id.seq = j+1;
+        streamEncodeID(buf,&id);
+        streamNACK *nack = raxFind(cg->pel,buf,sizeof(buf));
+        raxRemove(cg->pel,buf,sizeof(buf),NULL);
+        raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
+        streamFreeNACK(nack);
+    }
+    streamBenchEnd(&b,"PEL ack",pelsize);
+    assert(raxSize(cg->pel) == 0);
+    freeStream(s);
+}
+
+static void streamBenchReadGroup(long long count, client *c) {
+    streamBench b;
+    stream *s = streamBenchCreate(count,5);
+    streamID id = {0,0}, end = {UINT64_MAX,UINT64_MAX};
+    streamCG *cg = streamCreateCG(s,"group",5,&id,0);
+    sds name = sdsnew("consumer");
+    streamConsumer *consumer = streamCreateConsumer(cg,name,NULL,0,
+                                            SCC_NO_NOTIFY|SCC_NO_DIRTIFY);
+    sdsfree(name);
+    long long ops = 0;
+
+    /* Every call starts after the last delivered ID, as XREADGROUP > does. */
+    streamBenchStart(&b);
+    while (1) {
+        streamID start = cg->last_id;
+        streamIncrID(&start);
+        size_t emitted = streamReplyWithRange(c,s,&start,&end,100,0,
+                                              cg,consumer,0,NULL);
+        if (emitted == 0) break;
+        ops += emitted;
+        streamBenchResetClient(c);
+    }
+    streamBenchEnd(&b,"XREADGROUP > (100)",ops);
+    assert(ops == count && (long long)raxSize(cg->pel) == count);
+    streamBenchResetClient(c);
+    freeStream(s);
+}
+
+int streamTest(int argc, char **argv, int flags) {
+    UNUSED(argc);
+    UNUSED(argv);
+    int accurate = (flags & REDIS_TEST_ACCURATE);
+    long long count = accurate ? 1000000 : 100000;
+    static struct {
+        long long entries;
+        long long bytes;
+    } nodes[] = {{16,1024}, {100,4096}, {1000,65536}, {0,4096}};
+    int fields[] = {1,5,20};
+    long long pelsizes[] = {1000,100000,1000000};
+    int numpelsizes = accurate ? 3 : 2;
+
+    createSharedObjects();
+    client *c = streamBenchCreateClient();
+
+    for (size_t n = 0; n < sizeof(nodes)/sizeof(nodes[0]); n++) {
+        server.stream_node_max_entries = nodes[n].entries;
+        server.stream_node_max_bytes = nodes[n].bytes;
+        for (size_t f = 0; f < sizeof(fields)/sizeof(fields[0]); f++) {
+            printf("stream-node-max-entries %lld stream-node-max-bytes %lld, "
+                   "%d field(s), %lld entries:\n",
+                   nodes[n].entries, nodes[n].bytes, fields[f], count);
+            streamBenchAppend(count,fields[f]);
+            stream *s = streamBenchCreate(count,fields[f]);
+            streamBenchIterate(s);
+            streamBenchReply(s,c,10);
+            streamBenchReply(s,c,1000);
+            freeStream(s);
+            streamBenchTrim(count,fields[f]);
+        }
+    }
+
+    server.stream_node_max_entries = 100;
+    server.stream_node_max_bytes = 4096;
+    for (int p = 0; p < numpelsizes; p++) {
+        printf("PEL of %lld entries:\n", pelsizes[p]);
+        streamBenchPEL(pelsizes[p]);
+    }
+    printf("Consumer group reads, %lld entries:\n", count);
+    streamBenchReadGroup(count,c);
+
+    streamBenchFreeClient(c);
+    return 0;
+}
+#endif
@@ -235,6 +235,11 @@ static SSL_CTX *createSSLContext(redisTLSContextConfig *ctx_config, int protocol
     SSL_CTX_set_options(ctx, SSL_OP_NO_COMPRESSION);
 #endif
 
+#ifdef SSL_OP_ENABLE_KTLS
+    if (ctx_config->ktls)
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
     SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE|SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
     SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER|SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
 
@@ -295,6 +300,11 @@ static int tlsConfigure(void *priv, int reconfigure) {
         return C_OK;
     }
 
+#ifndef SSL_OP_ENABLE_KTLS
+    if (ctx_config->ktls)
+        serverLog(LL_WARNING, "tls-ktls is enabled but OpenSSL was built without kTLS support, TLS will be done in user space.");
+#endif
+
     if (!ctx_config->cert_file) {
         serverLog(LL_WARNING, "No tls-cert-file configured!");
         goto error;
@@ -446,6 +456,8 @@ typedef enum {
 #define TLS_CONN_FLAG_READ_WANT_WRITE   (1<<0)
 #define TLS_CONN_FLAG_WRITE_WANT_READ   (1<<1)
 #define TLS_CONN_FLAG_FD_SET            (1<<2)
+#define TLS_CONN_FLAG_KTLS_TX           (1<<3)  /* Kernel encrypts writes. */
+#define TLS_CONN_FLAG_KTLS_RX           (1<<4)  /* Kernel decrypts reads. */
 
 typedef struct tls_connection {
     connection c;
@@ -521,6 +533,20 @@ static connection *connCreateAcceptedTLS(int fd, void *priv) {
 static void tlsEventHandler(struct aeEventLoop *el, int fd, void *clientData, int mask);
 static void updateSSLEvent(tls_connection *conn);
 
+/* Called once the handshake is completed: with tls-ktls enabled, OpenSSL
+ * hands the session keys to the kernel if it supports the negotiated cipher,
+ * and we remember in which directions the kernel does the crypto. When the
+ * kernel lacks support we simply keep doing TLS in user space. */
+static void tlsHandshakeCompleted(tls_connection *conn) {
+    conn->c.state = CONN_STATE_CONNECTED;
+#ifdef SSL_OP_ENABLE_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(conn->ssl)))
+        conn->flags |= TLS_CONN_FLAG_KTLS_TX;
+    if (BIO_get_ktls_recv(SSL_get_rbio(conn->ssl)))
+        conn->flags |= TLS_CONN_FLAG_KTLS_RX;
+#endif
+}
+
 /* Process the return code received from OpenSSL>
  * Update the want parameter with expected I/O.
  * Update the connection's error state if a real error has occurred.
@@ -666,7 +692,7 @@ static void tlsHandleEvent(tls_connection *conn, int mask) {
                     /* If not handled, it's an error */
                     conn->c.state = CONN_STATE_ERROR;
                 } else {
-                    conn->c.state = CONN_STATE_CONNECTED;
+                    tlsHandshakeCompleted(conn);
                 }
             }
 
@@ -689,7 +715,7 @@ static void tlsHandleEvent(tls_connection *conn, int mask) {
                 /* If not handled, it's an error */
                 conn->c.state = CONN_STATE_ERROR;
             } else {
-                conn->c.state = CONN_STATE_CONNECTED;
+                tlsHandshakeCompleted(conn);
             }
 
             if (!callHandler((connection *) conn, conn->c.conn_handler)) return;
@@ -854,7 +880,7 @@ static int connTLSAccept(connection *_conn, ConnectionCallbackFunc accept_handle
         }
     }
 
-    conn->c.state = CONN_STATE_CONNECTED;
+    tlsHandshakeCompleted(conn);
     if (!callHandler((connection *) conn, conn->c.conn_handler)) return C_OK;
     conn->c.conn_handler = NULL;
 
@@ -882,17 +908,46 @@ static int connTLSConnect(connection *conn_, const char *addr, int port, const c
     return C_OK;
 }
 
+/* Write directly to the socket of a connection where the kernel does the
+ * encryption: no copy nor crypto in user space is needed. Once kTLS is
+ * active for writes, all the writes of the connection take this path, so
+ * OpenSSL never has a partially written record pending. */
+static int connKTLSWritev(tls_connection *conn, const struct iovec *iov, int iovcnt) {
+    int ret = writev(conn->c.fd, iov, iovcnt);
+    if (ret < 0 && errno != EAGAIN) {
+        conn->c.last_errno = errno;
+        if (errno != EINTR) {
+            if (conn->ssl_error) zfree(conn->ssl_error);
+            conn->ssl_error = zstrdup(strerror(errno));
+            conn->c.state = CONN_STATE_ERROR;
+        }
+    }
+    return ret;
+}
+
 static int connTLSWrite(connection *conn_, const void *data, size_t data_len) {
     tls_connection *conn = (tls_connection *) conn_;
     int ret;
 
     if (conn->c.state != CONN_STATE_CONNECTED) return -1;
+    if (conn->flags & TLS_CONN_FLAG_KTLS_TX) {
+        struct iovec iov = { .iov_base = (void *) data, .iov_len = data_len };
+        return connKTLSWritev(conn, &iov, 1);
+    }
     ERR_clear_error();
     ret = SSL_write(conn->ssl, data, data_len);
     return updateStateAfterSSLIO(conn, ret, 1);
 }
 
 static int connTLSWritev(connection *conn_, const struct iovec *iov, int iovcnt) {
+    tls_connection *conn = (tls_connection *) conn_;
+
+    /* With kTLS the buffers are handed to the kernel as they are. */
+    if (conn->flags & TLS_CONN_FLAG_KTLS_TX) {
+        if (conn->c.state != CONN_STATE_CONNECTED) return -1;
+        return connKTLSWritev(conn, iov, iovcnt);
+    }
+
     if (iovcnt == 1) return connTLSWrite(conn_, iov[0].iov_base, iov[0].iov_len);
 
     /* Accumulate the amount of bytes of each buffer and check if it exceeds NET_MAX_WRITES_PER_EVENT. */
@@ -994,7 +1049,7 @@ static int connTLSBlockingConnect(connection *conn_, const char *addr, int port,
     }
     unsetBlockingTimeout(conn);
 
-    conn->c.state = CONN_STATE_CONNECTED;
+    tlsHandshakeCompleted(conn);
     return C_OK;
 }
 
@@ -1063,6 +1118,20 @@ static const char *connTLSGetType(connection *conn_) {
     return CONN_TYPE_TLS;
 }
 
+/* Return how the TLS crypto of the connection is done: "ktls" if the kernel
+ * does it in both directions, "ktls-tx" or "ktls-rx" if only for writes or
+ * reads, and "user" if it's all done by OpenSSL in user space. */
+static const char *connTLSGetTLSMode(connection *conn_) {
+    tls_connection *conn = (tls_connection *) conn_;
+    int tx = conn->flags & TLS_CONN_FLAG_KTLS_TX;
+    int rx = conn->flags & TLS_CONN_FLAG_KTLS_RX;
+
+    if (tx && rx) return "ktls";
+    if (tx) return "ktls-tx";
+    if (rx) return "ktls-rx";
+    return "user";
+}
+
 static int tlsHasPendingData(void) {
     if (!pending_list)
         return 0;
@@ -1150,6 +1219,7 @@ static ConnectionType CT_TLS = {
 
     /* TLS specified methods */
     .get_peer_cert = connTLSGetPeerCert,
+    .get_tls_mode = connTLSGetTLSMode,
 };
 
 int RedisRegisterConnectionTypeTLS(void) {
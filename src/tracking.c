@@ -49,6 +49,37 @@ uint64_t TrackingTableTotalItems = 0; /* Total number of IDs stored across
                                          are using server side for CSC. */
 robj *TrackingChannelName;
 
+/* Stream metadata tracking.
+ *
+ * Commands returning metadata derived from a stream, like XLEN and
+ * XINFO GROUPS, are usually polled by dashboards and producers, while the
+ * stream itself is modified at a very high rate: with normal tracking every
+ * XADD invalidates the cached value, so clients end up re-fetching it all the
+ * time while receiving an invalidation message per write.
+ *
+ * When tracking-stream-meta-delay is non zero, the keys fetched by such
+ * commands are remembered in a different table, and when the stream is
+ * modified the invalidation is scheduled 'delay' milliseconds in the future
+ * instead of being sent ASAP. All the modifications happening in the
+ * meantime are coalesced into the same invalidation message, so clients
+ * receive at most one invalidation per key every 'delay' milliseconds, at
+ * the cost of caching values up to 'delay' milliseconds stale.
+ *
+ * The keys of this table count against tracking-table-max-keys as well, and
+ * are evicted by trackingLimitUsedSlots() like the ones of TrackingTable. */
+rax *StreamMetaTrackingTable = NULL;
+rax *StreamMetaPendingKeys = NULL; /* Keys with a scheduled invalidation,
+                                      keyed by due time (big endian) then
+                                      key name, so ordered by due time. */
+
+typedef struct streamMetaTracking {
+    rax *ids;              /* Client IDs that may have cached metadata. */
+    mstime_t due;          /* If non zero, the time at which the scheduled
+                              invalidation must be sent. */
+    uint64_t last_writer;  /* ID of the last client modifying the key, used
+                              to implement NOLOOP. */
+} streamMetaTracking;
+
 /* This is the structure that we have as value of the PrefixTable, and
  * represents the list of keys modified, and the list of clients that need
  * to be notified, for a given prefix. */
@@ -208,6 +239,39 @@ void enableTracking(client *c, uint64_t redirect_to, uint64_t options, robj **pr
                            CLIENT_TRACKING_NOLOOP);
 }
 
+/* Return non zero if 'cmd' only returns metadata derived from a stream, and
+ * its keys should be tracked as described at the top of this file. */
+static int isStreamMetaCommand(struct redisCommand *cmd) {
+    return cmd->proc == xlenCommand ||
+           (cmd->proc == xinfoCommand && !strcasecmp(cmd->declared_name,"groups"));
+}
+
+/* Remember that the client 'id' may have cached metadata about the stream
+ * at 'key'. */
+static void trackingRememberStreamMetaKey(uint64_t id, sds key) {
+    if (StreamMetaTrackingTable == NULL) {
+        StreamMetaTrackingTable = raxNew();
+        StreamMetaPendingKeys = raxNew();
+    }
+
+    streamMetaTracking *smt = raxFind(StreamMetaTrackingTable,
+                                      (unsigned char*)key,sdslen(key));
+    if (smt == raxNotFound) {
+        smt = zmalloc(sizeof(*smt));
+        smt->ids = raxNew();
+        smt->due = 0;
+        smt->last_writer = 0;
+        raxInsert(StreamMetaTrackingTable,(unsigned char*)key,sdslen(key),smt,NULL);
+    }
+    raxTryInsert(smt->ids,(unsigned char*)&id,sizeof(id),NULL,NULL);
+}
+
+static void freeStreamMetaTracking(void *ptr) {
+    streamMetaTracking *smt = ptr;
+    raxFree(smt->ids);
+    zfree(smt);
+}
+
 /* This function is called after the execution of a readonly command in the
  * case the client 'c' has keys tracking enabled and the tracking is not
  * in BCAST mode. It will populate the tracking invalidation table according
@@ -236,10 +300,16 @@ void trackingRememberKeys(client *tracking, client *executing) {
     }
 
     keyReference *keys = result.keys;
+    int stream_meta = server.tracking_stream_meta_delay &&
+                      isStreamMetaCommand(executing->cmd);
 
     for(int j = 0; j < numkeys; j++) {
         int idx = keys[j].pos;
         sds sdskey = executing->argv[idx]->ptr;
+        if (stream_meta) {
+            trackingRememberStreamMetaKey(tracking->id,sdskey);
+            continue;
+        }
         rax *ids = raxFind(TrackingTable,(unsigned char*)sdskey,sdslen(sdskey));
         if (ids == raxNotFound) {
             ids = raxNew();
@@ -347,6 +417,32 @@ void trackingRememberKeyToBroadcast(client *c, char *keyname, size_t keylen) {
     raxStop(&ri);
 }
 
+/* Called when the key 'keyobj' is modified: if some client may have cached
+ * stream metadata about it, schedule the invalidation message, unless one
+ * is already scheduled. */
+static void trackingScheduleStreamMetaInvalidation(client *c, robj *keyobj) {
+    streamMetaTracking *smt = raxFind(StreamMetaTrackingTable,
+                                      keyobj->ptr,sdslen(keyobj->ptr));
+    if (smt == raxNotFound) return;
+
+    smt->last_writer = c ? c->id : 0;
+    if (smt->due) return; /* Already scheduled. */
+    mstime_t now = mstime();
+    if (server.tracking_stream_meta_delay > LLONG_MAX - now)
+        smt->due = LLONG_MAX;
+    else
+        smt->due = now + server.tracking_stream_meta_delay;
+
+    /* The delay may change at runtime, so a key scheduled later may be due
+     * sooner: the pending keys are sorted by due time, not insertion. */
+    uint64_t due = htonu64((uint64_t)smt->due);
+    sds pending = sdsnewlen(&due,sizeof(due));
+    pending = sdscatsds(pending,keyobj->ptr);
+    raxInsert(StreamMetaPendingKeys,(unsigned char*)pending,sdslen(pending),
+              NULL,NULL);
+    sdsfree(pending);
+}
+
 /* This function is called from signalModifiedKey() or other places in Redis
  * when a key changes value. In the context of keys tracking, our task here is
  * to send a notification to every client that may have keys about such caching
@@ -372,6 +468,9 @@ void trackingInvalidateKey(client *c, robj *keyobj, int bcast) {
     if (bcast && raxSize(PrefixTable) > 0)
         trackingRememberKeyToBroadcast(c,(char *)key,keylen);
 
+    if (bcast && StreamMetaTrackingTable)
+        trackingScheduleStreamMetaInvalidation(c,keyobj);
+
     rax *ids = raxFind(TrackingTable,key,keylen);
     if (ids == raxNotFound) return;
 
@@ -449,6 +548,65 @@ void trackingHandlePendingKeyInvalidations(void) {
     listEmpty(server.tracking_pending_keys);
 }
 
+/* Send the invalidation message of the stream metadata key 'key' to the
+ * clients that may have cached it, and stop tracking it. */
+static void trackingInvalidateStreamMetaKey(unsigned char *key, size_t keylen,
+                                            streamMetaTracking *smt)
+{
+    raxIterator ri;
+    raxStart(&ri,smt->ids);
+    raxSeek(&ri,"^",NULL,0);
+    while(raxNext(&ri)) {
+        uint64_t id;
+        memcpy(&id,ri.key,sizeof(id));
+        client *target = lookupClientByID(id);
+        if (target == NULL ||
+            !(target->flags & CLIENT_TRACKING) ||
+            target->flags & CLIENT_TRACKING_BCAST)
+        {
+            continue;
+        }
+        if (target->flags & CLIENT_TRACKING_NOLOOP &&
+            target->id == smt->last_writer)
+        {
+            continue;
+        }
+        sendTrackingMessage(target,(char*)key,keylen,0);
+    }
+    raxStop(&ri);
+    freeStreamMetaTracking(smt);
+    raxRemove(StreamMetaTrackingTable,key,keylen,NULL);
+}
+
+/* Send the stream metadata invalidation messages that are due, see the top
+ * of this file for more information. Called from beforeSleep(). */
+void trackingHandlePendingStreamMetaInvalidations(void) {
+    if (StreamMetaPendingKeys == NULL || !raxSize(StreamMetaPendingKeys))
+        return;
+
+    mstime_t now = mstime();
+    raxIterator ri;
+    raxStart(&ri,StreamMetaPendingKeys);
+    while (1) {
+        raxSeek(&ri,"^",NULL,0);
+        if (!raxNext(&ri)) break;
+        uint64_t due;
+        memcpy(&due,ri.key,sizeof(due));
+        due = ntohu64(due);
+        if ((mstime_t)due > now) break;
+
+        /* The key may have been evicted, and maybe tracked and scheduled
+         * again since then: only the entry matching its due time counts. */
+        unsigned char *key = ri.key+sizeof(due);
+        size_t keylen = ri.key_len-sizeof(due);
+        streamMetaTracking *smt = raxFind(StreamMetaTrackingTable,key,keylen);
+        if (smt != raxNotFound && smt->due == (mstime_t)due)
+            trackingInvalidateStreamMetaKey(key,keylen,smt);
+        raxRemove(StreamMetaPendingKeys,ri.key,ri.key_len,NULL);
+    }
+    raxStop(&ri);
+}
+
 /* This function is called when one or all the Redis databases are
  * flushed. Caching keys are not specific for each DB but are global: 
  * currently what we do is send a special notification to clients with 
@@ -493,6 +651,15 @@ void trackingInvalidateKeysOnFlush(int async) {
         TrackingTable = raxNew();
         TrackingTableTotalItems = 0;
     }
+
+    /* Clients were already told all the keys are invalid, so there is
+     * nothing left to schedule for stream metadata. */
+    if (StreamMetaTrackingTable) {
+        raxFreeWithCallback(StreamMetaTrackingTable,freeStreamMetaTracking);
+        StreamMetaTrackingTable = raxNew();
+        raxFree(StreamMetaPendingKeys);
+        StreamMetaPendingKeys = raxNew();
+    }
 }
 
 /* Tracking forces Redis to remember information about which client may have
@@ -510,7 +677,7 @@ void trackingLimitUsedSlots(void) {
     if (TrackingTable == NULL) return;
     if (server.tracking_table_max_keys == 0) return; /* No limits set. */
     size_t max_keys = server.tracking_table_max_keys;
-    if (raxSize(TrackingTable) <= max_keys) {
+    if (trackingGetTotalKeys()+trackingGetTotalStreamMetaKeys() <= max_keys) {
         timeout_counter = 0;
         return; /* Limit not reached. */
     }
@@ -520,27 +687,35 @@ void trackingLimitUsedSlots(void) {
      * function and found that we are still over the limit. */
     int effort = 100 * (timeout_counter+1);
 
-    /* We just remove one key after another by using a random walk. */
-    raxIterator ri;
-    raxStart(&ri,TrackingTable);
+    /* We just remove one key after another by using a random walk, in the
+     * table holding most of the keys. */
     while(effort > 0) {
         effort--;
+        int stream_meta = trackingGetTotalStreamMetaKeys() > trackingGetTotalKeys();
+        raxIterator ri;
+        raxStart(&ri,stream_meta ? StreamMetaTrackingTable : TrackingTable);
         raxSeek(&ri,"^",NULL,0);
         raxRandomWalk(&ri,0);
-        if (raxEOF(&ri)) break;
-        robj *keyobj = createStringObject((char*)ri.key,ri.key_len);
-        trackingInvalidateKey(NULL,keyobj,0);
-        decrRefCount(keyobj);
-        if (raxSize(TrackingTable) <= max_keys) {
-            timeout_counter = 0;
+        if (raxEOF(&ri)) {
             raxStop(&ri);
+            break;
+        }
+        if (stream_meta) {
+            trackingInvalidateStreamMetaKey(ri.key,ri.key_len,ri.data);
+        } else {
+            robj *keyobj = createStringObject((char*)ri.key,ri.key_len);
+            trackingInvalidateKey(NULL,keyobj,0);
+            decrRefCount(keyobj);
+        }
+        raxStop(&ri);
+        if (trackingGetTotalKeys()+trackingGetTotalStreamMetaKeys() <= max_keys) {
+            timeout_counter = 0;
             return; /* Return ASAP: we are again under the limit. */
         }
     }
 
     /* If we reach this point, we were not able to go under the configured
      * limit using the maximum effort we had for this run. */
-    raxStop(&ri);
     timeout_counter++;
 }
 
@@ -654,6 +829,11 @@ uint64_t trackingGetTotalKeys(void) {
     return raxSize(TrackingTable);
 }
 
+uint64_t trackingGetTotalStreamMetaKeys(void) {
+    if (StreamMetaTrackingTable == NULL) return 0;
+    return raxSize(StreamMetaTrackingTable);
+}
+
 uint64_t trackingGetTotalPrefixes(void) {
     if (PrefixTable == NULL) return 0;
     return raxSize(PrefixTable);
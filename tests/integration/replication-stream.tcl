@@ -0,0 +1,228 @@
+start_server {tags {"repl external:skip"} overrides {save ""}} {
+    set replica [srv 0 client]
+    start_server {overrides {save ""}} {
+        set master [srv 0 client]
+        set master_host [srv 0 host]
+        set master_port [srv 0 port]
+
+        test {Replica with swapdb-per-db swaps every database once loaded} {
+            $master config set repl-diskless-sync yes
+            $master config set repl-diskless-sync-delay 0
+            $master config set rdbcompression no
+            $replica config set repl-diskless-load swapdb-per-db
+            $replica config set loading-process-events-interval-bytes 1024
+            $replica config set replica-read-only no
+
+            # Initial sync, so that the next one has a matching replid.
+            $replica replicaof $master_host $master_port
+            wait_for_condition 100 100 {
+                [s -1 master_link_status] eq {up}
+            } else {
+                fail "Master <-> Replica didn't finish sync"
+            }
+
+            # Keys only the replica has are dropped by the swap of their db.
+            $replica select 0
+            $replica xadd replica-only * f v
+            $replica select 1
+            $replica xadd replica-only * f v
+
+            set payload [string repeat x 4096]
+            $master select 0
+            $master xadd s0 * f $payload
+            $master select 1
+            for {set j 0} {$j < 50} {incr j} {
+                $master xadd s1-$j * f $payload
+            }
+            $master select 0
+
+            # Slow RDB generation, so we can watch the load.
+            $master config set rdb-key-save-delay 100000
+            set sync_full [s 0 sync_full]
+            $master multi
+            $master client kill type replica
+            $master config set repl-backlog-size 16384
+            for {set j 0} {$j < 5} {incr j} {
+                $master xadd filler * f [string repeat A 16384]
+            }
+            $master exec
+            wait_for_condition 100 100 {
+                [s 0 sync_full] > $sync_full
+            } else {
+                fail "Master <-> Replica didn't start the full sync"
+            }
+
+            # Once db 0 is loaded it's swapped, while db 1 is still the old one.
+            wait_for_condition 100 50 {
+                [s -1 async_loading] eq 1 &&
+                [$replica select 0] eq {OK} &&
+                [$replica exists replica-only] == 0
+            } else {
+                fail "Database 0 wasn't swapped during the load"
+            }
+            assert_equal 1 [$replica exists s0]
+            $replica select 1
+            assert_equal 1 [$replica exists replica-only]
+            assert_equal 1 [s -1 async_loading]
+
+            $master config set rdb-key-save-delay 0
+            wait_for_condition 100 100 {
+                [s -1 master_link_status] eq {up}
+            } else {
+                fail "Master <-> Replica didn't finish sync"
+            }
+            assert_equal 0 [$replica exists replica-only]
+            assert_equal 50 [$replica dbsize]
+            $replica select 0
+            assert_equal [$master dbsize] [$replica dbsize]
+            wait_for_ofs_sync $master $replica
+            assert_equal [$master debug digest] [$replica debug digest]
+        } {} {needs:debug}
+
+        test {Replica with swapdb-per-db flushes every database if the load fails} {
+            $replica select 1
+            $replica xadd replica-only * f v
+
+            $master config set rdb-key-save-delay 100000
+            set loglines [count_log_lines -1]
+            $master multi
+            $master client kill type replica
+            for {set j 0} {$j < 5} {incr j} {
+                $master xadd filler * f [string repeat A 16384]
+            }
+            $master exec
+
+            # Fail the load once db 0 was swapped, while db 1 is the old one.
+            wait_for_log_messages -1 {"*Swapping loaded DB 0*"} $loglines 100 100
+            $master config set rdb-key-save-delay 1000000
+            $master client kill type replica
+            wait_for_log_messages -1 {"*flushing the old ones*"} $loglines 100 100
+            foreach db {0 1} {
+                $replica select $db
+                assert_equal 0 [$replica dbsize]
+            }
+
+            # Kill the slow sync, the next one fills the replica again.
+            $master config set rdb-key-save-delay 0
+            $master client kill type replica
+            wait_for_condition 100 100 {
+                [s -1 master_link_status] eq {up}
+            } else {
+                fail "Master <-> Replica didn't finish sync"
+            }
+            wait_for_ofs_sync $master $replica
+            assert_equal [$master debug digest] [$replica debug digest]
+        } {} {needs:debug}
+    }
+}
+
+start_server {tags {"repl external:skip needs:debug"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set replica [srv 0 client]
+
+        $replica replicaof $master_host $master_port
+        wait_for_condition 50 100 {
+            [s 0 master_link_status] eq {up}
+        } else {
+            fail "Replication not started."
+        }
+
+        test {Replica applies the master stream in batches} {
+            $replica config set slowlog-log-slower-than 0
+            $replica slowlog reset
+            set batches [s 0 slave_apply_batches]
+            set commands [s 0 slave_apply_commands]
+
+            set rd [redis_deferring_client -1]
+            for {set j 0} {$j < 1000} {incr j} {
+                $rd xadd batched * item $j
+            }
+            for {set j 0} {$j < 1000} {incr j} {
+                $rd read
+            }
+            $rd close
+
+            wait_for_ofs_sync $master $replica
+            assert_equal 0 [s 0 slave_apply_lag]
+            assert_equal 1000 [$replica xlen batched]
+            assert_morethan_equal [s 0 slave_apply_commands] [expr {$commands + 1000}]
+            assert_lessthan [expr {[s 0 slave_apply_batches] - $batches}] 1000
+
+            # The commands of the master are not in the slow log by default.
+            foreach entry [$replica slowlog get -1] {
+                assert_not_equal xadd [lindex $entry 3 0]
+            }
+            $replica config set replica-apply-latency-tracking yes
+            $master xadd batched * item tracked
+            wait_for_ofs_sync $master $replica
+            set logged {}
+            foreach entry [$replica slowlog get -1] {
+                lappend logged [lindex $entry 3 0]
+            }
+            assert_equal 1 [llength [lsearch -all $logged xadd]]
+            $replica config set replica-apply-latency-tracking no
+            $replica config set slowlog-log-slower-than 10000
+        }
+
+        test {Sub-replicas receive the master stream applied in batches} {
+            start_server {} {
+                set subreplica [srv 0 client]
+                $subreplica replicaof [srv -1 host] [srv -1 port]
+                wait_for_condition 50 100 {
+                    [s 0 master_link_status] eq {up}
+                } else {
+                    fail "Replication not started."
+                }
+
+                set rd [redis_deferring_client -2]
+                for {set j 0} {$j < 1000} {incr j} {
+                    $rd xadd chained * item $j
+                }
+                for {set j 0} {$j < 1000} {incr j} {
+                    $rd read
+                }
+                $rd close
+
+                wait_for_ofs_sync $master $subreplica
+                assert_equal [$master debug digest] [$subreplica debug digest]
+                assert_equal [status $replica master_repl_offset] [status $master master_repl_offset]
+            }
+        }
+    }
+}
+
+start_server {tags {"repl external:skip needs:debug"} overrides {appendonly yes}} {
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set replica [srv 0 client]
+
+        test {Stream writes are propagated identically to the AOF and replicas} {
+            $replica replicaof $master_host $master_port
+            wait_for_condition 50 100 {
+                [s 0 master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+
+            $master del mystream
+            for {set j 0} {$j < 100} {incr j} {
+                $master xadd mystream * item $j
+            }
+            $master xadd mystream PX 100000 * item expiring
+            $master xtrim mystream MAXLEN 50
+            $master xgroup create mystream mygroup 0
+            $master xreadgroup group mygroup alice COUNT 10 STREAMS mystream >
+
+            wait_for_ofs_sync $master $replica
+            set digest [$master debug digest]
+            assert_equal $digest [$replica debug digest]
+            $master debug loadaof
+            assert_equal $digest [$master debug digest]
+        }
+    }
+}
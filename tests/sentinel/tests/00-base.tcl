@@ -98,6 +98,27 @@ test "New master [join $addr {:}] role matches" {
     assert {[RI $master_id role] eq {master}}
 }
 
+proc count_sentinels_with_failover_timing {} {
+    set leaders 0
+    foreach_sentinel_id id {
+        set info [S $id SENTINEL MASTER mymaster]
+        if {[dict get $info last-failover-reconf-ms] != -1} {
+            assert {[dict get $info last-failover-election-ms] >= 0}
+            assert {[dict get $info last-failover-promotion-ms] >= 0}
+            incr leaders
+        }
+    }
+    return $leaders
+}
+
+test "The failover leader reports the duration of every failover phase" {
+    wait_for_condition 1000 50 {
+        [count_sentinels_with_failover_timing] == 1
+    } else {
+        fail "The failover leader did not report the failover phases timing"
+    }
+}
+
 test "All the other slaves now point to the new master" {
     foreach_redis_id id {
         if {$id != $master_id && $id != 0} {
@@ -56,3 +56,52 @@ test "SENTINEL CONFIG SET, wrong number of arguments" {
         fail "Expected to return Missing argument error"
     }
 }
+
+test "SENTINEL CONFIG SET fast-detection-period" {
+    foreach_sentinel_id id {
+        assert_equal {OK} [S $id SENTINEL CONFIG SET fast-detection-period 50]
+        assert_match {*sentinel_fast_detection_period:50*} [S $id INFO sentinel]
+    }
+    assert_match {fast-detection-period 50} [S 1 SENTINEL CONFIG GET fast-detection-period]
+    assert_equal -1 [dict get [S 1 SENTINEL MASTER mymaster] last-failover-election-ms]
+
+    catch {[S 1 SENTINEL CONFIG SET fast-detection-period 5]} e
+    assert_match "*Invalid value*" $e
+
+    foreach_sentinel_id id {
+        assert_equal {OK} [S $id SENTINEL CONFIG SET fast-detection-period 0]
+    }
+    assert_match {fast-detection-period 0} [S 1 SENTINEL CONFIG GET fast-detection-period]
+}
+
+test "SENTINEL CONFIG SET masters-per-tick" {
+    foreach_sentinel_id id {
+        assert_equal {OK} [S $id SENTINEL CONFIG SET masters-per-tick 1]
+    }
+    assert_match {masters-per-tick 1} [S 1 SENTINEL CONFIG GET masters-per-tick]
+    wait_for_condition 50 100 {
+        [SI 1 sentinel_tick_instances] > 0
+    } else {
+        fail "Sentinel is not handling instances with masters-per-tick set"
+    }
+    assert {[SI 1 sentinel_tick_duration_max_usec] > 0}
+
+    # With more masters than masters-per-tick, every master is still
+    # handled, just not at every tick. Redis 1 is a replica, so the new
+    # master reports the slave role once its INFO is processed.
+    S 1 SENTINEL MONITOR tickmaster [get_instance_attrib redis 1 host] [get_instance_attrib redis 1 port] 1
+    wait_for_condition 100 100 {
+        [dict get [S 1 SENTINEL MASTER tickmaster] role-reported] eq {slave} &&
+        [dict get [S 1 SENTINEL MASTER mymaster] info-refresh] < 10000
+    } else {
+        fail "Masters are not handled with masters-per-tick set"
+    }
+    S 1 SENTINEL REMOVE tickmaster
+
+    catch {[S 1 SENTINEL CONFIG SET masters-per-tick -1]} e
+    assert_match "*Invalid value*" $e
+
+    foreach_sentinel_id id {
+        assert_equal {OK} [S $id SENTINEL CONFIG SET masters-per-tick 0]
+    }
+}
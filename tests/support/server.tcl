@@ -306,7 +306,7 @@ proc wait_server_started {config_file stdout pid} {
     set maxiter [expr {120*1000/$checkperiod}] ; # Wait up to 2 minutes.
     set port_busy 0
     while 1 {
-        if {[regexp -- " PID: $pid.*Server initialized" [exec cat $stdout]]} {
+        if {[regexp -- "PID: $pid.*Server initialized" [exec cat $stdout]]} {
             break
         }
         after $checkperiod
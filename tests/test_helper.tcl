@@ -16,6 +16,10 @@ source tests/support/util.tcl
 set ::all_tests {
     unit/type/stream
     unit/type/stream-cgroups
+    unit/cron
+    unit/db-isolation
+    unit/tls
+    integration/replication-stream
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -0,0 +1,42 @@
+start_cluster 1 0 {tags {external:skip cluster}} {
+
+    proc slot_keys {key} {
+        set slot [R 0 cluster keyslot $key]
+        list [R 0 cluster countkeysinslot $slot] [lsort [R 0 cluster getkeysinslot $slot 10]]
+    }
+
+    test "Keys created and deleted by a command are tracked in their slot" {
+        R 0 xadd "{user1}.a" * f v
+        R 0 xadd "{user1}.b" * f v
+        assert_equal [slot_keys user1] [list 2 [lsort [list "{user1}.a" "{user1}.b"]]]
+        R 0 del "{user1}.a"
+        assert_equal [slot_keys user1] [list 1 [list "{user1}.b"]]
+        R 0 del "{user1}.b"
+        assert_equal [slot_keys user1] {0 {}}
+    }
+
+    test "Keys created and deleted in a transaction are tracked in their slot" {
+        R 0 multi
+        R 0 xadd "{user2}.a" * f v
+        R 0 xadd "{user2}.b" * f v
+        R 0 del "{user2}.a"
+        R 0 exec
+        assert_equal [slot_keys user2] [list 1 [list "{user2}.b"]]
+        R 0 del "{user2}.b"
+    }
+
+    test "Keys created by scripts in different slots are tracked in their slot" {
+        R 0 eval {
+            redis.call('xadd', 'stream-a', '*', 'f', 'v')
+            redis.call('xadd', 'stream-b', '*', 'f', 'v')
+        } 0
+        assert_equal [slot_keys stream-a] {1 stream-a}
+        assert_equal [slot_keys stream-b] {1 stream-b}
+        R 0 eval {
+            redis.call('del', 'stream-a')
+            redis.call('del', 'stream-b')
+        } 0
+        assert_equal [slot_keys stream-a] {0 {}}
+        assert_equal [slot_keys stream-b] {0 {}}
+    }
+}
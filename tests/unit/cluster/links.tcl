@@ -163,16 +163,59 @@ start_cluster 3 0 {tags {external:skip cluster}} {
         set lines [R 0 cluster links]
         foreach l $lines {
             if {$l eq {}} continue
-            assert_equal [llength $l] 12
+            assert_equal [llength $l] 20
             assert_equal 1 [dict exists $l "direction"]
             assert_equal 1 [dict exists $l "node"]
             assert_equal 1 [dict exists $l "create-time"]
             assert_equal 1 [dict exists $l "events"]
             assert_equal 1 [dict exists $l "send-buffer-allocated"]
             assert_equal 1 [dict exists $l "send-buffer-used"]
+            assert_equal 1 [dict exists $l "messages-sent"]
+            assert_equal 1 [dict exists $l "messages-received"]
+            assert_equal 1 [dict exists $l "bytes-sent"]
+            assert_equal 1 [dict exists $l "bytes-received"]
         }
     }
 
+    test {Cluster links count messages and bytes} {
+        set lines [R 0 cluster links]
+        foreach l $lines {
+            if {$l eq {}} continue
+            assert {[dict get $l messages-received] > 0}
+            assert {[dict get $l bytes-sent] > 0}
+            # Past the first message, pings carry slot deltas rather than
+            # the whole 2KB slots bitmap.
+            assert {[dict get $l bytes-received] < [dict get $l messages-received] * 2256}
+        }
+        assert {[CI 0 cluster_stats_bytes_sent] > 0}
+        assert {[CI 0 cluster_stats_bytes_received] > 0}
+    }
+
+    test {Slot changes propagate through slot deltas} {
+        wait_for_condition 50 100 {
+            [CI 0 cluster_stats_messages_slots_delta_sent] > 0
+        } else {
+            fail "No slot deltas were sent"
+        }
+
+        set range [lindex [dict get [cluster_get_myself 0] slots] 0]
+        set slot [lindex [split $range -] 0]
+        set delta_sent [CI 0 cluster_stats_messages_slots_delta_sent]
+        # Owners that stop claiming a slot are not unbound by their peers,
+        # so unassign it everywhere and let the owner claim it back.
+        for {set j 0} {$j < 3} {incr j} {
+            R $j cluster delslots $slot
+        }
+        R 0 cluster addslots $slot
+        wait_for_condition 50 100 {
+            [CI 1 cluster_slots_assigned] == 16384 &&
+            [CI 2 cluster_slots_assigned] == 16384
+        } else {
+            fail "Assigned slot not propagated"
+        }
+        assert {[CI 0 cluster_stats_messages_slots_delta_sent] > $delta_sent}
+    }
+
     set primary1_id 0
     set primary2_id 1
 
@@ -0,0 +1,152 @@
+# Return a stream name served by the node 'id'.
+proc gather_key {id} {
+    for {set j 0} {1} {incr j} {
+        # Keys of other nodes are redirected.
+        if {![catch {R $id xlen "stream-$id-$j"}]} {
+            return "stream-$id-$j"
+        }
+    }
+}
+
+start_cluster 3 0 {tags {external:skip cluster}} {
+
+    set k0 [gather_key 0]
+    set k1 [gather_key 1]
+    set k2 [gather_key 2]
+
+    test "XGATHER reads the streams of every node" {
+        set id0 [R 0 xadd $k0 * item 0]
+        set id1 [R 1 xadd $k1 * item 1]
+        set id2 [R 2 xadd $k2 * item 2]
+
+        set res [R 0 xgather STREAMS $k0 $k1 $k2 0 0 0]
+        assert_equal [lsort -index 0 $res] [lsort -index 0 [list \
+            [list $k0 [list [list $id0 {item 0}]]] \
+            [list $k1 [list [list $id1 {item 1}]]] \
+            [list $k2 [list [list $id2 {item 2}]]]]]
+
+        # Streams with nothing new are omitted, as with XREAD.
+        set res [R 1 xgather STREAMS $k0 $k1 $k2 $id0 0 $id2]
+        assert_equal $res [list [list $k1 [list [list $id1 {item 1}]]]]
+
+        assert_equal {} [R 2 xgather STREAMS $k0 $k1 $k2 $id0 $id1 $id2]
+        assert_equal {} [R 2 xgather STREAMS missing-stream 0]
+    }
+
+    test "XGATHER RESP3 reply is a map" {
+        R 0 hello 3
+        set res [R 0 xgather COUNT 1 STREAMS $k1 $k2 0 0]
+        R 0 hello 2
+        assert_equal [lsort [dict keys $res]] [lsort [list $k1 $k2]]
+    }
+
+    test "XGATHER with GROUP reads for the consumer on every node" {
+        foreach id {0 1 2} key [list $k0 $k1 $k2] {
+            R $id xgroup create $key mygroup 0
+        }
+        set res [R 0 xgather GROUP mygroup alice STREAMS $k0 $k1 $k2 > > >]
+        assert_equal [llength $res] 3
+        foreach id {0 1 2} key [list $k0 $k1 $k2] {
+            assert_equal [lindex [R $id xpending $key mygroup] 0] 1
+        }
+
+        # Nothing left for the group.
+        assert_equal {} [R 0 xgather GROUP mygroup alice STREAMS $k0 $k1 $k2 > > >]
+    }
+
+    test "XGROUP SETDLQ requires the dead letter stream in the same slot" {
+        set other "dlq"
+        assert {[R 0 cluster keyslot $other] != [R 0 cluster keyslot $k0]}
+        assert_error "*same slot*" {R 0 xgroup setdlq $k0 mygroup $other 3}
+        assert_equal OK [R 0 xgroup setdlq $k0 mygroup "{$k0}dlq" 3]
+        R 0 xgroup setdlq $k0 mygroup "{$k0}dlq" 0
+    } {OK}
+
+    test "XGATHER returns the errors of the owners" {
+        assert_error "*NOGROUP*" {R 0 xgather GROUP nogroup alice STREAMS $k0 $k2 > >}
+        assert_error "*NOGROUP*" {R 0 xgather GROUP nogroup alice STREAMS $k2 >}
+        assert_error "*syntax*" {R 0 xgather COUNT 1 $k0 0}
+        assert_error "*Unbalanced*" {R 0 xgather STREAMS $k0 $k1 0}
+    }
+
+    test "XGATHER keys and write flag" {
+        assert_equal [list $k0 $k1] [R 0 command getkeys xgather COUNT 1 STREAMS $k0 $k1 0 0]
+        assert_equal [list $k0] [R 0 command getkeys xgather GROUP mygroup alice STREAMS $k0 >]
+
+        # Only the GROUP form writes, and is refused where writes are.
+        R 0 config set min-replicas-to-write 1
+        catch {R 0 xgather STREAMS $k0 $k1 0 0} res
+        assert_equal [llength $res] 2
+        assert_error "*NOREPLICAS*" {R 0 xgather GROUP mygroup alice STREAMS $k0 $k1 > >}
+        R 0 config set min-replicas-to-write 0
+    }
+
+    test "Blocking XGATHER is served by a remote XADD" {
+        set rd [redis_deferring_client]
+        $rd xgather BLOCK 0 STREAMS $k0 $k1 $k2 $ $ $
+        wait_for_blocked_clients_count 1
+        set id [R 2 xadd $k2 * item late]
+        assert_equal [$rd read] [list [list $k2 [list [list $id {item late}]]]]
+        assert_equal [s blocked_clients] 0
+
+        # The watches on the other nodes were dropped: the next XADDs don't
+        # reach the client.
+        R 1 xadd $k1 * item unseen
+        $rd xgather BLOCK 0 STREAMS $k0 $k1 $k2 $ $ $
+        wait_for_blocked_clients_count 1
+        set id [R 0 xadd $k0 * item local]
+        assert_equal [$rd read] [list [list $k0 [list [list $id {item local}]]]]
+        $rd close
+    }
+
+    test "Blocking XGATHER with GROUP is served by a remote XADD" {
+        R 0 xgather GROUP mygroup bob STREAMS $k0 $k1 $k2 > > >
+        set rd [redis_deferring_client]
+        $rd xgather GROUP mygroup bob BLOCK 0 STREAMS $k0 $k1 $k2 > > >
+        wait_for_blocked_clients_count 1
+        set id [R 1 xadd $k1 * item grouped]
+        assert_equal [$rd read] [list [list $k1 [list [list $id {item grouped}]]]]
+        assert_equal [lindex [R 1 xpending $k1 mygroup - + 10 bob] end 0] $id
+        $rd close
+    }
+
+    test "Blocking XGATHER times out" {
+        set rd [redis_deferring_client]
+        $rd xgather BLOCK 100 STREAMS $k0 $k1 $k2 $ $ $
+        assert_equal {} [$rd read]
+        $rd close
+        assert_equal [s blocked_clients] 0
+    }
+
+    test "XGATHER is not propagated" {
+        R 0 xadd $k0 * item again
+        set repl [attach_to_replication_stream]
+        R 0 xgather GROUP mygroup carol STREAMS $k0 $k1 >  >
+        R 0 xadd $k0 * item marker
+        assert_replication_stream $repl {
+            {select *}
+            {xclaim *}
+            {xadd *}
+        }
+        close_replication_stream $repl
+    } {} {needs:repl}
+}
+
+start_cluster 3 0 {tags {external:skip cluster}} {
+
+    test "Blocking XGATHER fails when a watching owner is lost" {
+        set k2 [gather_key 2]
+        set rd [redis_deferring_client]
+        $rd xgather BLOCK 0 STREAMS $k2 $
+        wait_for_blocked_clients_count 1
+
+        set node2_id [dict get [cluster_get_myself 2] id]
+        set node2_pid [srv -2 pid]
+        pause_process $node2_pid
+        wait_node_marked_fail 0 $node2_id
+        assert_error {*TRYAGAIN*} {$rd read}
+        assert_equal [s blocked_clients] 0
+        resume_process $node2_pid
+        $rd close
+    }
+}
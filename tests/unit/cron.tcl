@@ -0,0 +1,91 @@
+proc cronstat {task field} {
+    set stat [getInfoProperty [r info cronstats] cronstat_$task]
+    if {[regexp "$field=(\[0-9.\]+)" $stat -> value]} {
+        return $value
+    }
+}
+
+start_server {tags {"info" "external:skip"}} {
+    test {cronstats: cost of the cron tasks} {
+        # not part of the default sections
+        assert_equal [getInfoProperty [r info] cronstat_clients] {}
+
+        r config resetstat
+        after 350 ;# hz is 10, wait for a few cron ticks.
+        set info [r info cronstats]
+        foreach task {clients databases} {
+            set stat [getInfoProperty $info cronstat_$task]
+            assert_match {*usec_per_call=*max_usec=*over_budget=*interrupted=*} $stat
+            assert {[regexp {calls=(\d+)} $stat -> calls] && $calls > 0}
+        }
+    }
+
+    test {cronstats: only the ticks running a task are accounted} {
+        # replicationCron() runs once per second, the persistence checks only
+        # count while a child is around.
+        r config resetstat
+        after 1100
+        assert_range [cronstat replication calls] 1 2
+        assert_equal 0 [cronstat persistence calls]
+
+        r bgsave
+        waitForBgsave r
+        assert_morethan [cronstat persistence calls] 0
+    }
+
+    test {cron-task-budget cuts clientsCron short, the next tick goes on} {
+        set clients {}
+        for {set j 0} {$j < 300} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        r config resetstat
+        r config set cron-task-budget 1
+        wait_for_condition 50 100 {
+            [cronstat clients interrupted] > 0
+        } else {
+            fail "clientsCron was never cut short"
+        }
+        assert_morethan [cronstat clients over_budget] 0
+
+        # Every idle client is reached in the end, not only the ones at the
+        # head of the list.
+        r config set timeout 1
+        wait_for_condition 100 100 {
+            [s connected_clients] == 1
+        } else {
+            fail "Idle clients not closed: [s connected_clients]"
+        }
+        r config set timeout 0
+        r config set cron-task-budget 0
+        foreach rd $clients {
+            catch {$rd close}
+        }
+    }
+
+    test {cron-task-budget still lets databasesCron resize every database} {
+        r config set cron-task-budget 1
+        for {set db 0} {$db < 4} {incr db} {
+            r select $db
+            r debug populate 2000
+            for {set j 10} {$j < 2000} {incr j 500} {
+                set keys {}
+                for {set k $j} {$k < $j+500 && $k < 2000} {incr k} {
+                    lappend keys key:$k
+                }
+                r del {*}$keys
+            }
+        }
+        r select 3
+
+        # Each database is resized, not just the first one of every tick.
+        for {set db 0} {$db < 4} {incr db} {
+            wait_for_condition 100 100 {
+                [regexp {table size: 16\n} [r debug htstats $db]]
+            } else {
+                fail "Database $db not resized: [r debug htstats $db]"
+            }
+        }
+        r config set cron-task-budget 0
+        r flushall
+    } {OK} {needs:debug}
+}
@@ -0,0 +1,113 @@
+start_server {tags {"db-isolation external:skip"}} {
+    test {db-isolation-strict refuses the commands spanning databases} {
+        r config set db-isolation-strict yes
+        r select 0
+        r xadd mystream * f v
+        assert_error {*use FLUSHDB*} {r flushall}
+        assert_equal 1 [r exists mystream]
+
+        r multi
+        r select 0
+        r select 1
+        assert_error {*not allowed in transactions*} {r exec}
+        assert_error {*not allowed in transactions*} {
+            r eval {redis.call('select', 1)} 0
+        }
+
+        # SELECT alone still switches database.
+        r select 1
+        assert_equal 0 [r exists mystream]
+        r select 0
+        r config set db-isolation-strict no
+        r flushall
+        assert_equal 0 [r exists mystream]
+    }
+
+    test {db-isolation-slice postpones the database that used its share} {
+        r config set db-isolation-slice 1
+        r config resetstat
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        set rd3 [redis_deferring_client]
+        $rd1 select 1
+        $rd2 select 2
+        assert_equal OK [$rd1 read]
+        assert_equal OK [$rd2 read]
+
+        # Both pipelines are read in the same event loop iteration while the
+        # server sleeps: the first database served runs all of its commands,
+        # the second one waits for the next iteration after its first one.
+        # DEBUG SLEEP accesses no key, so it isn't charged to database 0.
+        $rd3 debug sleep 0.2
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 xadd s * n $j
+            $rd2 xadd s * n $j
+        }
+        $rd1 flush
+        $rd2 flush
+        assert_equal OK [$rd3 read]
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 read
+            $rd2 read
+        }
+        set postponed1 [s db_isolation_postponed_db1]
+        set postponed2 [s db_isolation_postponed_db2]
+        assert_equal {} [s db_isolation_postponed_db0]
+        assert {($postponed1 eq {} && $postponed2 > 0) ||
+                ($postponed2 eq {} && $postponed1 > 0)}
+        assert_equal [s db_isolation_postponed_commands] \
+                     [expr {$postponed1 eq {} ? $postponed2 : $postponed1}]
+        r select 1
+        assert_equal 100 [r xlen s]
+        r select 2
+        assert_equal 100 [r xlen s]
+
+        # A database alone never waits.
+        r select 1
+        r config resetstat
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 xadd s * n $j
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 read
+        }
+        assert_equal 0 [s db_isolation_postponed_commands]
+        $rd1 close
+        $rd2 close
+        $rd3 close
+        r select 0
+        r config set db-isolation-slice 0
+    } {OK} {needs:debug}
+
+    test {db-isolation-slice neither charges nor postpones keyless commands} {
+        r config set db-isolation-slice 1
+        r config resetstat
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        set rd3 [redis_deferring_client]
+        $rd1 select 1
+        $rd2 select 2
+        assert_equal OK [$rd1 read]
+        assert_equal OK [$rd2 read]
+
+        # Database 1 is the only one running commands with keys: it never
+        # waits, whatever DEBUG SLEEP and the PINGs of database 2 took.
+        $rd3 debug sleep 0.2
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 xadd s * n $j
+            $rd2 ping
+        }
+        $rd1 flush
+        $rd2 flush
+        assert_equal OK [$rd3 read]
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 read
+            assert_equal PONG [$rd2 read]
+        }
+        assert_equal 0 [s db_isolation_postponed_commands]
+        $rd1 close
+        $rd2 close
+        $rd3 close
+        r config set db-isolation-slice 0
+    } {OK} {needs:debug}
+}
@@ -1,4 +1,14 @@
 start_server {tags {"tls"}} {
+    test {CLIENT LIST reports how the TLS crypto is done} {
+        set cl [r client list id [r client id]]
+        if {$::tls} {
+            assert_match {* tls=*} $cl
+            assert_no_match {* tls=no*} $cl
+        } else {
+            assert_match {* tls=no*} $cl
+        }
+    }
+
     if {$::tls} {
         package require tls
 
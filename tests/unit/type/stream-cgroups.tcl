@@ -198,6 +198,44 @@ start_server {
         assert {[llength [lindex $res 0 1]] == 3}
     }
 
+    test {XREADGROUP > resumes correctly while the stream changes} {
+        r del mystream
+        set orig_max_entries [lindex [r config get stream-node-max-entries] 1]
+        # Big nodes: the entries count in the node header grows by a byte.
+        r config set stream-node-max-entries 300
+        r xgroup create mystream g1 $ MKSTREAM
+        r xgroup create mystream g2 $
+        set got1 {}
+        set got2 {}
+        for {set j 1} {$j <= 600} {incr j} {
+            r xadd mystream $j-1 f $j
+            foreach e [lindex [r xreadgroup group g1 c count 1 streams mystream >] 0 1] {
+                lappend got1 [lindex $e 1 1]
+            }
+            if {$j % 3 == 0} {
+                foreach e [lindex [r xreadgroup group g2 c count 3 streams mystream >] 0 1] {
+                    lappend got2 [lindex $e 1 1]
+                }
+            }
+            # Delete and trim entries both groups already read.
+            if {$j % 30 == 0} {r xdel mystream [expr {$j-10}]-1}
+            if {$j % 200 == 0} {r xtrim mystream minid [expr {$j-50}]-1}
+        }
+        set expected {}
+        for {set j 1} {$j <= 600} {incr j} {lappend expected $j}
+        assert_equal $expected $got1
+        assert_equal $expected $got2
+
+        # Moving the group elsewhere invalidates its position.
+        r xgroup setid mystream g1 550-1
+        set got1 {}
+        foreach e [lindex [r xreadgroup group g1 c streams mystream >] 0 1] {
+            lappend got1 [lindex $e 1 1]
+        }
+        assert_equal [lsearch -all -inline -not -regexp [lrange $expected 550 end] {^(560|590)$}] $got1
+        r config set stream-node-max-entries $orig_max_entries
+    }
+
     test {XREADGROUP history reporting of deleted entries. Bug #5570} {
         r del mystream
         r XGROUP CREATE mystream mygroup $ MKSTREAM
@@ -723,6 +761,130 @@ start_server {
         assert_equal [r XPENDING x grp - + 10 Alice] {}
     }
 
+    test {XGROUP SETDLQ sets and clears the dead letter stream} {
+        r DEL x dlq
+        r XADD x 1-0 f v
+        r XGROUP CREATE x grp 0
+        set group [lindex [r XINFO GROUPS x] 0]
+        assert_equal [dict get $group max-deliveries] 0
+        assert_equal [dict get $group dead-letter-key] {}
+
+        r XGROUP SETDLQ x grp dlq 3
+        set group [lindex [r XINFO GROUPS x] 0]
+        assert_equal [dict get $group max-deliveries] 3
+        assert_equal [dict get $group dead-letter-key] dlq
+
+        r XGROUP SETDLQ x grp dlq 0
+        set group [lindex [r XINFO GROUPS x] 0]
+        assert_equal [dict get $group max-deliveries] 0
+        assert_equal [dict get $group dead-letter-key] {}
+
+        assert_error "*different key*" {r XGROUP SETDLQ x grp x 3}
+        assert_error "*zero or positive*" {r XGROUP SETDLQ x grp dlq -1}
+        assert_error "*NOGROUP*" {r XGROUP SETDLQ x nogrp dlq 3}
+    }
+
+    test {XCLAIM moves entries delivered max-deliveries times to the dead letter stream} {
+        r DEL x dlq
+        r XADD x 1-0 f v1
+        r XADD x 2-0 f v2
+        r XGROUP CREATE x grp 0
+        r XGROUP SETDLQ x grp dlq 2
+        r XREADGROUP GROUP grp Alice STREAMS x >
+
+        # JUSTID doesn't count as a delivery, so it never dead letters.
+        assert_equal [r XCLAIM x grp Bob 0 1-0 JUSTID] {1-0}
+        assert_equal [r XCLAIM x grp Bob 0 1-0] {{1-0 {f v1}}}
+        assert_equal [r XCLAIM x grp Bob 0 1-0 JUSTID] {1-0}
+
+        # Third delivery of 1-0: it is moved and acknowledged instead.
+        assert_equal [r XCLAIM x grp Bob 0 1-0 2-0] {{2-0 {f v2}}}
+        set moved [r XRANGE dlq - +]
+        assert_equal [llength $moved] 1
+        assert_equal [lindex $moved 0 1] {f v1}
+        set pending [r XPENDING x grp - + 10]
+        assert_equal [llength $pending] 1
+        assert_equal [lindex $pending 0 0] 2-0
+        assert_equal [lindex $pending 0 3] 2
+        assert_equal [r XLEN x] 2
+    }
+
+    test {XAUTOCLAIM moves entries delivered max-deliveries times to the dead letter stream} {
+        r DEL x dlq
+        r XADD x 1-0 f v1
+        r XADD x 2-0 f v2
+        r XADD x 3-0 f v3
+        r XGROUP CREATE x grp 0
+        r XGROUP SETDLQ x grp dlq 1
+        r XREADGROUP GROUP grp Alice COUNT 2 STREAMS x >
+        r XREADGROUP GROUP grp Alice STREAMS x 0
+        r XREADGROUP GROUP grp Alice STREAMS x >
+
+        # 1-0 and 2-0 were delivered twice, 3-0 once: all of them reached
+        # the limit. The dead lettered entries count against COUNT.
+        assert_equal [r XAUTOCLAIM x grp Bob 0 0-0 COUNT 2] {3-0 {} {}}
+        assert_equal [r XAUTOCLAIM x grp Bob 0 0-0 JUSTID] {0-0 3-0 {}}
+        set moved [r XRANGE dlq - +]
+        assert_equal [llength $moved] 2
+        assert_equal [lindex $moved 0 1] {f v1}
+        assert_equal [lindex $moved 1 1] {f v2}
+        assert_equal [r XPENDING x grp] {1 3-0 3-0 {{Bob 1}}}
+    }
+
+    test {XCLAIM and XAUTOCLAIM don't dead letter to a key the user can't write} {
+        r DEL x dlq
+        r XADD x 1-0 f v1
+        r XGROUP CREATE x grp 0
+        r XGROUP SETDLQ x grp dlq 1
+        r XREADGROUP GROUP grp Alice STREAMS x >
+        r ACL SETUSER claimer on nopass +@all ~x %R~dlq
+        set rd [redis_client]
+        $rd AUTH claimer pass
+
+        # The entries are claimed as usual instead.
+        assert_equal [$rd XCLAIM x grp Bob 0 1-0] {{1-0 {f v1}}}
+        assert_equal [$rd XAUTOCLAIM x grp Bob 0 0-0] {0-0 {{1-0 {f v1}}} {}}
+        assert_equal [r EXISTS dlq] 0
+        assert_equal [r XPENDING x grp] {1 1-0 1-0 {{Bob 1}}}
+
+        # The default user can.
+        assert_equal [r XCLAIM x grp Bob 0 1-0] {}
+        assert_equal [r XLEN dlq] 1
+        $rd close
+        r ACL DELUSER claimer
+    } {1} {external:skip}
+
+    test {XDEADLETTER moves pending entries} {
+        r DEL x dlq
+        r XADD x 1-0 f v1
+        r XADD x 2-0 f v2
+        r XADD x 3-0 f v3
+        r XGROUP CREATE x grp 0
+        r XREADGROUP GROUP grp Alice COUNT 2 STREAMS x >
+
+        # 3-0 is not pending, 4-0 doesn't exist.
+        assert_equal [r XDEADLETTER x grp dlq DLQID 10-5 1-0 2-0 3-0 4-0] 2
+        assert_equal [r XRANGE dlq - +] {{10-5 {f v1}} {10-6 {f v2}}}
+        assert_equal [r XPENDING x grp] {0 {} {} {}}
+        assert_equal [r XDEADLETTER x grp dlq 1-0] 0
+        assert_equal [r XDEADLETTER x nogrp dlq 1-0] 0
+
+        assert_error "*equal or smaller*" {r XDEADLETTER x grp dlq DLQID 10-6 1-0}
+        assert_error "*different key*" {r XDEADLETTER x grp x 1-0}
+        assert_error "*Invalid stream ID*" {r XDEADLETTER x grp dlq 1-0 foo}
+    }
+
+    test {Dead letter streams survive DEBUG RELOAD} {
+        r DEL x dlq
+        r XADD x 1-0 f v
+        r XGROUP CREATE x grp 0
+        r XGROUP CREATE x other 0
+        r XGROUP SETDLQ x grp dlq 5
+        set groups [r XINFO GROUPS x]
+        r DEBUG RELOAD
+        assert_equal [r XINFO GROUPS x] $groups
+    } {} {needs:debug}
+
     test {XINFO FULL output} {
         r del x
         r XADD x 100 a 1
@@ -1157,6 +1319,32 @@ start_server {
                 }
             }
         }
+
+        test "Replication of entries moved to the dead letter stream" {
+            $replica replicaof $master_host $master_port
+            wait_for_condition 50 100 {
+                [s 0 master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+
+            $master DEL x dlq
+            $master XADD x 1-0 f v1
+            $master XADD x 2-0 f v2
+            $master XADD x 3-0 f v3
+            $master XGROUP CREATE x grp 0
+            $master XGROUP SETDLQ x grp dlq 1
+            $master XREADGROUP GROUP grp Alice STREAMS x >
+            assert_equal [$master XCLAIM x grp Bob 0 1-0] {}
+            assert_equal [$master XAUTOCLAIM x grp Bob 0 0-0] {0-0 {} {}}
+            wait_for_ofs_sync $master $replica
+            assert_equal [$master XLEN dlq] 3
+            assert_equal [$replica XRANGE dlq - +] [$master XRANGE dlq - +]
+            assert_equal [$replica XPENDING x grp] {0 {} {} {}}
+            set group [lindex [$replica XINFO GROUPS x] 0]
+            assert_equal [dict get $group max-deliveries] 1
+            assert_equal [dict get $group dead-letter-key] dlq
+        }
     }
 
     start_server {tags {"stream needs:debug"} overrides {appendonly yes aof-use-rdb-preamble no}} {
@@ -1170,5 +1358,32 @@ start_server {
             assert {[dict get [r xinfo stream mystream] length] == 0}
             assert_equal [r xinfo groups mystream] $grpinfo
         }
+
+        test {Dead letter streams are loaded from AOF, before and after AOFRW} {
+            r del mystream dlq
+            r XGROUP CREATE mystream mygroup $ MKSTREAM
+            r XGROUP SETDLQ mystream mygroup dlq 1
+            r XADD mystream 1-0 f v1
+            r XADD mystream 2-0 f v2
+            r XREADGROUP GROUP mygroup Alice STREAMS mystream ">"
+            r XCLAIM mystream mygroup Alice 0 1-0
+            set dlq [r XRANGE dlq - +]
+            set pending [r XPENDING mystream mygroup]
+            assert_equal [llength $dlq] 1
+            assert_equal [lindex $pending 0] 1
+
+            r debug loadaof
+            assert_equal [r XRANGE dlq - +] $dlq
+            assert_equal [r XPENDING mystream mygroup] $pending
+
+            r bgrewriteaof
+            waitForBgrewriteaof r
+            r debug loadaof
+            assert_equal [r XRANGE dlq - +] $dlq
+            assert_equal [r XPENDING mystream mygroup] $pending
+            set group [lindex [r xinfo groups mystream] 0]
+            assert_equal [dict get $group max-deliveries] 1
+            assert_equal [dict get $group dead-letter-key] dlq
+        }
     }
 }
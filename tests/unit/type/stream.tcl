@@ -709,6 +709,161 @@ start_server {
         $rd close
     }
 
+    test {XREAD WATERMARK returns a consistent cut across streams} {
+        r del s1 s2
+        r XADD s1 1-0 f a
+        r XADD s1 2-0 f b
+        r XADD s1 5-0 f c
+        r XADD s2 1-0 f d
+        r XADD s2 3-0 f e
+        r XADD s2 3-1 f g
+        # The watermark is 3 (the last ID of s2), so only entries with a
+        # millisecond time smaller than 3 are returned.
+        set res [r XREAD WATERMARK STREAMS s1 s2 0 0]
+        assert_equal [lindex $res 0] {s1 {{1-0 {f a}} {2-0 {f b}}}}
+        assert_equal [lindex $res 1] {s2 {{1-0 {f d}}}}
+        # Streams with nothing below the watermark are not reported.
+        set res [r XREAD WATERMARK STREAMS s1 s2 2-0 0]
+        assert_equal $res {{s2 {{1-0 {f d}}}}}
+        # COUNT is honored within the cut.
+        set res [r XREAD COUNT 1 WATERMARK STREAMS s1 s2 0 0]
+        assert_equal $res {{s1 {{1-0 {f a}}}} {s2 {{1-0 {f d}}}}}
+        # Advancing the slowest streams moves the watermark.
+        r XADD s2 6-0 f h
+        r XADD s1 7-0 f i
+        set res [r XREAD WATERMARK STREAMS s1 s2 2-0 1-0]
+        assert_equal [lindex $res 0] {s1 {{5-0 {f c}}}}
+        assert_equal [lindex $res 1] {s2 {{3-0 {f e}} {3-1 {f g}}}}
+    }
+
+    test {XREAD WATERMARK with a missing stream returns nothing} {
+        r del s1 s2
+        r XADD s1 1-0 f a
+        r XADD s1 2-0 f b
+        assert_equal {} [r XREAD WATERMARK STREAMS s1 s2 0 0]
+    }
+
+    test {XREAD WATERMARK blocks until the watermark moves} {
+        r del s1 s2
+        r XADD s1 5-0 f a
+        r XADD s2 1-0 f b
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 0 WATERMARK STREAMS s1 s2 0 1-0
+        wait_for_blocked_clients_count 1
+        # Still nothing in s1 below the watermark: the client keeps waiting.
+        r XADD s2 2-0 f c
+        wait_for_blocked_clients_count 1
+        r XADD s2 7-0 f d
+        set res [$rd read]
+        assert_equal $res {{s2 {{2-0 {f c}}}}}
+        $rd close
+    }
+
+    test {XREADGROUP with WATERMARK is not allowed} {
+        r del s1
+        r XGROUP CREATE s1 mygroup $ MKSTREAM
+        assert_error "*WATERMARK option is only supported by XREAD*" {
+            r XREADGROUP GROUP mygroup Alice WATERMARK STREAMS s1 >
+        }
+    }
+
+    test {XGATHER without cluster reads like XREAD} {
+        r del s1 s2
+        r XADD s1 1-0 f a
+        r XADD s2 2-0 f b
+        assert_equal [r XGATHER STREAMS s1 s2 0 0] [r XREAD STREAMS s1 s2 0 0]
+        assert_equal {} [r XGATHER STREAMS s1 s2 1-0 2-0]
+        r XGROUP CREATE s1 mygroup 0
+        assert_equal [r XGATHER GROUP mygroup Alice STREAMS s1 >] {{s1 {{1-0 {f a}}}}}
+        assert_equal [lindex [r XPENDING s1 mygroup] 0] 1
+        assert_error "*NOACK*" {r XGATHER NOACK STREAMS s1 0}
+    }
+
+    test {Blocking XGATHER is served by XADD} {
+        r del s1 s2
+        r XADD s1 1-0 f a
+        set rd [redis_deferring_client]
+        $rd XGATHER BLOCK 0 STREAMS s1 s2 $ $
+        wait_for_blocked_clients_count 1
+        r XADD s2 3-0 f c
+        assert_equal [$rd read] {{s2 {{3-0 {f c}}}}}
+        $rd XGATHER BLOCK 50 STREAMS s1 s2 $ $
+        assert_equal [$rd read] {}
+        $rd close
+    }
+
+    test {XGATHER checks the permissions of the reads} {
+        r ACL SETUSER gatherer on nopass +xgather ~s1
+        set rd [redis_client]
+        $rd AUTH gatherer pass
+        assert_error "*NOPERM*xread*" {$rd XGATHER STREAMS s1 0}
+        r ACL SETUSER gatherer +xread
+        assert_error "*NOPERM*key*" {$rd XGATHER STREAMS s1 s2 0 0}
+        assert_error "*NOPERM*xreadgroup*" {$rd XGATHER GROUP mygroup Alice STREAMS s1 >}
+        assert_equal [$rd XGATHER STREAMS s1 0] {{s1 {{1-0 {f a}}}}}
+        $rd close
+        r ACL DELUSER gatherer
+    } {1} {external:skip}
+
+    test {XADD IDEMPOTENT returns the original ID on retry} {
+        r del mystream
+        set id1 [r XADD mystream IDEMPOTENT req-1 * f v1]
+        set id2 [r XADD mystream IDEMPOTENT req-2 * f v2]
+        assert {$id1 ne $id2}
+        assert_equal $id1 [r XADD mystream IDEMPOTENT req-1 * f other]
+        assert_equal $id2 [r XADD mystream IDEMPOTENT req-2 MAXLEN 0 * f v2]
+        assert_equal 2 [r XLEN mystream]
+        # The key is remembered even if the entry is no longer there.
+        r XTRIM mystream MAXLEN 0
+        assert_equal $id1 [r XADD mystream IDEMPOTENT req-1 * f v1]
+        assert_equal 0 [r XLEN mystream]
+    }
+
+    test {XADD IDEMPOTENT keys are aged out by stream ID time} {
+        r del mystream
+        r config set stream-idempotency-window 1000
+        r XADD mystream IDEMPOTENT a 1000-0 f v
+        r XADD mystream IDEMPOTENT b 2000-0 f v
+        assert_equal 1000-0 [r XADD mystream IDEMPOTENT a * f v]
+        r XADD mystream IDEMPOTENT c 2001-0 f v
+        assert_equal 2001-1 [r XADD mystream IDEMPOTENT a 2001-1 f v]
+        assert_equal 2000-0 [r XADD mystream IDEMPOTENT b * f v]
+        r config set stream-idempotency-window 300000
+    }
+
+    test {XADD IDEMPOTENT keys are capped by stream-idempotency-max-keys} {
+        r del mystream
+        r config set stream-idempotency-max-keys 2
+        r XADD mystream IDEMPOTENT a 1-0 f v
+        r XADD mystream IDEMPOTENT b 2-0 f v
+        r XADD mystream IDEMPOTENT c 3-0 f v
+        assert_equal 2-0 [r XADD mystream IDEMPOTENT b * f v]
+        assert_equal 4-0 [r XADD mystream IDEMPOTENT a 4-0 f v]
+        assert_equal 4 [r XLEN mystream]
+        r config set stream-idempotency-max-keys 10000
+    }
+
+    test {XADD IDEMPOTENT keys change the RDB type, digest and memory usage} {
+        r del mystream
+        r XADD mystream 1-0 f v
+        # Without keys, the type older versions can load.
+        binary scan [r DUMP mystream] c type
+        assert_equal 21 $type
+        set digest [r DEBUG DIGEST-VALUE mystream]
+        set usage [r MEMORY USAGE mystream]
+
+        # The same entry, added with a key.
+        r del mystream
+        r XADD mystream IDEMPOTENT [string repeat k 100] 1-0 f v
+        binary scan [r DUMP mystream] c type
+        assert_equal 100 $type
+        assert {[r DEBUG DIGEST-VALUE mystream] ne $digest}
+        assert_morethan [r MEMORY USAGE mystream] $usage
+
+        r debug reload
+        assert_equal 1-0 [r XADD mystream IDEMPOTENT [string repeat k 100] * f v]
+    } {} {needs:debug}
+
     test {XADD streamID edge} {
         r del x
         r XADD x 2577343934890-18446744073709551615 f v ;# we need the timestamp to be in the future
@@ -1601,6 +1756,388 @@ start_server {tags {"stream needs:debug"} overrides {appendonly yes aof-use-rdb-
         assert {[dict get [r xinfo stream mystream] length] == 1}
         assert_equal [dict get [r xinfo stream mystream] last-generated-id] "2-2"
     }
+
+    test {XADD IDEMPOTENT keys survive AOF rewrite and RDB reload} {
+        r del mystream
+        r XADD mystream IDEMPOTENT a 1-1 f v
+        r XADD mystream IDEMPOTENT b 2-1 f v
+        r XADD mystream 3-1 f v
+        r XADD mystream IDEMPOTENT c 4-1 f v
+        r XADD mystream IDEMPOTENT d 5-1 f v
+        r XDEL mystream 2-1 5-1
+        set info [r XINFO STREAM mystream]
+
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $info [r XINFO STREAM mystream]
+        foreach {key id} {a 1-1 b 2-1 c 4-1 d 5-1} {
+            assert_equal $id [r XADD mystream IDEMPOTENT $key * f v]
+        }
+
+        r debug reload
+        assert_equal $info [r XINFO STREAM mystream]
+        foreach {key id} {a 1-1 b 2-1 c 4-1 d 5-1} {
+            assert_equal $id [r XADD mystream IDEMPOTENT $key * f v]
+        }
+    }
+}
+
+start_server {tags {"stream needs:debug"} overrides {appendonly yes stream-node-max-entries 10 stream-large-value-threshold 100}} {
+    proc add_mixed_entries {key count} {
+        set items {}
+        for {set j 1} {$j <= $count} {incr j} {
+            set big [string repeat [format %c [expr {97 + $j % 26}]] [expr {100 + $j * 7}]]
+            if {$j % 3 == 0} {
+                set fields [list other $j]
+            } else {
+                set fields [list small $j big $big number 12345]
+            }
+            r XADD $key $j-1 {*}$fields
+            lappend items [list $j-1 $fields]
+        }
+        return $items
+    }
+
+    test {XADD stores large values out of line transparently} {
+        r del mystream
+        set items [add_mixed_entries mystream 50]
+        assert_equal $items [r XRANGE mystream - +]
+        assert_equal [lreverse $items] [r XREVRANGE mystream + -]
+        assert_equal [lrange $items 10 14] [r XRANGE mystream 11-1 + COUNT 5]
+        assert_equal [lreverse [lrange $items 35 39]] [r XREVRANGE mystream 40-1 - COUNT 5]
+
+        # The values stay out of line even if the threshold changes.
+        r config set stream-large-value-threshold 0
+        assert_equal $items [r XRANGE mystream - +]
+        r config set stream-large-value-threshold 100
+    }
+
+    test {XDEL and XTRIM release the out of line values} {
+        r del mystream
+        r XADD mystream 1-1 small 1
+        set empty_usage [r memory usage mystream]
+        r del mystream
+
+        set items [add_mixed_entries mystream 50]
+        r XDEL mystream 2-1 4-1 25-1
+        r XTRIM mystream MINID 15-1
+        set items [lsearch -all -inline -not -regexp $items {^(2|4|25)-1 }]
+        assert_equal [lrange $items 12 end] [r XRANGE mystream - +]
+
+        r XTRIM mystream MAXLEN 1
+        r XADD mystream 51-1 small 1
+        r XDEL mystream 50-1
+        assert_range [r memory usage mystream] 1 [expr {$empty_usage * 2}]
+    }
+
+    test {Deleted out of line values don't change the RDB type} {
+        r del mystream
+        r XADD mystream 1-1 big [string repeat x 200]
+        r XADD mystream 2-1 small 2
+        r XADD mystream 3-1 big [string repeat y 200] small 3
+        r XADD mystream 4-1 small 4
+        binary scan [r DUMP mystream] c type
+        assert_equal 101 $type
+
+        # Neither XTRIM nor XDEL leave flagged entries behind.
+        r XTRIM mystream MINID 2-1
+        r XDEL mystream 3-1
+        binary scan [r DUMP mystream] c type
+        assert_equal 21 $type
+
+        set items [r XRANGE mystream - +]
+        r config set sanitize-dump-payload yes
+        set dump [r DUMP mystream]
+        r del mystream
+        r RESTORE mystream 0 $dump
+        assert_equal $items [r XRANGE mystream - +]
+        r debug reload
+        assert_equal $items [r XRANGE mystream - +]
+        r config set sanitize-dump-payload no
+    } {OK} {needs:debug}
+
+    test {Out of line values survive RDB reload, AOF rewrite and RESTORE} {
+        r del mystream
+        set items [add_mixed_entries mystream 30]
+        r XDEL mystream 5-1
+        set items [r XRANGE mystream - +]
+        set digest [r debug digest-value mystream]
+
+        r debug reload
+        assert_equal $items [r XRANGE mystream - +]
+        assert_equal $digest [r debug digest-value mystream]
+
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $items [r XRANGE mystream - +]
+
+        r config set sanitize-dump-payload yes
+        set dump [r DUMP mystream]
+        r del mystream
+        r RESTORE mystream 0 $dump
+        assert_equal $items [r XRANGE mystream - +]
+        r XADD mystream 100-1 big [string repeat x 200]
+        assert_equal [string repeat x 200] [lindex [r XRANGE mystream 100-1 100-1] 0 1 1]
+    }
+}
+
+start_server {tags {"stream needs:debug"} overrides {stream-node-max-entries 10 stream-tiering-age 500}} {
+    proc tier_stat {field} {
+        getInfoProperty [r info stats] stream_tier_$field
+    }
+
+    proc wait_for_spilled {nodes} {
+        wait_for_condition 100 50 {
+            [tier_stat nodes] == $nodes
+        } else {
+            fail "Stream nodes not spilled: [tier_stat nodes]"
+        }
+    }
+
+    proc add_old_entries {key count} {
+        set items {}
+        for {set j 1} {$j <= $count} {incr j} {
+            r XADD $key $j-1 item $j
+            lappend items [list $j-1 [list item $j]]
+        }
+        return $items
+    }
+
+    test {Cold stream nodes are spilled and read back} {
+        r del mystream
+        r config resetstat
+        set items [add_old_entries mystream 100]
+        # The last node is never spilled.
+        wait_for_spilled 9
+        assert_equal $items [r XRANGE mystream - +]
+        assert_equal [tier_stat nodes] 0
+        assert {[tier_stat misses] >= 9}
+        assert {[tier_stat fault_usec] > 0}
+
+        # Nodes read back are spilled again once they get cold.
+        wait_for_spilled 9
+        assert_equal [lreverse [lrange $items 20 24]] [r XREVRANGE mystream 25-1 - COUNT 5]
+        assert_equal [lrange $items 42 44] [r XRANGE mystream 43-1 + COUNT 3]
+        assert_equal [lindex $items 0] [dict get [r XINFO STREAM mystream] first-entry]
+        assert_equal 100 [r XLEN mystream]
+    }
+
+    test {Commands that can't block read spilled nodes synchronously} {
+        wait_for_spilled 9
+        set sync_faults [tier_stat sync_faults]
+        r multi
+        r XRANGE mystream 1-1 1-1
+        r XDEL mystream 2-1
+        set res [r exec]
+        assert_equal {{1-1 {item 1}}} [lindex $res 0]
+        assert_equal 1 [lindex $res 1]
+        assert {[tier_stat sync_faults] > $sync_faults}
+        assert_equal 99 [r XLEN mystream]
+    }
+
+    test {Consumer groups read spilled nodes} {
+        r del mystream
+        set items [add_old_entries mystream 100]
+        r XGROUP CREATE mystream mygroup 0
+        wait_for_spilled 9
+        set res [r XREADGROUP GROUP mygroup alice COUNT 100 STREAMS mystream >]
+        assert_equal $items [lindex $res 0 1]
+
+        wait_for_spilled 9
+        set res [r XREADGROUP GROUP mygroup alice COUNT 5 STREAMS mystream 30-1]
+        assert_equal [lrange $items 30 34] [lindex $res 0 1]
+
+        wait_for_spilled 9
+        assert_equal [lrange $items 50 51] [r XCLAIM mystream mygroup bob 0 51-1 52-1]
+        wait_for_spilled 9
+        set res [r XAUTOCLAIM mystream mygroup bob 0 0-0 COUNT 3]
+        assert_equal [lrange $items 0 2] [lindex $res 1]
+    }
+
+    test {Spilled nodes survive trimming and reload} {
+        r del mystream
+        set items [add_old_entries mystream 100]
+        wait_for_spilled 9
+        r XTRIM mystream MINID 35-1
+        assert_equal 66 [r XLEN mystream]
+        assert {[tier_stat nodes] <= 7}
+        assert_equal [lrange $items 34 end] [r XRANGE mystream - +]
+
+        wait_for_spilled 6
+        set digest [r debug digest-value mystream]
+        r debug reload
+        assert_equal $digest [r debug digest-value mystream]
+        assert_equal [lrange $items 34 end] [r XRANGE mystream - +]
+
+        wait_for_spilled 6
+        r del mystream
+        assert_equal 0 [tier_stat nodes]
+        assert_equal 0 [tier_stat bytes]
+    }
+}
+
+start_server {tags {"stream needs:debug"} overrides {stream-node-max-entries 10 rdbcompression no stream-mmap-load yes}} {
+    proc mapped_nodes {} {
+        getInfoProperty [r info stats] stream_tier_mapped_nodes
+    }
+
+    test {Stream nodes are left in the mapped RDB file at loading} {
+        r del mystream
+        for {set j 1} {$j <= 100} {incr j} {
+            r XADD mystream $j-1 item $j
+        }
+        set items [r XRANGE mystream - +]
+        set digest [r debug digest]
+        r debug reload
+        assert_equal 10 [mapped_nodes]
+        assert_equal 100 [r XLEN mystream]
+
+        # Nodes are copied from the mapping as they are accessed.
+        assert_equal [lrange $items 0 4] [r XRANGE mystream - + COUNT 5]
+        assert_range [mapped_nodes] 1 9
+        assert_equal $items [r XRANGE mystream - +]
+        assert_equal 0 [mapped_nodes]
+        assert_equal $digest [r debug digest]
+    }
+
+    test {Writes to streams loaded from a mapped RDB file} {
+        r debug reload
+        assert_equal 10 [mapped_nodes]
+        r XDEL mystream 15-1
+        r XTRIM mystream MINID 31-1
+        r XADD mystream 101-1 item 101
+        assert_equal 71 [r XLEN mystream]
+        assert_equal {31-1 {item 31}} [lindex [r XRANGE mystream - + COUNT 1] 0]
+
+        # Saving reads the nodes left in the file.
+        set items [r XRANGE mystream - +]
+        r debug reload
+        r debug reload
+        assert_equal $items [r XRANGE mystream - +]
+        r del mystream
+        assert_equal 0 [mapped_nodes]
+    }
+}
+
+set server_path [tmpdir "server.stream-mmap-load"]
+start_server [list tags {"stream external:skip"} overrides [list dir $server_path stream-node-max-entries 10 rdbcompression no]] {
+    test {A corrupted node fails the checksum of a mapped RDB file} {
+        for {set j 1} {$j <= 100} {incr j} {
+            r XADD mystream $j-1 item [string repeat x 20]-$j
+        }
+        r save
+        set fd [open [file join $server_path dump.rdb] r+]
+        fconfigure $fd -translation binary
+        set pos [string first "[string repeat x 20]-50" [read $fd]]
+        assert_morethan $pos 0
+        seek $fd $pos
+        puts -nonewline $fd y
+        close $fd
+
+        set srv [start_server [list overrides [list dir $server_path stream-mmap-load yes] keep_persistence true]]
+        wait_for_condition 50 100 {
+            [string match {*CRC error*} \
+                [exec tail -10 < [dict get $srv stdout]]]
+        } else {
+            fail "Server loaded a corrupted mapped RDB file"
+        }
+        kill_server $srv
+    }
+}
+
+start_server {tags {"stream"} overrides {stream-reply-slice-entries 10}} {
+    test {XRANGE replies to big ranges in slices} {
+        r del mystream
+        set items {}
+        for {set j 1} {$j <= 1000} {incr j} {
+            r XADD mystream $j-1 item $j
+            lappend items [list $j-1 [list item $j]]
+        }
+        assert_equal $items [r XRANGE mystream - +]
+        assert_equal [lreverse $items] [r XREVRANGE mystream + -]
+        assert_equal [lrange $items 99 598] [r XRANGE mystream 100 (600 COUNT 500]
+        assert_equal [lreverse [lrange $items 500 999]] [r XREVRANGE mystream + - COUNT 500]
+        assert_equal [lrange $items 0 9] [r XRANGE mystream - + COUNT 10]
+
+        # Pipelined commands are served once the reply is complete.
+        set rd [redis_deferring_client]
+        $rd XRANGE mystream - +
+        $rd PING
+        assert_equal $items [$rd read]
+        assert_equal PONG [$rd read]
+        $rd close
+
+        # Transactions get the reply at once.
+        r multi
+        r XRANGE mystream - +
+        assert_equal [list $items] [r exec]
+    }
+
+    proc fill_big_stream {value} {
+        r del mystream
+        set rd [redis_deferring_client]
+        for {set j 1} {$j <= 1000} {incr j} {
+            $rd XADD mystream $j-1 item $value
+        }
+        for {set j 1} {$j <= 1000} {incr j} {
+            $rd read
+        }
+        $rd close
+    }
+
+    test {XRANGE in slices is finished before its entries are deleted} {
+        set value [string repeat x 10000]
+        set items {}
+        for {set j 1} {$j <= 1000} {incr j} {
+            lappend items [list $j-1 [list item $value]]
+        }
+
+        foreach deletion {
+            {r XTRIM mystream MAXLEN 0}
+            {r XDEL mystream 1000-1}
+            {r DEL mystream}
+            {r FLUSHALL}
+        } {
+            fill_big_stream $value
+            set rd [redis_deferring_client]
+            $rd XRANGE mystream - +
+            # The client doesn't read: its reply stops when the socket is full.
+            wait_for_blocked_client
+            eval $deletion
+            assert_equal 0 [s blocked_clients]
+            assert_equal $items [$rd read]
+            $rd close
+        }
+    }
+
+    test {XRANGE is not sliced for clients that may receive pushes} {
+        set value [string repeat x 10000]
+        fill_big_stream $value
+        set rd [redis_deferring_client]
+        $rd HELLO 3
+        $rd read
+        $rd CLIENT TRACKING on
+        $rd read
+        $rd XLEN mystream
+        assert_equal 1000 [$rd read]
+        $rd XRANGE mystream - +
+        wait_for_condition 50 100 {
+            [string match {*cmd=xrange *} [r client list]]
+        } else {
+            fail "XRANGE not executed"
+        }
+        assert_equal 0 [s blocked_clients]
+
+        # The invalidation follows the whole reply.
+        r XADD mystream 1001-1 item new
+        set reply [$rd read]
+        assert_equal 1000 [llength $reply]
+        assert_equal [list 1000-1 [list item $value]] [lindex $reply end]
+        assert_equal {invalidate mystream} [$rd read]
+        $rd close
+    }
 }
 
 start_server {tags {"stream"}} {
@@ -1614,3 +2151,82 @@ start_server {tags {"stream"}} {
         assert_match "*wrong number of arguments for 'xinfo|help' command" $e
     }
 }
+
+start_server {tags {"stream tracking"}} {
+    set rd_redirection [redis_deferring_client]
+    $rd_redirection client id
+    set redir_id [$rd_redirection read]
+    $rd_redirection subscribe __redis__:invalidate
+    $rd_redirection read ; # Consume the SUBSCRIBE reply.
+    set rw [redis_client]
+
+    test {Stream metadata is tracked as a normal key when the delay is disabled} {
+        r CLIENT TRACKING on REDIRECT $redir_id
+        $rw XADD mystream * f v
+        r XLEN mystream
+        assert_equal 0 [s tracking_stream_meta_keys]
+        assert_equal 1 [s tracking_total_keys]
+        $rw XADD mystream * f v
+        assert_equal {mystream} [lindex [$rd_redirection read] 2]
+    }
+
+    test {Stream metadata invalidations are delayed and coalesced} {
+        r config set tracking-stream-meta-delay 200
+        $rw XGROUP CREATE mystream mygroup 0
+        r XLEN mystream
+        r XINFO GROUPS mystream
+        assert_equal 1 [s tracking_stream_meta_keys]
+        assert_equal 0 [s tracking_total_keys]
+
+        set start [clock milliseconds]
+        $rw XADD mystream * f v
+        $rw XADD mystream * f v
+        $rw XADD mystream * f v
+        assert_equal {mystream} [lindex [$rd_redirection read] 2]
+        assert_morethan_equal [expr {[clock milliseconds] - $start}] 150
+        assert_equal 0 [s tracking_stream_meta_keys]
+
+        # Just one invalidation was sent for the three writes: the next
+        # message is about another key, tracked as usual by XRANGE.
+        r XRANGE otherstream - +
+        $rw XADD otherstream * f v
+        assert_equal {otherstream} [lindex [$rd_redirection read] 2]
+        r config set tracking-stream-meta-delay 0
+    }
+
+    test {Stream metadata keys count against tracking-table-max-keys} {
+        r config set tracking-stream-meta-delay 9223372036854775807
+        r config set tracking-table-max-keys 1
+        r XLEN stream1
+        r XLEN stream2
+        r PING
+        assert_equal 1 [s tracking_stream_meta_keys]
+        set evicted [lindex [$rd_redirection read] 2]
+        assert {$evicted eq {stream1} || $evicted eq {stream2}}
+        r config set tracking-table-max-keys 0
+
+        # The longest delay doesn't overflow into an immediate invalidation.
+        $rw XADD stream1 * f v
+        $rw XADD stream2 * f v
+        r XRANGE otherstream - +
+        $rw XADD otherstream * f v
+        assert_equal {otherstream} [lindex [$rd_redirection read] 2]
+        r config set tracking-stream-meta-delay 0
+    } {OK}
+
+    test {Lowering tracking-stream-meta-delay doesn't wait for the longer delays} {
+        r config set tracking-stream-meta-delay 9223372036854775807
+        r XLEN stream3
+        $rw XADD stream3 * f v
+
+        # Scheduled after stream3, but due long before it.
+        r config set tracking-stream-meta-delay 100
+        r XLEN stream4
+        $rw XADD stream4 * f v
+        assert_equal {stream4} [lindex [$rd_redirection read] 2]
+        r config set tracking-stream-meta-delay 0
+    } {OK}
+
+    $rd_redirection close
+    $rw close
+}
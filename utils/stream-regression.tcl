@@ -0,0 +1,411 @@
+#!/usr/bin/env tclsh8.5
+# Stream performance regression harness.
+#
+# Runs a fixed set of stream workloads against a local redqueue-server built
+# in ../src, one fresh server per run, and records for each workload the
+# throughput, the p50/p99/p99.9 latency, the RSS and the server CPU time in
+# a CSV file. When a baseline file produced by a previous run is given, the
+# results are compared against it and the script exits with an error if a
+# metric got worse than the thresholds allow.
+#
+# Typical use, comparing a change against the commit it is based on:
+#
+#   cd utils
+#   git stash; make -C ../src; ./stream-regression.tcl --output base.csv
+#   git stash pop; make -C ../src
+#   ./stream-regression.tcl --output new.csv --baseline base.csv
+#
+# Released under the BSD license like Redis itself
+
+source ../tests/support/redis.tcl
+
+set ::port 12123
+set ::server ../src/redqueue-server
+set ::benchmark ../src/redqueue-benchmark
+set ::workdir stream-regression-data
+set ::output stream-regression.csv
+set ::baseline {}
+set ::workloads {xadd xadd_maxlen xdelay xreadgroup_xack xautoclaim del_expiring rdb_load}
+set ::requests 200000
+set ::clients 50
+set ::datasize 100
+set ::runs 3
+set ::seed 12345
+set ::pel_size 1000000
+set ::del_streams 100
+set ::del_items 10000
+set ::rdb_mb 1024
+set ::threshold 5
+set ::latency_threshold 10
+
+# Columns of the results file, the first one is the workload name. Latency
+# columns are empty for the workloads not measuring them.
+set ::columns {workload ops_per_sec p50_ms p99_ms p999_ms rss_bytes cpu_sec}
+
+# ----------------------------------------------------------------------------
+# Server handling
+# ----------------------------------------------------------------------------
+
+proc start-server {{keepdata 0}} {
+    if {!$keepdata} {
+        file delete -force $::workdir
+        file mkdir $::workdir
+    }
+    set fd [open $::workdir/redqueue.conf w]
+    puts $fd "port $::port"
+    puts $fd "dir [file normalize $::workdir]"
+    puts $fd "save \"\""
+    puts $fd "appendonly no"
+    puts $fd "loglevel warning"
+    puts $fd "logfile redqueue.log"
+    close $fd
+    set ::pid [exec $::server $::workdir/redqueue.conf &]
+
+    # Wait for the server to accept commands, including the time spent
+    # loading the dataset, which is what rdb_load measures.
+    set start [clock milliseconds]
+    while 1 {
+        if {![catch {
+            set r [redis 127.0.0.1 $::port]
+            set reply [$r ping]
+        } err] && $reply eq {PONG}} {
+            break
+        }
+        if {[info exists r]} {catch {$r close}; unset r}
+        if {[clock milliseconds] - $start > 600000} {
+            puts "The server didn't start, see $::workdir/redqueue.log"
+            exit 1
+        }
+        after 10
+    }
+    set ::r $r
+    return [expr {[clock milliseconds] - $start}]
+}
+
+proc stop-server {} {
+    catch {$::r shutdown nosave}
+    catch {$::r close}
+    # Wait for the process to exit, so that the port is free for the next run.
+    while {![catch {exec kill -0 $::pid}]} {
+        after 10
+    }
+}
+
+# Return the value of the INFO field 'field'.
+proc info-field {field} {
+    if {[regexp "\r\n$field:(.*?)\r\n" [$::r info] -> value]} {
+        return $value
+    }
+    return {}
+}
+
+proc server-cpu {} {
+    expr {[info-field used_cpu_user] + [info-field used_cpu_sys]}
+}
+
+# ----------------------------------------------------------------------------
+# Load generation
+# ----------------------------------------------------------------------------
+
+# Run redqueue-benchmark with the command line 'cmd' and return its CSV
+# result as a dict with ops_per_sec and the latency percentiles.
+proc bench {cmd {options {}}} {
+    set output [exec -ignorestderr $::benchmark -p $::port -c $::clients -n $::requests \
+                     --seed $::seed --csv {*}$options {*}$cmd]
+    set line [lindex [split [string trim $output] "\n"] end]
+    set fields [split [string map {\" {}} $line] ","]
+    lassign $fields title rps avg min p50 p95 p99 max p999
+    dict create ops_per_sec $rps p50_ms $p50 p99_ms $p99 p999_ms $p999
+}
+
+# Same as bench but only used to populate the dataset: the results are
+# discarded.
+proc fill {requests cmd {options {}}} {
+    exec -ignorestderr $::benchmark -p $::port -c $::clients -n $requests \
+         --seed $::seed -q -P 64 {*}$options {*}$cmd
+}
+
+proc value {size} {
+    string repeat x $size
+}
+
+# Compute the percentile 'p' of a list of latencies in milliseconds.
+proc percentile {samples p} {
+    set samples [lsort -real $samples]
+    set idx [expr {int(ceil([llength $samples]*$p/100.0))-1}]
+    if {$idx < 0} {set idx 0}
+    format %.3f [lindex $samples $idx]
+}
+
+# ----------------------------------------------------------------------------
+# Workloads
+#
+# Each workload runs against a fresh server and returns a dict with the
+# measured metrics. RSS and CPU are added by run-workload.
+# ----------------------------------------------------------------------------
+
+proc workload-xadd {} {
+    bench [list XADD regression:xadd * field [value $::datasize]]
+}
+
+proc workload-xadd_maxlen {} {
+    bench [list XADD regression:xadd MAXLEN ~ 100000 * field [value $::datasize]]
+}
+
+proc workload-xdelay {} {
+    bench [list XDELAY regression:xdelay MX 3600000 * field [value $::datasize]]
+}
+
+# A full consume cycle, XREADGROUP of one entry then XACK of it. It runs as
+# a script so that the ID returned by the first command can be used by the
+# second one without an extra client round trip being measured.
+proc workload-xreadgroup_xack {} {
+    $::r xgroup create regression:consume group $ MKSTREAM
+    fill $::requests [list XADD regression:consume * field [value $::datasize]]
+    set script {
+        local r = redis.call('XREADGROUP','GROUP','group','consumer','COUNT','1','STREAMS',KEYS[1],'>')
+        if r then redis.call('XACK',KEYS[1],'group',r[1][2][1][1]) end
+        return 1
+    }
+    bench [list EVAL $script 1 regression:consume]
+}
+
+# XAUTOCLAIM of 100 entries at a time from a group with a large PEL. Each
+# call does a hundred times the work of the other workloads requests, so
+# it runs a tenth of them.
+proc workload-xautoclaim {} {
+    fill $::pel_size [list XADD regression:pel * field [value $::datasize]]
+    $::r xgroup create regression:pel group 0
+    # XREADGROUP runs as a script, as the ">" argument can't be passed to
+    # exec, and so that the entries aren't sent back.
+    set script {
+        redis.call('XREADGROUP','GROUP','group','consumer','COUNT','1000','STREAMS',KEYS[1],'>')
+        return 1
+    }
+    fill [expr {$::pel_size/1000}] [list EVAL $script 1 regression:pel] {-c 1 -P 1}
+    bench {XAUTOCLAIM regression:pel group claimer 0 0-0 COUNT 100} \
+          [list -n [expr {$::requests/10}]]
+}
+
+# DEL of streams whose items all have an expire time, which also has to
+# remove the items expiration keys. Each DEL is timed on its own.
+proc workload-del_expiring {} {
+    fill [expr {$::del_streams*$::del_items}] \
+         [list XADD regression:del:__rand_int__ EX 3600 * field [value $::datasize]] \
+         [list -r $::del_streams]
+    # The streams names are the ones __rand_int__ expands to, the other keys
+    # are the items expiration keys.
+    set keys {}
+    for {set j 0} {$j < $::del_streams} {incr j} {
+        set key [format "regression:del:%012d" $j]
+        if {[$::r exists $key]} {lappend keys $key}
+    }
+    set samples {}
+    set start [clock microseconds]
+    foreach key $keys {
+        set t [clock microseconds]
+        $::r del $key
+        lappend samples [expr {([clock microseconds]-$t)/1000.0}]
+    }
+    set elapsed [expr {([clock microseconds]-$start)/1000000.0}]
+    dict create ops_per_sec [format %.2f [expr {[llength $keys]/$elapsed}]] \
+                p50_ms [percentile $samples 50] \
+                p99_ms [percentile $samples 99] \
+                p999_ms [percentile $samples 99.9]
+}
+
+# Generate a dataset of about rdb_mb megabytes of stream entries spread over
+# 16 streams, save it, and measure how fast the server loads it back. The
+# throughput is in entries loaded per second.
+proc workload-rdb_load {} {
+    set valuesize 1000
+    set entries [expr {$::rdb_mb*1024*1024/$valuesize}]
+    fill $entries [list XADD regression:rdb:__rand_int__ * field [value $valuesize]] \
+         {-r 16}
+    $::r save
+    stop-server
+    set ms [start-server 1]
+    dict create ops_per_sec [format %.2f [expr {$entries*1000.0/$ms}]] \
+                cpu_sec [format %.3f [server-cpu]]
+}
+
+# Run the workload 'name' runs times, each against a fresh server, and
+# return the results of the run with the median throughput.
+proc run-workload {name} {
+    set results {}
+    for {set run 0} {$run < $::runs} {incr run} {
+        start-server
+        set cpu [server-cpu]
+        if {[catch {workload-$name} res opts]} {
+            stop-server
+            return -options $opts $res
+        }
+        dict set res rss_bytes [info-field used_memory_rss]
+        if {![dict exists $res cpu_sec]} {
+            dict set res cpu_sec [format %.3f [expr {[server-cpu]-$cpu}]]
+        }
+        stop-server
+        puts [format "  run %d: %s" [expr {$run+1}] $res]
+        lappend results $res
+    }
+    set results [lsort -command {apply {{a b} {
+        expr {[dict get $a ops_per_sec] < [dict get $b ops_per_sec] ? -1 :
+              [dict get $a ops_per_sec] > [dict get $b ops_per_sec] ? 1 : 0}
+    }}} $results]
+    lindex $results [expr {[llength $results]/2}]
+}
+
+# ----------------------------------------------------------------------------
+# Results files
+# ----------------------------------------------------------------------------
+
+proc write-results {filename results} {
+    set fd [open $filename w]
+    puts $fd [join $::columns ,]
+    dict for {name res} $results {
+        set row [list $name]
+        foreach col [lrange $::columns 1 end] {
+            lappend row [expr {[dict exists $res $col] ? [dict get $res $col] : {}}]
+        }
+        puts $fd [join $row ,]
+    }
+    close $fd
+}
+
+proc read-results {filename} {
+    set fd [open $filename]
+    set lines [split [string trim [read $fd]] "\n"]
+    close $fd
+    set header [split [lindex $lines 0] ,]
+    set results {}
+    foreach line [lrange $lines 1 end] {
+        set row [split $line ,]
+        set res {}
+        foreach col [lrange $header 1 end] val [lrange $row 1 end] {
+            if {$val ne {}} {dict set res $col $val}
+        }
+        dict set results [lindex $row 0] $res
+    }
+    return $results
+}
+
+# Compare 'results' against 'baseline', printing every metric of every
+# workload. Returns the number of regressions: throughput lower, or RSS
+# higher, by more than threshold percent, or latency higher by more than
+# latency_threshold percent.
+proc compare-results {results baseline} {
+    set regressions 0
+    set checks [list \
+        ops_per_sec -1 $::threshold \
+        p50_ms 1 $::latency_threshold \
+        p99_ms 1 $::latency_threshold \
+        p999_ms 1 $::latency_threshold \
+        rss_bytes 1 $::threshold \
+        cpu_sec 0 0]
+    puts [format "%-16s %-12s %14s %14s %9s" workload metric baseline current change]
+    dict for {name res} $results {
+        if {![dict exists $baseline $name]} continue
+        set base [dict get $baseline $name]
+        foreach {metric direction threshold} $checks {
+            if {![dict exists $res $metric] || ![dict exists $base $metric]} continue
+            set old [dict get $base $metric]
+            set new [dict get $res $metric]
+            if {$old == 0} continue
+            set change [expr {($new-$old)*100.0/$old}]
+            set status {}
+            if {$direction && $change*$direction > $threshold} {
+                set status REGRESSION
+                incr regressions
+            }
+            puts [format "%-16s %-12s %14s %14s %+8.1f%% %s" \
+                $name $metric $old $new $change $status]
+        }
+    }
+    return $regressions
+}
+
+proc main {} {
+    puts "Using [exec $::server -v]"
+    set results {}
+    foreach name $::workloads {
+        puts "Running $name"
+        dict set results $name [run-workload $name]
+    }
+    write-results $::output $results
+    file delete -force $::workdir
+    puts "Results written to $::output"
+
+    if {$::baseline ne {}} {
+        puts ""
+        set regressions [compare-results $results [read-results $::baseline]]
+        if {$regressions} {
+            puts "\n$regressions regression(s) against $::baseline"
+            exit 1
+        }
+        puts "\nNo regressions against $::baseline"
+    }
+}
+
+# Force the user to run the script from the 'utils' directory.
+if {![file exists stream-regression.tcl]} {
+    puts "Please make sure to run stream-regression.tcl while inside /utils."
+    puts "Example: cd utils; ./stream-regression.tcl"
+    exit 1
+}
+
+proc usage {} {
+    puts "Usage: ./stream-regression.tcl \[options\]"
+    puts ""
+    puts "  --output <file>             Results file (default $::output)."
+    puts "  --baseline <file>           Compare with the results file of a previous run."
+    puts "  --threshold <pct>           Allowed throughput and RSS change (default $::threshold)."
+    puts "  --latency-threshold <pct>   Allowed latency change (default $::latency_threshold)."
+    puts "  --workloads <list>          Comma separated workloads, among:"
+    puts "                              [join $::workloads ,]"
+    puts "  --runs <count>              Runs per workload, the median is kept (default $::runs)."
+    puts "  --requests <count>          Requests per benchmark (default $::requests)."
+    puts "  --clients <count>           Benchmark clients (default $::clients)."
+    puts "  --datasize <bytes>          Size of the entries value (default $::datasize)."
+    puts "  --pel-size <count>          Pending entries for xautoclaim (default $::pel_size)."
+    puts "  --del-streams <count>       Streams deleted by del_expiring (default $::del_streams)."
+    puts "  --del-items <count>         Items per stream for del_expiring (default $::del_items)."
+    puts "  --rdb-mb <megabytes>        Size of the rdb_load dataset (default $::rdb_mb)."
+    puts "  --port <port>               Port of the server (default $::port)."
+    exit 1
+}
+
+# parse arguments
+for {set j 0} {$j < [llength $argv]} {incr j} {
+    set opt [lindex $argv $j]
+    set arg [lindex $argv [expr $j+1]]
+    switch -- $opt {
+        --output {set ::output $arg}
+        --baseline {set ::baseline $arg}
+        --threshold {set ::threshold $arg}
+        --latency-threshold {set ::latency_threshold $arg}
+        --workloads {set ::workloads [split $arg ,]}
+        --runs {set ::runs $arg}
+        --requests {set ::requests $arg}
+        --clients {set ::clients $arg}
+        --datasize {set ::datasize $arg}
+        --pel-size {set ::pel_size $arg}
+        --del-streams {set ::del_streams $arg}
+        --del-items {set ::del_items $arg}
+        --rdb-mb {set ::rdb_mb $arg}
+        --port {set ::port $arg}
+        default {
+            if {$opt ne {--help}} {puts "Wrong argument: $opt"}
+            usage
+        }
+    }
+    incr j
+}
+
+# Make sure there is not already a server running on the port
+set is_not_running [catch {set r [redis 127.0.0.1 $::port]}]
+if {!$is_not_running} {
+    puts "Sorry, you have a running server on port $::port"
+    exit 1
+}
+
+main